@@ -0,0 +1,232 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Support for programs compiled ahead of time by skeemc. A compiled program
+ *embeds its source, which aot_main runs as skeem would run the file, giving
+ *the procedures skeemc compiled their C code as they are defined. The code
+ *calls the other compiled procedures directly, without binding their
+ *parameters, which is only sound while their names and the primitives they
+ *use still mean what they meant when the program was compiled. Bindings of
+ *those names are watched, and once one is rebound in a context the
+ *compiled procedures that may call it run interpreted there.*/
+
+#define _GNU_SOURCE
+#include "aot.h"
+#include "types.h"
+#include "context.h"
+#include "mem.h"
+#include "builtins.h"
+#include "token.h"
+#include "macro.h"
+#include "fuel.h"
+#include "trace.h"
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+size_t aot_nprocs, aot_forms;
+static struct aot_proc *aot_procs;
+/*The compiled procedures by the address of their interned names, as their
+ *index plus one in open addressed slots*/
+static size_t *aot_index, aot_index_mask;
+
+static size_t name_slot(const char *name)
+{
+  return ((uintptr_t)name >> 4) * 0x9e3779b97f4a7c15ULL & aot_index_mask;
+}
+
+/*Note in CTX that a compiled procedure has been rebound if SYMBOL names one
+ *and VAL isn't a procedure with its body. Names are only watched once
+ *their defining form has been read.*/
+void aot_rebind(skeem_ctx_t *ctx, object_t *symbol, object_t *val)
+{
+  for (size_t i = name_slot(symbol->string); aot_index[i] != 0;
+       i = (i + 1) & aot_index_mask) {
+    struct aot_proc *p = &aot_procs[aot_index[i] - 1];
+
+    if (p->name == symbol->string && *p->body != NULL &&
+        (val == NULL || val->type != PROCEDURE ||
+         val->procedure->body != *p->body) &&
+        (ctx->aot_rebound == 0 || ctx->aot_rebound > p->form + 1))
+      ctx->aot_rebound = p->form + 1;
+  }
+}
+
+static size_t constants(object_t *exp, object_t **consts, size_t n,
+                        size_t found)
+{
+  if (_SYMBOL_P(exp)) return found;
+  if (_LIST_P(exp) && exp != EMPTY_LIST) {
+    if (_SYMBOL_P(exp->cell->car) &&
+        strcmp(exp->cell->car->string, "quote") == 0 &&
+        exp->cell->cdr != NULL) {
+      exp = exp->cell->cdr->car;
+    } else {
+      for (cons_t *cell = exp->cell; cell != NULL; cell = cell->cdr)
+        found = constants(cell->car, consts, n, found);
+      return found;
+    }
+  }
+  if (found < n) consts[found] = exp;
+  return found + 1;
+}
+
+/*Store up to N of the constants in EXP in CONSTS: the atoms that aren't
+ *symbols and the quoted data, from left to right. Returns how many there
+ *are. skeemc numbers the constants of compiled code in the same order.*/
+size_t aot_constants(object_t *exp, object_t **consts, size_t n)
+{
+  return constants(exp, consts, n, 0);
+}
+
+/*Called from compiled code*/
+
+object_t *aot_box(skeem_ctx_t *ctx, int64_t val)
+{
+  object_t *obj = obj_init(ctx, INTEGER);
+  obj->integer = val;
+  return obj;
+}
+
+/*Add VAL to SUM, the pinned result of a + form so far, or if there isn't
+ *one yet, to ACC, the sum of the integers before VAL. Returns the result,
+ *pinned.*/
+object_t *aot_add(skeem_ctx_t *ctx, object_t *sum, int64_t acc,
+                  object_t *val)
+{
+  if (sum == NULL) {
+    pin(ctx, val);
+    sum = aot_box(ctx, acc);
+    unpin_head(ctx);
+    pin(ctx, sum);
+  }
+  add(ctx, sum, val, sum);
+  return sum;
+}
+
+/*Compare X and Y as the primitive FN would*/
+object_t *aot_compare(skeem_ctx_t *ctx, primitive_t fn, object_t *x,
+                      object_t *y)
+{
+  object_t prim = {.type = PRIMITIVE, .primitive = fn};
+  cons_t last = {.car = y}, values = {.car = x, .cdr = &last};
+
+  pin(ctx, x);
+  pin(ctx, y);
+  object_t *result = apply_values(ctx, &prim, &values);
+  unpin_head(ctx);
+  unpin_head(ctx);
+  return result;
+}
+
+/*The body of FORM if it is (define (NAME PARAM ...) BODY), otherwise NULL*/
+static object_t *definition(object_t *form)
+{
+  if (!_LIST_P(form) || form == EMPTY_LIST || length(form->cell) != 3)
+    return NULL;
+
+  object_t *head = form->cell->car, *target = form->cell->cdr->car;
+  if (!_SYMBOL_P(head) || strcmp(head->string, "define") != 0 ||
+      !_LIST_P(target) || target == EMPTY_LIST ||
+      !_SYMBOL_P(target->cell->car))
+    return NULL;
+  return form->cell->cdr->cdr->car;
+}
+
+/*Note the body of the procedure FORM defines, before it is evaluated*/
+static void aot_read(skeem_ctx_t *ctx, object_t *form, size_t index)
+{
+  for (size_t i = 0; i < aot_nprocs; i++) {
+    struct aot_proc *p = &aot_procs[i];
+
+    if (p->form != index || definition(form) == NULL) continue;
+    *p->body = definition(form);
+    aot_constants(*p->body, p->consts, p->nconsts);
+  }
+}
+
+/*Give the procedures FORM defined their code*/
+static void aot_defined(skeem_ctx_t *ctx, object_t *form, size_t index)
+{
+  for (size_t i = 0; i < aot_nprocs; i++) {
+    struct aot_proc *p = &aot_procs[i];
+
+    if (p->form != index || *p->body == NULL) continue;
+    object_t *val = env_lookup(ctx, form->cell->cdr->car->cell->car);
+
+    if (val == NULL || !_PROCEDURE_P(val) ||
+        val->procedure->body != *p->body)
+      continue;
+    *p->proc = val->procedure;
+    jit_attach(val->procedure, p->entry);
+  }
+}
+
+/*Run the program whose source is the LEN bytes at SRC, and whose compiled
+ *procedures are PROCS*/
+int aot_main(const char *src, size_t len, struct aot_proc *procs)
+{
+  skeem_ctx_t *ctx = ctx_new();
+  FILE *stream = fmemopen((void *)src, len, "r");
+  object_t *obj;
+  size_t index = 0;
+
+  if (stream == NULL) {
+    perror("fmemopen");
+    return EXIT_FAILURE;
+  }
+  aot_procs = procs;
+  while (procs[aot_nprocs].name != NULL) aot_nprocs++;
+
+  size_t slots = 1;
+  while (slots < 2 * aot_nprocs) slots *= 2;
+  aot_index = ERR_MALLOC(slots * sizeof(size_t));
+  aot_index_mask = slots - 1;
+  for (size_t i = 0; i < aot_nprocs; i++) {
+    procs[i].name = symbol_intern(procs[i].name);
+    size_t slot = name_slot(procs[i].name);
+
+    while (aot_index[slot] != 0) slot = (slot + 1) & aot_index_mask;
+    aot_index[slot] = i + 1;
+  }
+
+  if (setjmp(ctx->err)) exit(EXIT_FAILURE);
+
+  fuel_start(ctx);
+  while ((obj = read_form(ctx, stream)) != NULL) {
+    uint64_t start = trace_begin();
+
+    ctx->no_gc = false;
+    macro_expand(ctx, obj);
+    aot_read(ctx, obj, index);
+    pin(ctx, obj);
+    eval(ctx, obj);
+    aot_defined(ctx, obj, index++);
+    aot_forms = index;
+    unpin_head(ctx);
+    trace_end(TRACE_EVAL, start);
+  }
+  fclose(stream);
+  ctx_free(ctx);
+  return 0;
+}
@@ -0,0 +1,78 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef AOT_H
+#define AOT_H
+#include "types.h"
+#include "context.h"
+#include "jit.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*A procedure compiled by skeemc, defined by a top level form of the
+ *program. Programs list theirs in an array ending with a NULL name, which
+ *aot_main replaces with the interned name.*/
+struct aot_proc {
+  const char *name;
+  /*The index of the defining form among the program's top level forms,
+   *and the last form defining a procedure its code calls, itself included*/
+  size_t form, needs;
+  jit_entry_t entry;
+  /*Filled in when the form is read: the constants of the body, in the
+   *order aot_constants finds them, and the body. Once the form has been
+   *evaluated, the procedure.*/
+  object_t **consts;
+  size_t nconsts;
+  object_t **body;
+  procedure_t **proc;
+};
+
+/*The number of compiled procedures, and of top level forms evaluated*/
+extern size_t aot_nprocs, aot_forms;
+
+extern void aot_rebind(skeem_ctx_t *ctx, object_t *symbol, object_t *val);
+extern size_t aot_constants(object_t *exp, object_t **consts, size_t n);
+extern object_t *aot_box(skeem_ctx_t *ctx, int64_t val);
+extern object_t *aot_add(skeem_ctx_t *ctx, object_t *sum, int64_t acc,
+                         object_t *val);
+extern object_t *aot_compare(skeem_ctx_t *ctx, primitive_t fn, object_t *x,
+                             object_t *y);
+extern int aot_main(const char *src, size_t len, struct aot_proc *procs);
+
+/*Note that SYMBOL is being bound to VAL in CTX*/
+static inline void aot_bind(skeem_ctx_t *ctx, object_t *symbol,
+                            object_t *val)
+{
+  if (aot_nprocs != 0) aot_rebind(ctx, symbol, val);
+}
+
+/*True if the code of a compiled procedure can run in CTX: the procedures
+ *it calls, defined by forms up to NEEDS, have been defined, and neither
+ *they nor the primitives the code inlines have been rebound in CTX*/
+static inline bool aot_ready(skeem_ctx_t *ctx, size_t needs)
+{
+  return aot_forms > needs && !ctx->jit_rebound &&
+         (ctx->aot_rebound == 0 || ctx->aot_rebound - 1 > needs);
+}
+
+#endif
@@ -0,0 +1,412 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "skeem.h"
+#include "types.h"
+#include "context.h"
+#include "mem.h"
+#include "builtins.h"
+#include "token.h"
+#include "macro.h"
+#include "str.h"
+#include "fuel.h"
+#include "trace.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+/*State of the caller saved on every entry into the interpreter, so that an
+ *error only unwinds as far as the innermost entry*/
+struct entry {
+  jmp_buf err;
+  object_t *env_base;
+  size_t pin_base;
+  bool no_gc;
+};
+
+static void enter(skeem_ctx_t *ctx, struct entry *e) {
+  memcpy(e->err, ctx->err, sizeof(jmp_buf));
+  e->env_base = ctx->env_base;
+  e->pin_base = ctx->pin_base;
+  e->no_gc = ctx->no_gc;
+
+  ctx->env_base = ctx->env_head;
+  ctx->pin_base = ctx->num_pinned;
+  /*Calls back in from a foreign procedure share the budget of the
+   *evaluation that made them*/
+  if (ctx->depth++ == 0) fuel_start(ctx);
+}
+
+static void leave(skeem_ctx_t *ctx, struct entry *e) {
+  memcpy(ctx->err, e->err, sizeof(jmp_buf));
+  ctx->env_base = e->env_base;
+  ctx->pin_base = e->pin_base;
+  ctx->no_gc = e->no_gc;
+  ctx->depth--;
+}
+
+/*Hand VAL to the host, holding it in the current scope*/
+static object_t *hold(skeem_ctx_t *ctx, object_t *val) {
+  pin(ctx, val);
+  return val;
+}
+
+skeem_ctx_t *skeem_open(void) {
+  return ctx_new();
+}
+
+void skeem_close(skeem_ctx_t *ctx) {
+  ctx_free(ctx);
+}
+
+void skeem_limit(skeem_ctx_t *ctx, uint64_t steps, uint32_t ms) {
+  limits_set(ctx, steps, ms);
+}
+
+void skeem_limit_memory(skeem_ctx_t *ctx, size_t bytes) {
+  ctx->max_bytes = bytes;
+}
+
+skeem_value *skeem_eval_string(skeem_ctx_t *ctx, const char *src,
+                               size_t len) {
+  FILE *stream = fmemopen((void *)src, len, "r");
+  object_t *val = EMPTY_LIST, *obj;
+  struct entry e;
+
+  if (stream == NULL) return NULL;
+
+  enter(ctx, &e);
+  if (setjmp(ctx->err)) {
+    clear_tokens(ctx);
+    ctx->paren_depth = 0;
+    ctx->nquotes = 0;
+    leave(ctx, &e);
+    fclose(stream);
+    return NULL;
+  }
+
+  while ((obj = read_form(ctx, stream)) != NULL) {
+    uint64_t start = trace_begin();
+
+    ctx->no_gc = false;
+    macro_expand(ctx, obj);
+    val = eval(ctx, obj);
+    trace_end(TRACE_EVAL, start);
+  }
+  if (ctx->paren_depth != 0 || ctx->nquotes % 2 != 0)
+    error("Unbalanced expression\n");
+
+  leave(ctx, &e);
+  fclose(stream);
+  return hold(ctx, val);
+}
+
+skeem_value *skeem_call(skeem_ctx_t *ctx, skeem_value *fn, int argc,
+                        skeem_value **argv) {
+  cons_t *values = NULL;
+  struct entry e;
+
+  enter(ctx, &e);
+  if (setjmp(ctx->err)) {
+    leave(ctx, &e);
+    return NULL;
+  }
+
+  /*The cells are kept reachable through a list object for the call*/
+  ctx->no_gc = true;
+  object_t *list = obj_init(ctx, LIST);
+  for (int i = argc - 1; i >= 0; i--) {
+    cons_t *cell = cons_init(ctx);
+    cell->car = argv[i];
+    cell->cdr = values;
+    values = cell;
+  }
+  list->cell = values;
+  pin(ctx, list);
+  ctx->no_gc = false;
+
+  object_t *val = apply_values(ctx, fn, values);
+  leave(ctx, &e);
+  ctx->num_pinned--;
+  return hold(ctx, val);
+}
+
+skeem_value *skeem_lookup(skeem_ctx_t *ctx, const char *name) {
+  object_t sym = {.type = SYMBOL, .string = (char *)name};
+  object_t *val = env_lookup(ctx, &sym);
+
+  return val == NULL ? NULL : hold(ctx, val);
+}
+
+/*Bind NAME to VAL in the global environment*/
+static void define_global(skeem_ctx_t *ctx, const char *name, object_t *val) {
+  pin(ctx, val);
+  object_t *sym = symbol_new(ctx, name);
+  unpin_head(ctx);
+  global_insert(ctx, sym, val);
+}
+
+void skeem_define(skeem_ctx_t *ctx, const char *name, skeem_value *val) {
+  define_global(ctx, name, val);
+}
+
+void skeem_define_primitive(skeem_ctx_t *ctx, const char *name, skeem_fn fn,
+                            int arity, void *data) {
+  object_t *obj = obj_init(ctx, FOREIGN);
+
+  obj->foreign->name = strdup(name);
+  obj->foreign->fn = fn;
+  obj->foreign->arity = arity;
+  obj->foreign->data = data;
+  define_global(ctx, name, obj);
+}
+
+void skeem_error(skeem_ctx_t *ctx, const char *fmt, ...) {
+  va_list ap;
+
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+  va_end(ap);
+  goto_top(ctx);
+}
+
+skeem_scope skeem_scope_open(skeem_ctx_t *ctx) {
+  return ctx->num_pinned;
+}
+
+void skeem_scope_close(skeem_ctx_t *ctx, skeem_scope scope) {
+  ctx->num_pinned = scope;
+}
+
+skeem_root skeem_root_new(skeem_ctx_t *ctx, skeem_value *val) {
+  size_t i = 0;
+
+  while (i < ctx->num_roots && ctx->roots[i] != NULL) i++;
+
+  if (i == ctx->num_roots) {
+    if (ctx->num_roots == ctx->max_roots) {
+      ctx->max_roots = ctx->max_roots == 0 ? 16 : ctx->max_roots * 2;
+      ctx->roots = realloc(ctx->roots, ctx->max_roots * sizeof(object_t *));
+
+      if (ctx->roots == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+      }
+    }
+    ctx->num_roots++;
+  }
+
+  ctx->roots[i] = val;
+  return i;
+}
+
+skeem_value *skeem_root_get(skeem_ctx_t *ctx, skeem_root root) {
+  return ctx->roots[root];
+}
+
+void skeem_root_free(skeem_ctx_t *ctx, skeem_root root) {
+  ctx->roots[root] = NULL;
+}
+
+skeem_value *skeem_int(skeem_ctx_t *ctx, int64_t n) {
+  object_t *obj = obj_init(ctx, INTEGER);
+  obj->integer = n;
+  return hold(ctx, obj);
+}
+
+skeem_value *skeem_float(skeem_ctx_t *ctx, double x) {
+  object_t *obj = obj_init(ctx, FLOAT);
+  obj->flt = x;
+  return hold(ctx, obj);
+}
+
+skeem_value *skeem_bool(bool b) {
+  return BOOL_TO_OBJ(b);
+}
+
+skeem_value *skeem_nil(void) {
+  return EMPTY_LIST;
+}
+
+skeem_value *skeem_string(skeem_ctx_t *ctx, const char *str) {
+  return hold(ctx, make_string(ctx, str_new(str, strlen(str))));
+}
+
+skeem_value *skeem_string_borrow(skeem_ctx_t *ctx, const char *str) {
+  object_t *obj = obj_init(ctx, STRING);
+  obj->string = (char *)str;
+  obj->borrowed = true;
+  return hold(ctx, obj);
+}
+
+skeem_value *skeem_symbol(skeem_ctx_t *ctx, const char *name) {
+  return hold(ctx, symbol_new(ctx, name));
+}
+
+/*Mirrors the cons primitive: the cells of a list CDR are shared*/
+skeem_value *skeem_cons(skeem_ctx_t *ctx, skeem_value *car,
+                        skeem_value *cdr) {
+  pin(ctx, car);
+  pin(ctx, cdr);
+  object_t *obj = obj_init(ctx, LIST);
+  unpin_head(ctx);
+  unpin_head(ctx);
+
+  obj->cell = cons_init(ctx);
+  obj->cell->car = car;
+  if (_LIST_P(cdr)) {
+    obj->cell->cdr = cdr->cell;
+  } else {
+    obj->cell->cdr = cons_init(ctx);
+    obj->cell->cdr->car = cdr;
+  }
+  return hold(ctx, obj);
+}
+
+static object_t *borrow_numvector(skeem_ctx_t *ctx, type_t type, void *data,
+                                  size_t len) {
+  object_t *obj = obj_init(ctx, type);
+
+  obj->numvector = ERR_MALLOC(sizeof(struct numvector));
+  obj->numvector->len = len;
+  obj->numvector->f64 = data;
+  obj->borrowed = true;
+  return hold(ctx, obj);
+}
+
+skeem_value *skeem_f64vector_borrow(skeem_ctx_t *ctx, double *data,
+                                    size_t len) {
+  return borrow_numvector(ctx, F64VECTOR, data, len);
+}
+
+skeem_value *skeem_s64vector_borrow(skeem_ctx_t *ctx, int64_t *data,
+                                    size_t len) {
+  return borrow_numvector(ctx, S64VECTOR, data, len);
+}
+
+bool skeem_is_int(skeem_value *val) {
+  return _INTEGER_P(val);
+}
+
+bool skeem_is_float(skeem_value *val) {
+  return _FLOAT_P(val);
+}
+
+bool skeem_is_string(skeem_value *val) {
+  return _STRING_P(val);
+}
+
+bool skeem_is_symbol(skeem_value *val) {
+  return _SYMBOL_P(val);
+}
+
+bool skeem_is_bool(skeem_value *val) {
+  return _BOOLEAN_P(val);
+}
+
+bool skeem_is_pair(skeem_value *val) {
+  return _LIST_P(val) && val != EMPTY_LIST;
+}
+
+bool skeem_is_nil(skeem_value *val) {
+  return val == EMPTY_LIST;
+}
+
+bool skeem_is_procedure(skeem_value *val) {
+  return val->type == PRIMITIVE || _PROCEDURE_P(val) || _CLOSURE_P(val) ||
+         val->type == FOREIGN;
+}
+
+bool skeem_is_f64vector(skeem_value *val) {
+  return _F64VECTOR_P(val);
+}
+
+bool skeem_is_s64vector(skeem_value *val) {
+  return _S64VECTOR_P(val);
+}
+
+int64_t skeem_to_int(skeem_ctx_t *ctx, skeem_value *val) {
+  if (_INTEGER_P(val)) return val->integer;
+  if (_FLOAT_P(val)) return (int64_t)val->flt;
+  error("Wrong argument type - %s. (Expected number)\n", types[val->type]);
+}
+
+double skeem_to_float(skeem_ctx_t *ctx, skeem_value *val) {
+  if (_FLOAT_P(val)) return val->flt;
+  if (_INTEGER_P(val)) return val->integer;
+  error("Wrong argument type - %s. (Expected number)\n", types[val->type]);
+}
+
+bool skeem_truthy(skeem_value *val) {
+  return IS_TRUE(val);
+}
+
+const char *skeem_to_string(skeem_ctx_t *ctx, skeem_value *val) {
+  if (!_STRING_P(val) && !_SYMBOL_P(val))
+    error("Wrong argument type - %s. (Expected string)\n", types[val->type]);
+  return val->string;
+}
+
+skeem_value *skeem_car(skeem_ctx_t *ctx, skeem_value *val) {
+  if (!skeem_is_pair(val))
+    error("Wrong argument type - %s. (Expected pair)\n", types[val->type]);
+  return hold(ctx, val->cell->car);
+}
+
+skeem_value *skeem_cdr(skeem_ctx_t *ctx, skeem_value *val) {
+  if (!skeem_is_pair(val))
+    error("Wrong argument type - %s. (Expected pair)\n", types[val->type]);
+  if (val->cell->cdr == NULL) return EMPTY_LIST;
+
+  pin(ctx, val);
+  object_t *obj = obj_init(ctx, LIST);
+  unpin_head(ctx);
+  obj->cell = val->cell->cdr;
+  return hold(ctx, obj);
+}
+
+static struct numvector *numvector_arg(skeem_ctx_t *ctx, object_t *val,
+                                       type_t type) {
+  if (val->type != type)
+    error("Wrong argument type - %s. (Expected %s)\n", types[val->type],
+          types[type]);
+  return val->numvector;
+}
+
+double *skeem_f64vector_data(skeem_ctx_t *ctx, skeem_value *val,
+                             size_t *len) {
+  struct numvector *nv = numvector_arg(ctx, val, F64VECTOR);
+  *len = nv->len;
+  return nv->f64;
+}
+
+int64_t *skeem_s64vector_data(skeem_ctx_t *ctx, skeem_value *val,
+                              size_t *len) {
+  struct numvector *nv = numvector_arg(ctx, val, S64VECTOR);
+  *len = nv->len;
+  return nv->s64;
+}
+
+void skeem_print(skeem_value *val, FILE *stream) {
+  print_obj(val, stream);
+}
@@ -24,25 +24,57 @@
 #include <stdlib.h>
 #include <string.h>
 #include <setjmp.h>
+#include <stdatomic.h>
 #include "types.h"
 #include "mem.h"
 #include "builtins.h"
-
-#define error(...)                \
-  {                               \
-    fprintf(stderr, __VA_ARGS__); \
-    goto_top();                   \
-  }
-
-static object_t *ZERO, *ONE;
-
-char *types[9] = {"integer", "float", "string", "symbol", "list",
-                  "boolean", "procedure", "procedure", "closure"};
-
-object_t *eval(object_t *);
-object_t *eval_nopush(object_t *);
-
-void add(object_t *n1, object_t *n2, object_t *result) {
+#include "vector.h"
+#include "numvec.h"
+#include "hash.h"
+#include "list.h"
+#include "sort.h"
+#include "context.h"
+#include "future.h"
+#include "coroutine.h"
+#include "io.h"
+#include "port.h"
+#include "macro.h"
+#include "library.h"
+#include "str.h"
+#include "fuel.h"
+#include "profile.h"
+#include "instrument.h"
+#include "trace.h"
+#include "jit.h"
+#include "aot.h"
+
+/*Constants are shared by every context. They are never on a heap, and start
+ *out marked so the GC never writes to them.*/
+static object_t true_obj = {.type = BOOLEAN, .marked = true, .boolean = true};
+static object_t false_obj = {.type = BOOLEAN, .marked = true, .boolean = false};
+static object_t empty_list_obj = {.type = LIST, .marked = true, .cell = NULL};
+static object_t zero_obj = {.type = INTEGER, .marked = true, .integer = 0};
+static object_t one_obj = {.type = INTEGER, .marked = true, .integer = 1};
+static object_t eof_obj = {.type = EOF_OBJECT, .marked = true};
+static object_t quote_obj = {.type = SYMBOL, .marked = true, .string = "quote"};
+
+object_t *const CONST_TRUE = &true_obj;
+object_t *const CONST_FALSE = &false_obj;
+object_t *const EMPTY_LIST = &empty_list_obj;
+object_t *const CONST_EOF = &eof_obj;
+static object_t *const ZERO = &zero_obj, *const ONE = &one_obj;
+static object_t *const QUOTE = &quote_obj;
+
+char *types[] = {"integer", "float", "char", "string", "symbol", "list",
+                 "boolean", "procedure", "procedure", "closure",
+                 "environment", "vector", "f64vector", "s64vector",
+                 "hash-table", "procedure", "future", "coroutine",
+                 "channel", "port", "eof-object", "macro"};
+
+object_t *eval(skeem_ctx_t *ctx, object_t *);
+object_t *eval_nopush(skeem_ctx_t *ctx, object_t *);
+
+void add(skeem_ctx_t *ctx, object_t *n1, object_t *n2, object_t *result) {
 
   if (_INTEGER_P(n1)) {
     if (_INTEGER_P(n2)) {
@@ -70,59 +102,226 @@ void add(object_t *n1, object_t *n2, object_t *result) {
   else error("add: Wrong argument type - %s (Expected number)\n", types[n1->type]);
 }
 
-object_t *add_list(cons_t *args)
+void subtract(skeem_ctx_t *ctx, object_t *n1, object_t *n2,
+              object_t *result) {
+  if (_INTEGER_P(n1)) {
+    if (_INTEGER_P(n2)) {
+      result->type = INTEGER;
+      result->integer = n1->integer - n2->integer;
+    } else if (_FLOAT_P(n2)) {
+      result->type = FLOAT;
+      result->flt = n1->integer - n2->flt;
+    }
+    else error("subtract: Wrong argument type - %s (Expected number)\n", types[n2->type]);
+  }
+
+  else if (_FLOAT_P(n1)) {
+    if (_INTEGER_P(n2)) {
+      result->type = FLOAT;
+      result->flt = n1->flt - n2->integer;
+    }
+    else if (_FLOAT_P(n2)) {
+      result->type = FLOAT;
+      result->flt = n1->flt - n2->flt;
+    }
+    else error("subtract: Wrong argument type - %s (Expected number)\n", types[n2->type]);
+  }
+
+  else error("subtract: Wrong argument type - %s (Expected number)\n", types[n1->type]);
+}
+
+void multiply(skeem_ctx_t *ctx, object_t *n1, object_t *n2, object_t *result) {
+  if (_INTEGER_P(n1)) {
+    if (_INTEGER_P(n2)) {
+      result->type = INTEGER;
+      result->integer = n1->integer * n2->integer;
+    } else if (_FLOAT_P(n2)) {
+      result->type = FLOAT;
+      result->flt = n1->integer * n2->flt;
+    } else error("Wrong argument type - %s (Wanted number)\n", types[n2->type])
+  }
+
+  else if (_FLOAT_P(n1)) {
+    result->type = FLOAT;
+
+    if (_INTEGER_P(n2))
+      result->flt = n1->flt * n2->integer;
+    else if (_FLOAT_P(n2))
+      result->flt = n1->flt * n2->flt;
+    else error("Wrong argument type - %s (Wanted number)\n", types[n2->type]);
+  }
+
+  else error("Wrong argument type - %s (Wanted number)\n", types[n1->type]);
+}
+
+/*Type feedback. The first argument cell of a call to + - * < or > records
+ *the types its operands have had: SEEN_INT while they have all been
+ *integers, SEEN_FLOAT while they have all been floats, and SEEN_MIXED for
+ *good once anything else has turned up. A call that has only seen one type
+ *takes a path specialized to it, which falls back to the general one on
+ *the first operand of another type.
+ *
+ *Futures' tasks run the same forms on other threads, so the byte is read
+ *and written relaxed. An update lost to a race at worst sends a call down
+ *the general path, or to a specialized one that checks its operands
+ *anyway.*/
+enum { SEEN_NONE, SEEN_INT, SEEN_FLOAT, SEEN_MIXED };
+
+static inline uint8_t seen_at(cons_t *site)
 {
-  if (args == NULL) /*no arguments*/
-    return ZERO;
+  return atomic_load_explicit(&site->seen, memory_order_relaxed);
+}
 
-  object_t *result = obj_init(INTEGER);
-  result->type = INTEGER;
-  result->integer = 0;
+static inline void seen_set(cons_t *site, uint8_t type)
+{
+  atomic_store_explicit(&site->seen, type, memory_order_relaxed);
+}
 
-  while (args != NULL) {
-    add(result, eval(args->car), result);
-    args = args->cdr;
+static inline void seen(cons_t *site, object_t *val)
+{
+  uint8_t type = _INTEGER_P(val) ? SEEN_INT :
+                 _FLOAT_P(val) ? SEEN_FLOAT : SEEN_MIXED;
+  uint8_t was = seen_at(site);
+
+  if (was == SEEN_NONE)
+    seen_set(site, type);
+  else if (was != type && was != SEEN_MIXED)
+    seen_set(site, SEEN_MIXED);
+}
+
+typedef void (*arith_t)(skeem_ctx_t *, object_t *, object_t *, object_t *);
+
+static inline int64_t int_arith(arith_t fn, int64_t n1, int64_t n2)
+{
+  if (fn == add) return n1 + n2;
+  if (fn == subtract) return n1 - n2;
+  return n1 * n2;
+}
+
+static inline double float_arith(arith_t fn, double n1, double n2)
+{
+  if (fn == add) return n1 + n2;
+  if (fn == subtract) return n1 - n2;
+  return n1 * n2;
+}
+
+/*The general path of a call to FN whose arguments start at SITE, from the
+ *operand CELL on, whose value is VAL. SO_FAR is the result of the operands
+ *before it, or NULL if VAL is the first operand of a subtraction.*/
+static object_t *arith_general(skeem_ctx_t *ctx, cons_t *site, arith_t fn,
+                               const object_t *so_far, cons_t *cell,
+                               object_t *val)
+{
+  pin(ctx, val);
+  object_t *result = obj_init(ctx, INTEGER);
+  unpin_head(ctx);
+  pin(ctx, result);
+
+  if (so_far == NULL) {
+    seen(site, val);
+    if (_INTEGER_P(val)) {
+      result->integer = val->integer;
+    } else if (_FLOAT_P(val)) {
+      result->type = FLOAT;
+      result->flt = val->flt;
+    }
+    else error("subtract: Wrong argument type - %s (Expected number)\n", types[val->type]);
+    cell = cell->cdr;
+    if (cell != NULL) val = eval(ctx, cell->car);
+  } else {
+    result->type = so_far->type;
+    if (so_far->type == FLOAT)
+      result->flt = so_far->flt;
+    else
+      result->integer = so_far->integer;
   }
 
+  while (cell != NULL) {
+    seen(site, val);
+    fn(ctx, result, val, result);
+    cell = cell->cdr;
+    if (cell != NULL) val = eval(ctx, cell->car);
+  }
+  unpin_head(ctx);
   return result;
 }
 
-#define NUMBER(n) (((n)->type == INTEGER) ? n->integer : n->flt)
+/*Fold the operands ARGS with FN, starting from UNIT, or if FROM_FIRST from
+ *the first operand*/
+static inline object_t *arith_list(skeem_ctx_t *ctx, cons_t *args,
+                                   arith_t fn, int64_t unit, bool from_first)
+{
+  object_t so_far = {.type = INTEGER, .integer = unit}, *val, *result;
+  cons_t *cell = args;
 
-void subtract(object_t *n1, object_t *n2, object_t *result) {
-  if (_FLOAT_P(n2))
-    n2->flt = -n2->flt;
-  else if (_INTEGER_P(n2))
-    n2->integer = -n2->integer;
+  if (seen_at(args) == SEEN_INT) {
+    int64_t acc = unit;
 
-  add(n1, n2, result);
+    for (; cell != NULL; cell = cell->cdr) {
+      val = eval(ctx, cell->car);
+      if (!_INTEGER_P(val)) {
+        so_far.integer = acc;
+        goto mismatch;
+      }
+      acc = from_first && cell == args ? val->integer
+                                       : int_arith(fn, acc, val->integer);
+    }
+    result = obj_init(ctx, INTEGER);
+    result->integer = acc;
+    return result;
+  }
 
-  if (_FLOAT_P(n2))
-    n2->flt = -n2->flt;
-  else if (_INTEGER_P(n2))
-    n2->integer = -n2->integer;
+  if (seen_at(args) == SEEN_FLOAT) {
+    double acc = unit;
+
+    for (; cell != NULL; cell = cell->cdr) {
+      val = eval(ctx, cell->car);
+      if (!_FLOAT_P(val)) {
+        /*Until an operand is folded in, the result is still UNIT*/
+        if (cell != args) {
+          so_far.type = FLOAT;
+          so_far.flt = acc;
+        }
+        goto mismatch;
+      }
+      acc = from_first && cell == args ? val->flt
+                                       : float_arith(fn, acc, val->flt);
+    }
+    result = obj_init(ctx, FLOAT);
+    result->flt = acc;
+    return result;
+  }
+
+  return arith_general(ctx, args, fn, from_first ? NULL : &so_far, args,
+                       eval(ctx, args->car));
+
+mismatch:
+  seen_set(args, SEEN_MIXED);
+  return arith_general(ctx, args, fn,
+                       from_first && cell == args ? NULL : &so_far, cell,
+                       val);
 }
 
-object_t *subtract_list(cons_t *args)
+object_t *add_list(skeem_ctx_t *ctx, cons_t *args)
 {
-  if (args == NULL)
+  if (args == NULL) /*no arguments*/
     return ZERO;
 
-  object_t *result = obj_init(args->car->type);
+  return arith_list(ctx, args, add, 0, false);
+}
 
-  if (_INTEGER_P(args->car))
-    result->integer = args->car->integer;
-  else if (_FLOAT_P(args->car))
-    result->flt = args->car->flt;
+/*(- X) is 0 - X*/
+object_t *subtract_list(skeem_ctx_t *ctx, cons_t *args)
+{
+  if (args == NULL)
+    return ZERO;
 
-  while (args != NULL) {
-    subtract(result, args->car, result);
-    args = args->cdr;
-  }
-  return result;
+  return arith_list(ctx, args, subtract, 0, args->cdr != NULL);
 }
 
-void divide(object_t *n1, object_t *n2, object_t *result) {
+#define NUMBER(n) (((n)->type == INTEGER) ? n->integer : n->flt)
+
+void divide(skeem_ctx_t *ctx, object_t *n1, object_t *n2, object_t *result) {
   if (_NUMBER_P(n1) && _NUMBER_P(n2)) {
     if (NUMBER(n1) == 0 || NUMBER(n2) == 0) {
       error("divide: Division by zero.\n");
@@ -133,67 +332,32 @@ void divide(object_t *n1, object_t *n2, object_t *result) {
   error("divide: Wrong argument type(s)\n");
 }
 
-object_t *divide_list(cons_t *args) {
+object_t *divide_list(skeem_ctx_t *ctx, cons_t *args) {
   if (args == NULL)
     return ONE;
 
-  object_t *result = obj_init(FLOAT);
+  object_t *result = obj_init(ctx, FLOAT);
   result->flt = 1.0;
 
   while (args != NULL) {
-    divide(args->car, result, result);
+    divide(ctx, args->car, result, result);
     args = args->cdr;
   }
   return result;
 }
 
-object_t *multiply(object_t *n1, object_t *n2, object_t *result) {
-  if (_INTEGER_P(n1)) {
-    if (_INTEGER_P(n2)) {
-      result->type = INTEGER;
-      result->integer = n1->integer * n2->integer;
-    } else if (_FLOAT_P(n2)) {
-      result->type = FLOAT;
-      result->flt = n1->integer * n2->flt;
-    } else error("Wrong argument type - %s (Wanted number)\n", types[n2->type])
-  }
-
-  else if (_FLOAT_P(n1)) {
-    result->type = FLOAT;
-
-    if (_INTEGER_P(n2))
-      result->flt = n1->flt * n2->integer;
-    else if (_FLOAT_P(n2))
-      result->flt = n1->flt * n2->flt;
-    else error("Wrong argument type - %s (Wanted number)\n", types[n2->type]);
-  }
-
-  else error("Wrong argument type - %s (Wanted number)\n", types[n2->type]);
-
-  return result;
-}
-
-
-object_t *multiply_list(cons_t *args)
+object_t *multiply_list(skeem_ctx_t *ctx, cons_t *args)
 {
   if (args == NULL)
     return ONE;
 
-  object_t *result = obj_init(INTEGER);
-  result->integer = 1;
-
-  while (args != NULL) {
-    multiply(result, args->car, result);
-    args = args->cdr;
-  }
-  return result;
+  return arith_list(ctx, args, multiply, 1, false);
 }
 
-#define BOOL_TO_OBJ(predicate) ((predicate) ? CONST_TRUE : CONST_FALSE)
-
 /*true if the length of args == params_no. Else, print an error message and
  * return false*/
-void correct_number_args(const char *function, int params_no, cons_t *args) {
+void correct_number_args(skeem_ctx_t *ctx, const char *function, int params_no,
+                         cons_t *args) {
   int len = length(args);
   if (len != params_no) {
     error("Wrong number of arguments to %s (Got %d, Wanted %d)\n", function,
@@ -201,12 +365,34 @@ void correct_number_args(const char *function, int params_no, cons_t *args) {
   }
 }
 
-#define assert_arity(ar) correct_number_args(__func__, (ar), args)
-object_t *greater(cons_t *args)
+/*Error unless OBJ can be applied*/
+void procedure_arg(skeem_ctx_t *ctx, const char *function, object_t *obj) {
+  switch (obj->type) {
+    case PRIMITIVE:
+    case PROCEDURE:
+    case CLOSURE:
+    case FOREIGN:
+      return;
+    default:
+      error("%s: Wrong argument type - %s (Expected procedure)\n", function,
+            types[obj->type]);
+  }
+}
+
+object_t *greater(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(2);
-  object_t *n1 = eval(args->car);
-  object_t *n2 = eval(args->cdr->car);
+  object_t *n1 = eval(ctx, args->car);
+  pin(ctx, n1);
+  object_t *n2 = eval(ctx, args->cdr->car);
+  unpin_head(ctx);
+
+  if (seen_at(args) == SEEN_INT && _INTEGER_P(n1) && _INTEGER_P(n2))
+    return BOOL_TO_OBJ(n1->integer > n2->integer);
+  if (seen_at(args) == SEEN_FLOAT && _FLOAT_P(n1) && _FLOAT_P(n2))
+    return BOOL_TO_OBJ(n1->flt > n2->flt);
+  seen(args, n1);
+  seen(args, n2);
 
   if (_INTEGER_P(n1)) {
     if (_FLOAT_P(n2)) return BOOL_TO_OBJ(n1->integer > n2->flt);
@@ -225,11 +411,20 @@ n2err:
   error("greater: Wrong argument type - %s (Wanted number)\n", types[n2->type]);
 }
 
-object_t *lesser(cons_t *args)
+object_t *lesser(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(2);
-  object_t *n1 = eval(args->car);
-  object_t *n2 = eval(args->cdr->car);
+  object_t *n1 = eval(ctx, args->car);
+  pin(ctx, n1);
+  object_t *n2 = eval(ctx, args->cdr->car);
+  unpin_head(ctx);
+
+  if (seen_at(args) == SEEN_INT && _INTEGER_P(n1) && _INTEGER_P(n2))
+    return BOOL_TO_OBJ(n1->integer < n2->integer);
+  if (seen_at(args) == SEEN_FLOAT && _FLOAT_P(n1) && _FLOAT_P(n2))
+    return BOOL_TO_OBJ(n1->flt < n2->flt);
+  seen(args, n1);
+  seen(args, n2);
 
   if (_INTEGER_P(n1)) {
     if (_FLOAT_P(n2)) return BOOL_TO_OBJ(n1->integer < n2->flt);
@@ -248,29 +443,26 @@ n2err:
   error("lesser: Wrong argument type - %s (Wanted number)\n", types[n2->type]);
 }
 
-#define IS_FALSE(val) (_BOOLEAN_P((val)) && !(val)->boolean)
-#define IS_TRUE(val) (!IS_FALSE((val)))
-
-object_t *and(cons_t *args)
+object_t *and(skeem_ctx_t *ctx, cons_t *args)
 {
   if (args == NULL) return CONST_TRUE;
 
   object_t *val;
   while (args != NULL) {
-    val = eval(args->car);
+    val = eval(ctx, args->car);
     if (IS_FALSE(val)) return val;
     args = args->cdr;
   }
   return val;
 }
 
-object_t *or(cons_t *args)
+object_t *or(skeem_ctx_t *ctx, cons_t *args)
 {
   if (args == NULL) return CONST_FALSE;
 
   object_t *val;
   while (args != NULL) {
-    val = eval(args->car);
+    val = eval(ctx, args->car);
     if (IS_TRUE(val)) return val;
     args = args->cdr;
   }
@@ -278,83 +470,101 @@ object_t *or(cons_t *args)
 
 }
 
-object_t *not(cons_t *args) {
+object_t *not(skeem_ctx_t *ctx, cons_t *args) {
   assert_arity(1);
   return IS_TRUE(args->car) ? CONST_FALSE : CONST_TRUE;
 }
 
 /*Execute EXP while pred evaluates to true*/
-object_t *loop_while(cons_t *args) {
+object_t *loop_while(skeem_ctx_t *ctx, cons_t *args) {
   assert_arity(2);
-  object_t *pred = eval(args->car);
-  object_t *exp = eval(args->cdr->car);
+  object_t *pred = eval(ctx, args->car);
+  object_t *exp = eval(ctx, args->cdr->car);
   object_t *last = CONST_FALSE;
 
-  while (IS_TRUE(eval(pred))) {
-    last = eval(exp);
+  while (IS_TRUE(eval(ctx, pred))) {
+    fuel_step(ctx);
+    last = eval(ctx, exp);
   }
 
   return last;
 }
 
-object_t *cons(cons_t *args) {
+object_t *cons(skeem_ctx_t *ctx, cons_t *args) {
   assert_arity(2);
-  object_t *obj1 = eval(args->car);
-  object_t *obj2 = eval(args->cdr->car);
-  object_t *cons = obj_init(LIST);
-
-  cons->cell = cons_init();
+  object_t *obj1 = eval(ctx, args->car);
+  pin(ctx, obj1);
+  object_t *obj2 = eval(ctx, args->cdr->car);
+  pin(ctx, obj2);
+  object_t *cons = obj_init(ctx, LIST);
+  unpin_head(ctx);
+  unpin_head(ctx);
+
+  cons->cell = cons_init(ctx);
   cons->cell->car = obj1;
-  cons->cell->cdr = cons_init();
-  cons->cell->cdr->car = obj2;
+
+  /*Cells are shared, so consing onto a list doesn't copy it*/
+  if (_LIST_P(obj2)) {
+    cons->cell->cdr = obj2->cell;
+  } else {
+    cons->cell->cdr = cons_init(ctx);
+    cons->cell->cdr->car = obj2;
+  }
 
   return cons;
 }
 
-object_t *if_else(cons_t *args) {
+object_t *if_else(skeem_ctx_t *ctx, cons_t *args) {
   assert_arity(3);
-  if (IS_TRUE(eval(args->car))) return eval(args->cdr->car);
-  return eval(args->cdr->cdr->car);
+  if (IS_TRUE(eval(ctx, args->car))) return eval(ctx, args->cdr->car);
+  return eval(ctx, args->cdr->cdr->car);
 }
 
-object_t *set(cons_t *args) {
+object_t *set(skeem_ctx_t *ctx, cons_t *args) {
   assert_arity(2);
   object_t *sym = args->car;
-  object_t *val = eval(args->cdr->car);
+  object_t *val = eval(ctx, args->cdr->car);
 
   if (_SYMBOL_P(sym)) {
-    struct bind_tree *bind = env_lookup_node(sym);
+    object_t *env;
+    struct bind_tree *bind = env_lookup_node(ctx, sym, &env);
 
+    if (bind == NULL && env_lookup(ctx, sym) != NULL)
+      error("set!: %s belongs to the parent of this future\n", sym->string);
     if (bind == NULL) {
       error("Unbound variable: %s\n", sym->string);
 
     }
+    env_modify(ctx, env);
+    jit_bind(ctx, sym, val);
+    aot_bind(ctx, sym, val);
     bind->val = val;
   }
 
   return val;
 }
 
-static object_t *make_procedure(char *name, cons_t *params, object_t *body)
+static object_t *make_procedure(skeem_ctx_t *ctx, const char *name,
+                               cons_t *params, object_t *body)
 {
-  object_t *proc = obj_init(PROCEDURE);
-  proc->procedure->name = name;
+  object_t *proc = obj_init(ctx, PROCEDURE);
+  proc->procedure->name = strdup(name);
   proc->procedure->params = params;
+  proc->procedure->nparams = length(params);
   proc->procedure->body = body;
   return proc;
 }
 
-object_t *define(cons_t *args) {
+object_t *define(skeem_ctx_t *ctx, cons_t *args) {
   assert_arity(2);
   object_t *sym = args->car;
   object_t *val = args->cdr->car;
 
   if (_SYMBOL_P(sym))
-    env_insert(sym, eval(val));
+    env_insert(ctx, sym, eval(ctx, val));
 
   else if (_LIST_P(sym))
-    env_insert(sym->cell->car,
-               make_procedure(sym->cell->car->string,
+    env_insert(ctx, sym->cell->car, make_procedure(ctx, sym->cell->car->string,
                               args->car->cell->cdr, args->cdr->car));
   else
     error("Wrong argument type - %s (needed symbol)\n", types[sym->type]);
@@ -362,12 +572,48 @@ object_t *define(cons_t *args) {
   return val;
 }
 
-object_t *quote(cons_t *args)
+/*Evaluate each form in the current environment, so that what they define
+ *is defined outside. Returns the value of the last.*/
+object_t *begin(skeem_ctx_t *ctx, cons_t *args)
+{
+  object_t *val = EMPTY_LIST;
+
+  for (; args != NULL; args = args->cdr) val = eval_nopush(ctx, args->car);
+  return val;
+}
+
+object_t *quote(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   return args->car;
 }
 
+/*Identity. Symbols are compared by name, since the reader does not intern
+ *them.*/
+bool _eq(object_t *obj1, object_t *obj2)
+{
+  if (obj1 == obj2) return true;
+  return _SYMBOL_P(obj1) && _SYMBOL_P(obj2) &&
+         strcmp(obj1->string, obj2->string) == 0;
+}
+
+/*Evaluate both arguments of an equivalence predicate and compare them*/
+static object_t *compare(skeem_ctx_t *ctx, cons_t *args,
+                         bool (*equiv)(object_t *, object_t *))
+{
+  object_t *obj1 = eval(ctx, args->car);
+  pin(ctx, obj1);
+  object_t *obj2 = eval(ctx, args->cdr->car);
+  unpin_head(ctx);
+  return BOOL_TO_OBJ(equiv(obj1, obj2));
+}
+
+object_t *eq(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  return compare(ctx, args, _eq);
+}
+
 bool _eqv(object_t *obj1, object_t *obj2)
 {
   if (obj1->type == obj2->type) {
@@ -389,19 +635,28 @@ bool _eqv(object_t *obj1, object_t *obj2)
         return obj1->string == obj2->string;
       case PRIMITIVE:
         return obj1->primitive == obj2->primitive;
+      case FOREIGN:
+        return obj1->foreign == obj2->foreign;
+      case VECTOR:
+        return obj1->vector == obj2->vector;
+      case F64VECTOR:
+      case S64VECTOR:
+        return obj1->numvector == obj2->numvector;
+      case PORT:
+        return obj1->port == obj2->port;
+      case EOF_OBJECT:
+        return true;
     }
   }
   return false;
 }
 
-object_t *eqv(cons_t *args)
+object_t *eqv(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(2);
-  return BOOL_TO_OBJ(_eqv(args->car, args->cdr->car));
+  return compare(ctx, args, _eqv);
 }
 
-bool _equal(object_t *obj1, object_t *obj2);
-
 bool eq_cons(cons_t *cell1, cons_t *cell2) {
   if (cell1 && cell2) {
     if (_equal(cell1->car, cell2->car)) /*Using && wouldn't result in TCO*/
@@ -420,7 +675,13 @@ bool _equal(object_t *obj1, object_t *obj2) {
       case LIST:
         return eq_cons(obj1->cell, obj2->cell);
       case STRING:
-        return strcmp(obj1->string, obj2->string) == 0;
+        return str_len(obj1) == str_len(obj2) &&
+               memcmp(obj1->string, obj2->string, str_len(obj1)) == 0;
+      case VECTOR:
+        return eq_vector(obj1->vector, obj2->vector);
+      case F64VECTOR:
+      case S64VECTOR:
+        return eq_numvector(obj1->numvector, obj2->numvector);
       default:
         return _eqv(obj1, obj2);
     }
@@ -428,47 +689,53 @@ bool _equal(object_t *obj1, object_t *obj2) {
   return false;
 }
 
-object_t *equal(cons_t *args)
+object_t *equal(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(2);
-  return BOOL_TO_OBJ(_equal(args->car, args->cdr->car));
+  return compare(ctx, args, _equal);
 }
 
-object_t *car(cons_t *args)
+object_t *car(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
+  object_t *list = eval(ctx, args->car);
 
-  if (args->car->type != LIST)
-    error("Wrong argument type - %s. (Expected list)\n", types[args->car->type]);
+  if (list->type != LIST || list == EMPTY_LIST)
+    error("Wrong argument type - %s. (Expected pair)\n", types[list->type]);
 
-  return args->car->cell->car;
+  return list->cell->car;
 }
 
-object_t *cdr(cons_t *args)
+object_t *cdr(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
+  object_t *list = eval(ctx, args->car);
 
-  if (args->car->type != LIST)
-    error("Wrong argument type - %s. (Expected list)\n", types[args->car->type]);
-  object_t *o = obj_init(LIST);
-  o->cell = args->car->cell->cdr;
-  return o->cell == NULL ? EMPTY_LIST : o;
+  if (list->type != LIST || list == EMPTY_LIST)
+    error("Wrong argument type - %s. (Expected pair)\n", types[list->type]);
+  if (list->cell->cdr == NULL) return EMPTY_LIST;
+
+  pin(ctx, list);
+  object_t *o = obj_init(ctx, LIST);
+  unpin_head(ctx);
+  o->cell = list->cell->cdr;
+  return o;
 }
 
-object_t *lambda(cons_t *args)
+object_t *lambda(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(2);
 
   if (!_LIST_P(args->car))
     error("Wrong argument type - %s (Expected list)\n", types[args->car->type]);
 
-  return make_procedure(strdup("lambda"), args->car->cell, args->cdr->car);
+  return make_procedure(ctx, "lambda", args->car->cell, args->cdr->car);
 }
 
 #if GCC_VERSION >= 40700
 _Noreturn
 #endif
-object_t *exit_status(cons_t *args)
+object_t *exit_status(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   if (_INTEGER_P(args->car)) exit(args->car->integer);
@@ -476,80 +743,276 @@ object_t *exit_status(cons_t *args)
   error("Wrong argument type - %s. (Expected integer)\n", types[args->car->type]);
 }
 
-object_t *apply_procedure(procedure_t *procedure, cons_t *args)
+/*Evaluate the body of PROC, a procedure, in the current environment, into
+ *which its parameters have already been bound*/
+static object_t *procedure_body(skeem_ctx_t *ctx, object_t *proc)
 {
-  cons_t *cur_param = procedure->params;
-  cons_t *cur_arg = args;
+  procedure_t *procedure = proc->procedure;
   object_t *body = procedure->body;
-  
-  if (body == EMPTY_LIST)
-    return EMPTY_LIST;
-  
-  cons_t *cur_exp = procedure->body->cell;
-  
-  if (_LIST_P(cur_exp->car) && _LIST_P(cur_exp->car->cell->car))
-    cur_exp = cur_exp->car->cell;
-  
-  correct_number_args(procedure->name,
-                      length(procedure->params),
-                      args);
-  while (cur_param != NULL) {
-    arg_insert(cur_param->car, eval(cur_arg->car));
-    cur_arg = cur_arg->cdr;
-    cur_param = cur_param->cdr;
-  }
-  
   object_t *last;
+
+  if (jit_ready(ctx, procedure)) {
+    /*The code goes with the procedure, which must outlive it*/
+    pin(ctx, proc);
+    last = jit_run(ctx, procedure);
+    unpin_head(ctx);
+    goto closure_check;
+  }
+
   if (!_LIST_P(body) || !_LIST_P(body->cell->car)) {
-    last = eval_nopush(body);
+    last = eval_nopush(ctx, body);
     goto closure_check;
   }
+
+  cons_t *cur_exp = body->cell;
+  if (_LIST_P(cur_exp->car) && _LIST_P(cur_exp->car->cell->car))
+    cur_exp = cur_exp->car->cell;
   
   while (cur_exp->cdr != NULL) {
-    eval(cur_exp->car);
+    eval(ctx, cur_exp->car);
     cur_exp = cur_exp->cdr;
   }
   
-  last = eval(cur_exp->car);
+  last = eval(ctx, cur_exp->car);
 
 closure_check:
   /*closure*/
   if (last->type == PROCEDURE) {
-    object_t *cl = obj_init(CLOSURE);
-    cl->closure->env = env_head;
+    object_t *cl = obj_init(ctx, CLOSURE);
+    cl->closure->env = ctx->env_head;
     cl->closure->proc = last; 
     return cl;
   }
   return last;
 }
 
-object_t *apply(object_t *function, cons_t *args)
+object_t *apply_procedure(skeem_ctx_t *ctx, object_t *proc, cons_t *args)
+{
+  procedure_t *procedure = proc->procedure;
+  cons_t *cur_arg = args;
+  int nargs = 0;
+
+  fuel_step(ctx);
+  stack_check(ctx);
+  if (procedure->body == EMPTY_LIST)
+    return EMPTY_LIST;
+
+  /*Every argument is evaluated before any parameter is bound, so an
+   *argument expression never sees the callee's bindings. The values wait
+   *on the pin stack, which grows on the heap however many there are. The
+   *parameter count is cached on the procedure; only a mismatch walks the
+   *rest.*/
+  size_t base = ctx->num_pinned;
+  for (; cur_arg != NULL && nargs < procedure->nparams;
+       cur_arg = cur_arg->cdr, nargs++)
+    pin(ctx, eval(ctx, cur_arg->car));
+
+  if (nargs != procedure->nparams || cur_arg != NULL)
+    error("Wrong number of arguments to %s (Got %d, Wanted %d)\n",
+          procedure->name, nargs + length(cur_arg), procedure->nparams);
+
+  /*Indexed afresh each time, as binding may pin and move the stack*/
+  nargs = 0;
+  for (cons_t *param = procedure->params; param != NULL; param = param->cdr)
+    arg_insert(ctx, param->car, ctx->pinned[base + nargs++]);
+  ctx->num_pinned = base;
+
+  struct frame frame;
+  frame_push(ctx, &frame, procedure);
+  object_t *val = procedure_body(ctx, proc);
+  frame_pop(ctx, &frame);
+  return val;
+}
+
+/*Call the procedure pinned below the last ARGC pinned values, which are its
+ *arguments, already evaluated and as many as it takes, and unpin them all.
+ *PUSH is whether the call is evaluated in an environment of its own. Used
+ *by compiled code.*/
+object_t *apply_pinned(skeem_ctx_t *ctx, int argc, bool push)
+{
+  object_t **vals = &ctx->pinned[ctx->num_pinned - argc];
+  object_t *proc = vals[-1];
+  procedure_t *procedure = proc->procedure;
+  int nargs = 0;
+
+  fuel_step(ctx);
+  stack_check(ctx);
+  if (push) env_push(ctx);
+  for (cons_t *param = procedure->params; param != NULL; param = param->cdr)
+    arg_insert(ctx, param->car, vals[nargs++]);
+  ctx->num_pinned -= argc;
+
+  struct frame frame;
+  frame_push(ctx, &frame, procedure);
+  object_t *val = procedure_body(ctx, proc);
+  frame_pop(ctx, &frame);
+  if (push) env_pop(ctx);
+  unpin_head(ctx);
+  return val;
+}
+
+/*Link the environment of CLOSURE onto the current one. A closure of another
+ *heap may be in use by other threads, so its environment is copied. Once
+ *there are coroutines, several of them may be inside the closure at once,
+ *each with its own chain, so a view of the environment is linked instead.
+ *So is an environment that is already linked into this chain, by a call
+ *to a closure that hasn't returned, as relinking it would make a cycle, or
+ *one the running futures of CTX may be walking.*/
+static void closure_push(skeem_ctx_t *ctx, object_t *closure)
+{
+  object_t *env = closure->closure->env;
+
+  if (env->heap != ctx->heap_id) {
+    pin(ctx, closure);
+    env = env_copy(ctx, env);
+    unpin_head(ctx);
+  } else if (ctx->sched != NULL || env == ctx->env_head ||
+             env->env->next != NULL ||
+             (ctx->futures != NULL && env_forked(env))) {
+    env = env_view(ctx, env);
+  }
+
+  env->env->prev = ctx->env_head;
+  ctx->env_head->env->next = env;
+  ctx->env_head = env;
+}
+
+/*Call FOREIGN with ARGC evaluated arguments, which the caller keeps
+ *reachable. Values the embedder creates during the call are pinned above
+ *them and released when it returns.*/
+static object_t *apply_foreign(skeem_ctx_t *ctx, foreign_t *foreign,
+                               int argc, object_t **argv)
+{
+  size_t num_pinned = ctx->num_pinned;
+
+  if (foreign->arity >= 0 && argc != foreign->arity)
+    error("Wrong number of arguments to %s (Got %d, Wanted %d)\n",
+          foreign->name, argc, foreign->arity);
+
+  object_t *val = foreign->fn(ctx, argc, argv, foreign->data);
+  ctx->num_pinned = num_pinned;
+  return val == NULL ? EMPTY_LIST : val;
+}
+
+/*Apply FUNCTION to VALUES, which have already been evaluated. Used by
+ *primitives that call back into user procedures. The values must be
+ *reachable by the GC for the duration of the call.*/
+object_t *apply_values(skeem_ctx_t *ctx, object_t *function, cons_t *values)
+{
+  switch (function->type) {
+    case PRIMITIVE: {
+      /*Primitives evaluate their own arguments, so anything that isn't
+       *self-evaluating is passed quoted*/
+      cons_t *args = NULL, **cur = &args;
+      bool old_no_gc = ctx->no_gc;
+
+      ctx->no_gc = true;
+      for (; values != NULL; values = values->cdr) {
+        object_t *val = values->car;
+
+        if (_SYMBOL_P(val) || (_LIST_P(val) && val != EMPTY_LIST)) {
+          object_t *quoted = obj_init(ctx, LIST);
+          quoted->cell = cons_init(ctx);
+          quoted->cell->car = QUOTE;
+          quoted->cell->cdr = cons_init(ctx);
+          quoted->cell->cdr->car = val;
+          val = quoted;
+        }
+        *cur = cons_init(ctx);
+        (*cur)->car = val;
+        cur = &(*cur)->cdr;
+      }
+      /*Keep the argument cells reachable while the primitive runs*/
+      object_t *arglist = obj_init(ctx, LIST);
+      arglist->cell = args;
+      pin(ctx, arglist);
+      ctx->no_gc = old_no_gc;
+
+      object_t *val = function->primitive(ctx, args);
+      unpin_head(ctx);
+      return val;
+    }
+    case FOREIGN: {
+      int argc = length(values);
+      object_t *argv[argc > 0 ? argc : 1];
+
+      for (int i = 0; i < argc; i++, values = values->cdr)
+        argv[i] = values->car;
+      return apply_foreign(ctx, function->foreign, argc, argv);
+    }
+    case PROCEDURE:
+    case CLOSURE: {
+      object_t *proc = _PROCEDURE_P(function) ? function
+                                              : function->closure->proc;
+      procedure_t *procedure = proc->procedure;
+      object_t *val = EMPTY_LIST;
+
+      fuel_step(ctx);
+      stack_check(ctx);
+      env_push(ctx);
+      if (_CLOSURE_P(function)) closure_push(ctx, function);
+
+      if (procedure->body != EMPTY_LIST) {
+        correct_number_args(ctx, procedure->name, procedure->nparams, values);
+        for (cons_t *param = procedure->params; param != NULL;
+             param = param->cdr, values = values->cdr)
+          arg_insert(ctx, param->car, values->car);
+
+        struct frame frame;
+        frame_push(ctx, &frame, procedure);
+        val = procedure_body(ctx, proc);
+        frame_pop(ctx, &frame);
+      }
+
+      if (_CLOSURE_P(function)) env_pop(ctx);
+      env_pop(ctx);
+      return val;
+    }
+    default:
+      fprintf(stderr, "Invalid Function: ");
+      print_obj(function, stderr);
+      fprintf(stderr, "\n");
+      goto_top(ctx);
+  }
+}
+
+object_t *apply(skeem_ctx_t *ctx, object_t *function, cons_t *args)
 {
   switch (function->type) {
     case PRIMITIVE:
-      return function->primitive(args);
+      return function->primitive(ctx, args);
+    case FOREIGN: {
+      int argc = length(args);
+      object_t *argv[argc > 0 ? argc : 1];
+
+      for (int i = 0; i < argc; i++, args = args->cdr) {
+        argv[i] = eval(ctx, args->car);
+        pin(ctx, argv[i]);
+      }
+      object_t *val = apply_foreign(ctx, function->foreign, argc, argv);
+      for (int i = 0; i < argc; i++) unpin_head(ctx);
+      return val;
+    }
     case SYMBOL:
-      function = eval(function);
-      return apply(function, args);
+      function = eval(ctx, function);
+      return apply(ctx, function, args);
     case PROCEDURE:
-      return apply_procedure(function->procedure, args);
+      return apply_procedure(ctx, function, args);
     case CLOSURE:
-      function->closure->env->env->prev = env_head;
-      env_head->env->next = function->closure->env;
-      env_head = env_head->env->next;
-      object_t *val = apply_procedure(function->closure->proc->procedure, args);
-      env_pop();
+      closure_push(ctx, function);
+      object_t *val = apply_procedure(ctx, function->closure->proc, args);
+      env_pop(ctx);
       return val;
     default:
       fprintf(stderr, "Invalid Function: ");
       print_obj(function, stderr);
       fprintf(stderr, "\n");
-      goto_top();
+      goto_top(ctx);
   }
 }
 
 /* Evaluate object */
-object_t *_eval(object_t *obj, bool push)
+object_t *_eval(skeem_ctx_t *ctx, object_t *obj, bool push)
 {
   if (obj == NULL) return NULL;
 
@@ -558,22 +1021,28 @@ object_t *_eval(object_t *obj, bool push)
       {
         if (obj == EMPTY_LIST) return EMPTY_LIST;
         
-        mark(obj);
-        if (push) env_push();
-        object_t *val = apply(obj->cell->car, obj->cell->cdr);
-        if (push) env_pop();
-        
+        pin(ctx, obj);
+        if (push) env_push(ctx);
+        object_t *function = obj->cell->car, *val;
+
+        if (_SYMBOL_P(function)) function = eval(ctx, function);
+        /*A macro defined after this form was expanded*/
+        if (function->type == MACRO)
+          val = _eval(ctx, macro_use(ctx, obj, function), false);
+        else
+          val = apply(ctx, function, obj->cell->cdr);
+        if (push) env_pop(ctx);
+        unpin_head(ctx);
+
         return val;
       }
     case SYMBOL: {
-      object_t *result = env_lookup(obj);
+      object_t *result = env_lookup(ctx, obj);
 
       if (result == NULL) {
         error("Unbound variable: %s\n", obj->string);
       }
 
-      while (result->type == SYMBOL) result = env_lookup(obj);
-
       return result;
     }
     default:
@@ -581,89 +1050,141 @@ object_t *_eval(object_t *obj, bool push)
   }
 }
 
-inline object_t *eval(object_t *obj)
+inline object_t *eval(skeem_ctx_t *ctx, object_t *obj)
 {
-  return _eval(obj, true);
+  return _eval(ctx, obj, true);
 }
 
-inline object_t *eval_nopush(object_t *obj)
+inline object_t *eval_nopush(skeem_ctx_t *ctx, object_t *obj)
 {
-  return _eval(obj, false);
+  return _eval(ctx, obj, false);
 }
 
-void add_primitive(char *name, primitive_t function)
+void add_primitive(skeem_ctx_t *ctx, char *name, primitive_t function)
 {
-  object_t *p = ERR_MALLOC(sizeof(object_t));
-  p->type = PRIMITIVE;
+  object_t *p = obj_init(ctx, PRIMITIVE);
   p->primitive = function;
-  object_t *n = ERR_MALLOC(sizeof(object_t));
-  n->type = SYMBOL;
-  n->string = strdup(name);
-  arg_insert(n, p);
+  pin(ctx, p);
+  object_t *n = symbol_new(ctx, name);
+  unpin_head(ctx);
+  arg_insert(ctx, n, p);
 }
 
-object_t *garbage_collect(cons_t *args)
+object_t *garbage_collect(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(0);
-  gc();
+  gc(ctx);
   return CONST_TRUE;
 }
 
-object_t *integer_p(cons_t *args)
+/*A (NAME BYTES) list for memory_usage, pushed onto LIST*/
+static cons_t *usage_entry(skeem_ctx_t *ctx, cons_t *list, const char *name,
+                           size_t bytes)
+{
+  object_t *sym = symbol_new(ctx, name), *n = obj_init(ctx, INTEGER);
+  object_t *entry = obj_init(ctx, LIST);
+  cons_t *cell = cons_init(ctx);
+
+  n->integer = bytes;
+  entry->cell = cons_init(ctx);
+  entry->cell->car = sym;
+  entry->cell->cdr = cons_init(ctx);
+  entry->cell->cdr->car = n;
+  cell->car = entry;
+  cell->cdr = list;
+  return cell;
+}
+
+/*(memory-usage) collects garbage, then lists the bytes held by each type of
+ *live object as (type bytes) lists, cons cells as pair, followed by
+ *(total bytes)*/
+object_t *memory_usage(skeem_ctx_t *ctx, cons_t *args)
+{
+  size_t by_type[MACRO + 1] = {0}, cells, total;
+  cons_t *list = NULL;
+
+  assert_arity(0);
+  gc(ctx);
+  heap_usage(ctx, by_type, &cells);
+
+  /*Several types share a name*/
+  for (int i = 0; i <= MACRO; i++)
+    for (int j = 0; j < i; j++)
+      if (strcmp(types[i], types[j]) == 0) {
+        by_type[j] += by_type[i];
+        by_type[i] = 0;
+      }
+
+  bool old_no_gc = ctx->no_gc;
+  ctx->no_gc = true;
+  total = cells;
+  for (int i = 0; i <= MACRO; i++) total += by_type[i];
+  list = usage_entry(ctx, list, "total", total);
+  list = usage_entry(ctx, list, "pair", cells);
+  for (int i = MACRO; i >= 0; i--)
+    if (by_type[i] != 0) list = usage_entry(ctx, list, types[i], by_type[i]);
+
+  object_t *usage = obj_init(ctx, LIST);
+  usage->cell = list;
+  ctx->no_gc = old_no_gc;
+  return usage;
+}
+
+object_t *integer_p(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   return BOOL_TO_OBJ(_INTEGER_P(args->car));
 }
 
-object_t *float_p(cons_t *args)
+object_t *float_p(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   return BOOL_TO_OBJ(_FLOAT_P(args->car));
 }
 
-object_t *number_p(cons_t *args)
+object_t *number_p(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   return BOOL_TO_OBJ(_NUMBER_P(args->car));
 }
 
-object_t *string_p(cons_t *args)
+object_t *string_p(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   return BOOL_TO_OBJ(_STRING_P(args->car));
 }
 
-object_t *symbol_p(cons_t *args)
+object_t *symbol_p(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   return BOOL_TO_OBJ(_SYMBOL_P(args->car));
 }
 
-object_t *list_p(cons_t *args)
+object_t *list_p(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   return BOOL_TO_OBJ(_LIST_P(args->car));
 }
 
-object_t *procedure_p(cons_t *args)
+object_t *procedure_p(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   return BOOL_TO_OBJ(_PROCEDURE_P(args->car));
 }
 
-object_t *boolean_p(cons_t *args)
+object_t *boolean_p(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   return BOOL_TO_OBJ(_BOOLEAN_P(args->car));
 }
 
-object_t *closure_p(cons_t *args)
+object_t *closure_p(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   return BOOL_TO_OBJ(_CLOSURE_P(args->car));
 }
 
-object_t *print(cons_t *args)
+object_t *print(skeem_ctx_t *ctx, cons_t *args)
 {
   assert_arity(1);
   print_obj(args->car, stdout);
@@ -671,60 +1192,62 @@ object_t *print(cons_t *args)
 }
 
 /*Initialize all builtin primitives and constants*/
-void builtins_init()
-{
-  add_primitive("+", add_list);
-  add_primitive("-", subtract_list);
-  add_primitive("*", multiply_list);
-  add_primitive("/", divide_list);
-  add_primitive(">", greater);
-  add_primitive("<", lesser);
-  add_primitive("and", and);
-  add_primitive("or", or);
-  add_primitive("not", not);
-  add_primitive("while", loop_while);
-  add_primitive("cons", cons);
-  add_primitive("if", if_else);
-  add_primitive("set!", set);
-  add_primitive("define", define);
-  add_primitive("quote", quote);
-  add_primitive("eqv?", eqv);
-  add_primitive("equal?", equal);
-  add_primitive("car", car);
-  add_primitive("cdr", cdr);
-  add_primitive("lambda", lambda);
-  add_primitive("exit", exit_status);
-  add_primitive("garbage-collect", garbage_collect);
-  add_primitive("print", print);
+void builtins_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "+", add_list);
+  add_primitive(ctx, "-", subtract_list);
+  add_primitive(ctx, "*", multiply_list);
+  add_primitive(ctx, "/", divide_list);
+  add_primitive(ctx, ">", greater);
+  add_primitive(ctx, "<", lesser);
+  add_primitive(ctx, "and", and);
+  add_primitive(ctx, "or", or);
+  add_primitive(ctx, "not", not);
+  add_primitive(ctx, "while", loop_while);
+  add_primitive(ctx, "cons", cons);
+  add_primitive(ctx, "if", if_else);
+  add_primitive(ctx, "set!", set);
+  add_primitive(ctx, "define", define);
+  add_primitive(ctx, "quote", quote);
+  add_primitive(ctx, "begin", begin);
+  add_primitive(ctx, "eq?", eq);
+  add_primitive(ctx, "eqv?", eqv);
+  add_primitive(ctx, "equal?", equal);
+  add_primitive(ctx, "car", car);
+  add_primitive(ctx, "cdr", cdr);
+  add_primitive(ctx, "lambda", lambda);
+  add_primitive(ctx, "exit", exit_status);
+  add_primitive(ctx, "garbage-collect", garbage_collect);
+  add_primitive(ctx, "memory-usage", memory_usage);
+  add_primitive(ctx, "print", print);
   /*Predicates*/
-  add_primitive("integer?", integer_p);
-  add_primitive("float?", float_p);
-  add_primitive("number?", number_p);
-  add_primitive("string?", string_p);
-  add_primitive("symbol?", symbol_p);
-  add_primitive("list?", list_p);
-  add_primitive("procedure?", procedure_p);
-  add_primitive("boolean?", boolean_p);
-  add_primitive("closure?", closure_p);
-  
-  CONST_TRUE = ERR_MALLOC(sizeof(object_t));
-  CONST_TRUE->type = BOOLEAN;
-  CONST_TRUE->boolean = true;
-
-  CONST_FALSE = ERR_MALLOC(sizeof(object_t));
-  CONST_FALSE->type = BOOLEAN;
-  CONST_FALSE->boolean = false;
-
-  EMPTY_LIST = ERR_MALLOC(sizeof(object_t));
-  EMPTY_LIST->type = LIST;
-
-  ZERO = ERR_MALLOC(sizeof(object_t));
-  ZERO->type = INTEGER;
-  ZERO->integer = 0;
+  add_primitive(ctx, "integer?", integer_p);
+  add_primitive(ctx, "float?", float_p);
+  add_primitive(ctx, "number?", number_p);
+  add_primitive(ctx, "string?", string_p);
+  add_primitive(ctx, "symbol?", symbol_p);
+  add_primitive(ctx, "list?", list_p);
+  add_primitive(ctx, "procedure?", procedure_p);
+  add_primitive(ctx, "boolean?", boolean_p);
+  add_primitive(ctx, "closure?", closure_p);
+
+  vector_init(ctx);
+  str_init(ctx);
+  macro_init(ctx);
+  library_init(ctx);
+  numvec_init(ctx);
+  hash_init(ctx);
+  list_init(ctx);
+  sort_init(ctx);
+  future_init(ctx);
+  coroutine_init(ctx);
+  io_init(ctx);
+  port_init(ctx);
+  trace_init(ctx);
+#ifdef INSTRUMENT
+  instrument_init(ctx);
+#endif
 
-  ONE = ERR_MALLOC(sizeof(object_t));
-  ONE->type = INTEGER;
-  ONE->integer = 1;
 }
 
 /* Local Variables:  */
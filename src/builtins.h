@@ -23,8 +23,16 @@
 #ifndef BUILTINS_H
 #define BUILTINS_H
 #include "types.h"
+#include "mem.h"
+#include <stdio.h>
 #include <setjmp.h>
 
+#define error(...)                \
+  {                               \
+    fprintf(stderr, __VA_ARGS__); \
+    goto_top(ctx);                \
+  }
+
 #define OPERATOR(o) ((o) + WHILE + EQUAL_P + 2)
 #define PREDICATE(p) ((p) + WHILE + 1)
 #define _INTEGER_P(n) ((n)->type == INTEGER)
@@ -36,12 +44,52 @@
 #define _PROCEDURE_P(n) ((n)->type == PROCEDURE)
 #define _BOOLEAN_P(n) ((n)->type == BOOLEAN)
 #define _CLOSURE_P(n) ((n)->type == CLOSURE)
+#define _VECTOR_P(n) ((n)->type == VECTOR)
+#define _F64VECTOR_P(n) ((n)->type == F64VECTOR)
+#define _S64VECTOR_P(n) ((n)->type == S64VECTOR)
+#define _HASH_TABLE_P(n) ((n)->type == HASH_TABLE)
+
+#define BOOL_TO_OBJ(predicate) ((predicate) ? CONST_TRUE : CONST_FALSE)
+/*VAL is evaluated once; it is often a call to eval or a predicate*/
+#define IS_FALSE(val) _is_false((val))
+#define IS_TRUE(val) (!IS_FALSE((val)))
+#define assert_arity(ar) correct_number_args(ctx, __func__, (ar), args)
+
+static inline bool _is_false(object_t *val) {
+  return _BOOLEAN_P(val) && !val->boolean;
+}
+
+extern char *types[];
 
-extern object_t *eval(object_t *obj);
-extern void builtins_init();
+extern object_t *eval(skeem_ctx_t *ctx, object_t *obj);
+extern object_t *eval_nopush(skeem_ctx_t *ctx, object_t *obj);
+extern object_t *begin(skeem_ctx_t *ctx, cons_t *args);
+extern object_t *apply_values(skeem_ctx_t *ctx, object_t *function,
+                              cons_t *values);
+extern object_t *apply_pinned(skeem_ctx_t *ctx, int argc, bool push);
+extern void procedure_arg(skeem_ctx_t *ctx, const char *function,
+                          object_t *obj);
+extern void correct_number_args(skeem_ctx_t *ctx, const char *function,
+                                int params_no, cons_t *args);
+extern bool _eq(object_t *obj1, object_t *obj2);
+extern bool _eqv(object_t *obj1, object_t *obj2);
+extern bool _equal(object_t *obj1, object_t *obj2);
+extern object_t *eq(skeem_ctx_t *ctx, cons_t *args);
+extern object_t *eqv(skeem_ctx_t *ctx, cons_t *args);
+extern object_t *equal(skeem_ctx_t *ctx, cons_t *args);
+extern void add(skeem_ctx_t *ctx, object_t *n1, object_t *n2,
+                object_t *result);
+extern object_t *add_list(skeem_ctx_t *ctx, cons_t *args);
+extern object_t *greater(skeem_ctx_t *ctx, cons_t *args);
+extern object_t *lesser(skeem_ctx_t *ctx, cons_t *args);
+extern object_t *if_else(skeem_ctx_t *ctx, cons_t *args);
+extern object_t *quote(skeem_ctx_t *ctx, cons_t *args);
+extern void add_primitive(skeem_ctx_t *ctx, char *name, primitive_t function);
+extern void builtins_init(skeem_ctx_t *ctx);
 
-object_t *CONST_TRUE;
-object_t *CONST_FALSE;
-object_t *EMPTY_LIST;
+extern object_t *const CONST_TRUE;
+extern object_t *const CONST_FALSE;
+extern object_t *const EMPTY_LIST;
+extern object_t *const CONST_EOF;
 
 #endif
@@ -0,0 +1,541 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Cache of parsed source files. A file's top-level forms are serialized into
+ *a flat image the first time it is run, and stored under the FNV-1a hash of
+ *the interpreter's version and build id, the reader's version and the file
+ *contents. Later runs of the same file
+ *skip the reader entirely. Images live in $SKEEM_CACHE_DIR, falling back to
+ *$XDG_CACHE_HOME/skeem and ~/.cache/skeem; an empty SKEEM_CACHE_DIR disables
+ *the on-disk cache.*/
+
+#define _GNU_SOURCE
+#include "cache.h"
+#include "types.h"
+#include "mem.h"
+#include "builtins.h"
+#include "vector.h"
+#include "numvec.h"
+#include "str.h"
+#include "token.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <link.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "SKMC"
+
+enum cache_tag {
+  TAG_INTEGER,
+  TAG_FLOAT,
+  TAG_CHAR,
+  TAG_STRING,
+  TAG_SYMBOL,
+  TAG_TRUE,
+  TAG_FALSE,
+  TAG_EMPTY_LIST,
+  TAG_LIST,
+  TAG_VECTOR,
+  TAG_F64VECTOR,
+  TAG_S64VECTOR
+};
+
+/*The source's length and a second digest of it guard against a collision
+ *of KEY running another program*/
+struct cache_header {
+  char magic[4];
+  uint32_t format;
+  uint64_t key;
+  char version[16];
+  uint64_t src_len, digest;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+  const unsigned char *bytes = data;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+struct build_id {
+  const void *bytes;
+  size_t len;
+};
+
+/*Find the GNU build id note of the object that cache_key is linked into,
+ *the interpreter or libskeem*/
+static int find_build_id(struct dl_phdr_info *info, size_t size, void *data) {
+  struct build_id *id = data;
+  uintptr_t self = (uintptr_t)cache_key;
+  bool found = false;
+
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+    uintptr_t start = info->dlpi_addr + ph->p_vaddr;
+
+    if (ph->p_type == PT_LOAD && self >= start && self < start + ph->p_memsz)
+      found = true;
+  }
+  if (!found) return 0;
+
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+    const char *note = (const char *)(info->dlpi_addr + ph->p_vaddr);
+    const char *end = note + ph->p_memsz;
+
+    if (ph->p_type != PT_NOTE) continue;
+    while (note + sizeof(ElfW(Nhdr)) <= end) {
+      const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr) *)note;
+      const char *name = note + sizeof(ElfW(Nhdr));
+      const char *desc = name + ((nhdr->n_namesz + 3) & ~3U);
+
+      if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+          memcmp(name, "GNU", 4) == 0) {
+        id->bytes = desc;
+        id->len = nhdr->n_descsz;
+        return 1;
+      }
+      note = desc + ((nhdr->n_descsz + 3) & ~3U);
+    }
+  }
+  return 1;
+}
+
+/*Key the image of SRC on everything that decides what reading it produces.
+ *The build id changes with every rebuild of the interpreter, so a reader
+ *change can't be served stale images even if READER_VERSION or
+ *CACHE_FORMAT wasn't bumped. Without one the versions have to do.*/
+uint64_t cache_key(const char *src, size_t len) {
+  uint64_t hash = 14695981039346656037ULL;
+  uint32_t versions[] = {CACHE_FORMAT, READER_VERSION};
+  struct build_id id = {NULL, 0};
+
+  hash = fnv1a(hash, SKEEM_VERSION, strlen(SKEEM_VERSION));
+  hash = fnv1a(hash, versions, sizeof(versions));
+  dl_iterate_phdr(find_build_id, &id);
+  hash = fnv1a(hash, id.bytes, id.len);
+  return fnv1a(hash, src, len);
+}
+
+/*A digest of SRC independent of cache_key's*/
+static uint64_t src_digest(const char *src, size_t len) {
+  uint64_t hash = len;
+
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char)src[i]) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+/*Write the path of the cache file for KEY into BUF. Returns false if no cache
+ *directory could be determined, in which case caching is skipped.*/
+static bool cache_path(uint64_t key, char *buf, size_t size, bool create) {
+  const char *dir = getenv("SKEEM_CACHE_DIR");
+  char base[4096];
+
+  if (dir != NULL) {
+    if (dir[0] == '\0') return false; /*explicitly disabled*/
+    snprintf(base, sizeof(base), "%s", dir);
+  } else if ((dir = getenv("XDG_CACHE_HOME")) != NULL && dir[0] != '\0') {
+    snprintf(base, sizeof(base), "%s/skeem", dir);
+  } else if ((dir = getenv("HOME")) != NULL && dir[0] != '\0') {
+    if (create) {
+      snprintf(base, sizeof(base), "%s/.cache", dir);
+      mkdir(base, 0755);
+    }
+    snprintf(base, sizeof(base), "%s/.cache/skeem", dir);
+  } else
+    return false;
+
+  if (create) mkdir(base, 0755);
+  snprintf(buf, size, "%s/%016llx.skc", base, (unsigned long long)key);
+  return true;
+}
+
+static void image_reserve(skeem_ctx_t *ctx, size_t bytes) {
+  if (ctx->image_len + bytes <= ctx->image_cap) return;
+
+  while (ctx->image_len + bytes > ctx->image_cap)
+    ctx->image_cap = ctx->image_cap == 0 ? 4096 : ctx->image_cap * 2;
+
+  ctx->image = realloc(ctx->image, ctx->image_cap);
+  if (ctx->image == NULL) {
+    perror("realloc");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void image_write(skeem_ctx_t *ctx, const void *data, size_t bytes) {
+  image_reserve(ctx, bytes);
+  memcpy(ctx->image + ctx->image_len, data, bytes);
+  ctx->image_len += bytes;
+}
+
+static void write_tag(skeem_ctx_t *ctx, enum cache_tag tag) {
+  unsigned char t = tag;
+  image_write(ctx, &t, 1);
+}
+
+static void write_string(skeem_ctx_t *ctx, const char *str) {
+  uint32_t len = strlen(str);
+  image_write(ctx, &len, sizeof(len));
+  image_write(ctx, str, len);
+}
+
+static void write_obj(skeem_ctx_t *ctx, object_t *obj) {
+  switch (obj->type) {
+    case INTEGER:
+      write_tag(ctx, TAG_INTEGER);
+      image_write(ctx, &obj->integer, sizeof(obj->integer));
+      break;
+    case FLOAT:
+      write_tag(ctx, TAG_FLOAT);
+      image_write(ctx, &obj->flt, sizeof(obj->flt));
+      break;
+    case CHAR:
+      write_tag(ctx, TAG_CHAR);
+      image_write(ctx, &obj->character, sizeof(obj->character));
+      break;
+    case STRING:
+      write_tag(ctx, TAG_STRING);
+      write_string(ctx, obj->string);
+      break;
+    case SYMBOL:
+      write_tag(ctx, TAG_SYMBOL);
+      write_string(ctx, obj->string);
+      break;
+    case BOOLEAN:
+      write_tag(ctx, obj->boolean ? TAG_TRUE : TAG_FALSE);
+      break;
+    case LIST: {
+      if (obj == EMPTY_LIST) {
+        write_tag(ctx, TAG_EMPTY_LIST);
+        break;
+      }
+      uint32_t len = length(obj->cell);
+      write_tag(ctx, TAG_LIST);
+      image_write(ctx, &len, sizeof(len));
+
+      for (cons_t *cur = obj->cell; cur != NULL; cur = cur->cdr)
+        write_obj(ctx, cur->car);
+    }
+      break;
+    case VECTOR: {
+      uint32_t len = obj->vector->len;
+      write_tag(ctx, TAG_VECTOR);
+      image_write(ctx, &len, sizeof(len));
+
+      for (uint32_t i = 0; i < len; i++) write_obj(ctx, obj->vector->items[i]);
+    }
+      break;
+    case F64VECTOR:
+    case S64VECTOR: {
+      uint32_t len = obj->numvector->len;
+      write_tag(ctx, obj->type == F64VECTOR ? TAG_F64VECTOR : TAG_S64VECTOR);
+      image_write(ctx, &len, sizeof(len));
+      image_write(ctx, obj->numvector->f64, len * sizeof(double));
+    }
+      break;
+    default:
+      /*The reader never produces any other type*/
+      fprintf(stderr, "cache: cannot serialize object of type %d\n",
+              obj->type);
+      exit(EXIT_FAILURE);
+  }
+}
+
+static bool image_read(skeem_ctx_t *ctx, void *data, size_t bytes) {
+  if (ctx->image_pos + bytes > ctx->image_len) return false;
+  memcpy(data, ctx->image + ctx->image_pos, bytes);
+  ctx->image_pos += bytes;
+  return true;
+}
+
+/*A string object's characters carry their length, a symbol's are bare*/
+static char *read_string(skeem_ctx_t *ctx, bool string) {
+  uint32_t len;
+  if (!image_read(ctx, &len,
+                  sizeof(len)) || ctx->image_pos + len > ctx->image_len)
+    return NULL;
+
+  char *str;
+  if (string) {
+    str = str_new(ctx->image + ctx->image_pos, len);
+  } else {
+    str = ERR_MALLOC(len + 1);
+    memcpy(str, ctx->image + ctx->image_pos, len);
+  }
+  ctx->image_pos += len;
+  return str;
+}
+
+static object_t *read_obj(skeem_ctx_t *ctx) {
+  unsigned char tag;
+  object_t *obj;
+
+  if (!image_read(ctx, &tag, 1)) return NULL;
+
+  switch (tag) {
+    case TAG_INTEGER:
+      obj = obj_init(ctx, INTEGER);
+      return image_read(ctx, &obj->integer, sizeof(obj->integer)) ? obj : NULL;
+    case TAG_FLOAT:
+      obj = obj_init(ctx, FLOAT);
+      return image_read(ctx, &obj->flt, sizeof(obj->flt)) ? obj : NULL;
+    case TAG_CHAR:
+      obj = obj_init(ctx, CHAR);
+      return image_read(ctx, &obj->character, sizeof(obj->character)) ? obj : NULL;
+    case TAG_STRING:
+      obj = obj_init(ctx, STRING);
+      obj->string = read_string(ctx, true);
+      return obj->string == NULL ? NULL : obj;
+    case TAG_SYMBOL: {
+      char *name = read_string(ctx, false);
+
+      if (name == NULL) return NULL;
+      obj = symbol_new(ctx, name);
+      free(name);
+      return obj;
+    }
+    case TAG_TRUE:
+      return CONST_TRUE;
+    case TAG_FALSE:
+      return CONST_FALSE;
+    case TAG_EMPTY_LIST:
+      return EMPTY_LIST;
+    case TAG_LIST: {
+      uint32_t len;
+      if (!image_read(ctx, &len, sizeof(len)) || len == 0) return NULL;
+
+      obj = obj_init(ctx, LIST);
+      obj->cell = cons_init(ctx);
+      cons_t *cur = obj->cell;
+
+      for (uint32_t i = 0; i < len; i++) {
+        if (i != 0) {
+          cur->cdr = cons_init(ctx);
+          cur = cur->cdr;
+        }
+        if ((cur->car = read_obj(ctx)) == NULL) return NULL;
+      }
+      return obj;
+    }
+    case TAG_VECTOR: {
+      uint32_t len;
+      if (!image_read(ctx, &len, sizeof(len))) return NULL;
+
+      obj = make_vector(ctx, len, NULL);
+      for (uint32_t i = 0; i < len; i++)
+        if ((obj->vector->items[i] = read_obj(ctx)) == NULL) return NULL;
+      return obj;
+    }
+    case TAG_F64VECTOR:
+    case TAG_S64VECTOR: {
+      uint32_t len;
+      if (!image_read(ctx, &len, sizeof(len))) return NULL;
+
+      obj = make_numvector(ctx, tag == TAG_F64VECTOR ? F64VECTOR : S64VECTOR,
+                           len);
+      if (!image_read(ctx, obj->numvector->f64,
+                      len * sizeof(double))) return NULL;
+      return obj;
+    }
+    default:
+      return NULL;
+  }
+}
+
+static void image_reset(skeem_ctx_t *ctx) {
+  free(ctx->image);
+  ctx->image = NULL;
+  ctx->image_len = ctx->image_cap = ctx->image_pos = 0;
+}
+
+/*Load the cached image of the LEN bytes of SRC, whose key is KEY. Returns
+ *false on a miss or if the cached file was written by a different
+ *interpreter version or for another source.*/
+bool cache_load(skeem_ctx_t *ctx, uint64_t key, const char *src,
+                size_t len) {
+  char path[4096];
+  struct cache_header header;
+  struct stat st;
+
+  image_reset(ctx);
+  if (!cache_path(key, path, sizeof(path), false)) return false;
+
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) return false;
+
+  if (fstat(fileno(file), &st) != 0 || st.st_size < (off_t)sizeof(header) ||
+      fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, CACHE_MAGIC, 4) != 0 ||
+      header.format != CACHE_FORMAT || header.key != key ||
+      header.src_len != len || header.digest != src_digest(src, len) ||
+      strncmp(header.version, SKEEM_VERSION, sizeof(header.version)) != 0) {
+    fclose(file);
+    return false;
+  }
+
+  ctx->image_len = ctx->image_cap = st.st_size - sizeof(header);
+  ctx->image = ERR_MALLOC(ctx->image_len + 1);
+
+  if (fread(ctx->image, 1, ctx->image_len, file) != ctx->image_len) {
+    fclose(file);
+    image_reset(ctx);
+    return false;
+  }
+
+  fclose(file);
+  ctx->image_key = key;
+  return true;
+}
+
+/*Start building a new image of the LEN bytes of SRC, whose key is KEY.
+ *Forms are appended with cache_add.*/
+void cache_begin(skeem_ctx_t *ctx, uint64_t key, const char *src,
+                 size_t len) {
+  image_reset(ctx);
+  ctx->image_key = key;
+  ctx->image_src_len = len;
+  ctx->image_digest = src_digest(src, len);
+}
+
+void cache_add(skeem_ctx_t *ctx, object_t *form) {
+  write_obj(ctx, form);
+}
+
+/*Write the image built so far to disk. Failing to write the file is not an
+ *error.*/
+void cache_commit(skeem_ctx_t *ctx) {
+  char path[4096], tmp[4200];
+  struct cache_header header;
+
+  if (!cache_path(ctx->image_key, path, sizeof(path), true)) return;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, 4);
+  header.format = CACHE_FORMAT;
+  header.key = ctx->image_key;
+  header.src_len = ctx->image_src_len;
+  header.digest = ctx->image_digest;
+  strncpy(header.version, SKEEM_VERSION, sizeof(header.version));
+
+  /*Write to a temporary file first, so that concurrent runs never see a
+   *partially written cache. Contexts in the same process get their own.*/
+  snprintf(tmp, sizeof(tmp), "%s.%ld.%p", path, (long)getpid(), (void *)ctx);
+  FILE *file = fopen(tmp, "wb");
+  if (file == NULL) return;
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(ctx->image, 1, ctx->image_len, file) == ctx->image_len;
+
+  if (fclose(file) != 0 || !ok || rename(tmp, path) != 0) unlink(tmp);
+}
+
+/*Read the whole of STREAM into memory*/
+static char *slurp(FILE *stream, size_t *len) {
+  size_t cap = 4096;
+  char *buf = ERR_MALLOC(cap);
+
+  *len = 0;
+  while (true) {
+    *len += fread(buf + *len, 1, cap - *len, stream);
+    if (*len < cap) break;
+    buf = realloc(buf, cap *= 2);
+    if (buf == NULL) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (ferror(stream)) {
+    perror("fread");
+    exit(EXIT_FAILURE);
+  }
+  return buf;
+}
+
+/*Make the image of the forms in STREAM the current one. It is loaded from the
+ *cache if these contents have been parsed before. Otherwise cache_next
+ *reads the forms one at a time, so that a syntax error is only raised
+ *after the forms before it have run, and the image is cached once the
+ *whole source has been read.*/
+void cache_open(skeem_ctx_t *ctx, FILE *stream) {
+  size_t len;
+  char *src = slurp(stream, &len);
+  uint64_t key = cache_key(src, len);
+
+  if (cache_load(ctx, key, src, len)) {
+    free(src);
+    return;
+  }
+
+  cache_begin(ctx, key, src, len);
+  ctx->image_src = src;
+  ctx->image_stream = fmemopen(src, len, "r");
+  if (ctx->image_stream == NULL) {
+    perror("fmemopen");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*Return the next top-level form of the current image, or NULL once all of
+ *them have been read.*/
+object_t *cache_next(skeem_ctx_t *ctx) {
+  object_t *form;
+
+  ctx->no_gc = true;
+  if (ctx->image_stream != NULL) {
+    if ((form = read_form(ctx, ctx->image_stream)) != NULL) {
+      cache_add(ctx, form);
+      return form;
+    }
+    cache_commit(ctx);
+    cache_close(ctx);
+    return NULL;
+  }
+  if (ctx->image == NULL || ctx->image_pos >= ctx->image_len) return NULL;
+
+  form = read_obj(ctx);
+
+  if (form == NULL) {
+    fprintf(stderr, "cache: corrupt image\n");
+    goto_top(ctx);
+  }
+  return form;
+}
+
+void cache_close(skeem_ctx_t *ctx) {
+  image_reset(ctx);
+  if (ctx->image_stream != NULL) {
+    fclose(ctx->image_stream);
+    free(ctx->image_src);
+    ctx->image_stream = NULL;
+    ctx->image_src = NULL;
+  }
+}
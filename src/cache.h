@@ -0,0 +1,45 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+#include "types.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*Bump whenever the serialized form layout changes*/
+#define CACHE_FORMAT 5
+
+extern uint64_t cache_key(const char *src, size_t len);
+extern bool cache_load(skeem_ctx_t *ctx, uint64_t key, const char *src,
+                       size_t len);
+extern void cache_begin(skeem_ctx_t *ctx, uint64_t key, const char *src,
+                        size_t len);
+extern void cache_add(skeem_ctx_t *ctx, object_t *form);
+extern void cache_commit(skeem_ctx_t *ctx);
+extern void cache_open(skeem_ctx_t *ctx, FILE *stream);
+extern object_t *cache_next(skeem_ctx_t *ctx);
+extern void cache_close(skeem_ctx_t *ctx);
+
+#endif
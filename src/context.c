@@ -0,0 +1,110 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "context.h"
+#include "mem.h"
+#include "builtins.h"
+#include "token.h"
+#include "cache.h"
+#include "future.h"
+#include "coroutine.h"
+#include "library.h"
+#include "instrument.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+/*Heap ids of the live contexts. Zero is reserved for the constants.*/
+static uint8_t heap_ids[(UINT16_MAX + 1) / 8] = {1};
+static uint16_t next_heap_id = 1;
+static pthread_mutex_t heap_ids_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint16_t heap_id_alloc()
+{
+  pthread_mutex_lock(&heap_ids_lock);
+  for (unsigned int n = 0; n <= UINT16_MAX; n++, next_heap_id++) {
+    uint16_t id = next_heap_id;
+
+    if (!(heap_ids[id / 8] & (1 << id % 8))) {
+      heap_ids[id / 8] |= 1 << id % 8;
+      next_heap_id++;
+      pthread_mutex_unlock(&heap_ids_lock);
+      return id;
+    }
+  }
+
+  fprintf(stderr, "Too many contexts\n");
+  exit(EXIT_FAILURE);
+}
+
+static void heap_id_free(uint16_t id)
+{
+  pthread_mutex_lock(&heap_ids_lock);
+  heap_ids[id / 8] &= ~(1 << id % 8);
+  pthread_mutex_unlock(&heap_ids_lock);
+}
+
+/*Create an interpreter with its own heap and a global environment holding
+ *the builtins*/
+skeem_ctx_t *ctx_new()
+{
+  skeem_ctx_t *ctx = ERR_MALLOC(sizeof(skeem_ctx_t));
+
+  ctx->heap_id = heap_id_alloc();
+  mem_init(ctx);
+  builtins_init(ctx);
+  return ctx;
+}
+
+/*Create a context for running a task on another thread. It allocates from
+ *its own heap, and sees the bindings of PARENT and its ancestors, including
+ *the builtins, through env_shared.*/
+skeem_ctx_t *ctx_fork(skeem_ctx_t *parent)
+{
+  skeem_ctx_t *ctx = ERR_MALLOC(sizeof(skeem_ctx_t));
+
+  ctx->heap_id = heap_id_alloc();
+  mem_init(ctx);
+  ctx->parent = parent;
+  ctx->env_shared = parent->env_head;
+  env_fork(parent->env_head);
+  /*A task shares the deadline of the evaluation that started it*/
+  ctx->max_ms = parent->max_ms;
+  ctx->deadline = parent->deadline;
+  ctx->max_bytes = parent->max_bytes;
+  return ctx;
+}
+
+void ctx_free(skeem_ctx_t *ctx)
+{
+  futures_cancel(ctx);
+  clear_tokens(ctx);
+  free(ctx->line);
+  cache_close(ctx);
+  coroutines_free(ctx);
+  libraries_free(ctx);
+#ifdef INSTRUMENT
+  instrument_free(ctx);
+#endif
+  mem_free(ctx);
+  heap_id_free(ctx->heap_id);
+  free(ctx);
+}
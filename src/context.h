@@ -0,0 +1,135 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+#include "types.h"
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct cons_block;
+struct _token;
+struct task;
+struct sched;
+struct library;
+struct frame;
+struct proc_record;
+
+/*All the state of one interpreter. Contexts share nothing, so any number of
+ *them can be used at once, each from a single thread.*/
+struct skeem_ctx {
+  /*Stamped on every object and cell allocated here*/
+  uint16_t heap_id;
+  /*Stores all allocated objects. Used by sweep()*/
+  struct obj_list *heap, *heap_head;
+  unsigned int max_obj, num_obj;
+  /*Cons cells, allocated in blocks and recycled through a free list*/
+  struct cons_block *cons_blocks;
+  cons_t *free_cells;
+  /*Pinned objects get marked every GC cycle*/
+  object_t **pinned;
+  size_t num_pinned, max_pinned;
+  bool no_gc;
+
+  object_t *env_global, *env_head;
+  /*For a context running a task, the context that started it and its
+   *environment at the time. Lookups that miss fall back to them.*/
+  skeem_ctx_t *parent;
+  object_t *env_shared;
+  /*Futures started from here whose results haven't been copied in yet.
+   *They may read this heap, so it isn't collected while any are running.*/
+  struct task *futures;
+  /*The coroutines of this context and their event loop, once one has been
+   *spawned or has waited for I/O*/
+  struct sched *sched;
+  /*error() returns here, after unwinding to env_base and pin_base. These
+   *mark the entry into the interpreter, which may be nested when an
+   *embedder calls back into a context from a foreign procedure.*/
+  jmp_buf err;
+  object_t *env_base;
+  size_t pin_base;
+  /*The innermost call to a Scheme procedure under way*/
+  struct frame *frames;
+
+  /*The standard ports, once current-input-port or current-output-port has
+   *asked for them*/
+  object_t *input_port, *output_port;
+
+  /*Values held by the embedder across calls; free slots are NULL*/
+  object_t **roots;
+  size_t num_roots, max_roots;
+
+  /*Libraries declared so far, each loaded when first imported*/
+  struct library *libraries;
+
+  /*Limits on each evaluation, zero for none, and what is left of them for
+   *the one under way: steps until they are next checked, steps beyond
+   *those, and the deadline in CLOCK_MONOTONIC nanoseconds*/
+  uint64_t max_steps;
+  uint32_t max_ms;
+  int64_t tick;
+  uint64_t fuel, deadline;
+  /*Bytes held by the heap as of the last collection, bytes allocated
+   *since, and the ceiling on the two together, zero for none*/
+  size_t live_bytes, new_bytes, max_bytes;
+  /*Calls into the interpreter under way from the embedding interface*/
+  unsigned int depth;
+  /*Set once a name whose primitive compiled code inlines has been bound
+   *here to anything else. The inlined forms then check what the name is
+   *bound to before taking their fast path.*/
+  bool jit_rebound;
+  /*One more than the first top level form defining a procedure compiled by
+   *skeemc whose name has been rebound here, or zero. Compiled code that may
+   *call it directly runs interpreted.*/
+  size_t aot_rebound;
+
+#ifdef INSTRUMENT
+  /*The counters of procedures that have been collected, by name*/
+  struct proc_record *retired;
+  size_t num_retired;
+#endif
+
+  /*Reader state*/
+  char *line;
+  size_t line_cap;
+  struct _token *tokens, *head_tok, *list_end;
+  bool in_string;
+  int paren_depth;
+  unsigned int nquotes;
+
+  /*The script cache image currently being written or read*/
+  char *image;
+  size_t image_len, image_cap, image_pos;
+  uint64_t image_key, image_src_len, image_digest;
+  /*A source missing from the cache, read form by form from IMAGE_SRC
+   *through IMAGE_STREAM while its image is built*/
+  FILE *image_stream;
+  char *image_src;
+};
+
+extern skeem_ctx_t *ctx_new();
+extern skeem_ctx_t *ctx_fork(skeem_ctx_t *parent);
+extern void ctx_free(skeem_ctx_t *ctx);
+
+#endif
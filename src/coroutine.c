@@ -0,0 +1,616 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Coroutines and channels. The coroutines of a context take turns on the
+ *thread that owns it, each on a C stack of its own, and switch only when one
+ *yields, waits for a channel or another coroutine, or would block on a
+ *descriptor. The interpreter state that belongs to a call stack - the
+ *environment chain, the pinned objects and the error handler - is switched
+ *along with the C stack. When no coroutine can run, the context waits in
+ *epoll for the descriptors they are blocked on.*/
+
+#include "coroutine.h"
+#include "types.h"
+#include "context.h"
+#include "mem.h"
+#include "builtins.h"
+#include "token.h"
+#include "fuel.h"
+#include "profile.h"
+#include "trace.h"
+#include <errno.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/*Stack size of every coroutine but the first, the usual size of a thread's
+ *stack. Only the pages that are touched get backed by memory.*/
+#define STACK_SIZE (8 * 1024 * 1024)
+/*Stacks of finished coroutines kept for reuse*/
+#define FREE_STACKS 64
+#define MAX_EVENTS 64
+
+struct coroutine {
+  ucontext_t uc;
+  char *stack;
+  /*The stack_limit while it runs*/
+  char *limit;
+  /*Held by the coroutine object, and by the scheduler until it finishes*/
+  int refs;
+  object_t *thunk;
+  object_t *value;
+  bool done;
+  bool failed;
+  /*Set when it is resumed only because nothing else can run*/
+  bool deadlock;
+  /*The bottom of its environment chain*/
+  object_t *base;
+  /*Its interpreter state while another coroutine runs*/
+  object_t *env_head, *env_base;
+  struct frame *frames;
+  object_t **pinned;
+  size_t num_pinned, max_pinned, pin_base;
+  bool no_gc;
+  jmp_buf err;
+  /*The descriptor it is blocked on, or -1*/
+  int fd;
+  /*Coroutines waiting for it to finish*/
+  struct coroutine *joiners;
+  /*Next in the run queue, or in the queue it is waiting in*/
+  struct coroutine *next;
+  /*The coroutines of the context that haven't finished*/
+  struct coroutine *live_prev, *live_next;
+};
+
+/*An unbounded queue of values. Receivers wait while it is empty.*/
+struct channel {
+  cons_t *head, *tail;
+  struct coroutine *receivers;
+};
+
+struct sched {
+  /*The coroutine that runs the script, on the thread's own stack*/
+  struct coroutine main;
+  struct coroutine *current;
+  struct coroutine *run_head, *run_tail;
+  struct coroutine *live;
+  /*Finished coroutines, whose stacks are freed by the next one to run*/
+  struct coroutine *dead;
+  char *stacks[FREE_STACKS];
+  size_t num_stacks;
+  int epfd;
+  size_t io_waiting;
+};
+
+/*The context of the coroutine being switched to, for one that starts*/
+static __thread skeem_ctx_t *entering;
+
+static struct sched *sched_get(skeem_ctx_t *ctx)
+{
+  if (ctx->sched != NULL) return ctx->sched;
+
+  struct sched *s = ERR_MALLOC(sizeof(struct sched));
+  s->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (s->epfd < 0) {
+    perror("epoll_create1");
+    exit(EXIT_FAILURE);
+  }
+
+  s->main.refs = 1;
+  s->main.base = ctx->env_global;
+  s->main.fd = -1;
+  s->current = &s->main;
+  s->live = &s->main;
+  ctx->sched = s;
+  return s;
+}
+
+static char *stack_alloc(struct sched *s)
+{
+  if (s->num_stacks > 0) return s->stacks[--s->num_stacks];
+
+  char *stack = mmap(NULL, STACK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                     -1, 0);
+  if (stack == MAP_FAILED) return NULL;
+
+  /*Overflowing into the guard page faults instead of corrupting memory*/
+  mprotect(stack, sysconf(_SC_PAGESIZE), PROT_NONE);
+  return stack;
+}
+
+static void stack_free(struct sched *s, char *stack)
+{
+  if (s->num_stacks < FREE_STACKS)
+    s->stacks[s->num_stacks++] = stack;
+  else
+    munmap(stack, STACK_SIZE);
+}
+
+void coroutine_unref(struct coroutine *co)
+{
+  if (--co->refs == 0) free(co);
+}
+
+static void live_remove(struct sched *s, struct coroutine *co)
+{
+  if (co->live_prev != NULL)
+    co->live_prev->live_next = co->live_next;
+  else
+    s->live = co->live_next;
+  if (co->live_next != NULL) co->live_next->live_prev = co->live_prev;
+}
+
+static void save(skeem_ctx_t *ctx, struct coroutine *co)
+{
+  co->env_head = ctx->env_head;
+  co->env_base = ctx->env_base;
+  co->frames = ctx->frames;
+  co->pinned = ctx->pinned;
+  co->num_pinned = ctx->num_pinned;
+  co->max_pinned = ctx->max_pinned;
+  co->pin_base = ctx->pin_base;
+  co->no_gc = ctx->no_gc;
+  memcpy(co->err, ctx->err, sizeof(jmp_buf));
+}
+
+static void load(skeem_ctx_t *ctx, struct coroutine *co)
+{
+  ctx->env_head = co->env_head;
+  ctx->env_base = co->env_base;
+  ctx->frames = co->frames;
+  ctx->pinned = co->pinned;
+  ctx->num_pinned = co->num_pinned;
+  ctx->max_pinned = co->max_pinned;
+  ctx->pin_base = co->pin_base;
+  ctx->no_gc = co->no_gc;
+  memcpy(ctx->err, co->err, sizeof(jmp_buf));
+}
+
+/*Free what is left of the coroutines that have finished*/
+static void reap(struct sched *s)
+{
+  while (s->dead != NULL) {
+    struct coroutine *co = s->dead;
+
+    s->dead = co->next;
+    stack_free(s, co->stack);
+    free(co->pinned);
+    co->stack = NULL;
+    co->pinned = NULL;
+    coroutine_unref(co);
+  }
+}
+
+/*Run TO until something switches back to the current coroutine*/
+static void switch_to(skeem_ctx_t *ctx, struct coroutine *to)
+{
+  struct sched *s = ctx->sched;
+  struct coroutine *from = s->current;
+
+  if (to == from) return;
+  save(ctx, from);
+  load(ctx, to);
+  from->limit = stack_limit;
+  stack_limit = to->limit;
+  s->current = to;
+  entering = ctx;
+  if (swapcontext(&from->uc, &to->uc) < 0) {
+    perror("swapcontext");
+    exit(EXIT_FAILURE);
+  }
+  reap(s);
+}
+
+static void make_runnable(struct sched *s, struct coroutine *co)
+{
+  co->next = NULL;
+  if (s->run_tail == NULL)
+    s->run_head = co;
+  else
+    s->run_tail->next = co;
+  s->run_tail = co;
+}
+
+/*Queue CO at the end of LIST*/
+static void add_waiter(struct coroutine **list, struct coroutine *co)
+{
+  while (*list != NULL) list = &(*list)->next;
+  co->next = NULL;
+  *list = co;
+}
+
+static void remove_waiter(struct coroutine **list, struct coroutine *co)
+{
+  while (*list != NULL && *list != co) list = &(*list)->next;
+  if (*list != NULL) *list = co->next;
+}
+
+/*Make the coroutines whose descriptors are ready runnable, waiting up to
+ *TIMEOUT milliseconds for one to be*/
+static void poll_io(struct sched *s, int timeout)
+{
+  struct epoll_event events[MAX_EVENTS];
+  uint64_t start = trace_begin();
+  int n = epoll_wait(s->epfd, events, MAX_EVENTS, timeout);
+
+  trace_end(TRACE_POLL, start);
+  if (n < 0 && errno != EINTR) {
+    perror("epoll_wait");
+    exit(EXIT_FAILURE);
+  }
+
+  for (int i = 0; i < n; i++) {
+    struct coroutine *co = events[i].data.ptr;
+
+    epoll_ctl(s->epfd, EPOLL_CTL_DEL, co->fd, NULL);
+    co->fd = -1;
+    s->io_waiting--;
+    make_runnable(s, co);
+  }
+}
+
+/*Take the next coroutine to run, waiting for I/O if none can yet. NULL if
+ *every coroutine is waiting for another.*/
+static struct coroutine *next_runnable(struct sched *s)
+{
+  while (s->run_head == NULL) {
+    if (s->io_waiting == 0) return NULL;
+    poll_io(s, -1);
+  }
+
+  struct coroutine *co = s->run_head;
+  s->run_head = co->next;
+  if (s->run_head == NULL) s->run_tail = NULL;
+  co->next = NULL;
+  return co;
+}
+
+/*Run other coroutines until the current one, which is waiting for something,
+ *is made runnable again. False if nothing else can run, in which case
+ *nothing ever will make it runnable.*/
+static bool suspend(skeem_ctx_t *ctx)
+{
+  struct sched *s = ctx->sched;
+  struct coroutine *co = s->current, *next = next_runnable(s);
+
+  if (next == NULL) return false;
+  switch_to(ctx, next);
+
+  if (co->deadlock) {
+    co->deadlock = false;
+    return false;
+  }
+  return true;
+}
+
+#if GCC_VERSION >= 40700
+_Noreturn
+#endif
+static void finish(skeem_ctx_t *ctx, struct coroutine *co)
+{
+  struct sched *s = ctx->sched;
+
+  co->done = true;
+  while (co->joiners != NULL) {
+    struct coroutine *joiner = co->joiners;
+
+    co->joiners = joiner->next;
+    make_runnable(s, joiner);
+  }
+  live_remove(s, co);
+  co->next = s->dead;
+  s->dead = co;
+
+  struct coroutine *next = next_runnable(s);
+  if (next == NULL) {
+    /*Everything left waits for something that won't happen. The script
+     *is told about it.*/
+    s->main.deadlock = true;
+    next = &s->main;
+  }
+  switch_to(ctx, next);
+  abort();
+}
+
+static void entry(void)
+{
+  skeem_ctx_t *ctx = entering;
+  struct coroutine *co = ctx->sched->current;
+
+  reap(ctx->sched);
+  if (setjmp(ctx->err) == 0) {
+    co->value = apply_values(ctx, co->thunk, NULL);
+  } else {
+    /*A read from a port that failed part way leaves its tokens here*/
+    clear_tokens(ctx);
+    ctx->paren_depth = 0;
+    ctx->nquotes = 0;
+    co->failed = true;
+  }
+  finish(ctx, co);
+}
+
+/*Suspend the current coroutine until FD is ready for EVENTS*/
+void coroutine_wait_fd(skeem_ctx_t *ctx, const char *function, int fd,
+                       uint32_t events)
+{
+  struct sched *s = sched_get(ctx);
+  struct coroutine *co = s->current;
+  struct epoll_event event = {.events = events | EPOLLONESHOT,
+                              .data.ptr = co};
+
+  if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &event) < 0)
+    error("%s: Can't wait for descriptor %d - %s\n", function, fd,
+          strerror(errno));
+
+  co->fd = fd;
+  s->io_waiting++;
+  /*It is runnable again once FD is ready, whatever else happens*/
+  uint64_t start = trace_begin();
+  suspend(ctx);
+  trace_end(TRACE_IO_WAIT, start);
+}
+
+void mark_coroutine(skeem_ctx_t *ctx, struct coroutine *co)
+{
+  if (co->thunk != NULL) mark(ctx, co->thunk);
+  if (co->value != NULL) mark(ctx, co->value);
+  if (co->done) return;
+
+  /*The environments of the call that spawned it, and its own*/
+  for (object_t *env = co->base->env->prev; env != NULL; env = env->env->prev)
+    mark(ctx, env);
+  mark_env_chain(ctx, co->base);
+
+  if (co != ctx->sched->current)
+    for (size_t i = 0; i < co->num_pinned; i++)
+      if (co->pinned[i] != NULL) mark(ctx, co->pinned[i]);
+}
+
+/*Mark the state of every coroutine that hasn't finished*/
+void mark_coroutines(skeem_ctx_t *ctx)
+{
+  if (ctx->sched == NULL) return;
+
+  for (struct coroutine *co = ctx->sched->live; co != NULL; co = co->live_next)
+    mark_coroutine(ctx, co);
+}
+
+void mark_channel(skeem_ctx_t *ctx, struct channel *chan)
+{
+  mark_list(ctx, chan->head);
+}
+
+/*Drop the coroutines of CTX, which is being freed. Those that haven't
+ *finished never will.*/
+void coroutines_free(skeem_ctx_t *ctx)
+{
+  struct sched *s = ctx->sched;
+
+  if (s == NULL) return;
+  reap(s);
+  while (s->live != NULL) {
+    struct coroutine *co = s->live;
+
+    live_remove(s, co);
+    if (co == &s->main) continue;
+    /*The pinned objects of the current coroutine are freed with the heap*/
+    if (co != s->current) free(co->pinned);
+    munmap(co->stack, STACK_SIZE);
+    coroutine_unref(co);
+  }
+  if (s->current != &s->main) free(s->main.pinned);
+
+  for (size_t i = 0; i < s->num_stacks; i++) munmap(s->stacks[i], STACK_SIZE);
+  close(s->epfd);
+  free(s);
+  ctx->sched = NULL;
+}
+
+static struct coroutine *coroutine_arg(skeem_ctx_t *ctx, const char *function,
+                                       object_t *obj)
+{
+  if (obj->type != COROUTINE)
+    error("%s: Wrong argument type - %s (Expected coroutine)\n", function,
+          types[obj->type]);
+  if (obj->heap != ctx->heap_id)
+    error("%s: The coroutine belongs to another thread\n", function);
+  return obj->coroutine;
+}
+
+static struct channel *channel_arg(skeem_ctx_t *ctx, const char *function,
+                                   object_t *obj)
+{
+  if (obj->type != CHANNEL)
+    error("%s: Wrong argument type - %s (Expected channel)\n", function,
+          types[obj->type]);
+  if (obj->heap != ctx->heap_id)
+    error("%s: The channel belongs to another thread\n", function);
+  return obj->channel;
+}
+
+/*(spawn thunk) starts a coroutine that evaluates (thunk). It first runs when
+ *the current one yields or waits.*/
+object_t *spawn(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *thunk = eval(ctx, args->car);
+  procedure_arg(ctx, "spawn", thunk);
+
+  if (ctx->parent != NULL)
+    error("spawn: Coroutines can't be started by a future\n");
+
+  struct sched *s = sched_get(ctx);
+  struct coroutine *co = ERR_MALLOC(sizeof(struct coroutine));
+  co->stack = stack_alloc(s);
+  if (co->stack == NULL) {
+    free(co);
+    error("spawn: Can't allocate a stack - %s\n", strerror(errno));
+  }
+
+  pin(ctx, thunk);
+  object_t *base = obj_init(ctx, ENVIRONMENT);
+  pin(ctx, base);
+  object_t *obj = obj_init(ctx, COROUTINE);
+  obj->coroutine = co;
+  unpin_head(ctx);
+  unpin_head(ctx);
+
+  /*Like a future, it sees the bindings of the call that spawned it*/
+  base->env->prev = ctx->env_head;
+  co->base = base;
+  co->env_head = base;
+  co->env_base = base;
+  co->thunk = thunk;
+  co->refs = 2;
+  co->fd = -1;
+
+  getcontext(&co->uc);
+  co->uc.uc_stack.ss_sp = co->stack;
+  co->uc.uc_stack.ss_size = STACK_SIZE;
+  co->limit = co->stack + STACK_MARGIN;
+  co->uc.uc_link = NULL;
+  makecontext(&co->uc, entry, 0);
+
+  co->live_next = s->live;
+  s->live->live_prev = co;
+  s->live = co;
+  make_runnable(s, co);
+  return obj;
+}
+
+/*(yield) lets the other runnable coroutines run*/
+object_t *yield(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(0);
+  struct sched *s = ctx->sched;
+
+  if (s == NULL) return CONST_TRUE;
+  if (s->io_waiting > 0) poll_io(s, 0);
+  make_runnable(s, s->current);
+  switch_to(ctx, next_runnable(s));
+  return CONST_TRUE;
+}
+
+/*(join coroutine) waits for COROUTINE to finish and returns its value*/
+object_t *join(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *obj = eval(ctx, args->car);
+  struct coroutine *co = coroutine_arg(ctx, "join", obj);
+
+  pin(ctx, obj);
+  while (!co->done) {
+    struct sched *s = ctx->sched;
+
+    if (co == s->current) error("join: A coroutine can't wait for itself\n");
+    add_waiter(&co->joiners, s->current);
+    if (!suspend(ctx)) {
+      remove_waiter(&co->joiners, s->current);
+      error("join: Deadlock - every coroutine is waiting\n");
+    }
+  }
+  unpin_head(ctx);
+
+  if (co->failed) error("join: The coroutine raised an error\n");
+  return co->value;
+}
+
+object_t *make_channel(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(0);
+  if (ctx->parent != NULL)
+    error("make-channel: Channels can't be made by a future\n");
+
+  object_t *obj = obj_init(ctx, CHANNEL);
+  obj->channel = ERR_MALLOC(sizeof(struct channel));
+  return obj;
+}
+
+/*(channel-send channel val) queues VAL, waking a receiver*/
+object_t *channel_send(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  object_t *obj = eval(ctx, args->car);
+  struct channel *chan = channel_arg(ctx, "channel-send", obj);
+
+  pin(ctx, obj);
+  object_t *val = eval(ctx, args->cdr->car);
+  unpin_head(ctx);
+
+  cons_t *cell = cons_init(ctx);
+  cell->car = val;
+  if (chan->tail == NULL)
+    chan->head = cell;
+  else
+    chan->tail->cdr = cell;
+  chan->tail = cell;
+
+  if (chan->receivers != NULL) {
+    struct coroutine *receiver = chan->receivers;
+
+    chan->receivers = receiver->next;
+    make_runnable(ctx->sched, receiver);
+  }
+  return val;
+}
+
+/*(channel-receive channel) takes the oldest value off CHANNEL, waiting for
+ *one to be sent if it is empty*/
+object_t *channel_receive(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *obj = eval(ctx, args->car);
+  struct channel *chan = channel_arg(ctx, "channel-receive", obj);
+
+  pin(ctx, obj);
+  while (chan->head == NULL) {
+    struct sched *s = sched_get(ctx);
+
+    add_waiter(&chan->receivers, s->current);
+    if (!suspend(ctx)) {
+      remove_waiter(&chan->receivers, s->current);
+      error("channel-receive: Deadlock - every coroutine is waiting\n");
+    }
+  }
+  unpin_head(ctx);
+
+  object_t *val = chan->head->car;
+  chan->head = chan->head->cdr;
+  if (chan->head == NULL) chan->tail = NULL;
+  return val;
+}
+
+void coroutine_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "spawn", spawn);
+  add_primitive(ctx, "yield", yield);
+  add_primitive(ctx, "join", join);
+  add_primitive(ctx, "make-channel", make_channel);
+  add_primitive(ctx, "channel-send", channel_send);
+  add_primitive(ctx, "channel-receive", channel_receive);
+}
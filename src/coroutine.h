@@ -0,0 +1,38 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+#include "types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+extern void coroutine_wait_fd(skeem_ctx_t *ctx, const char *function, int fd,
+                              uint32_t events);
+extern void coroutine_unref(struct coroutine *co);
+extern void mark_coroutine(skeem_ctx_t *ctx, struct coroutine *co);
+extern void mark_coroutines(skeem_ctx_t *ctx);
+extern void mark_channel(skeem_ctx_t *ctx, struct channel *chan);
+extern void coroutines_free(skeem_ctx_t *ctx);
+extern void coroutine_init(skeem_ctx_t *ctx);
+
+#endif
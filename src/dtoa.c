@@ -0,0 +1,324 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Number formatting for the printer. Doubles are written with the fewest
+ *digits that read back as the same value, using Grisu2 (Florian Loitsch,
+ *"Printing Floating-Point Numbers Quickly and Accurately with Integers",
+ *PLDI 2010), which finds the shortest form for nearly every double and a
+ *correct, slightly longer one otherwise.*/
+
+#include "dtoa.h"
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+static const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536"
+  "37383940414243444546474849505152535455565758596061626364656667686970717273"
+  "7475767778798081828384858687888990919293949596979899";
+
+/*Write N in decimal to BUF, two digits at a time. Returns the length.*/
+static size_t format_uint(uint64_t n, char *buf)
+{
+  char tmp[20];
+  char *p = tmp + sizeof(tmp);
+
+  while (n >= 100) {
+    unsigned i = (n % 100) * 2;
+    n /= 100;
+    *--p = digit_pairs[i + 1];
+    *--p = digit_pairs[i];
+  }
+  if (n >= 10) {
+    *--p = digit_pairs[n * 2 + 1];
+    *--p = digit_pairs[n * 2];
+  } else {
+    *--p = '0' + n;
+  }
+
+  size_t len = tmp + sizeof(tmp) - p;
+  memcpy(buf, p, len);
+  return len;
+}
+
+size_t format_int(int64_t n, char *buf)
+{
+  if (n >= 0) return format_uint(n, buf);
+  buf[0] = '-';
+  return 1 + format_uint(-(uint64_t)n, buf + 1);
+}
+
+/*A floating point number F * 2^E with a 64 bit significand*/
+typedef struct {
+  uint64_t f;
+  int e;
+} diy_fp;
+
+#define SIGNIFICAND_BITS 52
+#define HIDDEN_BIT (1ULL << SIGNIFICAND_BITS)
+#define EXPONENT_BIAS (0x3FF + SIGNIFICAND_BITS)
+
+static diy_fp from_double(double d)
+{
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+
+  int biased = (bits >> SIGNIFICAND_BITS) & 0x7FF;
+  uint64_t significand = bits & (HIDDEN_BIT - 1);
+
+  if (biased != 0)
+    return (diy_fp){significand + HIDDEN_BIT, biased - EXPONENT_BIAS};
+  return (diy_fp){significand, 1 - EXPONENT_BIAS};
+}
+
+static diy_fp multiply(diy_fp x, diy_fp y)
+{
+  unsigned __int128 p = (unsigned __int128)x.f * y.f;
+  uint64_t h = p >> 64, l = (uint64_t)p;
+
+  /*Round the dropped half*/
+  if (l & (1ULL << 63)) h++;
+  return (diy_fp){h, x.e + y.e + 64};
+}
+
+static diy_fp normalize(diy_fp x)
+{
+  int s = __builtin_clzll(x.f);
+  return (diy_fp){x.f << s, x.e - s};
+}
+
+/*The neighbours halfway to the doubles either side of V, with the same
+ *exponent*/
+static void boundaries(diy_fp v, diy_fp *minus, diy_fp *plus)
+{
+  diy_fp p = normalize((diy_fp){(v.f << 1) + 1, v.e - 1});
+  /*The gap below a power of two is half the gap above it*/
+  diy_fp m = v.f == HIDDEN_BIT ? (diy_fp){(v.f << 2) - 1, v.e - 2}
+                               : (diy_fp){(v.f << 1) - 1, v.e - 1};
+
+  m.f <<= m.e - p.e;
+  m.e = p.e;
+  *minus = m;
+  *plus = p;
+}
+
+/*10^K for K = -348, -340, ..., 340, normalized and rounded*/
+static const struct {
+  uint64_t f;
+  int e;
+} cached_powers[] = {
+  {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193}, {0x8b16fb203055ac76ULL, -1166},
+  {0xcf42894a5dce35eaULL, -1140}, {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+  {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034}, {0xbe5691ef416bd60cULL, -1007},
+  {0x8dd01fad907ffc3cULL, -980}, {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+  {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874}, {0x823c12795db6ce57ULL, -847},
+  {0xc21094364dfb5637ULL, -821}, {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+  {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715}, {0xb23867fb2a35b28eULL, -688},
+  {0x84c8d4dfd2c63f3bULL, -661}, {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+  {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555}, {0xf3e2f893dec3f126ULL, -529},
+  {0xb5b5ada8aaff80b8ULL, -502}, {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+  {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396}, {0xa6dfbd9fb8e5b88fULL, -369},
+  {0xf8a95fcf88747d94ULL, -343}, {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+  {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236}, {0xe45c10c42a2b3b06ULL, -210},
+  {0xaa242499697392d3ULL, -183}, {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+  {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77}, {0x9c40000000000000ULL, -50},
+  {0xe8d4a51000000000ULL, -24}, {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+  {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83}, {0xd5d238a4abe98068ULL, 109},
+  {0x9f4f2726179a2245ULL, 136}, {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+  {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242}, {0x924d692ca61be758ULL, 269},
+  {0xda01ee641a708deaULL, 295}, {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+  {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402}, {0xc83553c5c8965d3dULL, 428},
+  {0x952ab45cfa97a0b3ULL, 455}, {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+  {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561}, {0x88fcf317f22241e2ULL, 588},
+  {0xcc20ce9bd35c78a5ULL, 614}, {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+  {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720}, {0xbb764c4ca7a44410ULL, 747},
+  {0x8bab8eefb6409c1aULL, 774}, {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+  {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880}, {0x80444b5e7aa7cf85ULL, 907},
+  {0xbf21e44003acdd2dULL, 933}, {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+  {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039}, {0xaf87023b9bf0ee6bULL, 1066}
+};
+
+/*A cached power of ten that brings a number with binary exponent E into the
+ *range [2^-60, 2^-32) when multiplied by it, and its decimal exponent K*/
+static diy_fp cached_power(int e, int *k)
+{
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = (int)dk;
+  if (dk - ik > 0.0) ik++;
+
+  unsigned index = (ik >> 3) + 1;
+  *k = -(-348 + (int)index * 8);
+  return (diy_fp){cached_powers[index].f, cached_powers[index].e};
+}
+
+static const uint64_t pow10[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+  10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+  100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+  100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+  100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/*Move the last digit towards W while it stays in the rounding interval*/
+static void round_weed(char *buf, int len, uint64_t delta, uint64_t rest,
+                       uint64_t ten_kappa, uint64_t wp_w)
+{
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buf[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+static int count_digits(uint32_t n)
+{
+  int d = 1;
+  while (d < 10 && n >= pow10[d]) d++;
+  return d;
+}
+
+/*Generate the digits of W, given the upper bound MP of its rounding interval
+ *and the width DELTA of the interval. The value is BUF * 10^K.*/
+static int digit_gen(diy_fp w, diy_fp mp, uint64_t delta, char *buf, int *k)
+{
+  diy_fp one = {1ULL << -mp.e, mp.e};
+  uint64_t wp_w = mp.f - w.f;
+  uint32_t p1 = mp.f >> -one.e;
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = count_digits(p1);
+  int len = 0;
+
+  while (kappa > 0) {
+    uint32_t d = p1 / pow10[kappa - 1];
+    p1 %= pow10[kappa - 1];
+
+    if (d != 0 || len != 0) buf[len++] = '0' + d;
+    kappa--;
+
+    uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+    if (rest <= delta) {
+      *k += kappa;
+      round_weed(buf, len, delta, rest, pow10[kappa] << -one.e, wp_w);
+      return len;
+    }
+  }
+
+  while (true) {
+    p2 *= 10;
+    delta *= 10;
+
+    char d = p2 >> -one.e;
+    if (d != 0 || len != 0) buf[len++] = '0' + d;
+    p2 &= one.f - 1;
+    kappa--;
+
+    if (p2 < delta) {
+      *k += kappa;
+      int index = -kappa;
+      round_weed(buf, len, delta, p2, one.f,
+                 wp_w * (index < 20 ? pow10[index] : 0));
+      return len;
+    }
+  }
+}
+
+/*The shortest digits of positive, finite D, with D = BUF * 10^K*/
+static int grisu2(double d, char *buf, int *k)
+{
+  diy_fp v = from_double(d), minus, plus;
+
+  boundaries(v, &minus, &plus);
+  diy_fp c_mk = cached_power(plus.e, k);
+  diy_fp w = multiply(normalize(v), c_mk);
+  diy_fp wp = multiply(plus, c_mk), wm = multiply(minus, c_mk);
+
+  /*Stay strictly inside the interval, as its ends may not round back*/
+  wm.f++;
+  wp.f--;
+  return digit_gen(w, wp, wp.f - wm.f, buf, k);
+}
+
+/*Write the LEN digits in BUF, times 10^K, as a float the reader accepts:
+ *with a decimal point, in exponent form only if very large or small*/
+static size_t place_point(char *buf, int len, int k)
+{
+  int point = len + k;
+
+  if (k >= 0 && point <= 21) {
+    /*1234e7 -> 12340000000.0*/
+    memset(buf + len, '0', k);
+    memcpy(buf + point, ".0", 2);
+    return point + 2;
+  }
+  if (point > 0 && point <= 21) {
+    /*1234e-2 -> 12.34*/
+    memmove(buf + point + 1, buf + point, len - point);
+    buf[point] = '.';
+    return len + 1;
+  }
+  if (point > -6 && point <= 0) {
+    /*1234e-6 -> 0.001234*/
+    int zeros = 2 - point;
+    memmove(buf + zeros, buf, len);
+    buf[0] = '0';
+    buf[1] = '.';
+    memset(buf + 2, '0', -point);
+    return len + zeros;
+  }
+
+  /*1234e30 -> 1.234e33*/
+  size_t n = 1;
+  if (len > 1) {
+    memmove(buf + 2, buf + 1, len - 1);
+    buf[1] = '.';
+    n = len + 1;
+  }
+  buf[n++] = 'e';
+  return n + format_int(point - 1, buf + n);
+}
+
+size_t format_double(double d, char *buf)
+{
+  if (isnan(d)) {
+    memcpy(buf, "+nan.0", 6);
+    return 6;
+  }
+
+  size_t n = 0;
+  if (signbit(d)) {
+    buf[n++] = '-';
+    d = -d;
+  }
+  if (isinf(d)) {
+    if (n == 0) buf[n++] = '+';
+    memcpy(buf + n, "inf.0", 5);
+    return n + 5;
+  }
+  if (d == 0) {
+    memcpy(buf + n, "0.0", 3);
+    return n + 3;
+  }
+
+  int k;
+  int len = grisu2(d, buf + n, &k);
+  return n + place_point(buf + n, len, k);
+}
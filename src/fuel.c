@@ -0,0 +1,104 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE
+#include "fuel.h"
+#include "types.h"
+#include "context.h"
+#include "builtins.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+__thread char *stack_limit;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*Take the next run of steps out of the budget, so that the last run ends
+ *exactly when the budget does*/
+static void refuel(skeem_ctx_t *ctx)
+{
+  int64_t run = FUEL_INTERVAL;
+
+  if (ctx->max_steps != 0 && ctx->fuel < FUEL_INTERVAL) run = ctx->fuel;
+  if (ctx->max_steps != 0) ctx->fuel -= run;
+  ctx->tick = run;
+}
+
+static void find_stack_limit(void)
+{
+  pthread_attr_t attr;
+  void *addr;
+  size_t size;
+
+  if (pthread_getattr_np(pthread_self(), &attr) != 0) return;
+  if (pthread_attr_getstack(&attr, &addr, &size) == 0 && size > STACK_MARGIN)
+    stack_limit = (char *)addr + STACK_MARGIN;
+  pthread_attr_destroy(&attr);
+}
+
+/*Limit every evaluation in CTX to STEPS steps and MS milliseconds; zero
+ *leaves either unlimited*/
+void limits_set(skeem_ctx_t *ctx, uint64_t steps, uint32_t ms)
+{
+  ctx->max_steps = steps;
+  ctx->max_ms = ms;
+  fuel_start(ctx);
+}
+
+/*Begin an evaluation, with a fresh budget and deadline*/
+void fuel_start(skeem_ctx_t *ctx)
+{
+  ctx->fuel = ctx->max_steps;
+  ctx->deadline = ctx->max_ms != 0 ? now_ns() + ctx->max_ms * 1000000ull : 0;
+  refuel(ctx);
+}
+
+/*The slow path of fuel_step, once a run of steps is used up*/
+void fuel_check(skeem_ctx_t *ctx)
+{
+  if (stack_limit == NULL) find_stack_limit();
+
+  if (ctx->max_steps != 0 && ctx->fuel == 0) {
+    /*Every later step fails too, until the next evaluation starts*/
+    ctx->tick = 1;
+    error("Step limit of %llu exceeded\n",
+          (unsigned long long)ctx->max_steps);
+  }
+  if (ctx->deadline != 0 && now_ns() >= ctx->deadline) {
+    ctx->tick = 1;
+    error("Time limit of %u ms exceeded\n", ctx->max_ms);
+  }
+  refuel(ctx);
+}
+
+void stack_exhausted(skeem_ctx_t *ctx)
+{
+  error("Recursion too deep\n");
+}
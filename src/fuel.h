@@ -0,0 +1,59 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef FUEL_H
+#define FUEL_H
+#include "types.h"
+#include "context.h"
+#include <stdint.h>
+
+/*Steps taken between checks of the step budget and the deadline*/
+#define FUEL_INTERVAL 4096
+/*Stack kept free below the deepest call, for the primitives and the error
+ *path running on top of it*/
+#define STACK_MARGIN (64 * 1024)
+
+/*The lowest address the current thread or coroutine may recurse down to,
+ *or NULL until the first check works it out*/
+extern __thread char *stack_limit;
+
+extern void fuel_start(skeem_ctx_t *ctx);
+extern void fuel_check(skeem_ctx_t *ctx);
+extern void stack_exhausted(skeem_ctx_t *ctx);
+extern void limits_set(skeem_ctx_t *ctx, uint64_t steps, uint32_t ms);
+
+/*Count a step of evaluation. Called on procedure entry, loop iterations and
+ *allocation; all but one in FUEL_INTERVAL calls are a decrement.*/
+static inline void fuel_step(skeem_ctx_t *ctx)
+{
+  if (__builtin_expect(--ctx->tick <= 0, 0)) fuel_check(ctx);
+}
+
+/*Raise an error instead of overflowing the stack on deep recursion*/
+static inline void stack_check(skeem_ctx_t *ctx)
+{
+  char here;
+
+  if (__builtin_expect(&here < stack_limit, 0)) stack_exhausted(ctx);
+}
+
+#endif
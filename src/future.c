@@ -0,0 +1,632 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Futures and parallel-map. Tasks run on a process-wide pool of threads, each
+ *in a context of its own that is forked from the one that started it: the
+ *task allocates from its own heap and collects its own garbage, and reads
+ *the parent's bindings and data where they are. The parent doesn't collect
+ *while its tasks run, waits for them before it modifies anything they can
+ *read, and copies a task's result into its own heap once the task is
+ *done.*/
+
+#include "future.h"
+#include "types.h"
+#include "context.h"
+#include "mem.h"
+#include "builtins.h"
+#include "vector.h"
+#include "numvec.h"
+#include "hash.h"
+#include "port.h"
+#include "str.h"
+#include "macro.h"
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_WORKERS 64
+/*parallel-map splits its list into this many tasks per worker, so that
+ *workers that finish early can steal the rest*/
+#define TASKS_PER_WORKER 4
+
+enum task_state {
+  TASK_QUEUED,
+  TASK_RUNNING,
+  TASK_DONE
+};
+
+struct task {
+  _Atomic int state;
+  /*Held by the future or parallel-map, and by the queue*/
+  _Atomic int refs;
+  bool failed;
+  /*The task's own heap, freed once the result has been copied out*/
+  skeem_ctx_t *ctx;
+  object_t *(*run)(struct task *);
+  /*The thunk of a future, or the procedure and slice of a parallel-map*/
+  object_t *fn;
+  cons_t *items;
+  size_t count;
+  /*The result on the task's heap, and its copy on the parent's*/
+  object_t *result;
+  object_t *value;
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  /*Next unsettled future of the parent*/
+  struct task *next;
+};
+
+/*A worker's tasks. The owner pushes and pops at the bottom, thieves take
+ *the oldest task from the top.*/
+struct deque {
+  pthread_mutex_t lock;
+  struct task **tasks;
+  size_t top, bottom, cap;
+};
+
+static struct {
+  int nworkers;
+  /*One deque per worker, and one for threads outside the pool*/
+  struct deque queues[MAX_WORKERS + 1];
+  _Atomic long queued;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER,
+          .wake = PTHREAD_COND_INITIALIZER};
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static __thread int worker_id = -1;
+
+static void deque_push(struct deque *q, struct task *task)
+{
+  pthread_mutex_lock(&q->lock);
+  if (q->bottom - q->top == q->cap) {
+    size_t cap = q->cap == 0 ? 64 : q->cap * 2;
+    struct task **tasks = ERR_MALLOC(cap * sizeof(struct task *));
+
+    for (size_t i = q->top; i < q->bottom; i++)
+      tasks[i % cap] = q->tasks[i % q->cap];
+    free(q->tasks);
+    q->tasks = tasks;
+    q->cap = cap;
+  }
+  q->tasks[q->bottom++ % q->cap] = task;
+  pthread_mutex_unlock(&q->lock);
+}
+
+static struct task *deque_pop(struct deque *q)
+{
+  struct task *task = NULL;
+
+  pthread_mutex_lock(&q->lock);
+  if (q->bottom != q->top) task = q->tasks[--q->bottom % q->cap];
+  pthread_mutex_unlock(&q->lock);
+  return task;
+}
+
+static struct task *deque_steal(struct deque *q)
+{
+  struct task *task = NULL;
+
+  pthread_mutex_lock(&q->lock);
+  if (q->bottom != q->top) task = q->tasks[q->top++ % q->cap];
+  pthread_mutex_unlock(&q->lock);
+  return task;
+}
+
+static void task_unref(struct task *task)
+{
+  if (atomic_fetch_sub(&task->refs, 1) == 1) {
+    pthread_mutex_destroy(&task->lock);
+    pthread_cond_destroy(&task->done);
+    free(task);
+  }
+}
+
+static void run_task(struct task *task)
+{
+  if (setjmp(task->ctx->err) == 0)
+    task->result = task->run(task);
+  else
+    task->failed = true;
+
+  pthread_mutex_lock(&task->lock);
+  atomic_store(&task->state, TASK_DONE);
+  pthread_cond_broadcast(&task->done);
+  pthread_mutex_unlock(&task->lock);
+}
+
+/*Run TASK unless someone else has claimed it already*/
+static bool task_claim(struct task *task)
+{
+  int queued = TASK_QUEUED;
+
+  if (!atomic_compare_exchange_strong(&task->state, &queued, TASK_RUNNING))
+    return false;
+  run_task(task);
+  return true;
+}
+
+/*Wait for TASK to finish, running it here if no worker has started it*/
+static void task_wait(struct task *task)
+{
+  if (task_claim(task)) return;
+
+  pthread_mutex_lock(&task->lock);
+  while (atomic_load(&task->state) != TASK_DONE)
+    pthread_cond_wait(&task->done, &task->lock);
+  pthread_mutex_unlock(&task->lock);
+}
+
+static struct task *take_task(int self)
+{
+  struct task *task = self >= 0 ? deque_pop(&pool.queues[self]) : NULL;
+
+  for (int i = 0; task == NULL && i <= pool.nworkers; i++)
+    task = deque_steal(&pool.queues[(self + 1 + i) % (pool.nworkers + 1)]);
+
+  if (task != NULL) atomic_fetch_sub(&pool.queued, 1);
+  return task;
+}
+
+static void *worker(void *arg)
+{
+  worker_id = (intptr_t)arg;
+
+  while (true) {
+    struct task *task = take_task(worker_id);
+
+    if (task == NULL) {
+      pthread_mutex_lock(&pool.lock);
+      while (atomic_load(&pool.queued) == 0)
+        pthread_cond_wait(&pool.wake, &pool.lock);
+      pthread_mutex_unlock(&pool.lock);
+      continue;
+    }
+
+    /*Waiting threads run queued tasks themselves, leaving stale entries*/
+    task_claim(task);
+    task_unref(task);
+  }
+  return NULL;
+}
+
+/*Start one worker per processor, or SKEEM_THREADS of them*/
+static void pool_start()
+{
+  const char *env = getenv("SKEEM_THREADS");
+  long n = env != NULL ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (n < 0) n = 0;
+  if (n > MAX_WORKERS) n = MAX_WORKERS;
+  for (int i = 0; i <= MAX_WORKERS; i++)
+    pthread_mutex_init(&pool.queues[i].lock, NULL);
+
+  /*A worker that fails to start leaves its deque to the thieves*/
+  pool.nworkers = n;
+  for (int i = 0; i < n; i++) {
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, worker, (void *)(intptr_t)i) == 0)
+      pthread_detach(thread);
+  }
+}
+
+static void submit(struct task *task)
+{
+  atomic_fetch_add(&task->refs, 1);
+  deque_push(&pool.queues[worker_id >= 0 ? worker_id : pool.nworkers], task);
+  atomic_fetch_add(&pool.queued, 1);
+
+  pthread_mutex_lock(&pool.lock);
+  pthread_cond_signal(&pool.wake);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+static struct task *task_new(skeem_ctx_t *ctx, object_t *(*run)(struct task *),
+                             object_t *fn)
+{
+  struct task *task = ERR_MALLOC(sizeof(struct task));
+
+  pthread_once(&pool_once, pool_start);
+  atomic_init(&task->state, TASK_QUEUED);
+  atomic_init(&task->refs, 1);
+  task->ctx = ctx_fork(ctx);
+  task->run = run;
+  task->fn = fn;
+  pthread_mutex_init(&task->lock, NULL);
+  pthread_cond_init(&task->done, NULL);
+  return task;
+}
+
+static void import_tree(skeem_ctx_t *ctx, uint16_t from, struct bind_tree *to,
+                        struct bind_tree *tree);
+
+/*Copy OBJ from the heap FROM of a finished task to CTX. Objects of other
+ *heaps were shared with the task and are kept as they are.*/
+static object_t *import(skeem_ctx_t *ctx, uint16_t from, object_t *obj)
+{
+  if (obj == NULL || obj->heap != from) return obj;
+
+  object_t *copy;
+  switch (obj->type) {
+    case LIST: {
+      cons_t **tail;
+
+      copy = obj_init(ctx, LIST);
+      tail = &copy->cell;
+      for (cons_t *cell = obj->cell; cell != NULL; cell = cell->cdr) {
+        /*A tail of another heap is shared*/
+        if (cell->heap != from) {
+          *tail = cell;
+          break;
+        }
+        *tail = cons_init(ctx);
+        (*tail)->car = import(ctx, from, cell->car);
+        tail = &(*tail)->cdr;
+      }
+      return copy;
+    }
+    case STRING:
+    case SYMBOL:
+      copy = obj_init(ctx, obj->type);
+      copy->borrowed = obj->borrowed;
+      if (obj->borrowed)
+        copy->string = obj->string;
+      else if (obj->type == STRING)
+        copy->string = str_new(obj->string, str_len(obj));
+      else
+        copy->string = strdup(obj->string);
+      return copy;
+    case VECTOR:
+      copy = make_vector(ctx, obj->vector->len, NULL);
+      for (size_t i = 0; i < obj->vector->len; i++)
+        copy->vector->items[i] = import(ctx, from, obj->vector->items[i]);
+      return copy;
+    case F64VECTOR:
+    case S64VECTOR:
+      if (obj->borrowed) {
+        copy = obj_init(ctx, obj->type);
+        copy->numvector = ERR_MALLOC(sizeof(struct numvector));
+        *copy->numvector = *obj->numvector;
+        copy->borrowed = true;
+        return copy;
+      }
+      copy = make_numvector(ctx, obj->type, obj->numvector->len);
+      memcpy(copy->numvector->f64, obj->numvector->f64,
+             obj->numvector->len * sizeof(double));
+      return copy;
+    case HASH_TABLE: {
+      struct hash_table *table = obj->table;
+
+      copy = make_hash_table(ctx, table->mode, table->cap);
+      for (size_t i = 0; i < table->cap; i++)
+        if (table->entries[i].dist != 0)
+          hash_insert(copy->table, import(ctx, from, table->entries[i].key),
+                      import(ctx, from, table->entries[i].val));
+      return copy;
+    }
+    case PROCEDURE: {
+      procedure_t *proc = obj->procedure;
+      object_t params = {.type = LIST, .heap = from, .cell = proc->params};
+
+      copy = obj_init(ctx, PROCEDURE);
+      copy->procedure->name = strdup(proc->name);
+      copy->procedure->params = import(ctx, from, &params)->cell;
+      copy->procedure->nparams = proc->nparams;
+      copy->procedure->body = import(ctx, from, proc->body);
+      return copy;
+    }
+    case MACRO: {
+      object_t literals = {.type = LIST, .heap = from,
+                           .cell = obj->macro->literals};
+      object_t rules = {.type = LIST, .heap = from, .cell = obj->macro->rules};
+
+      copy = obj_init(ctx, MACRO);
+      copy->macro = ERR_MALLOC(sizeof(struct macro));
+      copy->macro->literals = import(ctx, from, &literals)->cell;
+      copy->macro->rules = import(ctx, from, &rules)->cell;
+      return copy;
+    }
+    case CLOSURE:
+      copy = obj_init(ctx, CLOSURE);
+      copy->closure->proc = import(ctx, from, obj->closure->proc);
+      copy->closure->env = import(ctx, from, obj->closure->env);
+      return copy;
+    case ENVIRONMENT:
+      copy = obj_init(ctx, ENVIRONMENT);
+      import_tree(ctx, from, copy->env->tree, obj->env->tree);
+      return copy;
+    case FUTURE:
+      /*Its task has been settled on the task's heap; the value moves on*/
+      copy = obj_init(ctx, FUTURE);
+      copy->task = obj->task;
+      atomic_fetch_add(&copy->task->refs, 1);
+      copy->task->value = import(ctx, from, copy->task->value);
+      return copy;
+    case PORT:
+      copy = obj_init(ctx, PORT);
+      copy->port = obj->port;
+      port_ref(copy->port);
+      return copy;
+    case INTEGER:
+      copy = obj_init(ctx, INTEGER);
+      copy->integer = obj->integer;
+      return copy;
+    case FLOAT:
+      copy = obj_init(ctx, FLOAT);
+      copy->flt = obj->flt;
+      return copy;
+    case CHAR:
+      copy = obj_init(ctx, CHAR);
+      copy->character = obj->character;
+      return copy;
+    case BOOLEAN:
+      return BOOL_TO_OBJ(obj->boolean);
+    default:
+      /*Primitives and foreign procedures are only made by ctx_new*/
+      return obj;
+  }
+}
+
+static void import_tree(skeem_ctx_t *ctx, uint16_t from, struct bind_tree *to,
+                        struct bind_tree *tree)
+{
+  if (tree != NULL && tree->symbol != NULL) {
+    tree_insert(ctx, to, import(ctx, from, tree->symbol),
+                import(ctx, from, tree->val));
+    import_tree(ctx, from, to, tree->left);
+    import_tree(ctx, from, to, tree->right);
+  }
+}
+
+/*Copy the result of the finished TASK to CTX, and free the task's heap*/
+static void settle(skeem_ctx_t *ctx, struct task *task)
+{
+  bool no_gc = ctx->no_gc;
+
+  /*The task's own futures may still be reading its heap*/
+  futures_join(task->ctx);
+
+  ctx->no_gc = true;
+  if (!task->failed)
+    task->value = import(ctx, task->ctx->heap_id, task->result);
+  ctx->no_gc = no_gc;
+
+  ctx_free(task->ctx);
+  task->ctx = NULL;
+}
+
+/*Wait for every future started from CTX and settle it. CTX does this before
+ *it modifies data its running tasks may be reading.*/
+void futures_join(skeem_ctx_t *ctx)
+{
+  while (ctx->futures != NULL) {
+    struct task *task = ctx->futures;
+
+    ctx->futures = task->next;
+    task_wait(task);
+    settle(ctx, task);
+  }
+}
+
+/*Settle the futures of CTX that are done. True if none is left running.*/
+bool futures_settle(skeem_ctx_t *ctx)
+{
+  struct task **cur = &ctx->futures;
+
+  while (*cur != NULL) {
+    struct task *task = *cur;
+
+    if (atomic_load(&task->state) == TASK_DONE) {
+      *cur = task->next;
+      settle(ctx, task);
+    } else {
+      cur = &task->next;
+    }
+  }
+  return ctx->futures == NULL;
+}
+
+/*Drop the futures of CTX, which is being freed. Queued ones never run.*/
+void futures_cancel(skeem_ctx_t *ctx)
+{
+  while (ctx->futures != NULL) {
+    struct task *task = ctx->futures;
+    int queued = TASK_QUEUED;
+
+    ctx->futures = task->next;
+    if (atomic_compare_exchange_strong(&task->state, &queued, TASK_DONE))
+      task->failed = true;
+    else
+      task_wait(task);
+
+    ctx_free(task->ctx);
+    task->ctx = NULL;
+  }
+}
+
+void future_free(struct task *task)
+{
+  task_unref(task);
+}
+
+void mark_future(skeem_ctx_t *ctx, struct task *task)
+{
+  if (task->value != NULL) mark(ctx, task->value);
+}
+
+static object_t *run_future(struct task *task)
+{
+  return apply_values(task->ctx, task->fn, NULL);
+}
+
+/*Apply the procedure to each item of the task's slice. The results are
+ *kept in a vector on the task's heap.*/
+static object_t *run_map(struct task *task)
+{
+  skeem_ctx_t *ctx = task->ctx;
+  object_t *out = make_vector(ctx, task->count, NULL);
+  cons_t *item = task->items;
+
+  pin(ctx, out);
+  for (size_t i = 0; i < task->count; i++, item = item->cdr) {
+    cons_t arg = {item->car, NULL};
+    out->vector->items[i] = apply_values(ctx, task->fn, &arg);
+  }
+  return out;
+}
+
+/*(future thunk) starts evaluating (thunk) on another thread*/
+object_t *future(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *thunk = eval(ctx, args->car);
+  procedure_arg(ctx, "future", thunk);
+
+  pin(ctx, thunk);
+  object_t *obj = obj_init(ctx, FUTURE);
+  unpin_head(ctx);
+
+  obj->task = task_new(ctx, run_future, thunk);
+  obj->task->next = ctx->futures;
+  ctx->futures = obj->task;
+  submit(obj->task);
+  return obj;
+}
+
+/*(touch future) waits for FUTURE and returns its value*/
+object_t *touch(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *obj = eval(ctx, args->car);
+
+  if (obj->type != FUTURE)
+    error("touch: Wrong argument type - %s (Expected future)\n",
+          types[obj->type]);
+
+  struct task *task = obj->task;
+  if (task->ctx != NULL) {
+    if (obj->heap != ctx->heap_id)
+      error("touch: The future was started by another future\n");
+
+    struct task **cur = &ctx->futures;
+    while (*cur != task) cur = &(*cur)->next;
+    *cur = task->next;
+
+    pin(ctx, obj);
+    task_wait(task);
+    settle(ctx, task);
+    unpin_head(ctx);
+  }
+
+  if (task->failed) error("touch: The future raised an error\n");
+  return task->value;
+}
+
+/*(parallel-map proc list) is (map proc list), with PROC applied to the
+ *elements on the thread pool*/
+object_t *parallel_map(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  object_t *fn = eval(ctx, args->car);
+  procedure_arg(ctx, "parallel-map", fn);
+  pin(ctx, fn);
+  object_t *list = eval(ctx, args->cdr->car);
+  pin(ctx, list);
+
+  if (!_LIST_P(list))
+    error("parallel-map: Wrong argument type - %s (Expected list)\n",
+          types[list->type]);
+
+  size_t n = length(list->cell);
+  if (n == 0) {
+    unpin_head(ctx);
+    unpin_head(ctx);
+    return EMPTY_LIST;
+  }
+
+  pthread_once(&pool_once, pool_start);
+  /*Without workers this thread runs the tasks as it waits for them, each
+   *as short as the cap on their number allows*/
+  size_t ntasks = pool.nworkers * TASKS_PER_WORKER;
+  if (ntasks == 0) ntasks = MAX_WORKERS * TASKS_PER_WORKER;
+  if (ntasks > n) ntasks = n;
+
+  struct task *tasks[ntasks];
+  cons_t *item = list->cell;
+  for (size_t i = 0; i < ntasks; i++) {
+    tasks[i] = task_new(ctx, run_map, fn);
+    tasks[i]->items = item;
+    tasks[i]->count = n / ntasks + (i < n % ntasks);
+    for (size_t j = 0; j < tasks[i]->count; j++) item = item->cdr;
+    submit(tasks[i]);
+  }
+
+  bool failed = false;
+  for (size_t i = 0; i < ntasks; i++) {
+    task_wait(tasks[i]);
+    failed |= tasks[i]->failed;
+  }
+
+  /*Copy the results out in order, then free the tasks*/
+  object_t *result = NULL;
+  cons_t **tail = NULL;
+  bool no_gc = ctx->no_gc;
+
+  ctx->no_gc = true;
+  if (!failed) {
+    result = obj_init(ctx, LIST);
+    tail = &result->cell;
+  }
+
+  for (size_t i = 0; i < ntasks; i++) {
+    struct task *task = tasks[i];
+
+    futures_join(task->ctx);
+    for (size_t j = 0; !failed && j < task->count; j++) {
+      *tail = cons_init(ctx);
+      (*tail)->car = import(ctx, task->ctx->heap_id,
+                            task->result->vector->items[j]);
+      tail = &(*tail)->cdr;
+    }
+    ctx_free(task->ctx);
+    task_unref(task);
+  }
+  ctx->no_gc = no_gc;
+
+  unpin_head(ctx);
+  unpin_head(ctx);
+  if (failed) error("parallel-map: The procedure raised an error\n");
+  return result;
+}
+
+void future_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "future", future);
+  add_primitive(ctx, "touch", touch);
+  add_primitive(ctx, "parallel-map", parallel_map);
+}
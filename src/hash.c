@@ -0,0 +1,559 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Native hash tables. Keys are compared with eq?, eqv? or equal?, and stored
+ *in a single array using Robin Hood probing: an entry that is further from
+ *its home bucket than the one occupying a slot takes the slot over, which
+ *keeps probe sequences short even at high load factors. Deletion shifts the
+ *following entries back instead of leaving tombstones.*/
+
+#include "hash.h"
+#include "types.h"
+#include "mem.h"
+#include "builtins.h"
+#include "future.h"
+#include "str.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_CAP 8
+/*Grow once the table is 7/8 full*/
+#define MAX_LOAD(cap) ((cap) - (cap) / 8)
+/*Only this many elements of a list or vector key contribute to its hash*/
+#define HASH_ELEMS 16
+
+static uint64_t mix(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+static uint64_t hash_bytes(const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static uint64_t hash_eqv(object_t *obj)
+{
+  switch (obj->type) {
+    case INTEGER:
+      return mix(obj->integer);
+    case FLOAT: {
+      uint64_t bits;
+      double flt = obj->flt == 0 ? 0 : obj->flt; /*0.0 and -0.0 are eqv*/
+      memcpy(&bits, &flt, sizeof(bits));
+      return mix(bits);
+    }
+    case CHAR:
+      return mix(obj->character);
+    case BOOLEAN:
+      return mix(obj->boolean);
+    case SYMBOL:
+      return hash_bytes(obj->string, strlen(obj->string));
+    case STRING:
+      return mix((uintptr_t)obj->string);
+    case LIST:
+      return mix((uintptr_t)obj->cell);
+    case VECTOR:
+      return mix((uintptr_t)obj->vector);
+    case F64VECTOR:
+    case S64VECTOR:
+      return mix((uintptr_t)obj->numvector);
+    case PRIMITIVE:
+      return mix((uintptr_t)obj->primitive);
+    default:
+      return mix((uintptr_t)obj);
+  }
+}
+
+static uint64_t hash_equal(object_t *obj)
+{
+  uint64_t hash = obj->type;
+
+  switch (obj->type) {
+    case STRING:
+      return hash_bytes(obj->string, str_len(obj));
+    case LIST: {
+      int n = 0;
+      for (cons_t *cur = obj->cell; cur != NULL && n < HASH_ELEMS;
+           cur = cur->cdr, n++)
+        hash = mix(hash ^ hash_equal(cur->car));
+      return hash;
+    }
+    case VECTOR:
+      for (size_t i = 0; i < obj->vector->len && i < HASH_ELEMS; i++)
+        hash = mix(hash ^ hash_equal(obj->vector->items[i]));
+      return hash;
+    case F64VECTOR:
+    case S64VECTOR:
+      return hash_bytes(obj->numvector->f64,
+                        obj->numvector->len * sizeof(double));
+    default:
+      return hash_eqv(obj);
+  }
+}
+
+static uint32_t hash(enum hash_mode mode, object_t *key)
+{
+  uint64_t h;
+
+  switch (mode) {
+    case HASH_EQ:
+      h = _SYMBOL_P(key) ? hash_eqv(key) : mix((uintptr_t)key);
+      break;
+    case HASH_EQV:
+      h = hash_eqv(key);
+      break;
+    default:
+      h = hash_equal(key);
+  }
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+static bool equiv(enum hash_mode mode, object_t *k1, object_t *k2)
+{
+  if (k1 == k2) return true;
+
+  switch (mode) {
+    case HASH_EQ:
+      return _eq(k1, k2);
+    case HASH_EQV:
+      return _eqv(k1, k2);
+    default:
+      return _equal(k1, k2);
+  }
+}
+
+object_t *make_hash_table(skeem_ctx_t *ctx, enum hash_mode mode, size_t cap)
+{
+  size_t c = MIN_CAP;
+  while (c < cap) c *= 2;
+
+  mem_reserve(ctx, sizeof(struct hash_table) + c * sizeof(struct hash_entry));
+  object_t *obj = obj_init(ctx, HASH_TABLE);
+  obj->table = ERR_MALLOC(sizeof(struct hash_table));
+  obj->table->mode = mode;
+  obj->table->cap = c;
+  obj->table->entries = ERR_MALLOC(c * sizeof(struct hash_entry));
+  return obj;
+}
+
+static size_t find_slot(struct hash_table *table, object_t *key)
+{
+  size_t mask = table->cap - 1;
+  uint32_t h = hash(table->mode, key);
+  size_t i = h & mask;
+
+  for (uint32_t dist = 1;; dist++, i = (i + 1) & mask) {
+    struct hash_entry *e = &table->entries[i];
+
+    /*A poorer entry would have been displaced by KEY, had it been present*/
+    if (e->dist < dist) return table->cap;
+    if (e->hash == h && equiv(table->mode, e->key, key)) return i;
+  }
+}
+
+struct hash_entry *hash_lookup(struct hash_table *table, object_t *key)
+{
+  size_t i = find_slot(table, key);
+  return i == table->cap ? NULL : &table->entries[i];
+}
+
+/*Place ENTRY, which must not be present, swapping it with richer entries*/
+static void robin_hood_insert(struct hash_table *table, struct hash_entry entry)
+{
+  size_t mask = table->cap - 1;
+  size_t i = entry.hash & mask;
+
+  entry.dist = 1;
+  for (;; i = (i + 1) & mask, entry.dist++) {
+    struct hash_entry *e = &table->entries[i];
+
+    if (e->dist == 0) {
+      *e = entry;
+      return;
+    }
+    if (e->dist < entry.dist) {
+      struct hash_entry tmp = *e;
+      *e = entry;
+      entry = tmp;
+    }
+  }
+}
+
+static void grow(struct hash_table *table)
+{
+  struct hash_entry *old = table->entries;
+  size_t old_cap = table->cap;
+
+  table->cap *= 2;
+  table->entries = ERR_MALLOC(table->cap * sizeof(struct hash_entry));
+
+  for (size_t i = 0; i < old_cap; i++)
+    if (old[i].dist != 0) robin_hood_insert(table, old[i]);
+  free(old);
+}
+
+void hash_insert(struct hash_table *table, object_t *key, object_t *val)
+{
+  struct hash_entry *e = hash_lookup(table, key);
+
+  if (e != NULL) {
+    e->val = val;
+    return;
+  }
+
+  if (table->count + 1 > MAX_LOAD(table->cap)) grow(table);
+
+  struct hash_entry entry = {key, val, hash(table->mode, key), 0};
+  robin_hood_insert(table, entry);
+  table->count++;
+}
+
+bool hash_delete(struct hash_table *table, object_t *key)
+{
+  size_t mask = table->cap - 1;
+  size_t i = find_slot(table, key);
+
+  if (i == table->cap) return false;
+
+  /*Shift the rest of the probe sequence back by one*/
+  size_t next = (i + 1) & mask;
+  while (table->entries[next].dist > 1) {
+    table->entries[i] = table->entries[next];
+    table->entries[i].dist--;
+    i = next;
+    next = (next + 1) & mask;
+  }
+  memset(&table->entries[i], 0, sizeof(struct hash_entry));
+  table->count--;
+  return true;
+}
+
+void hash_table_free(struct hash_table *table)
+{
+  free(table->entries);
+  free(table);
+}
+
+void mark_hash_table(skeem_ctx_t *ctx, struct hash_table *table)
+{
+  for (size_t i = 0; i < table->cap; i++) {
+    if (table->entries[i].dist != 0) {
+      mark(ctx, table->entries[i].key);
+      mark(ctx, table->entries[i].val);
+    }
+  }
+}
+
+static struct hash_table *table_arg(skeem_ctx_t *ctx, const char *function,
+                                    object_t *obj)
+{
+  if (!_HASH_TABLE_P(obj))
+    error("%s: Wrong argument type - %s (Expected hash-table)\n", function,
+          types[obj->type]);
+  return obj->table;
+}
+
+static void arity_between(skeem_ctx_t *ctx, const char *function, int min,
+                          int max, cons_t *args)
+{
+  int len = length(args);
+  if (len < min || len > max)
+    error("Wrong number of arguments to %s (Got %d, Wanted %d to %d)\n",
+          function, len, min, max);
+}
+
+/*(make-hash-table [equiv]), where EQUIV is one of eq?, eqv? or equal?*/
+object_t *make_hash_table_prim(skeem_ctx_t *ctx, cons_t *args)
+{
+  arity_between(ctx, "make-hash-table", 0, 1, args);
+  enum hash_mode mode = HASH_EQUAL;
+
+  if (args != NULL) {
+    object_t *equiv = eval(ctx, args->car);
+
+    if (equiv->type == PRIMITIVE && equiv->primitive == eq)
+      mode = HASH_EQ;
+    else if (equiv->type == PRIMITIVE && equiv->primitive == eqv)
+      mode = HASH_EQV;
+    else if (equiv->type != PRIMITIVE || equiv->primitive != equal)
+      error("make-hash-table: Expected one of eq?, eqv? or equal?\n");
+  }
+
+  return make_hash_table(ctx, mode, MIN_CAP);
+}
+
+object_t *hash_table_p(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  return BOOL_TO_OBJ(_HASH_TABLE_P(eval(ctx, args->car)));
+}
+
+/*Evaluate the table and key arguments, leaving both pinned*/
+static object_t *table_and_key(skeem_ctx_t *ctx, const char *function,
+                               cons_t *args, object_t **key)
+{
+  object_t *table = eval(ctx, args->car);
+  table_arg(ctx, function, table);
+  pin(ctx, table);
+  *key = eval(ctx, args->cdr->car);
+  pin(ctx, *key);
+  return table;
+}
+
+/*Refuse to modify TABLE from a future's task if the parent owns it, and wait
+ *for the futures of CTX, which may be reading it, before it is modified*/
+static void table_modify(skeem_ctx_t *ctx, const char *function,
+                         object_t *table)
+{
+  if (foreign_p(ctx, table))
+    error("%s: The hash table belongs to the parent of this future\n",
+          function);
+  futures_join(ctx);
+}
+
+static void unpin_table_and_key(skeem_ctx_t *ctx)
+{
+  unpin_head(ctx);
+  unpin_head(ctx);
+}
+
+/*(hash-table-ref table key [thunk]) calls THUNK if KEY is missing*/
+object_t *hash_table_ref(skeem_ctx_t *ctx, cons_t *args)
+{
+  arity_between(ctx, "hash-table-ref", 2, 3, args);
+  object_t *key;
+  struct hash_table *table =
+      table_and_key(ctx, "hash-table-ref", args, &key)->table;
+  struct hash_entry *e = hash_lookup(table, key);
+  object_t *val;
+
+  if (e != NULL)
+    val = e->val;
+  else if (args->cdr->cdr != NULL)
+    val = apply_values(ctx, eval(ctx, args->cdr->cdr->car), NULL);
+  else
+    error("hash-table-ref: Key not found\n");
+
+  unpin_table_and_key(ctx);
+  return val;
+}
+
+object_t *hash_table_ref_default(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(3);
+  object_t *key;
+  struct hash_table *table =
+      table_and_key(ctx, "hash-table-ref/default", args, &key)->table;
+  struct hash_entry *e = hash_lookup(table, key);
+  object_t *val = e != NULL ? e->val : eval(ctx, args->cdr->cdr->car);
+
+  unpin_table_and_key(ctx);
+  return val;
+}
+
+object_t *hash_table_set(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(3);
+  object_t *key;
+  object_t *table = table_and_key(ctx, "hash-table-set!", args, &key);
+  table_modify(ctx, "hash-table-set!", table);
+  object_t *val = eval(ctx, args->cdr->cdr->car);
+
+  hash_insert(table->table, key, val);
+  unpin_table_and_key(ctx);
+  return val;
+}
+
+object_t *hash_table_delete(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  object_t *key;
+  object_t *table = table_and_key(ctx, "hash-table-delete!", args, &key);
+  table_modify(ctx, "hash-table-delete!", table);
+  bool found = hash_delete(table->table, key);
+
+  unpin_table_and_key(ctx);
+  return BOOL_TO_OBJ(found);
+}
+
+object_t *hash_table_contains(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  object_t *key;
+  struct hash_table *table =
+      table_and_key(ctx, "hash-table-contains?", args, &key)->table;
+  bool found = hash_lookup(table, key) != NULL;
+
+  unpin_table_and_key(ctx);
+  return BOOL_TO_OBJ(found);
+}
+
+/*(hash-table-update! table key proc [thunk]) stores (proc value), where
+ *VALUE is the current value for KEY, or the result of THUNK if missing*/
+object_t *hash_table_update(skeem_ctx_t *ctx, cons_t *args)
+{
+  arity_between(ctx, "hash-table-update!", 3, 4, args);
+  object_t *key;
+  object_t *table = table_and_key(ctx, "hash-table-update!", args, &key);
+  table_modify(ctx, "hash-table-update!", table);
+  object_t *proc = eval(ctx, args->cdr->cdr->car);
+  pin(ctx, proc);
+
+  struct hash_entry *e = hash_lookup(table->table, key);
+  object_t *val;
+
+  if (e != NULL)
+    val = e->val;
+  else if (args->cdr->cdr->cdr != NULL)
+    val = apply_values(ctx, eval(ctx, args->cdr->cdr->cdr->car), NULL);
+  else
+    error("hash-table-update!: Key not found\n");
+
+  pin(ctx, val);
+  cons_t arg = {val, NULL};
+  val = apply_values(ctx, proc, &arg);
+  unpin_head(ctx);
+
+  /*PROC may have modified the table, so look KEY up again*/
+  hash_insert(table->table, key, val);
+  unpin_head(ctx);
+  unpin_table_and_key(ctx);
+  return val;
+}
+
+object_t *hash_table_count(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  struct hash_table *table =
+      table_arg(ctx, "hash-table-count", eval(ctx, args->car));
+  size_t n = table->count;
+  object_t *count = obj_init(ctx, INTEGER);
+  count->integer = n;
+  return count;
+}
+
+/*(hash-table-walk table proc) calls (proc key value) for every entry*/
+object_t *hash_table_walk(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  object_t *obj = eval(ctx, args->car);
+  struct hash_table *table = table_arg(ctx, "hash-table-walk", obj);
+  pin(ctx, obj);
+  object_t *proc = eval(ctx, args->cdr->car);
+  pin(ctx, proc);
+
+  /*PROC may resize the table, so never hold on to an entry pointer*/
+  for (size_t i = 0; i < table->cap; i++) {
+    if (table->entries[i].dist == 0) continue;
+
+    cons_t val = {table->entries[i].val, NULL};
+    cons_t key = {table->entries[i].key, &val};
+    apply_values(ctx, proc, &key);
+  }
+
+  unpin_head(ctx);
+  unpin_head(ctx);
+  return CONST_TRUE;
+}
+
+/*Collect the keys, or (key value) lists if PAIRS, of TABLE into a list*/
+static object_t *table_to_list(skeem_ctx_t *ctx, struct hash_table *table,
+                               bool pairs)
+{
+  if (table->count == 0) return EMPTY_LIST;
+
+  object_t *list = obj_init(ctx, LIST);
+  pin(ctx, list);
+
+  cons_t **cur = &list->cell;
+  for (size_t i = 0; i < table->cap; i++) {
+    struct hash_entry *e = &table->entries[i];
+    if (e->dist == 0) continue;
+
+    object_t *elem = e->key;
+    if (pairs) {
+      elem = obj_init(ctx, LIST);
+      elem->cell = cons_init(ctx);
+      elem->cell->car = e->key;
+      elem->cell->cdr = cons_init(ctx);
+      elem->cell->cdr->car = e->val;
+    }
+    *cur = cons_init(ctx);
+    (*cur)->car = elem;
+    cur = &(*cur)->cdr;
+  }
+
+  unpin_head(ctx);
+  return list;
+}
+
+object_t *hash_table_keys(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *obj = eval(ctx, args->car);
+  pin(ctx, obj);
+  object_t *keys = table_to_list(ctx, table_arg(ctx, "hash-table-keys", obj),
+                                 false);
+  unpin_head(ctx);
+  return keys;
+}
+
+object_t *hash_table_to_alist(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *obj = eval(ctx, args->car);
+  pin(ctx, obj);
+  object_t *alist =
+      table_to_list(ctx, table_arg(ctx, "hash-table->alist", obj), true);
+  unpin_head(ctx);
+  return alist;
+}
+
+void hash_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "make-hash-table", make_hash_table_prim);
+  add_primitive(ctx, "hash-table?", hash_table_p);
+  add_primitive(ctx, "hash-table-ref", hash_table_ref);
+  add_primitive(ctx, "hash-table-ref/default", hash_table_ref_default);
+  add_primitive(ctx, "hash-table-set!", hash_table_set);
+  add_primitive(ctx, "hash-table-delete!", hash_table_delete);
+  add_primitive(ctx, "hash-table-contains?", hash_table_contains);
+  add_primitive(ctx, "hash-table-update!", hash_table_update);
+  add_primitive(ctx, "hash-table-count", hash_table_count);
+  add_primitive(ctx, "hash-table-walk", hash_table_walk);
+  add_primitive(ctx, "hash-table-keys", hash_table_keys);
+  add_primitive(ctx, "hash-table->alist", hash_table_to_alist);
+}
@@ -0,0 +1,63 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef HASH_H
+#define HASH_H
+#include "types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*Equivalence used to compare keys*/
+enum hash_mode {
+  HASH_EQ,
+  HASH_EQV,
+  HASH_EQUAL
+};
+
+struct hash_entry {
+  object_t *key;
+  object_t *val;
+  uint32_t hash;
+  /*Distance from the home bucket plus one. Zero marks an empty bucket.*/
+  uint32_t dist;
+};
+
+/*Open addressing with Robin Hood probing. CAP is always a power of two.*/
+struct hash_table {
+  enum hash_mode mode;
+  size_t count;
+  size_t cap;
+  struct hash_entry *entries;
+};
+
+extern object_t *make_hash_table(skeem_ctx_t *ctx, enum hash_mode mode,
+                                 size_t cap);
+extern struct hash_entry *hash_lookup(struct hash_table *table, object_t *key);
+extern void hash_insert(struct hash_table *table, object_t *key,
+                        object_t *val);
+extern bool hash_delete(struct hash_table *table, object_t *key);
+extern void hash_table_free(struct hash_table *table);
+extern void mark_hash_table(skeem_ctx_t *ctx, struct hash_table *table);
+extern void hash_init(skeem_ctx_t *ctx);
+
+#endif
@@ -0,0 +1,261 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Instrumentation for the build made with `make instrument`. Every call to
+ *a Scheme procedure counts towards the procedure's calls and its inclusive
+ *and exclusive time, measured from call to return, so a coroutine's time
+ *suspended counts too. Allocations and collections count towards the
+ *procedure running when they happen. Only a context's own thread counts,
+ *not those running its futures, as procedures are shared with them.*/
+
+#ifdef INSTRUMENT
+#include "instrument.h"
+#include "types.h"
+#include "context.h"
+#include "mem.h"
+#include "builtins.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/*The context whose counters are printed at exit*/
+static skeem_ctx_t *reported;
+
+static inline uint64_t instrument_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void instrument_call(skeem_ctx_t *ctx, struct frame *frame)
+{
+  if (ctx->parent != NULL) return;
+  frame->proc->stats.active++;
+  frame->callees = 0;
+  frame->start = instrument_clock();
+}
+
+void instrument_return(skeem_ctx_t *ctx, struct frame *frame)
+{
+  if (ctx->parent != NULL) return;
+
+  struct proc_stats *stats = &frame->proc->stats;
+  uint64_t elapsed = instrument_clock() - frame->start;
+
+  stats->calls++;
+  stats->exclusive += elapsed - frame->callees;
+  if (--stats->active == 0) stats->inclusive += elapsed;
+  if (frame->caller != NULL) frame->caller->callees += elapsed;
+}
+
+void instrument_alloc(skeem_ctx_t *ctx)
+{
+  if (ctx->parent == NULL && ctx->frames != NULL)
+    ctx->frames->proc->stats.allocations++;
+}
+
+void instrument_gc(skeem_ctx_t *ctx)
+{
+  if (ctx->parent == NULL && ctx->frames != NULL)
+    ctx->frames->proc->stats.collections++;
+}
+
+static void stats_add(struct proc_stats *to, const struct proc_stats *from)
+{
+  to->calls += from->calls;
+  to->inclusive += from->inclusive;
+  to->exclusive += from->exclusive;
+  to->allocations += from->allocations;
+  to->collections += from->collections;
+}
+
+/*Add STATS to the record for NAME in RECORDS, making one if needed*/
+static void record_add(struct proc_record **records, size_t *num,
+                       const char *name, const struct proc_stats *stats)
+{
+  for (size_t i = 0; i < *num; i++)
+    if (strcmp((*records)[i].name, name) == 0) {
+      stats_add(&(*records)[i].stats, stats);
+      return;
+    }
+
+  *records = realloc(*records, (*num + 1) * sizeof(struct proc_record));
+  if (*records == NULL) {
+    perror("realloc");
+    exit(EXIT_FAILURE);
+  }
+  (*records)[*num].name = strdup(name);
+  memset(&(*records)[*num].stats, 0, sizeof(struct proc_stats));
+  stats_add(&(*records)[*num].stats, stats);
+  (*num)++;
+}
+
+/*Keep the counters of PROC, which is about to be collected*/
+void instrument_retire(skeem_ctx_t *ctx, procedure_t *proc)
+{
+  if (proc->stats.calls != 0)
+    record_add(&ctx->retired, &ctx->num_retired, proc->name, &proc->stats);
+}
+
+static void records_free(struct proc_record *records, size_t num)
+{
+  for (size_t i = 0; i < num; i++) free(records[i].name);
+  free(records);
+}
+
+void instrument_free(skeem_ctx_t *ctx)
+{
+  records_free(ctx->retired, ctx->num_retired);
+}
+
+static int by_exclusive(const void *a, const void *b)
+{
+  const struct proc_record *x = a, *y = b;
+
+  if (x->stats.exclusive != y->stats.exclusive)
+    return x->stats.exclusive < y->stats.exclusive ? 1 : -1;
+  return strcmp(x->name, y->name);
+}
+
+/*The counters of the live and collected procedures of CTX, merged by name
+ *and ordered by exclusive time*/
+static struct proc_record *gather(skeem_ctx_t *ctx, size_t *num)
+{
+  struct proc_record *records = NULL;
+
+  *num = 0;
+  for (size_t i = 0; i < ctx->num_retired; i++)
+    record_add(&records, num, ctx->retired[i].name, &ctx->retired[i].stats);
+  for (struct obj_list *curr = ctx->heap; curr->val != NULL;
+       curr = curr->next) {
+    object_t *obj = curr->val;
+
+    if (obj->type == PROCEDURE && obj->procedure->stats.calls != 0)
+      record_add(&records, num, obj->procedure->name,
+                 &obj->procedure->stats);
+  }
+  qsort(records, *num, sizeof(struct proc_record), by_exclusive);
+  return records;
+}
+
+static void report_print(skeem_ctx_t *ctx, FILE *out)
+{
+  size_t num;
+  struct proc_record *records = gather(ctx, &num);
+
+  fprintf(out, "%-24s %12s %16s %16s %12s %6s\n", "procedure", "calls",
+          "inclusive", "exclusive", "allocations", "gcs");
+  for (size_t i = 0; i < num; i++) {
+    struct proc_stats *s = &records[i].stats;
+
+    fprintf(out, "%-24s %12llu %16llu %16llu %12llu %6llu\n", records[i].name,
+            (unsigned long long)s->calls, (unsigned long long)s->inclusive,
+            (unsigned long long)s->exclusive,
+            (unsigned long long)s->allocations,
+            (unsigned long long)s->collections);
+  }
+  records_free(records, num);
+}
+
+static object_t *make_int(skeem_ctx_t *ctx, uint64_t n)
+{
+  object_t *obj = obj_init(ctx, INTEGER);
+
+  obj->integer = n;
+  return obj;
+}
+
+/*(profile-report) lists the counters of each procedure called so far as
+ *(name calls inclusive exclusive allocations collections) lists, ordered
+ *by exclusive time. Times are in timestamp counter cycles.*/
+static object_t *profile_report(skeem_ctx_t *ctx, cons_t *args)
+{
+  size_t num;
+  struct proc_record *records;
+  cons_t *list = NULL;
+
+  assert_arity(0);
+  records = gather(ctx, &num);
+
+  bool old_no_gc = ctx->no_gc;
+  ctx->no_gc = true;
+  for (size_t i = num; i-- > 0;) {
+    struct proc_stats *s = &records[i].stats;
+    uint64_t values[] = {s->calls, s->inclusive, s->exclusive,
+                         s->allocations, s->collections};
+    object_t *entry = obj_init(ctx, LIST);
+    object_t *name = symbol_new(ctx, records[i].name);
+    cons_t **cur = &entry->cell, *cell = cons_init(ctx);
+
+    *cur = cons_init(ctx);
+    (*cur)->car = name;
+    cur = &(*cur)->cdr;
+    for (size_t j = 0; j < sizeof(values) / sizeof(*values); j++) {
+      *cur = cons_init(ctx);
+      (*cur)->car = make_int(ctx, values[j]);
+      cur = &(*cur)->cdr;
+    }
+    cell->car = entry;
+    cell->cdr = list;
+    list = cell;
+  }
+  object_t *report = EMPTY_LIST;
+  if (list != NULL) {
+    report = obj_init(ctx, LIST);
+    report->cell = list;
+  }
+  ctx->no_gc = old_no_gc;
+
+  records_free(records, num);
+  return report;
+}
+
+/*Print the counters of CTX to stderr at exit, or at instrument_stop()*/
+void instrument_start(skeem_ctx_t *ctx)
+{
+  reported = ctx;
+  atexit(instrument_stop);
+}
+
+void instrument_stop(void)
+{
+  if (reported == NULL) return;
+  report_print(reported, stderr);
+  reported = NULL;
+}
+
+void instrument_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "profile-report", profile_report);
+}
+#endif
@@ -0,0 +1,44 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+#ifdef INSTRUMENT
+#include "types.h"
+#include <stdio.h>
+
+/*The counters of every procedure with a name, merged*/
+struct proc_record {
+  char *name;
+  struct proc_stats stats;
+};
+
+extern void instrument_alloc(skeem_ctx_t *ctx);
+extern void instrument_gc(skeem_ctx_t *ctx);
+extern void instrument_retire(skeem_ctx_t *ctx, procedure_t *proc);
+extern void instrument_free(skeem_ctx_t *ctx);
+extern void instrument_start(skeem_ctx_t *ctx);
+extern void instrument_stop(void);
+extern void instrument_init(skeem_ctx_t *ctx);
+
+#endif
+#endif
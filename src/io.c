@@ -0,0 +1,336 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Descriptors: pipes, TCP and Unix domain sockets, and reads and writes that
+ *suspend the current coroutine instead of blocking the thread. Descriptors
+ *made here are nonblocking; others are made so with fd-nonblocking.*/
+
+#define _GNU_SOURCE
+#include "io.h"
+#include "types.h"
+#include "mem.h"
+#include "builtins.h"
+#include "coroutine.h"
+#include "str.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int fd_arg(skeem_ctx_t *ctx, const char *function, object_t *obj)
+{
+  if (!_INTEGER_P(obj) || obj->integer < 0 || obj->integer > INT32_MAX)
+    error("%s: Wrong argument - expected a descriptor\n", function);
+  return obj->integer;
+}
+
+static object_t *make_integer(skeem_ctx_t *ctx, int64_t n)
+{
+  object_t *obj = obj_init(ctx, INTEGER);
+  obj->integer = n;
+  return obj;
+}
+
+static void set_nonblocking(skeem_ctx_t *ctx, const char *function, int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    error("%s: %s\n", function, strerror(errno));
+}
+
+static int make_socket(skeem_ctx_t *ctx, const char *function, int domain)
+{
+  int fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (fd < 0) error("%s: %s\n", function, strerror(errno));
+  return fd;
+}
+
+static void inet_address(skeem_ctx_t *ctx, const char *function,
+                         cons_t *args, struct sockaddr_in *addr)
+{
+  object_t *host = eval(ctx, args->car);
+  if (!_STRING_P(host))
+    error("%s: Wrong argument type - %s (Expected string)\n", function,
+          types[host->type]);
+
+  object_t *port = eval(ctx, args->cdr->car);
+  if (!_INTEGER_P(port) || port->integer < 0 || port->integer > 65535)
+    error("%s: Wrong argument - expected a port number\n", function);
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons(port->integer);
+  if (inet_pton(AF_INET, host->string, &addr->sin_addr) != 1)
+    error("%s: Not an IPv4 address - %s\n", function, host->string);
+}
+
+static void unix_address(skeem_ctx_t *ctx, const char *function,
+                         cons_t *args, struct sockaddr_un *addr)
+{
+  object_t *path = eval(ctx, args->car);
+  if (!_STRING_P(path))
+    error("%s: Wrong argument type - %s (Expected string)\n", function,
+          types[path->type]);
+  if (strlen(path->string) >= sizeof(addr->sun_path))
+    error("%s: Path too long - %s\n", function, path->string);
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  strcpy(addr->sun_path, path->string);
+}
+
+static object_t *listen_on(skeem_ctx_t *ctx, const char *function, int domain,
+                           struct sockaddr *addr, socklen_t len)
+{
+  int fd = make_socket(ctx, function, domain);
+  int one = 1;
+
+  if (domain == AF_INET)
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(fd, addr, len) < 0 || listen(fd, SOMAXCONN) < 0) {
+    int err = errno;
+    close(fd);
+    error("%s: %s\n", function, strerror(err));
+  }
+  return make_integer(ctx, fd);
+}
+
+/*Connect a nonblocking socket, waiting for the handshake in the event loop*/
+static object_t *connect_to(skeem_ctx_t *ctx, const char *function, int domain,
+                            struct sockaddr *addr, socklen_t len)
+{
+  int fd = make_socket(ctx, function, domain);
+  int err = 0;
+
+  if (connect(fd, addr, len) < 0) {
+    err = errno;
+    if (err == EINPROGRESS || err == EAGAIN) {
+      socklen_t size = sizeof(err);
+
+      coroutine_wait_fd(ctx, function, fd, EPOLLOUT);
+      if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &size) < 0) err = errno;
+    }
+  }
+
+  if (err != 0) {
+    close(fd);
+    error("%s: %s\n", function, strerror(err));
+  }
+  return make_integer(ctx, fd);
+}
+
+/*(tcp-listen host port) listens on the IPv4 address HOST. Port 0 picks a
+ *free one, see socket-port.*/
+object_t *tcp_listen(skeem_ctx_t *ctx, cons_t *args)
+{
+  struct sockaddr_in addr;
+
+  assert_arity(2);
+  inet_address(ctx, "tcp-listen", args, &addr);
+  return listen_on(ctx, "tcp-listen", AF_INET, (struct sockaddr *)&addr,
+                   sizeof(addr));
+}
+
+/*(tcp-connect host port)*/
+object_t *tcp_connect(skeem_ctx_t *ctx, cons_t *args)
+{
+  struct sockaddr_in addr;
+
+  assert_arity(2);
+  inet_address(ctx, "tcp-connect", args, &addr);
+  return connect_to(ctx, "tcp-connect", AF_INET, (struct sockaddr *)&addr,
+                    sizeof(addr));
+}
+
+/*(unix-listen path)*/
+object_t *unix_listen(skeem_ctx_t *ctx, cons_t *args)
+{
+  struct sockaddr_un addr;
+
+  assert_arity(1);
+  unix_address(ctx, "unix-listen", args, &addr);
+  return listen_on(ctx, "unix-listen", AF_UNIX, (struct sockaddr *)&addr,
+                   sizeof(addr));
+}
+
+/*(unix-connect path)*/
+object_t *unix_connect(skeem_ctx_t *ctx, cons_t *args)
+{
+  struct sockaddr_un addr;
+
+  assert_arity(1);
+  unix_address(ctx, "unix-connect", args, &addr);
+  return connect_to(ctx, "unix-connect", AF_UNIX, (struct sockaddr *)&addr,
+                    sizeof(addr));
+}
+
+/*(socket-port fd) is the local port of a TCP socket*/
+object_t *socket_port(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  int fd = fd_arg(ctx, "socket-port", eval(ctx, args->car));
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+
+  if (getsockname(fd, (struct sockaddr *)&addr, &len) < 0)
+    error("socket-port: %s\n", strerror(errno));
+  if (addr.sin_family != AF_INET)
+    error("socket-port: Not a TCP socket - %d\n", fd);
+  return make_integer(ctx, ntohs(addr.sin_port));
+}
+
+/*(accept fd) waits for a connection on the listening socket FD*/
+object_t *accept_prim(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  int fd = fd_arg(ctx, "accept", eval(ctx, args->car));
+  int conn;
+
+  while ((conn = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      coroutine_wait_fd(ctx, "accept", fd, EPOLLIN);
+    else if (errno != EINTR && errno != ECONNABORTED)
+      error("accept: %s\n", strerror(errno));
+  }
+  return make_integer(ctx, conn);
+}
+
+/*(make-pipe) is a list of the read and write ends of a new pipe*/
+object_t *make_pipe(skeem_ctx_t *ctx, cons_t *args)
+{
+  int fds[2];
+
+  assert_arity(0);
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    error("make-pipe: %s\n", strerror(errno));
+
+  object_t *list = obj_init(ctx, LIST);
+  pin(ctx, list);
+  list->cell = cons_init(ctx);
+  list->cell->car = make_integer(ctx, fds[0]);
+  list->cell->cdr = cons_init(ctx);
+  list->cell->cdr->car = make_integer(ctx, fds[1]);
+  unpin_head(ctx);
+  return list;
+}
+
+/*(fd-read fd k) reads up to K bytes from FD, waiting until some are
+ *available. #f at the end of the stream.*/
+object_t *fd_read(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  int fd = fd_arg(ctx, "fd-read", eval(ctx, args->car));
+  object_t *k = eval(ctx, args->cdr->car);
+  if (!_INTEGER_P(k) || k->integer <= 0)
+    error("fd-read: Wrong argument - expected a positive integer\n");
+
+  char *buf = str_alloc(k->integer);
+  ssize_t n;
+
+  while ((n = read(fd, buf, k->integer)) < 0) {
+    int err = errno;
+
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+      coroutine_wait_fd(ctx, "fd-read", fd, EPOLLIN);
+    } else if (err != EINTR) {
+      str_free(buf);
+      error("fd-read: %s\n", strerror(err));
+    }
+  }
+
+  if (n == 0) {
+    str_free(buf);
+    return CONST_FALSE;
+  }
+  str_set_len(buf, n);
+  return make_string(ctx, buf);
+}
+
+/*(fd-write fd string) writes all of STRING to FD, waiting whenever FD is
+ *full, and returns the number of bytes written*/
+object_t *fd_write(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  int fd = fd_arg(ctx, "fd-write", eval(ctx, args->car));
+  object_t *str = eval(ctx, args->cdr->car);
+  if (!_STRING_P(str))
+    error("fd-write: Wrong argument type - %s (Expected string)\n",
+          types[str->type]);
+
+  pin(ctx, str);
+  size_t len = str_len(str), done = 0;
+  while (done < len) {
+    ssize_t n = write(fd, str->string + done, len - done);
+
+    if (n >= 0)
+      done += n;
+    else if (errno == EAGAIN || errno == EWOULDBLOCK)
+      coroutine_wait_fd(ctx, "fd-write", fd, EPOLLOUT);
+    else if (errno != EINTR)
+      error("fd-write: %s\n", strerror(errno));
+  }
+  unpin_head(ctx);
+  return make_integer(ctx, len);
+}
+
+object_t *fd_close(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  int fd = fd_arg(ctx, "fd-close", eval(ctx, args->car));
+
+  if (close(fd) < 0) error("fd-close: %s\n", strerror(errno));
+  return CONST_TRUE;
+}
+
+/*(fd-nonblocking fd) makes a descriptor opened elsewhere, such as 0 for
+ *standard input, suspend coroutines instead of blocking*/
+object_t *fd_nonblocking(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  int fd = fd_arg(ctx, "fd-nonblocking", eval(ctx, args->car));
+
+  set_nonblocking(ctx, "fd-nonblocking", fd);
+  return CONST_TRUE;
+}
+
+void io_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "tcp-listen", tcp_listen);
+  add_primitive(ctx, "tcp-connect", tcp_connect);
+  add_primitive(ctx, "unix-listen", unix_listen);
+  add_primitive(ctx, "unix-connect", unix_connect);
+  add_primitive(ctx, "socket-port", socket_port);
+  add_primitive(ctx, "accept", accept_prim);
+  add_primitive(ctx, "make-pipe", make_pipe);
+  add_primitive(ctx, "fd-read", fd_read);
+  add_primitive(ctx, "fd-write", fd_write);
+  add_primitive(ctx, "fd-close", fd_close);
+  add_primitive(ctx, "fd-nonblocking", fd_nonblocking);
+}
@@ -0,0 +1,760 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*A template compiler for hot procedures. Once a procedure has been called
+ *JIT_THRESHOLD times its body is translated, form by form, to x86-64
+ *machine code. Compiled code keeps to the interpreter's conventions: its
+ *parameters are read from the environment they were bound in, calls bind
+ *a new environment, and every value is an object. What it saves is the
+ *dispatch, environment and lookups of the forms it inlines: if, quote,
+ *and + < > on integers. An integer operand is checked for and unboxed,
+ *and anything else is handed to the interpreter, which takes the form up
+ *where the code left it. Other forms are evaluated by calling into the
+ *interpreter.*/
+
+#define _GNU_SOURCE
+#include "jit.h"
+#include "types.h"
+#include "context.h"
+#include "builtins.h"
+#include "mem.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+unsigned int jit_threshold = JIT_THRESHOLD;
+
+/*The primitives compiled code inlines, and their names once interned*/
+static struct {
+  const char *name;
+  primitive_t fn;
+  const char *interned;
+} inlined[] = {
+  {"+", add_list}, {"<", lesser}, {">", greater}, {"if", if_else},
+  {"quote", quote},
+};
+static pthread_once_t inlined_once = PTHREAD_ONCE_INIT;
+
+static void intern_inlined(void)
+{
+  for (size_t i = 0; i < sizeof(inlined) / sizeof(inlined[0]); i++)
+    inlined[i].interned = symbol_intern(inlined[i].name);
+}
+
+/*Note in CTX that an inlined primitive has been rebound if SYMBOL names one
+ *and VAL isn't the primitive itself*/
+void jit_rebind(skeem_ctx_t *ctx, object_t *symbol, object_t *val)
+{
+  pthread_once(&inlined_once, intern_inlined);
+  for (size_t i = 0; i < sizeof(inlined) / sizeof(inlined[0]); i++)
+    if (symbol->string == inlined[i].interned &&
+        (val == NULL || val->type != PRIMITIVE ||
+         val->primitive != inlined[i].fn))
+      ctx->jit_rebound = true;
+}
+
+/*True if SYMBOL is bound to the primitive FN where CTX is now. Called from
+ *compiled code, before an inlined form, once something has been rebound.*/
+bool jit_inlined(skeem_ctx_t *ctx, object_t *symbol, primitive_t fn)
+{
+  object_t *val = env_lookup(ctx, symbol);
+
+  return val != NULL && val->type == PRIMITIVE && val->primitive == fn;
+}
+
+struct jit_code {
+  /*Called with the parameters' bindings, in the order of the parameters*/
+  jit_entry_t entry;
+  /*Bytes mapped for the code; zero for code linked into the program*/
+  size_t size;
+};
+
+/*Give PROC code compiled ahead of time, which stays for the life of the
+ *program*/
+void jit_attach(procedure_t *proc, jit_entry_t entry)
+{
+  if (proc->jit != NULL) return;
+
+  proc->jit = ERR_MALLOC(sizeof(struct jit_code));
+  proc->jit->entry = entry;
+  proc->jit->size = 0;
+}
+
+/*Run the compiled body of PROC, whose parameters have been bound in the
+ *current environment*/
+object_t *jit_run(skeem_ctx_t *ctx, procedure_t *proc)
+{
+  struct bind_tree *bindings[proc->nparams > 0 ? proc->nparams : 1];
+  int i = 0;
+
+  for (cons_t *param = proc->params; param != NULL; param = param->cdr)
+    bindings[i++] = tree_lookup(ctx->env_head->env->tree, param->car);
+  return proc->jit->entry(ctx, bindings);
+}
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+
+static FILE *perf_map;
+static pid_t perf_map_pid;
+static bool perf_map_on;
+
+/*Describe compiled code in /tmp/perf-PID.map, for perf to find*/
+void jit_perf_map(void)
+{
+  perf_map_on = true;
+}
+
+static void perf_map_add(struct jit_code *code, const char *name)
+{
+  /*A forked server child records its code in a map of its own*/
+  if (perf_map != NULL && perf_map_pid != getpid()) {
+    fclose(perf_map);
+    perf_map = NULL;
+  }
+  if (perf_map == NULL) {
+    char path[64];
+
+    perf_map_pid = getpid();
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)perf_map_pid);
+    if ((perf_map = fopen(path, "a")) == NULL) {
+      perror(path);
+      perf_map_on = false;
+      return;
+    }
+  }
+  fprintf(perf_map, "%lx %zx skeem:%s\n", (unsigned long)code->entry,
+          code->size, name);
+  fflush(perf_map);
+}
+
+/*Called from compiled code*/
+
+static object_t *jit_box(skeem_ctx_t *ctx, int64_t val)
+{
+  object_t *obj = obj_init(ctx, INTEGER);
+  obj->integer = val;
+  return obj;
+}
+
+/*Finish a + form as add_list would, given the sum of the arguments before
+ *VAL and the arguments after it, not yet evaluated*/
+static object_t *jit_add_slow(skeem_ctx_t *ctx, cons_t *rest, int64_t sum,
+                              object_t *val)
+{
+  pin(ctx, val);
+  object_t *result = jit_box(ctx, sum);
+  pin(ctx, result);
+
+  add(ctx, result, val, result);
+  for (; rest != NULL; rest = rest->cdr)
+    add(ctx, result, eval(ctx, rest->car), result);
+  unpin_head(ctx);
+  unpin_head(ctx);
+  return result;
+}
+
+/*Finish a comparison of the two ARGS as FN would, given VAL, the value of
+ *the first, or if SECOND, that of the second, the first being FIRST*/
+static object_t *jit_compare_slow(skeem_ctx_t *ctx, primitive_t fn,
+                                  cons_t *args, int64_t first, object_t *val,
+                                  bool second)
+{
+  object_t prim = {.type = PRIMITIVE, .primitive = fn};
+  object_t *x = val, *y = val;
+
+  pin(ctx, val);
+  if (second)
+    x = jit_box(ctx, first);
+  else
+    y = eval(ctx, args->cdr->car);
+  pin(ctx, second ? x : y);
+
+  cons_t last = {.car = y}, values = {.car = x, .cdr = &last};
+  object_t *result = apply_values(ctx, &prim, &values);
+  unpin_head(ctx);
+  unpin_head(ctx);
+  return result;
+}
+
+/*The procedure called by EXP, pinned, if compiled code can make the call:
+ *one that takes NARGS arguments, evaluated. Otherwise NULL, and the call
+ *is left to the interpreter.*/
+static object_t *jit_callee(skeem_ctx_t *ctx, object_t *exp, int nargs)
+{
+  object_t *function = eval(ctx, exp->cell->car);
+
+  if (!_PROCEDURE_P(function) || function->procedure->nparams != nargs ||
+      function->procedure->body == EMPTY_LIST)
+    return NULL;
+  pin(ctx, function);
+  return function;
+}
+
+enum reg {RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9};
+/*Condition codes, as in the low nibble of Jcc*/
+enum cond {CC_E = 0x4, CC_NE = 0x5, CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe,
+           CC_G = 0xf, CC_ALWAYS = -1};
+
+/*The fields compiled code reads have one byte displacements*/
+_Static_assert(offsetof(object_t, integer) < 128, "object layout");
+_Static_assert(offsetof(object_t, boolean) < 128, "object layout");
+_Static_assert(offsetof(struct bind_tree, val) < 128, "binding layout");
+
+struct jit {
+  procedure_t *proc;
+  unsigned char *code;
+  size_t len, cap;
+  /*Stack slots holding integers being worked on, and the most at once*/
+  int slots, max_slots;
+};
+
+static void emit(struct jit *j, const void *bytes, size_t len)
+{
+  if (j->len + len > j->cap) {
+    j->cap = j->cap == 0 ? 1024 : j->cap * 2;
+    j->code = realloc(j->code, j->cap);
+
+    if (j->code == NULL) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(j->code + j->len, bytes, len);
+  j->len += len;
+}
+
+#define EMIT(j, ...)                                                  \
+  emit((j), (unsigned char[]){__VA_ARGS__},                           \
+       sizeof((unsigned char[]){__VA_ARGS__}))
+
+static void emit32(struct jit *j, uint32_t val)
+{
+  emit(j, &val, sizeof(val));
+}
+
+/*mov REG, VAL*/
+static void emit_mov_imm(struct jit *j, enum reg reg, uint64_t val)
+{
+  EMIT(j, 0x48 | (reg >= R8), 0xb8 + (reg & 7));
+  emit(j, &val, sizeof(val));
+}
+
+/*Call FN with CTX as its first argument, the others already in place*/
+#define emit_call(j, fn) emit_call_at((j), (uintptr_t)(fn))
+
+static void emit_call_at(struct jit *j, uintptr_t fn)
+{
+  EMIT(j, 0x48, 0x89, 0xdf);                    /*mov rdi, rbx*/
+  emit_mov_imm(j, RAX, fn);
+  EMIT(j, 0xff, 0xd0);                          /*call rax*/
+}
+
+/*Displacement from rbp of stack slot SLOT, below the saved registers*/
+static int32_t slot_disp(int slot)
+{
+  return -24 - 8 * slot;
+}
+
+static int slot_take(struct jit *j)
+{
+  if (j->slots == j->max_slots) j->max_slots++;
+  return j->slots++;
+}
+
+/*mov REG, [rbp + slot]*/
+static void emit_load_slot(struct jit *j, enum reg reg, int slot)
+{
+  EMIT(j, 0x48 | (reg >= R8) << 2, 0x8b, 0x85 | (reg & 7) << 3);
+  emit32(j, slot_disp(slot));
+}
+
+/*Jumps not yet placed are chained through their displacements, each
+ *holding the position of the one before, so a label is just the position
+ *of the last jump to it. Position 0 is in the prologue, so ends a chain.*/
+static size_t emit_jump(struct jit *j, enum cond cc, size_t chain)
+{
+  if (cc == CC_ALWAYS)
+    EMIT(j, 0xe9);
+  else
+    EMIT(j, 0x0f, 0x80 | cc);
+  emit32(j, chain);
+  return j->len - 4;
+}
+
+/*Point every jump in CHAIN here*/
+static void land(struct jit *j, size_t chain)
+{
+  while (chain != 0) {
+    uint32_t next;
+    int32_t rel = j->len - (chain + 4);
+
+    memcpy(&next, j->code + chain, 4);
+    memcpy(j->code + chain, &rel, 4);
+    chain = next;
+  }
+}
+
+/*Jump unless the object in rax is of TYPE*/
+static size_t emit_guard(struct jit *j, type_t type, size_t chain)
+{
+  /*cmp dword [rax + type], TYPE*/
+  EMIT(j, 0x83, 0x78, offsetof(object_t, type), type);
+  return emit_jump(j, CC_NE, chain);
+}
+
+/*Jump if the object in rax is of TYPE*/
+static size_t emit_guard_is(struct jit *j, type_t type, size_t chain)
+{
+  EMIT(j, 0x83, 0x78, offsetof(object_t, type), type);
+  return emit_jump(j, CC_E, chain);
+}
+
+/*Jump unless the head of EXP is still bound to FN, the primitive of the
+ *form inlined after this. That is only looked up once one of the inlined
+ *primitives has been rebound in the context.*/
+static size_t emit_binding_check(struct jit *j, object_t *exp, primitive_t fn,
+                                 size_t chain)
+{
+  EMIT(j, 0x80, 0xbb);                          /*cmp byte [rbx + rebound], 0*/
+  emit32(j, offsetof(skeem_ctx_t, jit_rebound));
+  EMIT(j, 0x00);
+  size_t bound = emit_jump(j, CC_E, 0);
+
+  emit_mov_imm(j, RSI, (uintptr_t)exp->cell->car);
+  emit_mov_imm(j, RDX, (uintptr_t)fn);
+  emit_call(j, jit_inlined);
+  EMIT(j, 0x84, 0xc0);                          /*test al, al*/
+  chain = emit_jump(j, CC_E, chain);
+  land(j, bound);
+  return chain;
+}
+
+/*Evaluate EXP the way the interpreter does, into rax*/
+static void emit_eval(struct jit *j, object_t *exp, bool push)
+{
+  emit_mov_imm(j, RSI, (uintptr_t)exp);
+  emit_call(j, push ? eval : eval_nopush);
+}
+
+/*Jump if the object in rax is false*/
+static size_t emit_branch_false(struct jit *j, size_t chain)
+{
+  size_t truthy = emit_guard(j, BOOLEAN, 0);
+
+  /*cmp byte [rax + boolean], 0*/
+  EMIT(j, 0x80, 0x78, offsetof(object_t, boolean), 0x00);
+  chain = emit_jump(j, CC_E, chain);
+  land(j, truthy);
+  return chain;
+}
+
+static bool symbol_named(object_t *obj, const char *name)
+{
+  return _SYMBOL_P(obj) && strcmp(obj->string, name) == 0;
+}
+
+static bool small_integer(object_t *obj)
+{
+  return _INTEGER_P(obj) && obj->integer >= INT32_MIN &&
+         obj->integer <= INT32_MAX;
+}
+
+/*Which inlined form EXP is, if any, given that it has NARGS arguments*/
+enum form {FORM_CALL, FORM_IF, FORM_QUOTE, FORM_ADD, FORM_LESS, FORM_MORE};
+
+static enum form form_of(object_t *exp, int nargs)
+{
+  object_t *head = exp->cell->car;
+
+  if (symbol_named(head, "if") && nargs == 3) return FORM_IF;
+  if (symbol_named(head, "quote") && nargs == 1) return FORM_QUOTE;
+  if (symbol_named(head, "+") && nargs > 0) return FORM_ADD;
+  if (symbol_named(head, "<") && nargs == 2) return FORM_LESS;
+  if (symbol_named(head, ">") && nargs == 2) return FORM_MORE;
+  return FORM_CALL;
+}
+
+/*The primitive an inlined FORM stands for*/
+static primitive_t form_fn(enum form form)
+{
+  switch (form) {
+    case FORM_IF: return if_else;
+    case FORM_QUOTE: return quote;
+    case FORM_ADD: return add_list;
+    case FORM_LESS: return lesser;
+    default: return greater;
+  }
+}
+
+static void compile_value(struct jit *j, object_t *exp, bool push);
+
+/*Parameter PARAM, whose binding is in slot PARAM of the entry's second
+ *argument. The interpreter looks a symbol value up again, so that is left
+ *to it.*/
+static void compile_param(struct jit *j, object_t *sym, int param)
+{
+  EMIT(j, 0x49, 0x8b, 0x84, 0x24);              /*mov rax, [r12 + disp]*/
+  emit32(j, 8 * param);
+  /*mov rax, [rax + val]*/
+  EMIT(j, 0x48, 0x8b, 0x40, offsetof(struct bind_tree, val));
+  size_t plain = emit_guard(j, SYMBOL, 0);
+  emit_eval(j, sym, true);
+  land(j, plain);
+}
+
+/*Add the integers in EXP's arguments in a stack slot. An argument that
+ *isn't one goes to jit_add_slow with the sum so far and the arguments
+ *still to evaluate.*/
+static void compile_add(struct jit *j, object_t *exp)
+{
+  int slot = slot_take(j);
+  size_t done = 0;
+
+  EMIT(j, 0x48, 0xc7, 0x85);                    /*mov qword [rbp + slot], 0*/
+  emit32(j, slot_disp(slot));
+  emit32(j, 0);
+
+  for (cons_t *arg = exp->cell->cdr; arg != NULL; arg = arg->cdr) {
+    if (small_integer(arg->car)) {
+      EMIT(j, 0x48, 0x81, 0x85);                /*add qword [rbp + slot], imm*/
+      emit32(j, slot_disp(slot));
+      emit32(j, arg->car->integer);
+      continue;
+    }
+    compile_value(j, arg->car, true);
+    size_t integer = emit_guard_is(j, INTEGER, 0);
+    EMIT(j, 0x48, 0x89, 0xc1);                  /*mov rcx, rax*/
+    emit_mov_imm(j, RSI, (uintptr_t)arg->cdr);
+    emit_load_slot(j, RDX, slot);
+    emit_call(j, jit_add_slow);
+    done = emit_jump(j, CC_ALWAYS, done);
+
+    land(j, integer);
+    /*mov rax, [rax + integer]; add [rbp + slot], rax*/
+    EMIT(j, 0x48, 0x8b, 0x40, offsetof(object_t, integer));
+    EMIT(j, 0x48, 0x01, 0x85);
+    emit32(j, slot_disp(slot));
+  }
+
+  emit_load_slot(j, RSI, slot);
+  emit_call(j, jit_box);
+  land(j, done);
+  j->slots--;
+}
+
+/*Compare the two integer arguments of EXP, a < or > form, jumping to the
+ *returned chain if the comparison is false. Anything but integers goes to
+ *jit_compare_slow, whose result is tested instead.*/
+static size_t compile_compare(struct jit *j, object_t *exp, enum form form)
+{
+  cons_t *args = exp->cell->cdr;
+  primitive_t fn = form == FORM_LESS ? lesser : greater;
+  int slot = slot_take(j);
+  size_t boxed = 0;
+
+  if (small_integer(args->car)) {
+    EMIT(j, 0x48, 0xc7, 0x85);                  /*mov qword [rbp + slot], imm*/
+    emit32(j, slot_disp(slot));
+    emit32(j, args->car->integer);
+  } else {
+    compile_value(j, args->car, true);
+    size_t integer = emit_guard_is(j, INTEGER, 0);
+    EMIT(j, 0x49, 0x89, 0xc0);                  /*mov r8, rax*/
+    emit_mov_imm(j, RSI, (uintptr_t)fn);
+    emit_mov_imm(j, RDX, (uintptr_t)args);
+    emit_mov_imm(j, RCX, 0);
+    emit_mov_imm(j, R9, false);
+    emit_call(j, jit_compare_slow);
+    boxed = emit_jump(j, CC_ALWAYS, boxed);
+
+    land(j, integer);
+    /*mov rax, [rax + integer]; mov [rbp + slot], rax*/
+    EMIT(j, 0x48, 0x8b, 0x40, offsetof(object_t, integer));
+    EMIT(j, 0x48, 0x89, 0x85);
+    emit32(j, slot_disp(slot));
+  }
+
+  if (small_integer(args->cdr->car)) {
+    emit_load_slot(j, RDX, slot);
+    EMIT(j, 0x48, 0x81, 0xfa);                  /*cmp rdx, imm*/
+    emit32(j, args->cdr->car->integer);
+  } else {
+    compile_value(j, args->cdr->car, true);
+    size_t integer = emit_guard_is(j, INTEGER, 0);
+    EMIT(j, 0x49, 0x89, 0xc0);                  /*mov r8, rax*/
+    emit_mov_imm(j, RSI, (uintptr_t)fn);
+    emit_mov_imm(j, RDX, (uintptr_t)args);
+    emit_load_slot(j, RCX, slot);
+    emit_mov_imm(j, R9, true);
+    emit_call(j, jit_compare_slow);
+    boxed = emit_jump(j, CC_ALWAYS, boxed);
+
+    land(j, integer);
+    /*mov rax, [rax + integer]; cmp [rbp + slot], rax*/
+    EMIT(j, 0x48, 0x8b, 0x40, offsetof(object_t, integer));
+    emit_load_slot(j, RDX, slot);
+    EMIT(j, 0x48, 0x39, 0xc2);                  /*cmp rdx, rax*/
+  }
+  j->slots--;
+
+  size_t fail = emit_jump(j, form == FORM_LESS ? CC_GE : CC_LE, 0);
+  size_t pass = emit_jump(j, CC_ALWAYS, 0);
+  land(j, boxed);
+  fail = emit_branch_false(j, fail);
+  land(j, pass);
+  return fail;
+}
+
+/*Evaluate EXP as the test of an if, jumping to the returned chain if it
+ *is false*/
+static size_t compile_test(struct jit *j, object_t *exp)
+{
+  if (_LIST_P(exp) && exp != EMPTY_LIST) {
+    enum form form = form_of(exp, length(exp->cell->cdr));
+
+    if (form == FORM_LESS || form == FORM_MORE) {
+      size_t generic = emit_binding_check(j, exp, form_fn(form), 0);
+      size_t fail = compile_compare(j, exp, form);
+      size_t pass = emit_jump(j, CC_ALWAYS, 0);
+
+      land(j, generic);
+      emit_eval(j, exp, true);
+      fail = emit_branch_false(j, fail);
+      land(j, pass);
+      return fail;
+    }
+  }
+  compile_value(j, exp, true);
+  return emit_branch_false(j, 0);
+}
+
+/*A call to a procedure: the arguments are evaluated and pinned, and
+ *apply_pinned binds them. A call to anything else is left to the
+ *interpreter.*/
+static void compile_call(struct jit *j, object_t *exp, int nargs, bool push)
+{
+  if (!_SYMBOL_P(exp->cell->car)) {
+    emit_eval(j, exp, push);
+    return;
+  }
+
+  emit_mov_imm(j, RSI, (uintptr_t)exp);
+  emit_mov_imm(j, RDX, nargs);
+  emit_call(j, jit_callee);
+  EMIT(j, 0x48, 0x85, 0xc0);                    /*test rax, rax*/
+  size_t generic = emit_jump(j, CC_E, 0);
+
+  for (cons_t *arg = exp->cell->cdr; arg != NULL; arg = arg->cdr) {
+    compile_value(j, arg->car, true);
+    EMIT(j, 0x48, 0x89, 0xc6);                  /*mov rsi, rax*/
+    emit_call(j, pin);
+  }
+  emit_mov_imm(j, RSI, nargs);
+  emit_mov_imm(j, RDX, push);
+  emit_call(j, apply_pinned);
+  size_t done = emit_jump(j, CC_ALWAYS, 0);
+
+  land(j, generic);
+  emit_eval(j, exp, push);
+  land(j, done);
+}
+
+/*A list form. The inlined ones fall back to the interpreter where their
+ *primitives have been rebound.*/
+static void compile_form(struct jit *j, object_t *exp, bool push)
+{
+  cons_t *args = exp->cell->cdr;
+  int nargs = length(args);
+  enum form form = form_of(exp, nargs);
+  size_t done = 0;
+
+  if (form == FORM_CALL) {
+    compile_call(j, exp, nargs, push);
+    return;
+  }
+
+  size_t generic = emit_binding_check(j, exp, form_fn(form), 0);
+  switch (form) {
+    case FORM_IF: {
+      size_t fail = compile_test(j, args->car);
+
+      compile_value(j, args->cdr->car, true);
+      done = emit_jump(j, CC_ALWAYS, done);
+      land(j, fail);
+      compile_value(j, args->cdr->cdr->car, true);
+      break;
+    }
+    case FORM_QUOTE:
+      emit_mov_imm(j, RAX, (uintptr_t)args->car);
+      break;
+    case FORM_ADD:
+      compile_add(j, exp);
+      break;
+    default: {
+      size_t fail = compile_compare(j, exp, form);
+
+      emit_mov_imm(j, RAX, (uintptr_t)CONST_TRUE);
+      done = emit_jump(j, CC_ALWAYS, done);
+      land(j, fail);
+      emit_mov_imm(j, RAX, (uintptr_t)CONST_FALSE);
+    }
+  }
+  done = emit_jump(j, CC_ALWAYS, done);
+
+  land(j, generic);
+  emit_eval(j, exp, push);
+  land(j, done);
+}
+
+/*Evaluate EXP into rax. PUSH is false for the body itself, which the
+ *interpreter evaluates in the environment of the call.*/
+static void compile_value(struct jit *j, object_t *exp, bool push)
+{
+  switch (exp->type) {
+    case SYMBOL: {
+      int i = 0;
+
+      for (cons_t *param = j->proc->params; param != NULL;
+           param = param->cdr, i++)
+        if (_SYMBOL_P(param->car) &&
+            strcmp(param->car->string, exp->string) == 0) {
+          compile_param(j, exp, i);
+          return;
+        }
+      emit_eval(j, exp, push);
+      return;
+    }
+    case LIST:
+      if (exp != EMPTY_LIST) {
+        compile_form(j, exp, push);
+        return;
+      }
+      /*Fall through*/
+    default:
+      emit_mov_imm(j, RAX, (uintptr_t)exp);
+  }
+}
+
+/*Whether EXP has a definition in it. The interpreter makes those in the
+ *environment of the enclosing form, which compiled code doesn't push.*/
+static bool defines(object_t *exp)
+{
+  if (!_LIST_P(exp) || exp == EMPTY_LIST) return false;
+  if (_SYMBOL_P(exp->cell->car) &&
+      strncmp(exp->cell->car->string, "define", 6) == 0)
+    return true;
+
+  for (cons_t *cell = exp->cell; cell != NULL; cell = cell->cdr)
+    if (defines(cell->car)) return true;
+  return false;
+}
+
+static size_t map_size(size_t len)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  return (len + page - 1) / page * page;
+}
+
+/*Compile PROC, if it has a single form for a body. Nothing is done if it
+ *can't be, and it stays interpreted.*/
+void jit_compile(procedure_t *proc)
+{
+  object_t *body = proc->body;
+  struct jit j = {.proc = proc};
+
+  if (jit_threshold == 0 || body == EMPTY_LIST ||
+      (_LIST_P(body) && _LIST_P(body->cell->car)) || defines(body))
+    return;
+
+  EMIT(&j, 0x55);                               /*push rbp*/
+  EMIT(&j, 0x48, 0x89, 0xe5);                   /*mov rbp, rsp*/
+  EMIT(&j, 0x53);                               /*push rbx*/
+  EMIT(&j, 0x41, 0x54);                         /*push r12*/
+  EMIT(&j, 0x48, 0x81, 0xec);                   /*sub rsp, frame*/
+  size_t frame = j.len;
+  emit32(&j, 0);
+  EMIT(&j, 0x48, 0x89, 0xfb);                   /*mov rbx, rdi*/
+  EMIT(&j, 0x49, 0x89, 0xf4);                   /*mov r12, rsi*/
+
+  compile_value(&j, body, false);
+
+  EMIT(&j, 0x48, 0x8d, 0x65, 0xf0);             /*lea rsp, [rbp - 16]*/
+  EMIT(&j, 0x41, 0x5c);                         /*pop r12*/
+  EMIT(&j, 0x5b);                               /*pop rbx*/
+  EMIT(&j, 0x5d);                               /*pop rbp*/
+  EMIT(&j, 0xc3);                               /*ret*/
+
+  /*The slots, in a frame that keeps the stack 16 byte aligned for calls*/
+  uint32_t frame_size = (8 * j.max_slots + 15) & ~15;
+  memcpy(j.code + frame, &frame_size, 4);
+
+  void *mem = mmap(NULL, map_size(j.len), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    free(j.code);
+    return;
+  }
+  memcpy(mem, j.code, j.len);
+  free(j.code);
+  if (mprotect(mem, map_size(j.len), PROT_READ | PROT_EXEC) != 0) {
+    munmap(mem, map_size(j.len));
+    return;
+  }
+
+  struct jit_code *code = ERR_MALLOC(sizeof(struct jit_code));
+  code->entry = (jit_entry_t)mem;
+  code->size = j.len;
+  proc->jit = code;
+  if (perf_map_on) perf_map_add(code, proc->name);
+}
+
+void jit_free(procedure_t *proc)
+{
+  if (proc->jit == NULL) return;
+
+  if (proc->jit->size != 0)
+    munmap((void *)proc->jit->entry, map_size(proc->jit->size));
+  free(proc->jit);
+}
+
+#else
+
+/*Other platforms interpret everything*/
+void jit_perf_map(void)
+{
+}
+
+void jit_compile(procedure_t *proc)
+{
+}
+
+void jit_free(procedure_t *proc)
+{
+  free(proc->jit);
+}
+
+#endif
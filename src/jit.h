@@ -0,0 +1,77 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef JIT_H
+#define JIT_H
+#include "types.h"
+#include "context.h"
+#include <stdbool.h>
+
+/*Calls after which a procedure is compiled to machine code*/
+#define JIT_THRESHOLD 64
+
+/*The threshold in use; zero leaves everything to the interpreter*/
+extern unsigned int jit_threshold;
+
+struct bind_tree;
+
+/*Compiled code, called with the bindings of the procedure's parameters in
+ *the order of the parameters*/
+typedef object_t *(*jit_entry_t)(skeem_ctx_t *, struct bind_tree **);
+
+extern void jit_compile(procedure_t *proc);
+extern void jit_attach(procedure_t *proc, jit_entry_t entry);
+extern object_t *jit_run(skeem_ctx_t *ctx, procedure_t *proc);
+extern void jit_free(procedure_t *proc);
+extern void jit_rebind(skeem_ctx_t *ctx, object_t *symbol, object_t *val);
+extern bool jit_inlined(skeem_ctx_t *ctx, object_t *symbol, primitive_t fn);
+extern void jit_perf_map(void);
+
+/*Note that SYMBOL is being bound to VAL in CTX. Called for every binding,
+ *so it only looks further at names that start like an inlined
+ *primitive's.*/
+static inline void jit_bind(skeem_ctx_t *ctx, object_t *symbol,
+                            object_t *val)
+{
+  if (ctx->jit_rebound) return;
+  switch (symbol->string[0]) {
+    case '+':
+    case '<':
+    case '>':
+    case 'i':
+    case 'q':
+      jit_rebind(ctx, symbol, val);
+  }
+}
+
+/*Count a call to PROC, compiling it once it is hot. True if the call
+ *should run the compiled code. Contexts running tasks share procedures
+ *with their parent, so only the parent counts and compiles.*/
+static inline bool jit_ready(skeem_ctx_t *ctx, procedure_t *proc)
+{
+  if (ctx->parent != NULL) return false;
+  if (proc->jit == NULL && ++proc->calls == jit_threshold)
+    jit_compile(proc);
+  return proc->jit != NULL;
+}
+
+#endif
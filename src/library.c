@@ -0,0 +1,526 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*R7RS libraries. (define-library name declaration ...) only records a
+ *library; its declarations are evaluated the first time it is imported, into
+ *an environment of its own, so a script pays only for the libraries it uses.
+ *A library that hasn't been declared is looked for in NAME.sld, with (a b c)
+ *naming a/b/c.sld, under each directory of $SKEEM_LIBRARY_PATH and then the
+ *current directory. Library files are parsed through the cache like scripts,
+ *so each is read once per version of its source.
+ *
+ *Variables are dynamically scoped, so the procedures a library exports are
+ *imported as closures over its environment, which is how they see the
+ *definitions it doesn't export.*/
+
+#include "library.h"
+#include "types.h"
+#include "mem.h"
+#include "builtins.h"
+#include "cache.h"
+#include "macro.h"
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*A binding an import set makes*/
+struct binding {
+  object_t *name, *val;
+  struct binding *next;
+};
+
+static cons_t *cells(object_t *list)
+{
+  return list == EMPTY_LIST ? NULL : list->cell;
+}
+
+static bool symbol_is(object_t *obj, const char *name)
+{
+  return _SYMBOL_P(obj) && strcmp(obj->string, name) == 0;
+}
+
+/*Join the parts of the library name NAME with '/'. Returns NULL unless they
+ *are all symbols or exact non-negative integers.*/
+static char *library_name(object_t *name)
+{
+  char *joined = NULL;
+  size_t size;
+
+  if (!_LIST_P(name) || name == EMPTY_LIST) return NULL;
+
+  FILE *out = open_memstream(&joined, &size);
+  if (out == NULL) {
+    perror("open_memstream");
+    exit(EXIT_FAILURE);
+  }
+
+  for (cons_t *cur = name->cell; cur != NULL; cur = cur->cdr) {
+    object_t *part = cur->car;
+
+    if (cur != name->cell) fputc('/', out);
+    if (_SYMBOL_P(part)) {
+      fputs(part->string, out);
+    } else if (part->type == INTEGER && part->integer >= 0) {
+      fprintf(out, "%lld", (long long)part->integer);
+    } else {
+      fclose(out);
+      free(joined);
+      return NULL;
+    }
+  }
+  fclose(out);
+  return joined;
+}
+
+static struct library *find_library(skeem_ctx_t *ctx, const char *name)
+{
+  struct library *lib = ctx->libraries;
+
+  while (lib != NULL && strcmp(lib->name, name) != 0) lib = lib->next;
+  return lib;
+}
+
+static bool export_spec_valid(object_t *spec)
+{
+  if (_SYMBOL_P(spec)) return true;
+  if (!_LIST_P(spec) || spec == EMPTY_LIST || length(spec->cell) != 3)
+    return false;
+
+  cons_t *cell = spec->cell;
+  return symbol_is(cell->car, "rename") && _SYMBOL_P(cell->cdr->car) &&
+         _SYMBOL_P(cell->cdr->cdr->car);
+}
+
+static bool decls_valid(cons_t *decls)
+{
+  for (; decls != NULL; decls = decls->cdr) {
+    object_t *decl = decls->car;
+
+    if (!_LIST_P(decl) || decl == EMPTY_LIST) return false;
+    if (symbol_is(decl->cell->car, "export")) {
+      for (cons_t *spec = decl->cell->cdr; spec != NULL; spec = spec->cdr)
+        if (!export_spec_valid(spec->car)) return false;
+    } else if (!symbol_is(decl->cell->car, "import") &&
+               !symbol_is(decl->cell->car, "begin")) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*(define-library name declaration ...), where each declaration is an
+ *(export spec ...), (import set ...) or (begin form ...)*/
+object_t *define_library(skeem_ctx_t *ctx, cons_t *args)
+{
+  if (args == NULL) error("define-library: Expected a library name\n");
+  if (!decls_valid(args->cdr))
+    error("define-library: Expected export, import and begin "
+          "declarations\n");
+
+  char *name = library_name(args->car);
+  if (name == NULL)
+    error("define-library: A library name is a list of symbols and "
+          "integers\n");
+
+  struct library *lib = find_library(ctx, name);
+  if (lib != NULL && lib->loading) {
+    free(name);
+    error("define-library: Library is being loaded\n");
+  }
+
+  object_t *decls = EMPTY_LIST;
+  if (args->cdr != NULL) {
+    decls = obj_init(ctx, LIST);
+    decls->cell = args->cdr;
+  }
+
+  if (lib == NULL) {
+    lib = ERR_MALLOC(sizeof(struct library));
+    lib->name = name;
+    lib->next = ctx->libraries;
+    ctx->libraries = lib;
+  } else {
+    free(name);
+  }
+  /*A library declared again is loaded afresh when it is next imported*/
+  lib->decls = decls;
+  lib->env = NULL;
+  return args->car;
+}
+
+static void restore_image(skeem_ctx_t *ctx, char *image, size_t len,
+                          size_t cap, size_t pos, uint64_t key,
+                          FILE *stream, char *src)
+{
+  ctx->image = image;
+  ctx->image_len = len;
+  ctx->image_cap = cap;
+  ctx->image_pos = pos;
+  ctx->image_key = key;
+  ctx->image_stream = stream;
+  ctx->image_src = src;
+}
+
+/*Evaluate the forms in STREAM at the current level, and close it. The image
+ *of the script being run is set aside while they are read.*/
+static void load_forms(skeem_ctx_t *ctx, FILE *stream)
+{
+  char *image = ctx->image;
+  size_t image_len = ctx->image_len, image_cap = ctx->image_cap,
+         image_pos = ctx->image_pos;
+  uint64_t image_key = ctx->image_key;
+  FILE *image_stream = ctx->image_stream;
+  char *image_src = ctx->image_src;
+  bool no_gc = ctx->no_gc;
+  jmp_buf err;
+
+  memcpy(err, ctx->err, sizeof(jmp_buf));
+  restore_image(ctx, NULL, 0, 0, 0, 0, NULL, NULL);
+
+  /*A file that can't be parsed must not take the script's image with it*/
+  if (setjmp(ctx->err)) {
+    fclose(stream);
+    cache_close(ctx);
+    restore_image(ctx, image, image_len, image_cap, image_pos, image_key,
+                  image_stream, image_src);
+    memcpy(ctx->err, err, sizeof(jmp_buf));
+    longjmp(ctx->err, 1);
+  }
+
+  cache_open(ctx, stream);
+  object_t *forms = EMPTY_LIST, *form;
+  cons_t **tail = NULL;
+
+  /*cache_next holds off the GC until the forms are evaluated*/
+  while ((form = cache_next(ctx)) != NULL) {
+    if (forms == EMPTY_LIST) {
+      forms = obj_init(ctx, LIST);
+      tail = &forms->cell;
+    }
+    *tail = cons_init(ctx);
+    (*tail)->car = form;
+    tail = &(*tail)->cdr;
+  }
+
+  fclose(stream);
+  cache_close(ctx);
+  restore_image(ctx, image, image_len, image_cap, image_pos, image_key,
+                image_stream, image_src);
+  memcpy(ctx->err, err, sizeof(jmp_buf));
+
+  pin(ctx, forms);
+  for (cons_t *cur = cells(forms); cur != NULL; cur = cur->cdr) {
+    ctx->no_gc = false;
+    macro_expand(ctx, cur->car);
+    eval(ctx, cur->car);
+  }
+  unpin_head(ctx);
+  ctx->no_gc = no_gc;
+}
+
+/*Load the file declaring the library NAME. Returns the library, or NULL if
+ *there is no such file or it doesn't declare NAME.*/
+static struct library *load_library_file(skeem_ctx_t *ctx, const char *name)
+{
+  const char *dirs = getenv("SKEEM_LIBRARY_PATH");
+  char path[4096];
+  FILE *stream = NULL;
+
+  while (stream == NULL && dirs != NULL && *dirs != '\0') {
+    size_t len = strcspn(dirs, ":");
+
+    if (len > 0) {
+      snprintf(path, sizeof(path), "%.*s/%s.sld", (int)len, dirs, name);
+      stream = fopen(path, "r");
+    }
+    dirs += len;
+    if (*dirs == ':') dirs++;
+  }
+
+  if (stream == NULL) {
+    snprintf(path, sizeof(path), "%s.sld", name);
+    stream = fopen(path, "r");
+  }
+  if (stream == NULL) return NULL;
+
+  load_forms(ctx, stream);
+  return find_library(ctx, name);
+}
+
+static void bind_all(skeem_ctx_t *ctx, object_t *env,
+                     struct binding *bindings)
+{
+  env_modify(ctx, env);
+  for (; bindings != NULL; bindings = bindings->next)
+    tree_insert(ctx, env->env->tree, bindings->name, bindings->val);
+}
+
+static void bindings_free(struct binding *bindings)
+{
+  while (bindings != NULL) {
+    struct binding *next = bindings->next;
+    free(bindings);
+    bindings = next;
+  }
+}
+
+static void import_into(skeem_ctx_t *ctx, object_t *env, cons_t *sets);
+
+/*Evaluate the declarations of LIB in a new environment. If an error escapes,
+ *the library is left unloaded, to be tried again by the next import.*/
+static void instantiate(skeem_ctx_t *ctx, struct library *lib)
+{
+  bool no_gc = ctx->no_gc;
+  jmp_buf err;
+
+  if (lib->loading) error("import: %s imports itself\n", lib->name);
+
+  memcpy(err, ctx->err, sizeof(jmp_buf));
+  if (setjmp(ctx->err)) {
+    lib->env = NULL;
+    lib->loading = false;
+    memcpy(ctx->err, err, sizeof(jmp_buf));
+    longjmp(ctx->err, 1);
+  }
+
+  lib->loading = true;
+  lib->env = obj_init(ctx, ENVIRONMENT);
+
+  /*Link the environment in as the current one, so that the definitions of
+   *the body land in it*/
+  lib->env->env->prev = ctx->env_head;
+  ctx->env_head->env->next = lib->env;
+  ctx->env_head = lib->env;
+
+  for (cons_t *decl = cells(lib->decls); decl != NULL; decl = decl->cdr) {
+    cons_t *cell = decl->car->cell;
+
+    if (symbol_is(cell->car, "import")) {
+      import_into(ctx, lib->env, cell->cdr);
+    } else if (symbol_is(cell->car, "begin")) {
+      for (cons_t *form = cell->cdr; form != NULL; form = form->cdr) {
+        ctx->no_gc = false;
+        macro_expand(ctx, form->car);
+        eval(ctx, form->car);
+      }
+    }
+  }
+
+  env_pop(ctx);
+  env_modify(ctx, lib->env);
+  lib->env->env->prev = NULL;
+  lib->loading = false;
+  ctx->no_gc = no_gc;
+  memcpy(ctx->err, err, sizeof(jmp_buf));
+}
+
+/*The bindings LIB exports. Procedures are closed over its environment.*/
+static struct binding *library_exports(skeem_ctx_t *ctx, struct library *lib)
+{
+  struct binding *exports = NULL;
+
+  for (cons_t *decl = cells(lib->decls); decl != NULL; decl = decl->cdr) {
+    cons_t *cell = decl->car->cell;
+    if (!symbol_is(cell->car, "export")) continue;
+
+    for (cons_t *spec = cell->cdr; spec != NULL; spec = spec->cdr) {
+      object_t *internal = spec->car, *external = spec->car;
+
+      if (_LIST_P(spec->car)) {
+        internal = spec->car->cell->cdr->car;
+        external = spec->car->cell->cdr->cdr->car;
+      }
+
+      struct bind_tree *bind = tree_lookup(lib->env->env->tree, internal);
+      if (bind == NULL) {
+        bindings_free(exports);
+        error("import: %s does not define %s\n", lib->name, internal->string);
+      }
+
+      object_t *val = bind->val;
+      if (val->type == PROCEDURE) {
+        val = obj_init(ctx, CLOSURE);
+        val->closure->proc = bind->val;
+        val->closure->env = lib->env;
+      }
+
+      struct binding *b = ERR_MALLOC(sizeof(struct binding));
+      b->name = external;
+      b->val = val;
+      b->next = exports;
+      exports = b;
+    }
+  }
+  return exports;
+}
+
+static bool import_modifier(object_t *set, const char *name)
+{
+  return symbol_is(set->cell->car, name) && set->cell->cdr != NULL &&
+         _LIST_P(set->cell->cdr->car) && set->cell->cdr->car != EMPTY_LIST;
+}
+
+static object_t *find_id(cons_t *ids, object_t *name)
+{
+  for (; ids != NULL; ids = ids->cdr) {
+    object_t *id = _LIST_P(ids->car) ? ids->car->cell->car : ids->car;
+    if (_eq(id, name)) return ids->car;
+  }
+  return NULL;
+}
+
+static bool ids_valid(cons_t *ids, bool pairs)
+{
+  for (; ids != NULL; ids = ids->cdr) {
+    object_t *id = ids->car;
+
+    if (pairs ? !_LIST_P(id) || id == EMPTY_LIST || length(id->cell) != 2 ||
+                    !_SYMBOL_P(id->cell->car) ||
+                    !_SYMBOL_P(id->cell->cdr->car)
+              : !_SYMBOL_P(id))
+      return false;
+  }
+  return true;
+}
+
+/*The bindings the import set SET makes: a library name, or one of (only set
+ *id ...), (except set id ...), (prefix set id) and (rename set (id id) ...).
+ *The library is loaded first, and the GC is then held off until the
+ *bindings are in place.*/
+static struct binding *import_set(skeem_ctx_t *ctx, object_t *set)
+{
+  if (!_LIST_P(set) || set == EMPTY_LIST)
+    error("import: Wrong argument type - %s (Expected import set)\n",
+          types[set->type]);
+
+  cons_t *ids = set->cell->cdr == NULL ? NULL : set->cell->cdr->cdr;
+  bool only = import_modifier(set, "only"),
+       except = import_modifier(set, "except"),
+       prefix = import_modifier(set, "prefix"),
+       rename = import_modifier(set, "rename");
+
+  if (only || except || prefix || rename) {
+    if (prefix ? length(ids) != 1 || !_SYMBOL_P(ids->car)
+               : !ids_valid(ids, rename))
+      error("import: Malformed %s import set\n", set->cell->car->string);
+
+    struct binding *bindings = import_set(ctx, set->cell->cdr->car), **cur;
+
+    for (cur = &bindings; *cur != NULL;) {
+      struct binding *b = *cur;
+      object_t *id = prefix ? NULL : find_id(ids, b->name);
+
+      if ((only && id == NULL) || (except && id != NULL)) {
+        *cur = b->next;
+        free(b);
+        continue;
+      }
+
+      if (prefix) {
+        size_t len = strlen(ids->car->string) + strlen(b->name->string) + 1;
+        char *name = ERR_MALLOC(len);
+
+        snprintf(name, len, "%s%s", ids->car->string, b->name->string);
+        b->name = symbol_new(ctx, name);
+        free(name);
+      } else if (rename && id != NULL) {
+        b->name = id->cell->cdr->car;
+      }
+      cur = &b->next;
+    }
+    return bindings;
+  }
+
+  char *name = library_name(set);
+  if (name == NULL)
+    error("import: A library name is a list of symbols and integers\n");
+
+  /*The standard libraries are the builtins, which are always visible*/
+  if (strncmp(name, "scheme/", 7) == 0) {
+    free(name);
+    ctx->no_gc = true;
+    return NULL;
+  }
+
+  struct library *lib = find_library(ctx, name);
+  if (lib == NULL) lib = load_library_file(ctx, name);
+  free(name);
+
+  if (lib == NULL) {
+    fprintf(stderr, "import: Library not found: ");
+    print_obj(set, stderr);
+    fprintf(stderr, "\n");
+    goto_top(ctx);
+  }
+
+  if (lib->env == NULL) instantiate(ctx, lib);
+  ctx->no_gc = true;
+  return library_exports(ctx, lib);
+}
+
+/*Bind what each of the import sets SETS makes in ENV*/
+static void import_into(skeem_ctx_t *ctx, object_t *env, cons_t *sets)
+{
+  bool no_gc = ctx->no_gc;
+
+  for (; sets != NULL; sets = sets->cdr) {
+    struct binding *bindings = import_set(ctx, sets->car);
+
+    bind_all(ctx, env, bindings);
+    bindings_free(bindings);
+    ctx->no_gc = no_gc;
+  }
+}
+
+/*(import set ...) binds what the libraries export in the enclosing
+ *environment*/
+object_t *import(skeem_ctx_t *ctx, cons_t *args)
+{
+  import_into(ctx, ctx->env_head->env->prev, args);
+  return EMPTY_LIST;
+}
+
+void mark_libraries(skeem_ctx_t *ctx)
+{
+  for (struct library *lib = ctx->libraries; lib != NULL; lib = lib->next) {
+    mark(ctx, lib->decls);
+    if (lib->env != NULL) mark(ctx, lib->env);
+  }
+}
+
+void libraries_free(skeem_ctx_t *ctx)
+{
+  while (ctx->libraries != NULL) {
+    struct library *next = ctx->libraries->next;
+
+    free(ctx->libraries->name);
+    free(ctx->libraries);
+    ctx->libraries = next;
+  }
+}
+
+void library_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "define-library", define_library);
+  add_primitive(ctx, "import", import);
+}
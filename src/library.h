@@ -0,0 +1,44 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef LIBRARY_H
+#define LIBRARY_H
+#include "types.h"
+#include <stdbool.h>
+
+/*A library declared with define-library. Its declarations are kept as they
+ *were written until it is first imported.*/
+struct library {
+  /*The parts of its name joined with '/', as in its file's path*/
+  char *name;
+  object_t *decls;
+  /*Holds its definitions, once it has been loaded*/
+  object_t *env;
+  bool loading;
+  struct library *next;
+};
+
+extern void mark_libraries(skeem_ctx_t *ctx);
+extern void libraries_free(skeem_ctx_t *ctx);
+extern void library_init(skeem_ctx_t *ctx);
+
+#endif
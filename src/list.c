@@ -0,0 +1,364 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "list.h"
+#include "types.h"
+#include "mem.h"
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static object_t *list_arg(skeem_ctx_t *ctx, const char *function, object_t *obj)
+{
+  if (!_LIST_P(obj))
+    error("%s: Wrong argument type - %s (Expected list)\n", function,
+          types[obj->type]);
+  return obj;
+}
+
+static void arity_at_least(skeem_ctx_t *ctx, const char *function, int min,
+                           cons_t *args)
+{
+  int len = length(args);
+  if (len < min)
+    error("Wrong number of arguments to %s (Got %d, Wanted at least %d)\n",
+          function, len, min);
+}
+
+/*Store VAL in a new cell at *TAIL, returning where the next one goes*/
+static cons_t **push_cell(skeem_ctx_t *ctx, cons_t **tail, object_t *val)
+{
+  *tail = cons_init(ctx);
+  (*tail)->car = val;
+  return &(*tail)->cdr;
+}
+
+/*A list object sharing the cells of LIST starting at CELL*/
+static object_t *sublist(skeem_ctx_t *ctx, object_t *list, cons_t *cell)
+{
+  if (cell == NULL) return EMPTY_LIST;
+
+  pin(ctx, list);
+  object_t *obj = obj_init(ctx, LIST);
+  unpin_head(ctx);
+  obj->cell = cell;
+  return obj;
+}
+
+/*A new list being built is empty until its first cell is pushed*/
+static object_t *finish_list(object_t *list)
+{
+  return list->cell == NULL ? EMPTY_LIST : list;
+}
+
+/*Evaluate and pin every list in ARGS, storing a cursor into each in CUR.
+ *The caller must unpin them.*/
+static void eval_lists(skeem_ctx_t *ctx, const char *function, cons_t *args,
+                       cons_t **cur)
+{
+  for (int i = 0; args != NULL; args = args->cdr, i++) {
+    object_t *list = list_arg(ctx, function, eval(ctx, args->car));
+    pin(ctx, list);
+    cur[i] = list->cell;
+  }
+}
+
+/*Fill VALS with the next element of each of the N lists and advance them.
+ *Returns false once the shortest list runs out.*/
+static bool next_values(int n, cons_t **cur, cons_t *vals)
+{
+  for (int i = 0; i < n; i++) {
+    if (cur[i] == NULL) return false;
+
+    vals[i].car = cur[i]->car;
+    vals[i].cdr = i + 1 < n ? &vals[i + 1] : NULL;
+    cur[i] = cur[i]->cdr;
+  }
+  return true;
+}
+
+object_t *list(skeem_ctx_t *ctx, cons_t *args)
+{
+  if (args == NULL) return EMPTY_LIST;
+
+  object_t *list = obj_init(ctx, LIST);
+  cons_t **tail = &list->cell;
+
+  pin(ctx, list);
+  for (; args != NULL; args = args->cdr)
+    tail = push_cell(ctx, tail, eval(ctx, args->car));
+  unpin_head(ctx);
+
+  return list;
+}
+
+object_t *length_prim(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *list = list_arg(ctx, "length", eval(ctx, args->car));
+  int n = length(list->cell);
+  object_t *len = obj_init(ctx, INTEGER);
+  len->integer = n;
+  return len;
+}
+
+/*(append list ...) copies every list but the last, which is shared*/
+object_t *append(skeem_ctx_t *ctx, cons_t *args)
+{
+  object_t *result = obj_init(ctx, LIST);
+  cons_t **tail = &result->cell;
+
+  pin(ctx, result);
+  for (; args != NULL; args = args->cdr) {
+    object_t *list = list_arg(ctx, "append", eval(ctx, args->car));
+
+    if (args->cdr == NULL) {
+      *tail = list->cell;
+      break;
+    }
+    for (cons_t *cur = list->cell; cur != NULL; cur = cur->cdr)
+      tail = push_cell(ctx, tail, cur->car);
+  }
+  unpin_head(ctx);
+
+  return finish_list(result);
+}
+
+object_t *reverse(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *list = list_arg(ctx, "reverse", eval(ctx, args->car));
+
+  pin(ctx, list);
+  object_t *result = obj_init(ctx, LIST);
+  unpin_head(ctx);
+
+  for (cons_t *cur = list->cell; cur != NULL; cur = cur->cdr) {
+    cons_t *cell = cons_init(ctx);
+    cell->car = cur->car;
+    cell->cdr = result->cell;
+    result->cell = cell;
+  }
+  return finish_list(result);
+}
+
+/*Walk K cells into the list argument of FUNCTION*/
+static cons_t *list_index(skeem_ctx_t *ctx, const char *function, cons_t *args,
+                          object_t **list)
+{
+  *list = list_arg(ctx, function, eval(ctx, args->car));
+  pin(ctx, *list);
+  object_t *k = eval(ctx, args->cdr->car);
+  unpin_head(ctx);
+
+  if (!_INTEGER_P(k) || k->integer < 0)
+    error("%s: Wrong argument - expected a non-negative integer\n", function);
+
+  cons_t *cur = (*list)->cell;
+  for (long i = 0; i < k->integer; i++) {
+    if (cur == NULL)
+      error("%s: Index out of range - %ld\n", function, k->integer);
+    cur = cur->cdr;
+  }
+  return cur;
+}
+
+object_t *list_tail(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  object_t *list;
+  cons_t *cell = list_index(ctx, "list-tail", args, &list);
+  return sublist(ctx, list, cell);
+}
+
+object_t *list_ref(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  object_t *list;
+  cons_t *cell = list_index(ctx, "list-ref", args, &list);
+
+  if (cell == NULL) error("list-ref: Index out of range\n");
+  return cell->car;
+}
+
+/*(map proc list ...) and (for-each proc list ...) evaluate PROC once and
+ *apply it directly to the elements, stopping at the shortest list*/
+static object_t *map_lists(skeem_ctx_t *ctx, const char *function,
+                           cons_t *args, bool collect)
+{
+  arity_at_least(ctx, function, 2, args);
+  int nlists = length(args->cdr);
+  cons_t *cur[nlists], vals[nlists];
+  object_t *proc = eval(ctx, args->car);
+  pin(ctx, proc);
+  eval_lists(ctx, function, args->cdr, cur);
+
+  object_t *result = obj_init(ctx, LIST);
+  cons_t **tail = &result->cell;
+  pin(ctx, result);
+
+  while (next_values(nlists, cur, vals)) {
+    object_t *val = apply_values(ctx, proc, vals);
+    if (collect) tail = push_cell(ctx, tail, val);
+  }
+
+  for (int i = 0; i < nlists + 2; i++) unpin_head(ctx);
+  return collect ? finish_list(result) : CONST_TRUE;
+}
+
+object_t *map(skeem_ctx_t *ctx, cons_t *args)
+{
+  return map_lists(ctx, "map", args, true);
+}
+
+object_t *for_each(skeem_ctx_t *ctx, cons_t *args)
+{
+  return map_lists(ctx, "for-each", args, false);
+}
+
+object_t *filter(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  object_t *pred = eval(ctx, args->car);
+  pin(ctx, pred);
+  object_t *list = list_arg(ctx, "filter", eval(ctx, args->cdr->car));
+  pin(ctx, list);
+
+  object_t *result = obj_init(ctx, LIST);
+  cons_t **tail = &result->cell;
+  pin(ctx, result);
+
+  for (cons_t *cur = list->cell; cur != NULL; cur = cur->cdr) {
+    cons_t val = {cur->car, NULL};
+    if (IS_TRUE(apply_values(ctx, pred, &val)))
+      tail = push_cell(ctx, tail, cur->car);
+  }
+
+  unpin_head(ctx);
+  unpin_head(ctx);
+  unpin_head(ctx);
+  return finish_list(result);
+}
+
+/*(fold kons knil list ...) calls (kons elem ... acc) left to right*/
+object_t *fold(skeem_ctx_t *ctx, cons_t *args)
+{
+  arity_at_least(ctx, "fold", 3, args);
+  int nlists = length(args->cdr->cdr);
+  cons_t *cur[nlists], vals[nlists + 1];
+  object_t *kons = eval(ctx, args->car);
+  pin(ctx, kons);
+  object_t *acc = eval(ctx, args->cdr->car);
+  pin(ctx, acc);
+  eval_lists(ctx, "fold", args->cdr->cdr, cur);
+
+  /*KNIL stays pinned below the lists; the running value is kept on top*/
+  pin(ctx, acc);
+
+  while (next_values(nlists, cur, vals)) {
+    vals[nlists - 1].cdr = &vals[nlists];
+    vals[nlists].car = acc;
+    vals[nlists].cdr = NULL;
+    acc = apply_values(ctx, kons, vals);
+    unpin_head(ctx);
+    pin(ctx, acc);
+  }
+
+  for (int i = 0; i < nlists + 3; i++) unpin_head(ctx);
+  return acc;
+}
+
+/*Search for the first element of LIST that is EQUIV to KEY. With ALIST,
+ *compare the car of each element instead and return the element.*/
+static object_t *find(skeem_ctx_t *ctx, const char *function, cons_t *args,
+                      bool (*equiv)(object_t *, object_t *), bool alist)
+{
+  assert_arity(2);
+  object_t *key = eval(ctx, args->car);
+  pin(ctx, key);
+  object_t *list = list_arg(ctx, function, eval(ctx, args->cdr->car));
+  unpin_head(ctx);
+
+  for (cons_t *cur = list->cell; cur != NULL; cur = cur->cdr) {
+    if (!alist) {
+      if (equiv(key, cur->car)) return sublist(ctx, list, cur);
+      continue;
+    }
+
+    object_t *pair = cur->car;
+    if (!_LIST_P(pair) || pair == EMPTY_LIST)
+      error("%s: Wrong element type - %s (Expected pair)\n", function,
+            types[pair->type]);
+    if (equiv(key, pair->cell->car)) return pair;
+  }
+  return CONST_FALSE;
+}
+
+object_t *memq(skeem_ctx_t *ctx, cons_t *args)
+{
+  return find(ctx, "memq", args, _eq, false);
+}
+
+object_t *memv(skeem_ctx_t *ctx, cons_t *args)
+{
+  return find(ctx, "memv", args, _eqv, false);
+}
+
+object_t *member(skeem_ctx_t *ctx, cons_t *args)
+{
+  return find(ctx, "member", args, _equal, false);
+}
+
+object_t *assq(skeem_ctx_t *ctx, cons_t *args)
+{
+  return find(ctx, "assq", args, _eq, true);
+}
+
+object_t *assv(skeem_ctx_t *ctx, cons_t *args)
+{
+  return find(ctx, "assv", args, _eqv, true);
+}
+
+object_t *assoc(skeem_ctx_t *ctx, cons_t *args)
+{
+  return find(ctx, "assoc", args, _equal, true);
+}
+
+void list_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "list", list);
+  add_primitive(ctx, "length", length_prim);
+  add_primitive(ctx, "append", append);
+  add_primitive(ctx, "reverse", reverse);
+  add_primitive(ctx, "list-tail", list_tail);
+  add_primitive(ctx, "list-ref", list_ref);
+  add_primitive(ctx, "map", map);
+  add_primitive(ctx, "for-each", for_each);
+  add_primitive(ctx, "filter", filter);
+  add_primitive(ctx, "fold", fold);
+  add_primitive(ctx, "memq", memq);
+  add_primitive(ctx, "memv", memv);
+  add_primitive(ctx, "member", member);
+  add_primitive(ctx, "assq", assq);
+  add_primitive(ctx, "assv", assv);
+  add_primitive(ctx, "assoc", assoc);
+}
@@ -0,0 +1,428 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/*syntax-rules macros. A use of a macro is replaced, in place, by its
+ *expansion, so each form is expanded once however often it runs. Top level
+ *forms are expanded before they are evaluated; uses of a macro defined after
+ *a form was expanded are expanded when they are first evaluated.
+ *
+ *Expansions are hygienic for the names a template binds: a symbol the
+ *template introduces in a lambda or define is renamed afresh for each
+ *expansion, so it cannot capture a variable of the code using the macro.*/
+
+#include "macro.h"
+#include "types.h"
+#include "mem.h"
+#include "builtins.h"
+#include "vector.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*Suffixes of renamed symbols, unique across contexts*/
+static atomic_ulong renames;
+
+static cons_t *cells(object_t *list)
+{
+  return list == EMPTY_LIST ? NULL : list->cell;
+}
+
+static bool symbol_is(object_t *obj, const char *name)
+{
+  return _SYMBOL_P(obj) && strcmp(obj->string, name) == 0;
+}
+
+static object_t *make_list(skeem_ctx_t *ctx, cons_t *cell)
+{
+  if (cell == NULL) return EMPTY_LIST;
+  object_t *list = obj_init(ctx, LIST);
+  list->cell = cell;
+  return list;
+}
+
+static cons_t *push(skeem_ctx_t *ctx, object_t *obj, cons_t *list)
+{
+  cons_t *cell = cons_init(ctx);
+  cell->car = obj;
+  cell->cdr = list;
+  return cell;
+}
+
+/*Pattern variables are bound to vectors of the variable, its ellipsis depth
+ *and what it matched. Below depth 0 the match is a vector of the matches of
+ *one less depth.*/
+#define BINDING_VAR(b) ((b)->vector->items[0])
+#define BINDING_DEPTH(b) ((b)->vector->items[1]->integer)
+#define BINDING_VAL(b) ((b)->vector->items[2])
+
+static object_t *make_binding(skeem_ctx_t *ctx, object_t *var, int depth,
+                              object_t *val)
+{
+  object_t *b = make_vector(ctx, 3, NULL);
+  BINDING_VAR(b) = var;
+  b->vector->items[1] = obj_init(ctx, INTEGER);
+  BINDING_DEPTH(b) = depth;
+  BINDING_VAL(b) = val;
+  return b;
+}
+
+static object_t *binding(cons_t *binds, object_t *var)
+{
+  for (; binds != NULL; binds = binds->cdr)
+    if (_eq(BINDING_VAR(binds->car), var)) return binds->car;
+  return NULL;
+}
+
+static bool literal_p(struct macro *m, object_t *sym)
+{
+  for (cons_t *cur = m->literals; cur != NULL; cur = cur->cdr)
+    if (_eq(cur->car, sym)) return true;
+  return false;
+}
+
+static bool ellipsis_follows(cons_t *cell)
+{
+  return cell->cdr != NULL && symbol_is(cell->cdr->car, "...");
+}
+
+/*Add the variables of PAT, with their depths, to *VARS*/
+static void pattern_vars(skeem_ctx_t *ctx, struct macro *m, object_t *pat,
+                         int depth, cons_t **vars)
+{
+  if (_SYMBOL_P(pat)) {
+    if (!literal_p(m, pat) && !symbol_is(pat, "_") &&
+        !symbol_is(pat, "..."))
+      *vars = push(ctx, make_binding(ctx, pat, depth, NULL), *vars);
+  } else if (_LIST_P(pat)) {
+    for (cons_t *cur = cells(pat); cur != NULL; cur = cur->cdr)
+      pattern_vars(ctx, m, cur->car, depth + ellipsis_follows(cur), vars);
+  }
+}
+
+static bool match(skeem_ctx_t *ctx, struct macro *m, object_t *pat,
+                  object_t *form, cons_t **binds);
+
+/*Match the elements FORMS against the element patterns PATS, one of which
+ *may be followed by an ellipsis*/
+static bool match_list(skeem_ctx_t *ctx, struct macro *m, cons_t *pats,
+                       cons_t *forms, cons_t **binds)
+{
+  for (; pats != NULL && !ellipsis_follows(pats); pats = pats->cdr) {
+    if (forms == NULL || !match(ctx, m, pats->car, forms->car, binds))
+      return false;
+    forms = forms->cdr;
+  }
+  if (pats == NULL) return forms == NULL;
+
+  /*The repeated pattern takes all the forms the rest does not need*/
+  cons_t *rest = pats->cdr->cdr;
+  int n = length(forms) - length(rest);
+  if (n < 0) return false;
+
+  cons_t *vars = NULL;
+  pattern_vars(ctx, m, pats->car, 0, &vars);
+  for (cons_t *v = vars; v != NULL; v = v->cdr)
+    BINDING_VAL(v->car) = make_vector(ctx, n, NULL);
+
+  for (int i = 0; i < n; i++, forms = forms->cdr) {
+    cons_t *sub = NULL;
+
+    if (!match(ctx, m, pats->car, forms->car, &sub)) return false;
+    for (cons_t *v = vars; v != NULL; v = v->cdr)
+      BINDING_VAL(v->car)->vector->items[i] =
+          BINDING_VAL(binding(sub, BINDING_VAR(v->car)));
+  }
+
+  for (cons_t *v = vars; v != NULL; v = v->cdr) {
+    BINDING_DEPTH(v->car)++;
+    *binds = push(ctx, v->car, *binds);
+  }
+  return match_list(ctx, m, rest, forms, binds);
+}
+
+static bool match(skeem_ctx_t *ctx, struct macro *m, object_t *pat,
+                  object_t *form, cons_t **binds)
+{
+  if (_SYMBOL_P(pat)) {
+    if (literal_p(m, pat)) return _SYMBOL_P(form) && _eq(pat, form);
+    if (!symbol_is(pat, "_"))
+      *binds = push(ctx, make_binding(ctx, pat, 0, form), *binds);
+    return true;
+  }
+  if (_LIST_P(pat))
+    return _LIST_P(form) &&
+           match_list(ctx, m, cells(pat), cells(form), binds);
+  return _equal(pat, form);
+}
+
+/*Add the symbols TMPL binds with lambda or define, other than pattern
+ *variables, to *BOUND*/
+static void template_binders(skeem_ctx_t *ctx, object_t *tmpl, cons_t *binds,
+                             cons_t **bound)
+{
+  cons_t *cur = _LIST_P(tmpl) ? cells(tmpl) : NULL;
+  if (cur == NULL) return;
+
+  if ((symbol_is(cur->car, "lambda") || symbol_is(cur->car, "define")) &&
+      cur->cdr != NULL) {
+    object_t *target = cur->cdr->car;
+    cons_t *names = _LIST_P(target) ? cells(target) : NULL;
+
+    if (_SYMBOL_P(target) && binding(binds, target) == NULL)
+      *bound = push(ctx, target, *bound);
+    for (; names != NULL; names = names->cdr)
+      if (_SYMBOL_P(names->car) && binding(binds, names->car) == NULL)
+        *bound = push(ctx, names->car, *bound);
+  }
+
+  for (; cur != NULL; cur = cur->cdr)
+    template_binders(ctx, cur->car, binds, bound);
+}
+
+/*The fresh name of SYM for this expansion if the template binds it*/
+static object_t *rename_bound(skeem_ctx_t *ctx, object_t *sym, cons_t *bound,
+                        cons_t **renamed)
+{
+  object_t *b = binding(*renamed, sym);
+  if (b != NULL) return BINDING_VAL(b);
+
+  for (; bound != NULL; bound = bound->cdr) {
+    if (!_eq(bound->car, sym)) continue;
+
+    unsigned long n = atomic_fetch_add(&renames, 1) + 1;
+    size_t len = strlen(sym->string) + 22;
+    char *name = ERR_MALLOC(len);
+
+    snprintf(name, len, "%s.%lu", sym->string, n);
+    object_t *fresh = symbol_new(ctx, name);
+    free(name);
+    *renamed = push(ctx, make_binding(ctx, sym, 0, fresh), *renamed);
+    return fresh;
+  }
+  return sym;
+}
+
+/*Add the variables of TMPL that are bound below depth 0 to *VARS, and check
+ *that they repeat the same number of times*/
+static void iterated_vars(skeem_ctx_t *ctx, object_t *tmpl, cons_t *binds,
+                          cons_t **vars, int *n)
+{
+  if (_SYMBOL_P(tmpl)) {
+    object_t *b = binding(binds, tmpl);
+
+    if (b == NULL || BINDING_DEPTH(b) == 0 || binding(*vars, tmpl) != NULL)
+      return;
+    if (*n >= 0 && (size_t)*n != BINDING_VAL(b)->vector->len)
+      error("syntax-rules: %s repeats a different number of times\n",
+            tmpl->string);
+    *n = BINDING_VAL(b)->vector->len;
+    *vars = push(ctx, b, *vars);
+  } else if (_LIST_P(tmpl)) {
+    for (cons_t *cur = cells(tmpl); cur != NULL; cur = cur->cdr)
+      iterated_vars(ctx, cur->car, binds, vars, n);
+  }
+}
+
+static object_t *instantiate(skeem_ctx_t *ctx, object_t *tmpl, cons_t *binds,
+                             cons_t *bound, cons_t **renamed)
+{
+  if (_SYMBOL_P(tmpl)) {
+    object_t *b = binding(binds, tmpl);
+
+    if (b == NULL) return rename_bound(ctx, tmpl, bound, renamed);
+    if (BINDING_DEPTH(b) != 0)
+      error("syntax-rules: %s needs an ellipsis after it\n", tmpl->string);
+    return BINDING_VAL(b);
+  }
+  if (!_LIST_P(tmpl) || tmpl == EMPTY_LIST) return tmpl;
+
+  cons_t *out = NULL, **tail = &out;
+  for (cons_t *cur = tmpl->cell; cur != NULL; cur = cur->cdr) {
+    if (!ellipsis_follows(cur)) {
+      *tail = push(ctx, instantiate(ctx, cur->car, binds, bound, renamed),
+                   NULL);
+      tail = &(*tail)->cdr;
+      continue;
+    }
+
+    cons_t *vars = NULL;
+    int n = -1;
+    iterated_vars(ctx, cur->car, binds, &vars, &n);
+    if (vars == NULL)
+      error("syntax-rules: No pattern variable to repeat before ...\n");
+
+    for (int i = 0; i < n; i++) {
+      cons_t *inner = binds;
+
+      for (cons_t *v = vars; v != NULL; v = v->cdr) {
+        object_t *b = v->car;
+        inner = push(ctx,
+                     make_binding(ctx, BINDING_VAR(b), BINDING_DEPTH(b) - 1,
+                                  BINDING_VAL(b)->vector->items[i]),
+                     inner);
+      }
+      *tail = push(ctx, instantiate(ctx, cur->car, inner, bound, renamed),
+                   NULL);
+      tail = &(*tail)->cdr;
+    }
+    cur = cur->cdr;
+  }
+  return make_list(ctx, out);
+}
+
+/*The expansion of FORM by the first rule of M that matches it*/
+static object_t *expand_once(skeem_ctx_t *ctx, struct macro *m,
+                             object_t *form)
+{
+  for (cons_t *rule = m->rules; rule != NULL; rule = rule->cdr) {
+    object_t *pattern = rule->car->cell->car;
+    object_t *tmpl = rule->car->cell->cdr->car;
+    cons_t *binds = NULL, *bound = NULL, *renamed = NULL;
+
+    /*The keyword position of a pattern is ignored*/
+    if (!match_list(ctx, m, pattern->cell->cdr, form->cell->cdr, &binds))
+      continue;
+    template_binders(ctx, tmpl, binds, &bound);
+    return instantiate(ctx, tmpl, binds, bound, &renamed);
+  }
+
+  error("%s: No syntax rule matches the form\n",
+        _SYMBOL_P(form->cell->car) ? form->cell->car->string : "macro");
+}
+
+/*Expand FORM, a use of MACRO, and replace it by its expansion. An expansion
+ *that is not a list is kept as (begin expansion). A form of another heap,
+ *shared with a running task, is left as it is. Returns what to evaluate.*/
+object_t *macro_use(skeem_ctx_t *ctx, object_t *form, object_t *macro)
+{
+  bool no_gc = ctx->no_gc;
+
+  /*The intermediate bindings are not rooted*/
+  ctx->no_gc = true;
+  object_t *expansion = expand_once(ctx, macro->macro, form);
+
+  if (form->heap == ctx->heap_id) {
+    if (_LIST_P(expansion) && expansion != EMPTY_LIST) {
+      form->cell = expansion->cell;
+    } else {
+      object_t *prim = obj_init(ctx, PRIMITIVE);
+      prim->primitive = begin;
+      form->cell = push(ctx, prim, push(ctx, expansion, NULL));
+    }
+    expansion = form;
+  }
+
+  ctx->no_gc = no_gc;
+  return expansion;
+}
+
+static void expand_cells(skeem_ctx_t *ctx, cons_t *cur)
+{
+  for (; cur != NULL; cur = cur->cdr) macro_expand(ctx, cur->car);
+}
+
+/*Expand the uses of macros throughout FORM, as far as the macros are known
+ *now. Quoted data, the parameters of lambdas and defines and the templates
+ *of macros are left alone.*/
+void macro_expand(skeem_ctx_t *ctx, object_t *form)
+{
+  if (!_LIST_P(form) || form == EMPTY_LIST) return;
+
+  bool no_gc = ctx->no_gc;
+  ctx->no_gc = true;
+
+  object_t *head = form->cell->car;
+  while (_SYMBOL_P(head)) {
+    object_t *val = env_lookup(ctx, head);
+
+    if (val == NULL || val->type != MACRO || form->heap != ctx->heap_id)
+      break;
+    macro_use(ctx, form, val);
+    head = form->cell->car;
+  }
+
+  cons_t *rest = form->cell->cdr;
+  if (symbol_is(head, "quote") || symbol_is(head, "syntax-rules") ||
+      symbol_is(head, "define-syntax")) {
+    rest = NULL;
+  } else if ((symbol_is(head, "lambda") || symbol_is(head, "define")) &&
+             rest != NULL) {
+    if (symbol_is(head, "define") && !_LIST_P(rest->car))
+      macro_expand(ctx, rest->car);
+    rest = rest->cdr;
+  } else {
+    macro_expand(ctx, head);
+  }
+  expand_cells(ctx, rest);
+
+  ctx->no_gc = no_gc;
+}
+
+static bool rules_valid(cons_t *rules)
+{
+  for (; rules != NULL; rules = rules->cdr) {
+    object_t *rule = rules->car;
+
+    if (!_LIST_P(rule) || length(cells(rule)) != 2 ||
+        !_LIST_P(rule->cell->car) || rule->cell->car == EMPTY_LIST)
+      return false;
+  }
+  return true;
+}
+
+/*(syntax-rules (literal ...) (pattern template) ...) is a macro*/
+object_t *syntax_rules(skeem_ctx_t *ctx, cons_t *args)
+{
+  if (args == NULL || !_LIST_P(args->car))
+    error("syntax-rules: Expected a list of literals\n");
+  if (!rules_valid(args->cdr))
+    error("syntax-rules: Each rule must be a pattern list and a template\n");
+
+  object_t *macro = obj_init(ctx, MACRO);
+  macro->macro = ERR_MALLOC(sizeof(struct macro));
+  macro->macro->literals = cells(args->car);
+  macro->macro->rules = args->cdr;
+  return macro;
+}
+
+/*(define-syntax keyword macro)*/
+object_t *define_syntax(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  if (!_SYMBOL_P(args->car))
+    error("define-syntax: Wrong argument type - %s (Expected symbol)\n",
+          types[args->car->type]);
+
+  object_t *macro = eval(ctx, args->cdr->car);
+  if (macro->type != MACRO)
+    error("define-syntax: Wrong argument type - %s (Expected macro)\n",
+          types[macro->type]);
+
+  env_insert(ctx, args->car, macro);
+  return macro;
+}
+
+void macro_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "syntax-rules", syntax_rules);
+  add_primitive(ctx, "define-syntax", define_syntax);
+}
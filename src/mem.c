@@ -23,16 +23,35 @@
 #include "mem.h"
 #include "types.h"
 #include "builtins.h"
+#include "hash.h"
+#include "future.h"
+#include "coroutine.h"
+#include "port.h"
+#include "str.h"
+#include "macro.h"
+#include "library.h"
+#include "fuel.h"
+#include "profile.h"
+#include "instrument.h"
+#include "trace.h"
+#include "jit.h"
+#include "aot.h"
 #include <stdio.h>
 #include <string.h>
 #include <setjmp.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <stdlib.h>
 
-static unsigned int max_obj = INIT_GC_THRESHOLD, num_obj;
-/*Stores all allocated objects. Used by sweep()*/
-static struct obj_list *heap = NULL, *heap_head = NULL;
-/*Pinned objects get marked every GC cycle*/
-static struct obj_list *pinned = NULL, *pin_head = NULL;
+/*Cons cells are carved out of blocks and recycled through a free list. They
+ *are shared between list objects (cdr and cons share tails), so they are
+ *swept separately from the objects that point to them.*/
+#define CONS_BLOCK_SIZE 1024
+struct cons_block {
+  struct cons_block *next;
+  cons_t cells[CONS_BLOCK_SIZE];
+};
 
 void *ERR_MALLOC(size_t bytes) {
   void *ptr = calloc(1, bytes);
@@ -44,90 +63,183 @@ void *ERR_MALLOC(size_t bytes) {
   return ptr;
 }
 
+/*The names of symbols, each stored once for the life of the process, so
+ *that names can be told apart by address. Shared by every context.*/
+static struct {
+  pthread_mutex_t lock;
+  char **slots;
+  size_t cap, len;
+} names = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0};
+
+static size_t name_slot(char **slots, size_t cap, const char *name) {
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (const char *c = name; *c != '\0'; c++)
+    hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+  size_t i = hash & (cap - 1);
+
+  while (slots[i] != NULL && strcmp(slots[i], name) != 0)
+    i = (i + 1) & (cap - 1);
+  return i;
+}
+
+/*The interned copy of NAME. It is never freed and mustn't be modified.*/
+char *symbol_intern(const char *name) {
+  pthread_mutex_lock(&names.lock);
+  if (2 * (names.len + 1) > names.cap) {
+    size_t cap = names.cap == 0 ? 1024 : 2 * names.cap;
+    char **slots = ERR_MALLOC(cap * sizeof(char *));
+
+    for (size_t i = 0; i < names.cap; i++)
+      if (names.slots[i] != NULL)
+        slots[name_slot(slots, cap, names.slots[i])] = names.slots[i];
+    free(names.slots);
+    names.slots = slots;
+    names.cap = cap;
+  }
+
+  size_t i = name_slot(names.slots, names.cap, name);
+  if (names.slots[i] == NULL) {
+    names.slots[i] = strdup(name);
+    if (names.slots[i] == NULL) {
+      perror("strdup");
+      exit(EXIT_FAILURE);
+    }
+    names.len++;
+  }
+  char *interned = names.slots[i];
+  pthread_mutex_unlock(&names.lock);
+  return interned;
+}
+
+/*A symbol named NAME. Every symbol is made here, so two symbols with the
+ *same name share its interned copy.*/
+object_t *symbol_new(skeem_ctx_t *ctx, const char *name) {
+  object_t *sym = obj_init(ctx, SYMBOL);
+
+  sym->string = symbol_intern(name);
+  sym->borrowed = true;
+  return sym;
+}
+
 struct obj_list *obj_list_init() {
   struct obj_list *n = ERR_MALLOC(sizeof(struct obj_list));
   return n;
 }
 
-void pin(object_t *obj) {
-#ifdef DEBUG
-  printf("Pinned object\n");
-#endif
-  if (pinned == NULL) {
-    pinned = obj_list_init();
-    pin_head = pinned;
-  } else {
-    pin_head->next = obj_list_init();
-    pin_head->next->prev = pin_head;
-    pin_head = pin_head->next;
+void pin(skeem_ctx_t *ctx, object_t *obj) {
+  if (ctx->num_pinned == ctx->max_pinned) {
+    ctx->max_pinned = ctx->max_pinned == 0 ? 64 : ctx->max_pinned * 2;
+    ctx->pinned = realloc(ctx->pinned, ctx->max_pinned * sizeof(object_t *));
+
+    if (ctx->pinned == NULL) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
   }
 
-  pin_head->val = obj;
+  ctx->pinned[ctx->num_pinned++] = obj;
 }
 
-void unpin_head() {
-#ifdef DEBUG
-  printf("Unpinned head.\n");
-#endif
-
-  pin_head->val->marked = false;
-  if (pin_head != pinned) {
-    pin_head = pin_head->prev;
-    free(pin_head->next);
-  }
+void unpin_head(skeem_ctx_t *ctx) {
+  ctx->num_pinned--;
+}
 
-  else { /*The only pinned object is unpinned*/
-    free(pinned);
-    pin_head = NULL;
-    pinned = NULL;
+cons_t *cons_init(skeem_ctx_t *ctx) {
+  if (ctx->free_cells == NULL) {
+    struct cons_block *block = ERR_MALLOC(sizeof(struct cons_block));
+    /*The caller may hold unreachable objects, so this never collects*/
+    ctx->new_bytes += sizeof(struct cons_block);
+    block->next = ctx->cons_blocks;
+    ctx->cons_blocks = block;
+
+    for (size_t i = 0; i < CONS_BLOCK_SIZE; i++) {
+      block->cells[i].cdr = ctx->free_cells;
+      ctx->free_cells = &block->cells[i];
+    }
   }
-}
 
-cons_t *cons_init() {
-  cons_t *cell = ERR_MALLOC(sizeof(cons_t));
+  cons_t *cell = ctx->free_cells;
+  ctx->free_cells = cell->cdr;
   cell->car = NULL;
   cell->cdr = NULL;
+  cell->used = true;
+  cell->marked = false;
+  cell->heap = ctx->heap_id;
+  atomic_init(&cell->seen, 0);
 
   return cell;
 }
 
-void cons_free(cons_t *cell) {
-  cons_t *curr = cell;
+/*Return a single cell that is known to be unreachable to the free list*/
+void cons_free(skeem_ctx_t *ctx, cons_t *cell) {
+  cell->used = false;
+  cell->car = NULL;
+  cell->cdr = ctx->free_cells;
+  ctx->free_cells = cell;
+}
+
+/*Initialize the heap, root environment, and pinned list*/
+void mem_init(skeem_ctx_t *ctx) {
+  ctx->max_obj = INIT_GC_THRESHOLD;
+  ctx->heap = ERR_MALLOC(sizeof(struct obj_list));
+  ctx->heap_head = ctx->heap;
+
+  ctx->env_global = ERR_MALLOC(sizeof(object_t));
+  ctx->env_global->env = ERR_MALLOC(sizeof(struct env));
+  ctx->env_global->env->tree = ERR_MALLOC(sizeof(struct bind_tree));
+  ctx->env_head = ctx->env_global;
+  ctx->env_base = ctx->env_global;
+}
+
+void bind_tree_free(struct bind_tree *tree);
+
+/*Free the heap, root environment and pinned list of CTX*/
+void mem_free(skeem_ctx_t *ctx) {
+  struct obj_list *curr = ctx->heap;
 
   while (curr != NULL) {
-    obj_free(curr->car);
-    curr = curr->cdr;
+    struct obj_list *next = curr->next;
+    if (curr->val != NULL) obj_free(curr->val);
+    free(curr);
+    curr = next;
   }
-}
 
-/*Initialize the heap, root environment, and pinned list*/
-void mem_init() {
-  heap = ERR_MALLOC(sizeof(struct obj_list));
-  heap_head = heap;
+  while (ctx->cons_blocks != NULL) {
+    struct cons_block *next = ctx->cons_blocks->next;
+    free(ctx->cons_blocks);
+    ctx->cons_blocks = next;
+  }
 
-  env_global = ERR_MALLOC(sizeof(object_t));
-  env_global->env = ERR_MALLOC(sizeof(struct env));
-  env_global->env->tree = ERR_MALLOC(sizeof(struct bind_tree));
-  env_head = env_global;
+  bind_tree_free(ctx->env_global->env->tree);
+  free(ctx->env_global->env);
+  free(ctx->env_global);
+  free(ctx->pinned);
+  free(ctx->roots);
 }
 
-object_t *obj_init(type_t type)
+object_t *obj_init(skeem_ctx_t *ctx, type_t type)
 {
-  if (num_obj >= max_obj && !no_gc) gc();
+  /*Allocation is a step only where a collection could run, as that is
+   *where the caller's state is consistent enough to unwind from*/
+  if (!ctx->no_gc) {
+    fuel_step(ctx);
+    if (ctx->num_obj >= ctx->max_obj) gc(ctx);
+  }
+  mem_reserve(ctx, sizeof(object_t) + sizeof(struct obj_list));
+#ifdef INSTRUMENT
+  instrument_alloc(ctx);
+#endif
 
   object_t *obj = ERR_MALLOC(sizeof(object_t));
   obj->type = type;
   obj->marked = false;
+  obj->heap = ctx->heap_id;
 
-  if (type == SYMBOL) {
-    num_obj += 1;
-    return obj;
-  }
-
-  heap_head->val = obj;
-  heap_head->next = obj_list_init();
-  heap_head->next->prev = heap_head;
-  heap_head = heap_head->next;
+  ctx->heap_head->val = obj;
+  ctx->heap_head->next = obj_list_init();
+  ctx->heap_head->next->prev = ctx->heap_head;
+  ctx->heap_head = ctx->heap_head->next;
 
   if (type == ENVIRONMENT) {
     obj->env = ERR_MALLOC(sizeof(struct env));
@@ -138,8 +250,10 @@ object_t *obj_init(type_t type)
   }
   else if (type == CLOSURE)
     obj->closure = ERR_MALLOC(sizeof(closure_t));
+  else if (type == FOREIGN)
+    obj->foreign = ERR_MALLOC(sizeof(foreign_t));
 
-  num_obj += 1;
+  ctx->num_obj += 1;
   return obj;
 }
 
@@ -148,125 +262,292 @@ void bind_tree_free(struct bind_tree *tree)
   if (tree != NULL) { 
     bind_tree_free(tree->left);
     struct bind_tree *right = tree->right;
-    free(tree->symbol);
+    /*Symbols are shared with the forms that bound them, so only the nodes
+     *are freed*/
     free(tree);
     bind_tree_free(right);
   }
 }
 
+/*The parameter list of a procedure belongs to the form that defined it*/
 void free_procedure(procedure_t *proc)
 {
+  jit_free(proc);
   free(proc->name);
-  free(proc->params);
+  free(proc);
 }
 
 void obj_free(object_t *obj)
 {
-#ifdef DEBUG
-  printf("freed ");
-  print_obj(obj, stdout);
-  printf("\n");
-#endif
   switch (obj->type) {
     case ENVIRONMENT:
-      bind_tree_free(obj->env->tree);
+      if (obj->env->shared == NULL) bind_tree_free(obj->env->tree);
+      free(obj->env);
       break;
     case STRING:
+      if (!obj->borrowed) str_free(obj->string);
+      break;
     case SYMBOL:
-      free(obj->string);
+      if (!obj->borrowed) free(obj->string);
       break;
-    case LIST:
-      free(obj->cell);
+    case VECTOR:
+      free(obj->vector);
+      break;
+    case F64VECTOR:
+    case S64VECTOR:
+      if (!obj->borrowed) free(obj->numvector->f64);
+      free(obj->numvector);
+      break;
+    case HASH_TABLE:
+      hash_table_free(obj->table);
       break;
     case PROCEDURE:
       free_procedure(obj->procedure);
-      free(obj->procedure->name);
-      free(obj->procedure->params);
+      break;
+    case FUTURE:
+      future_free(obj->task);
+      break;
+    case COROUTINE:
+      coroutine_unref(obj->coroutine);
+      break;
+    case CHANNEL:
+      free(obj->channel);
+      break;
+    case PORT:
+      port_unref(obj->port);
+      break;
+    case MACRO:
+      /*The literals and rules belong to the syntax-rules form*/
+      free(obj->macro);
+      break;
+    case FOREIGN:
+      free(obj->foreign->name);
+      free(obj->foreign);
       break;
     case CLOSURE:
-      free_procedure(obj->closure->proc->procedure);
-      bind_tree_free(obj->closure->env->env->tree);
+      /*The procedure and environment are collected separately*/
+      free(obj->closure);
     default:
       break;
   }
   free(obj);
 }
 
-void mark_list(cons_t *cur);
-void mark_bind_tree(struct bind_tree *tree);
-void mark(object_t *obj)
+void mark_list(skeem_ctx_t *ctx, cons_t *cur);
+void mark_bind_tree(skeem_ctx_t *ctx, struct bind_tree *tree);
+void mark(skeem_ctx_t *ctx, object_t *obj)
 {
-  if (obj->marked) return;
+  /*Objects of other heaps are shared with a running task, and belong to
+   *their owner's GC*/
+  if (obj->marked || obj->heap != ctx->heap_id) return;
 
   obj->marked = true;
 
   switch (obj->type) {
     case LIST:
-      mark_list(obj->cell);
+      mark_list(ctx, obj->cell);
       return;
     case PROCEDURE:
-      mark_list(obj->procedure->params);
-      mark(obj->procedure->body);
+      mark_list(ctx, obj->procedure->params);
+      mark(ctx, obj->procedure->body);
       return;
     case CLOSURE:
-      mark(obj->closure->proc);
-      mark(obj->closure->env);
+      mark(ctx, obj->closure->proc);
+      mark(ctx, obj->closure->env);
       return;
     case ENVIRONMENT:
-      mark_bind_tree(obj->env->tree);
+      mark_bind_tree(ctx, obj->env->tree);
+      if (obj->env->shared != NULL) mark(ctx, obj->env->shared);
+      return;
+    case VECTOR:
+      for (size_t i = 0; i < obj->vector->len; i++)
+        if (obj->vector->items[i] != NULL) mark(ctx, obj->vector->items[i]);
+      return;
+    case FUTURE:
+      mark_future(ctx, obj->task);
+      return;
+    case COROUTINE:
+      mark_coroutine(ctx, obj->coroutine);
+      return;
+    case CHANNEL:
+      mark_channel(ctx, obj->channel);
+      return;
+    case HASH_TABLE:
+      mark_hash_table(ctx, obj->table);
+      return;
+    case MACRO:
+      mark_list(ctx, obj->macro->literals);
+      mark_list(ctx, obj->macro->rules);
+      return;
     default:
       return;
   }
 }
 
-void mark_list(cons_t *cell)
+void mark_list(skeem_ctx_t *ctx, cons_t *cell)
 {
-  if (cell->car ==  NULL) /*Empty list*/
-    return;
-  cons_t *cur = cell;
-  while (cur != NULL) {
-    mark(cur->car);
-    cur = cur->cdr;
+  for (cons_t *cur = cell; cur != NULL; cur = cur->cdr) {
+    /*The rest of a shared tail has been marked already, or belongs to
+     *another heap*/
+    if (cur->marked || cur->heap != ctx->heap_id) return;
+    cur->marked = true;
+
+    if (cur->car != NULL) mark(ctx, cur->car);
   }
 }
 
-void mark_bind_tree(struct bind_tree *tree)
+void mark_bind_tree(skeem_ctx_t *ctx, struct bind_tree *tree)
 {
-  if (tree != NULL) {
-    mark_bind_tree(tree->left);
-    mark(tree->symbol);
-    mark(tree->val);
-    mark_bind_tree(tree->right);
+  /*The root of an empty tree has no symbol*/
+  if (tree != NULL && tree->symbol != NULL) {
+    mark_bind_tree(ctx, tree->left);
+    mark(ctx, tree->symbol);
+    mark(ctx, tree->val);
+    mark_bind_tree(ctx, tree->right);
   }
 }
 
-void mark_all() {
-  object_t *cur = env_global;
-
+/*Mark the environments pushed on top of CUR*/
+void mark_env_chain(skeem_ctx_t *ctx, object_t *cur) {
   while (cur != NULL) {
     if (cur->env->tree->symbol != NULL) /*tree isnt empty*/
-      mark_bind_tree(cur->env->tree);
+      mark_bind_tree(ctx, cur->env->tree);
     cur->marked = true;
+    if (cur->env->shared != NULL) mark(ctx, cur->env->shared);
     cur = cur->env->next;
   }
+}
+
+void mark_all(skeem_ctx_t *ctx) {
+  mark_env_chain(ctx, ctx->env_global);
 
   /*mark all pinned objects*/
-  struct obj_list *cur_pin = pinned;
-  if (pinned == NULL) return;
+  for (size_t i = 0; i < ctx->num_pinned; i++)
+    if (ctx->pinned[i] != NULL) mark(ctx, ctx->pinned[i]);
 
-  if (cur_pin->val == NULL) {
-    while (cur_pin != NULL) {
-      mark(cur_pin->val);
-      cur_pin = cur_pin->next;
+  for (size_t i = 0; i < ctx->num_roots; i++)
+    if (ctx->roots[i] != NULL) mark(ctx, ctx->roots[i]);
+
+  mark_coroutines(ctx);
+  mark_libraries(ctx);
+
+  if (ctx->input_port != NULL) mark(ctx, ctx->input_port);
+  if (ctx->output_port != NULL) mark(ctx, ctx->output_port);
+}
+
+static size_t tree_size(struct bind_tree *tree)
+{
+  if (tree == NULL) return 0;
+  return sizeof(struct bind_tree) + tree_size(tree->left) +
+         tree_size(tree->right);
+}
+
+/*Bytes held by OBJ: the object, its node in the heap list and whatever it
+ *owns. Cons cells are counted separately, as they may be shared.*/
+size_t obj_size(object_t *obj)
+{
+  size_t size = sizeof(object_t) + sizeof(struct obj_list);
+
+  switch (obj->type) {
+    case ENVIRONMENT:
+      size += sizeof(struct env);
+      if (obj->env->shared == NULL) size += tree_size(obj->env->tree);
+      break;
+    case STRING:
+      if (!obj->borrowed)
+        size += sizeof(struct str_header) + STR_HEADER(obj->string)->cap + 1;
+      break;
+    case SYMBOL:
+      if (!obj->borrowed) size += strlen(obj->string) + 1;
+      break;
+    case VECTOR:
+      size += sizeof(struct vector) + obj->vector->len * sizeof(object_t *);
+      break;
+    case F64VECTOR:
+    case S64VECTOR:
+      size += sizeof(struct numvector);
+      if (!obj->borrowed) size += obj->numvector->len * sizeof(double);
+      break;
+    case HASH_TABLE:
+      size += sizeof(struct hash_table) +
+              obj->table->cap * sizeof(struct hash_entry);
+      break;
+    case PROCEDURE:
+      size += sizeof(procedure_t);
+      break;
+    case CLOSURE:
+      size += sizeof(closure_t);
+      break;
+    case FOREIGN:
+      size += sizeof(foreign_t);
+      break;
+    default:
+      break;
+  }
+  return size;
+}
+
+/*Add up the bytes held by each type of object on the heap, counting the
+ *global environment's bindings as an environment, and by the cons cells in
+ *use*/
+void heap_usage(skeem_ctx_t *ctx, size_t *by_type, size_t *cells)
+{
+  for (struct obj_list *curr = ctx->heap; curr->val != NULL;
+       curr = curr->next)
+    by_type[curr->val->type] += obj_size(curr->val);
+  by_type[ENVIRONMENT] += tree_size(ctx->env_global->env->tree);
+
+  *cells = 0;
+  for (struct cons_block *block = ctx->cons_blocks; block != NULL;
+       block = block->next)
+    for (size_t i = 0; i < CONS_BLOCK_SIZE; i++)
+      if (block->cells[i].used) *cells += sizeof(cons_t);
+}
+
+/*Charge BYTES, about to be allocated, to the heap. Over the ceiling, a full
+ *collection is tried before giving up with an error. Where no collection
+ *may run, going over is only noticed by the next allocation where one may.*/
+void mem_reserve(skeem_ctx_t *ctx, size_t bytes)
+{
+  ctx->new_bytes += bytes;
+  if (ctx->max_bytes == 0 || ctx->no_gc ||
+      ctx->live_bytes + ctx->new_bytes <= ctx->max_bytes)
+    return;
+
+  ctx->new_bytes -= bytes;
+  gc(ctx);
+  if (ctx->live_bytes + ctx->new_bytes + bytes > ctx->max_bytes)
+    error("Out of memory: heap limit of %zu bytes reached\n",
+          ctx->max_bytes);
+  ctx->new_bytes += bytes;
+}
+
+void sweep_cons(skeem_ctx_t *ctx) {
+  for (struct cons_block *block = ctx->cons_blocks; block != NULL;
+       block = block->next) {
+    ctx->live_bytes += sizeof(struct cons_block);
+    for (size_t i = 0; i < CONS_BLOCK_SIZE; i++) {
+      cons_t *cell = &block->cells[i];
+
+      if (!cell->used) continue;
+      if (cell->marked)
+        cell->marked = false;
+      else
+        cons_free(ctx, cell);
     }
   }
 }
 
-void sweep() {
-  struct obj_list *curr = heap, *prev = NULL;
+void sweep(skeem_ctx_t *ctx) {
+  struct obj_list *curr = ctx->heap, *prev = NULL;
+  size_t live = tree_size(ctx->env_global->env->tree);
 
   while (curr->val != NULL) {
     if (!curr->val->marked) {
+#ifdef INSTRUMENT
+      if (curr->val->type == PROCEDURE)
+        instrument_retire(ctx, curr->val->procedure);
+#endif
       obj_free(curr->val);
 
       if (prev != NULL) {
@@ -275,32 +556,51 @@ void sweep() {
         curr = prev->next;
       } else {
         /*the first object on the heap is being freed*/
-        heap = heap->next;
+        ctx->heap = ctx->heap->next;
         free(curr);
-        curr = heap;
+        curr = ctx->heap;
       }
-      num_obj--;
+      ctx->num_obj--;
     } else {
       curr->val->marked = false;
+      live += obj_size(curr->val);
       prev = curr;
       curr = curr->next;
     }
   }
+  ctx->live_bytes = live;
+  ctx->new_bytes = 0;
 }
 
-void gc() {
-#ifdef DEBUG
-  printf("Started GC cycle\n");
-#endif
+void gc(skeem_ctx_t *ctx) {
+  /*Running futures may read any object here. Collection waits until they
+   *are done.*/
+  if (!futures_settle(ctx)) {
+    ctx->max_obj = ctx->num_obj * 2;
+    return;
+  }
 
-  mark_all();
-  sweep();
-  max_obj = num_obj * 2;
+#ifdef INSTRUMENT
+  instrument_gc(ctx);
+#endif
+  uint64_t start = trace_begin();
+  mark_all(ctx);
+  trace_end(TRACE_MARK, start);
+
+  uint64_t swept = trace_begin();
+  sweep(ctx);
+  sweep_cons(ctx);
+  trace_end(TRACE_SWEEP, swept);
+  trace_end(TRACE_GC, start);
+  ctx->max_obj = ctx->num_obj * 2;
 }
 
-void tree_insert(struct bind_tree *tree, object_t *symbol, object_t *val) {
+void tree_insert(skeem_ctx_t *ctx, struct bind_tree *tree, object_t *symbol,
+                 object_t *val) {
   struct bind_tree *y = NULL, *x = tree;
 
+  jit_bind(ctx, symbol, val);
+  aot_bind(ctx, symbol, val);
   if (tree->symbol != NULL) { /*tree isnt empty*/
     while (x != NULL) {
       y = x;
@@ -332,13 +632,49 @@ void tree_insert(struct bind_tree *tree, object_t *symbol, object_t *val) {
     y->right = new;
 }
 
-inline void env_insert(object_t *symbol, object_t *val) {
-  tree_insert(env_head->env->prev->env->tree, symbol, val);
+inline void env_insert(skeem_ctx_t *ctx, object_t *symbol, object_t *val) {
+  env_modify(ctx, ctx->env_head->env->prev);
+  tree_insert(ctx, ctx->env_head->env->prev->env->tree, symbol, val);
+}
+
+static void tree_copy(skeem_ctx_t *ctx, struct bind_tree *to,
+                      struct bind_tree *from) {
+  if (from != NULL && from->symbol != NULL) {
+    tree_insert(ctx, to, from->symbol, from->val);
+    tree_copy(ctx, to, from->left);
+    tree_copy(ctx, to, from->right);
+  }
+}
+
+/*A new environment object holding the bindings of ENV*/
+object_t *env_copy(skeem_ctx_t *ctx, object_t *env) {
+  object_t *copy = obj_init(ctx, ENVIRONMENT);
+  tree_copy(ctx, copy->env->tree, env->env->tree);
+  return copy;
+}
+
+/*A new environment object sharing the bindings of ENV, so that they can be
+ *linked into more than one environment chain at a time*/
+object_t *env_view(skeem_ctx_t *ctx, object_t *env) {
+  pin(ctx, env);
+  object_t *view = obj_init(ctx, ENVIRONMENT);
+  unpin_head(ctx);
+
+  free(view->env->tree);
+  view->env->tree = env->env->tree;
+  view->env->shared = env;
+  return view;
+}
+
+void global_insert(skeem_ctx_t *ctx, object_t *symbol, object_t *val) {
+  env_modify(ctx, ctx->env_global);
+  tree_insert(ctx, ctx->env_global->env->tree, symbol, val);
 }
 
 /**/
-inline void arg_insert(object_t *symbol, object_t *val) {
-  tree_insert(env_head->env->tree, symbol, val);
+inline void arg_insert(skeem_ctx_t *ctx, object_t *symbol, object_t *val) {
+  env_modify(ctx, ctx->env_head);
+  tree_insert(ctx, ctx->env_head->env->tree, symbol, val);
 }
 
 struct bind_tree *tree_lookup(struct bind_tree *tree, object_t *symbol) {
@@ -357,30 +693,64 @@ struct bind_tree *tree_lookup(struct bind_tree *tree, object_t *symbol) {
   return tree == NULL ? NULL : tree;
 }
 
-object_t *env_lookup(object_t *symbol) {
+object_t *env_lookup(skeem_ctx_t *ctx, object_t *symbol) {
   struct bind_tree *bind = NULL;
-  object_t *cur = env_head;
+  object_t *cur = ctx->env_head;
 
   while (bind == NULL && cur != NULL) {
     bind = tree_lookup(cur->env->tree, symbol);
     cur = cur->env->prev;
   }
 
-  bind = bind == NULL ? tree_lookup(env_head->env->tree, symbol) : bind;
+  for (skeem_ctx_t *c = ctx; bind == NULL && c->parent != NULL; c = c->parent)
+    for (cur = c->env_shared; bind == NULL && cur != NULL;
+         cur = cur->env->prev)
+      bind = tree_lookup(cur->env->tree, symbol);
+
+  bind = bind == NULL ? tree_lookup(ctx->env_head->env->tree, symbol) : bind;
 
   return bind == NULL ? NULL : bind->val;
 }
 
-struct bind_tree *env_lookup_node(object_t *symbol) {
+/*The binding of SYMBOL in the chain of CTX, and in *ENV the environment
+ *holding it*/
+struct bind_tree *env_lookup_node(skeem_ctx_t *ctx, object_t *symbol,
+                                  object_t **env) {
   struct bind_tree *bind = NULL;
-  object_t *cur = env_head->env->prev;
+  object_t *cur = ctx->env_head->env->prev;
 
   while (bind == NULL && cur != NULL) {
     bind = tree_lookup(cur->env->tree, symbol);
+    *env = cur;
     cur = cur->env->prev;
   }
 
-  return bind == NULL ? tree_lookup(env_head->env->tree, symbol) : bind;
+  if (bind == NULL) {
+    bind = tree_lookup(ctx->env_head->env->tree, symbol);
+    *env = ctx->env_head;
+  }
+  return bind;
+}
+
+/*Mark the chain ending at ENV as seen by a future's task that is starting,
+ *along with the environments whose bindings its views share*/
+void env_fork(object_t *env) {
+  for (; env != NULL; env = env->env->prev)
+    for (object_t *cur = env; cur != NULL; cur = cur->env->shared)
+      cur->env->forked = true;
+}
+
+/*True if a future's task may be reading the bindings of ENV*/
+bool env_forked(object_t *env) {
+  for (; env != NULL; env = env->env->shared)
+    if (env->env->forked) return true;
+  return false;
+}
+
+/*Called before CTX changes the bindings or links of ENV. If its running
+ *futures may be reading them, wait for those to finish first.*/
+void env_modify(skeem_ctx_t *ctx, object_t *env) {
+  if (ctx->futures != NULL && env_forked(env)) futures_join(ctx);
 }
 
 void print_obj_list(struct obj_list *list) {
@@ -417,35 +787,43 @@ void print_obj_list(struct obj_list *list) {
   }
 }
 
-void print_heap() {
+void print_heap(skeem_ctx_t *ctx) {
   printf("Current heap: \n");
-  print_obj_list(heap);
+  print_obj_list(ctx->heap);
 }
 
-void print_pinned() {
+void print_pinned(skeem_ctx_t *ctx) {
   printf("Pinned objects: \n");
-  print_obj_list(pinned);
+  for (size_t i = 0; i < ctx->num_pinned; i++) {
+    print_obj(ctx->pinned[i], stdout);
+    putchar('\n');
+  }
 }
 
-void env_push() {
-  env_head->env->next = obj_init(ENVIRONMENT);
-  env_head->env->next->env->prev = env_head;
-  env_head = env_head->env->next;
-  env_head->marked = true;
+void env_push(skeem_ctx_t *ctx) {
+  trace_instant(TRACE_ENV_PUSH);
+  ctx->env_head->env->next = obj_init(ctx, ENVIRONMENT);
+  ctx->env_head->env->next->env->prev = ctx->env_head;
+  ctx->env_head = ctx->env_head->env->next;
 }
 
-inline void env_pop() {
-  env_head = env_head->env->prev;
-  env_head->env->next = NULL;
+inline void env_pop(skeem_ctx_t *ctx) {
+  trace_instant(TRACE_ENV_POP);
+  ctx->env_head = ctx->env_head->env->prev;
+  ctx->env_head->env->next = NULL;
 }
 
 #if GCC_VERSION >= 40700
 _Noreturn
 #endif
 void
-goto_top() {
-  while (env_head->env->prev != NULL) env_pop();
-  while (pinned != NULL) unpin_head();
-  
-  longjmp(err, 1);
+goto_top(skeem_ctx_t *ctx) {
+  while (ctx->env_head != ctx->env_base) {
+    while (ctx->frames != NULL && ctx->frames->env == ctx->env_head)
+      frame_pop(ctx, ctx->frames);
+    env_pop(ctx);
+  }
+  ctx->num_pinned = ctx->pin_base;
+
+  longjmp(ctx->err, 1);
 }
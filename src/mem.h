@@ -25,11 +25,9 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "types.h"
+#include "context.h"
 #include <setjmp.h>
 
-bool no_gc;
-jmp_buf err;
-
 /*Binary tree for symbol table*/
 struct bind_tree {
   object_t *symbol;
@@ -44,29 +42,65 @@ struct env {
   struct bind_tree *tree;
   object_t *next;
   object_t *prev;
+  /*For a view, the environment whose bindings it shares*/
+  object_t *shared;
+  /*Whether a future's task was started while this was in the chain, and so
+   *may be reading it*/
+  bool forked;
 };
 
-object_t *env_global, *env_head;
-
-extern cons_t *cons_init();
-extern void cons_free(cons_t *cell);
-extern object_t *obj_init(type_t type);
+extern cons_t *cons_init(skeem_ctx_t *ctx);
+extern void cons_free(skeem_ctx_t *ctx, cons_t *cell);
+extern object_t *obj_init(skeem_ctx_t *ctx, type_t type);
+extern char *symbol_intern(const char *name);
+extern object_t *symbol_new(skeem_ctx_t *ctx, const char *name);
 extern void obj_free(object_t *obj);
-extern void pin(object_t *obj);
-extern void unpin_head();
-extern void print_heap();
-extern void print_pinned();
-extern void mem_init();
-extern void env_push();
-extern void env_pop();
-extern void goto_top();
-extern void env_insert(struct _object_t *sym, struct _object_t *val);
-extern void arg_insert(struct _object_t *sym, struct _object_t *val);
-extern struct bind_tree *env_lookup_node(object_t *symbol);
-extern struct _object_t *env_lookup(struct _object_t *sym);
-extern struct _object_t *arg_lookup(struct _object_t *sym);
-extern void gc();
-extern void mark();
+extern void pin(skeem_ctx_t *ctx, object_t *obj);
+extern void unpin_head(skeem_ctx_t *ctx);
+extern void print_heap(skeem_ctx_t *ctx);
+extern void print_pinned(skeem_ctx_t *ctx);
+extern void mem_init(skeem_ctx_t *ctx);
+extern void mem_free(skeem_ctx_t *ctx);
+extern void env_push(skeem_ctx_t *ctx);
+extern void env_pop(skeem_ctx_t *ctx);
+#if GCC_VERSION >= 40700
+_Noreturn
+#endif
+extern void goto_top(skeem_ctx_t *ctx);
+extern void env_insert(skeem_ctx_t *ctx, struct _object_t *sym,
+                       struct _object_t *val);
+extern void arg_insert(skeem_ctx_t *ctx, struct _object_t *sym,
+                       struct _object_t *val);
+extern void global_insert(skeem_ctx_t *ctx, struct _object_t *sym,
+                          struct _object_t *val);
+extern struct bind_tree *env_lookup_node(skeem_ctx_t *ctx, object_t *symbol,
+                                         object_t **env);
+extern void env_fork(object_t *env);
+extern bool env_forked(object_t *env);
+extern void env_modify(skeem_ctx_t *ctx, object_t *env);
+extern struct _object_t *env_lookup(skeem_ctx_t *ctx, struct _object_t *sym);
+extern struct _object_t *arg_lookup(skeem_ctx_t *ctx, struct _object_t *sym);
+extern struct bind_tree *tree_lookup(struct bind_tree *tree,
+                                     object_t *symbol);
+extern void tree_insert(skeem_ctx_t *ctx, struct bind_tree *tree,
+                        object_t *symbol, object_t *val);
+extern object_t *env_copy(skeem_ctx_t *ctx, object_t *env);
+extern object_t *env_view(skeem_ctx_t *ctx, object_t *env);
+extern void gc(skeem_ctx_t *ctx);
+extern void mem_reserve(skeem_ctx_t *ctx, size_t bytes);
+extern size_t obj_size(object_t *obj);
+extern void heap_usage(skeem_ctx_t *ctx, size_t *by_type, size_t *cells);
+extern void mark(skeem_ctx_t *ctx, object_t *obj);
+extern void mark_list(skeem_ctx_t *ctx, cons_t *cell);
+extern void mark_env_chain(skeem_ctx_t *ctx, object_t *env);
+
+/*True if OBJ belongs to another heap. A future's task shares its parent's
+ *data, but mustn't modify it: nothing orders the task's writes against the
+ *parent's or other tasks', and the parent's GC can't see the task's objects
+ *stored there.*/
+static inline bool foreign_p(skeem_ctx_t *ctx, object_t *obj) {
+  return obj->heap != ctx->heap_id;
+}
 
 #ifdef emalloc
 #define ERR_MALLOC err_malloc
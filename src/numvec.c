@@ -0,0 +1,675 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*SRFI-4 style homogeneous vectors. Elements are stored unboxed in a single
+ *aligned buffer, and the bulk operations below work on the raw arrays. The
+ *floating point reductions are written with SSE2/AVX intrinsics, since the
+ *compiler may not reorder them into vector code itself; the remaining
+ *kernels are plain loops left to the auto-vectorizer. Note that the vector
+ *reductions sum in a different order than a left fold would.*/
+
+#include "numvec.h"
+#include "types.h"
+#include "mem.h"
+#include "builtins.h"
+#include "future.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+typedef __m256d vf64_t;
+#define VF64_LANES 4
+#define vf64_zero() _mm256_setzero_pd()
+#define vf64_load(p) _mm256_loadu_pd((p))
+#define vf64_store(p, v) _mm256_storeu_pd((p), (v))
+#define vf64_set1(x) _mm256_set1_pd((x))
+#define vf64_add(a, b) _mm256_add_pd((a), (b))
+#define vf64_mul(a, b) _mm256_mul_pd((a), (b))
+#define vf64_min(a, b) _mm256_min_pd((a), (b))
+#define vf64_max(a, b) _mm256_max_pd((a), (b))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128d vf64_t;
+#define VF64_LANES 2
+#define vf64_zero() _mm_setzero_pd()
+#define vf64_load(p) _mm_loadu_pd((p))
+#define vf64_store(p, v) _mm_storeu_pd((p), (v))
+#define vf64_set1(x) _mm_set1_pd((x))
+#define vf64_add(a, b) _mm_add_pd((a), (b))
+#define vf64_mul(a, b) _mm_mul_pd((a), (b))
+#define vf64_min(a, b) _mm_min_pd((a), (b))
+#define vf64_max(a, b) _mm_max_pd((a), (b))
+#endif
+
+#define NUMVEC_ALIGN 32
+#define PREFIX(type) ((type) == F64VECTOR ? "f64vector" : "s64vector")
+
+#ifdef VF64_LANES
+/*Fold the lanes of V with OP*/
+static inline double vf64_reduce(vf64_t v, char op) {
+  double lanes[VF64_LANES];
+  vf64_store(lanes, v);
+
+  double acc = lanes[0];
+  for (int i = 1; i < VF64_LANES; i++) {
+    if (op == '+') acc += lanes[i];
+    else if (op == '<') acc = lanes[i] < acc ? lanes[i] : acc;
+    else acc = lanes[i] > acc ? lanes[i] : acc;
+  }
+  return acc;
+}
+#endif
+
+double f64_sum(const double *restrict x, size_t n) {
+  size_t i = 0;
+  double sum = 0;
+#ifdef VF64_LANES
+  /*Two accumulators hide the latency of the adds*/
+  vf64_t acc0 = vf64_zero(), acc1 = vf64_zero();
+
+  for (; i + 2 * VF64_LANES <= n; i += 2 * VF64_LANES) {
+    acc0 = vf64_add(acc0, vf64_load(x + i));
+    acc1 = vf64_add(acc1, vf64_load(x + i + VF64_LANES));
+  }
+  sum = vf64_reduce(vf64_add(acc0, acc1), '+');
+#endif
+  for (; i < n; i++) sum += x[i];
+  return sum;
+}
+
+double f64_dot(const double *restrict x, const double *restrict y, size_t n) {
+  size_t i = 0;
+  double sum = 0;
+#ifdef VF64_LANES
+  vf64_t acc0 = vf64_zero(), acc1 = vf64_zero();
+
+  for (; i + 2 * VF64_LANES <= n; i += 2 * VF64_LANES) {
+    acc0 = vf64_add(acc0, vf64_mul(vf64_load(x + i), vf64_load(y + i)));
+    acc1 = vf64_add(acc1, vf64_mul(vf64_load(x + i + VF64_LANES),
+                                   vf64_load(y + i + VF64_LANES)));
+  }
+  sum = vf64_reduce(vf64_add(acc0, acc1), '+');
+#endif
+  for (; i < n; i++) sum += x[i] * y[i];
+  return sum;
+}
+
+/*N must be non-zero*/
+double f64_min(const double *restrict x, size_t n) {
+  size_t i = 0;
+  double min = x[0];
+#ifdef VF64_LANES
+  if (n >= VF64_LANES) {
+    vf64_t acc = vf64_load(x);
+    for (i = VF64_LANES; i + VF64_LANES <= n; i += VF64_LANES)
+      acc = vf64_min(acc, vf64_load(x + i));
+    min = vf64_reduce(acc, '<');
+  }
+#endif
+  for (; i < n; i++) min = x[i] < min ? x[i] : min;
+  return min;
+}
+
+/*N must be non-zero*/
+double f64_max(const double *restrict x, size_t n) {
+  size_t i = 0;
+  double max = x[0];
+#ifdef VF64_LANES
+  if (n >= VF64_LANES) {
+    vf64_t acc = vf64_load(x);
+    for (i = VF64_LANES; i + VF64_LANES <= n; i += VF64_LANES)
+      acc = vf64_max(acc, vf64_load(x + i));
+    max = vf64_reduce(acc, '>');
+  }
+#endif
+  for (; i < n; i++) max = x[i] > max ? x[i] : max;
+  return max;
+}
+
+void f64_axpy(double a, const double *restrict x, double *restrict y,
+              size_t n) {
+  for (size_t i = 0; i < n; i++) y[i] += a * x[i];
+}
+
+void f64_add(const double *restrict x, const double *restrict y,
+             double *restrict out, size_t n) {
+  for (size_t i = 0; i < n; i++) out[i] = x[i] + y[i];
+}
+
+void f64_mul(const double *restrict x, const double *restrict y,
+             double *restrict out, size_t n) {
+  for (size_t i = 0; i < n; i++) out[i] = x[i] * y[i];
+}
+
+void f64_scale(double a, double *restrict x, size_t n) {
+  for (size_t i = 0; i < n; i++) x[i] *= a;
+}
+
+/*Integer arithmetic wraps around on overflow, hence the unsigned casts*/
+int64_t s64_sum(const int64_t *restrict x, size_t n) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < n; i++) sum += (uint64_t)x[i];
+  return (int64_t)sum;
+}
+
+int64_t s64_dot(const int64_t *restrict x, const int64_t *restrict y,
+                size_t n) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < n; i++) sum += (uint64_t)x[i] * (uint64_t)y[i];
+  return (int64_t)sum;
+}
+
+int64_t s64_min(const int64_t *restrict x, size_t n) {
+  int64_t min = x[0];
+  for (size_t i = 1; i < n; i++) min = x[i] < min ? x[i] : min;
+  return min;
+}
+
+int64_t s64_max(const int64_t *restrict x, size_t n) {
+  int64_t max = x[0];
+  for (size_t i = 1; i < n; i++) max = x[i] > max ? x[i] : max;
+  return max;
+}
+
+void s64_axpy(int64_t a, const int64_t *restrict x, int64_t *restrict y,
+              size_t n) {
+  for (size_t i = 0; i < n; i++)
+    y[i] = (int64_t)((uint64_t)y[i] + (uint64_t)a * (uint64_t)x[i]);
+}
+
+void s64_add(const int64_t *restrict x, const int64_t *restrict y,
+             int64_t *restrict out, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    out[i] = (int64_t)((uint64_t)x[i] + (uint64_t)y[i]);
+}
+
+void s64_mul(const int64_t *restrict x, const int64_t *restrict y,
+             int64_t *restrict out, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    out[i] = (int64_t)((uint64_t)x[i] * (uint64_t)y[i]);
+}
+
+void s64_scale(int64_t a, int64_t *restrict x, size_t n) {
+  for (size_t i = 0; i < n; i++) x[i] = (int64_t)((uint64_t)x[i] * a);
+}
+
+object_t *make_numvector(skeem_ctx_t *ctx, type_t type, size_t len)
+{
+  if (len > (SIZE_MAX - NUMVEC_ALIGN - sizeof(struct numvector)) /
+                sizeof(double))
+    error("Out of memory: %zu elements are too many for one %s\n", len,
+          PREFIX(type));
+
+  /*Round up to a whole number of SIMD registers*/
+  size_t bytes = (len * sizeof(double) + NUMVEC_ALIGN - 1) &
+                 ~(size_t)(NUMVEC_ALIGN - 1);
+  mem_reserve(ctx, bytes + sizeof(struct numvector));
+  /*obj_init can unwind, so the buffer is only allocated once it has an
+   *owner*/
+  object_t *vec = obj_init(ctx, type);
+  vec->numvector = ERR_MALLOC(sizeof(struct numvector));
+  vec->numvector->len = len;
+  vec->numvector->f64 =
+      aligned_alloc(NUMVEC_ALIGN, bytes == 0 ? NUMVEC_ALIGN : bytes);
+
+  if (vec->numvector->f64 == NULL) {
+    perror("aligned_alloc");
+    exit(EXIT_FAILURE);
+  }
+  memset(vec->numvector->f64, 0, bytes);
+  return vec;
+}
+
+bool eq_numvector(struct numvector *v1, struct numvector *v2)
+{
+  return v1->len == v2->len &&
+         memcmp(v1->f64, v2->f64, v1->len * sizeof(double)) == 0;
+}
+
+/*Expand the primitive name FMT for the vector type into NAME, e.g. "%s-ref"
+ *to "f64vector-ref", and check that ARGS has ARITY elements.*/
+static void nv_name(skeem_ctx_t *ctx, char name[32], const char *fmt,
+                    type_t type, int arity, cons_t *args)
+{
+  snprintf(name, 32, fmt, PREFIX(type));
+  if (arity >= 0) correct_number_args(ctx, name, arity, args);
+}
+
+static struct numvector *numvec_arg(skeem_ctx_t *ctx, const char *name,
+                                    type_t type, object_t *obj)
+{
+  if (obj->type != type)
+    error("%s: Wrong argument type - %s (Expected %s)\n", name,
+          types[obj->type], PREFIX(type));
+  return obj->numvector;
+}
+
+/*As numvec_arg, for a vector FUNCTION modifies, which a future's task
+ *mustn't if the parent owns it. The futures of CTX may be reading it, and
+ *are waited for.*/
+static struct numvector *target_numvec_arg(skeem_ctx_t *ctx, const char *name,
+                                           type_t type, object_t *obj)
+{
+  struct numvector *nv = numvec_arg(ctx, name, type, obj);
+
+  if (foreign_p(ctx, obj))
+    error("%s: The vector belongs to the parent of this future\n", name);
+  futures_join(ctx);
+  return nv;
+}
+
+static size_t index_arg(skeem_ctx_t *ctx, const char *name,
+                        struct numvector *nv, object_t *k)
+{
+  if (!_INTEGER_P(k))
+    error("%s: Wrong argument type - %s (Expected integer)\n", name,
+          types[k->type]);
+  if (k->integer < 0 || (size_t)k->integer >= nv->len)
+    error("%s: Index out of range - %ld (Length %zu)\n", name, k->integer,
+          nv->len);
+  return k->integer;
+}
+
+static double f64_arg(skeem_ctx_t *ctx, const char *name, object_t *n)
+{
+  if (_INTEGER_P(n)) return n->integer;
+  if (_FLOAT_P(n)) return n->flt;
+  error("%s: Wrong argument type - %s (Expected number)\n", name,
+        types[n->type]);
+}
+
+static int64_t s64_arg(skeem_ctx_t *ctx, const char *name, object_t *n)
+{
+  if (_INTEGER_P(n)) return n->integer;
+  error("%s: Wrong argument type - %s (Expected integer)\n", name,
+        types[n->type]);
+}
+
+static void store(skeem_ctx_t *ctx, const char *name, type_t type,
+                  struct numvector *nv, size_t i, object_t *n)
+{
+  if (type == F64VECTOR)
+    nv->f64[i] = f64_arg(ctx, name, n);
+  else
+    nv->s64[i] = s64_arg(ctx, name, n);
+}
+
+static object_t *box_f64(skeem_ctx_t *ctx, double x)
+{
+  object_t *obj = obj_init(ctx, FLOAT);
+  obj->flt = x;
+  return obj;
+}
+
+static object_t *box_s64(skeem_ctx_t *ctx, int64_t x)
+{
+  object_t *obj = obj_init(ctx, INTEGER);
+  obj->integer = x;
+  return obj;
+}
+
+static object_t *box(skeem_ctx_t *ctx, type_t type, struct numvector *nv,
+                     size_t i)
+{
+  return type == F64VECTOR ? box_f64(ctx, nv->f64[i])
+                           : box_s64(ctx, nv->s64[i]);
+}
+
+static void same_length(skeem_ctx_t *ctx, const char *name, struct numvector *x,
+                        struct numvector *y)
+{
+  if (x->len != y->len)
+    error("%s: Length mismatch (%zu and %zu)\n", name, x->len, y->len);
+}
+
+static object_t *nv_p(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "%s?", type, 1, args);
+  return BOOL_TO_OBJ(eval(ctx, args->car)->type == type);
+}
+
+/*(make-f64vector k [fill])*/
+static object_t *nv_make(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "make-%s", type, -1, args);
+  int len = length(args);
+  if (len != 1 && len != 2)
+    error("Wrong number of arguments to %s (Got %d, Wanted 1 or 2)\n", name,
+          len);
+
+  object_t *k = eval(ctx, args->car);
+  if (!_INTEGER_P(k) || k->integer < 0)
+    error("%s: Wrong argument - expected a non-negative integer\n", name);
+
+  size_t n = k->integer;
+  object_t *fill = len == 2 ? eval(ctx, args->cdr->car) : NULL;
+  pin(ctx, fill == NULL ? k : fill);
+  object_t *vec = make_numvector(ctx, type, n);
+  unpin_head(ctx);
+
+  if (fill != NULL && n != 0) {
+    struct numvector *nv = vec->numvector;
+    store(ctx, name, type, nv, 0, fill);
+    /*Both element types are 64 bits wide, so copy the bit pattern*/
+    for (size_t i = 1; i < n; i++) nv->s64[i] = nv->s64[0];
+  }
+  return vec;
+}
+
+/*(f64vector x ...)*/
+static object_t *nv_new(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "%s", type, -1, args);
+  object_t *vec = make_numvector(ctx, type, length(args));
+
+  pin(ctx, vec);
+  for (size_t i = 0; args != NULL; i++, args = args->cdr)
+    store(ctx, name, type, vec->numvector, i, eval(ctx, args->car));
+  unpin_head(ctx);
+
+  return vec;
+}
+
+static object_t *nv_length(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "%s-length", type, 1, args);
+  struct numvector *nv = numvec_arg(ctx, name, type, eval(ctx, args->car));
+  return box_s64(ctx, nv->len);
+}
+
+static object_t *nv_ref(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "%s-ref", type, 2, args);
+  object_t *vec = eval(ctx, args->car);
+  struct numvector *nv = numvec_arg(ctx, name, type, vec);
+
+  pin(ctx, vec);
+  size_t i = index_arg(ctx, name, nv, eval(ctx, args->cdr->car));
+  object_t *elem = box(ctx, type, nv, i);
+  unpin_head(ctx);
+  return elem;
+}
+
+static object_t *nv_set(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "%s-set!", type, 3, args);
+  object_t *vec = eval(ctx, args->car);
+  struct numvector *nv = target_numvec_arg(ctx, name, type, vec);
+
+  pin(ctx, vec);
+  size_t i = index_arg(ctx, name, nv, eval(ctx, args->cdr->car));
+  object_t *val = eval(ctx, args->cdr->cdr->car);
+  unpin_head(ctx);
+
+  store(ctx, name, type, nv, i, val);
+  return val;
+}
+
+static object_t *nv_to_list(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "%s->list", type, 1, args);
+  object_t *vec = eval(ctx, args->car);
+  struct numvector *nv = numvec_arg(ctx, name, type, vec);
+
+  if (nv->len == 0) return EMPTY_LIST;
+
+  pin(ctx, vec);
+  object_t *list = obj_init(ctx, LIST);
+  pin(ctx, list);
+
+  cons_t **cur = &list->cell;
+  for (size_t i = 0; i < nv->len; i++) {
+    object_t *elem = box(ctx, type, nv, i);
+    *cur = cons_init(ctx);
+    (*cur)->car = elem;
+    cur = &(*cur)->cdr;
+  }
+
+  unpin_head(ctx);
+  unpin_head(ctx);
+  return list;
+}
+
+static object_t *list_to_nv(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "list->%s", type, 1, args);
+  object_t *list = eval(ctx, args->car);
+
+  if (!_LIST_P(list))
+    error("%s: Wrong argument type - %s (Expected list)\n", name,
+          types[list->type]);
+
+  pin(ctx, list);
+  object_t *vec = make_numvector(ctx, type, length(list->cell));
+  unpin_head(ctx);
+
+  size_t i = 0;
+  for (cons_t *cur = list->cell; cur != NULL; cur = cur->cdr)
+    store(ctx, name, type, vec->numvector, i++, cur->car);
+  return vec;
+}
+
+static object_t *nv_sum(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "%s-sum", type, 1, args);
+  struct numvector *nv = numvec_arg(ctx, name, type, eval(ctx, args->car));
+
+  return type == F64VECTOR ? box_f64(ctx, f64_sum(nv->f64, nv->len))
+                           : box_s64(ctx, s64_sum(nv->s64, nv->len));
+}
+
+static object_t *nv_dot(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "%s-dot", type, 2, args);
+  object_t *x = eval(ctx, args->car);
+  pin(ctx, x);
+  object_t *y = eval(ctx, args->cdr->car);
+  unpin_head(ctx);
+
+  struct numvector *xv = numvec_arg(ctx, name, type, x);
+  struct numvector *yv = numvec_arg(ctx, name, type, y);
+  same_length(ctx, name, xv, yv);
+
+  return type == F64VECTOR ? box_f64(ctx, f64_dot(xv->f64, yv->f64, xv->len))
+                           : box_s64(ctx, s64_dot(xv->s64, yv->s64, xv->len));
+}
+
+static object_t *nv_extremum(skeem_ctx_t *ctx, const char *fmt, bool min,
+                             type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, fmt, type, 1, args);
+  struct numvector *nv = numvec_arg(ctx, name, type, eval(ctx, args->car));
+
+  if (nv->len == 0) error("%s: Empty vector\n", name);
+
+  if (type == F64VECTOR)
+    return box_f64(ctx, min ? f64_min(nv->f64, nv->len)
+                            : f64_max(nv->f64, nv->len));
+  return box_s64(ctx, min ? s64_min(nv->s64, nv->len)
+                          : s64_max(nv->s64, nv->len));
+}
+
+static object_t *nv_min(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  return nv_extremum(ctx, "%s-min", true, type, args);
+}
+
+static object_t *nv_max(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  return nv_extremum(ctx, "%s-max", false, type, args);
+}
+
+/*(f64vector-axpy! a x y) sets y to a*x + y*/
+static object_t *nv_axpy(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "%s-axpy!", type, 3, args);
+  object_t *a = eval(ctx, args->car);
+  pin(ctx, a);
+  object_t *x = eval(ctx, args->cdr->car);
+  pin(ctx, x);
+  object_t *y = eval(ctx, args->cdr->cdr->car);
+  unpin_head(ctx);
+  unpin_head(ctx);
+
+  struct numvector *xv = numvec_arg(ctx, name, type, x);
+  struct numvector *yv = target_numvec_arg(ctx, name, type, y);
+  same_length(ctx, name, xv, yv);
+
+  if (type == F64VECTOR)
+    f64_axpy(f64_arg(ctx, name, a), xv->f64, yv->f64, xv->len);
+  else
+    s64_axpy(s64_arg(ctx, name, a), xv->s64, yv->s64, xv->len);
+  return y;
+}
+
+static object_t *nv_elementwise(skeem_ctx_t *ctx, const char *fmt, bool add,
+                                type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, fmt, type, 2, args);
+  object_t *x = eval(ctx, args->car);
+  pin(ctx, x);
+  object_t *y = eval(ctx, args->cdr->car);
+  pin(ctx, y);
+
+  struct numvector *xv = numvec_arg(ctx, name, type, x);
+  struct numvector *yv = numvec_arg(ctx, name, type, y);
+  same_length(ctx, name, xv, yv);
+
+  object_t *out = make_numvector(ctx, type, xv->len);
+  struct numvector *ov = out->numvector;
+  unpin_head(ctx);
+  unpin_head(ctx);
+
+  if (type == F64VECTOR) {
+    if (add) f64_add(xv->f64, yv->f64, ov->f64, xv->len);
+    else f64_mul(xv->f64, yv->f64, ov->f64, xv->len);
+  } else {
+    if (add) s64_add(xv->s64, yv->s64, ov->s64, xv->len);
+    else s64_mul(xv->s64, yv->s64, ov->s64, xv->len);
+  }
+  return out;
+}
+
+static object_t *nv_add(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  return nv_elementwise(ctx, "%s-add", true, type, args);
+}
+
+static object_t *nv_mul(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  return nv_elementwise(ctx, "%s-mul", false, type, args);
+}
+
+/*(f64vector-scale! a x) multiplies every element of x by a*/
+static object_t *nv_scale(skeem_ctx_t *ctx, type_t type, cons_t *args)
+{
+  char name[32];
+  nv_name(ctx, name, "%s-scale!", type, 2, args);
+  object_t *a = eval(ctx, args->car);
+  pin(ctx, a);
+  object_t *x = eval(ctx, args->cdr->car);
+  unpin_head(ctx);
+
+  struct numvector *xv = target_numvec_arg(ctx, name, type, x);
+
+  if (type == F64VECTOR)
+    f64_scale(f64_arg(ctx, name, a), xv->f64, xv->len);
+  else
+    s64_scale(s64_arg(ctx, name, a), xv->s64, xv->len);
+  return x;
+}
+
+/*Define the f64vector and s64vector primitives for the generic operation OP*/
+#define NUMVEC_PRIMITIVES(op)                                            \
+  static object_t *f64vector_##op(skeem_ctx_t *ctx, cons_t *args) {      \
+    return nv_##op(ctx, F64VECTOR, args);                                \
+  }                                                                      \
+  static object_t *s64vector_##op(skeem_ctx_t *ctx, cons_t *args) {      \
+    return nv_##op(ctx, S64VECTOR, args);                                \
+  }
+
+NUMVEC_PRIMITIVES(p)
+NUMVEC_PRIMITIVES(make)
+NUMVEC_PRIMITIVES(new)
+NUMVEC_PRIMITIVES(length)
+NUMVEC_PRIMITIVES(ref)
+NUMVEC_PRIMITIVES(set)
+NUMVEC_PRIMITIVES(to_list)
+NUMVEC_PRIMITIVES(sum)
+NUMVEC_PRIMITIVES(dot)
+NUMVEC_PRIMITIVES(min)
+NUMVEC_PRIMITIVES(max)
+NUMVEC_PRIMITIVES(axpy)
+NUMVEC_PRIMITIVES(add)
+NUMVEC_PRIMITIVES(mul)
+NUMVEC_PRIMITIVES(scale)
+
+static object_t *list_to_f64vector(skeem_ctx_t *ctx, cons_t *args)
+{
+  return list_to_nv(ctx, F64VECTOR, args);
+}
+
+static object_t *list_to_s64vector(skeem_ctx_t *ctx, cons_t *args)
+{
+  return list_to_nv(ctx, S64VECTOR, args);
+}
+
+#define ADD_NUMVEC_PRIMITIVE(name, op)                \
+  add_primitive(ctx, "f64" name, f64vector_##op);     \
+  add_primitive(ctx, "s64" name, s64vector_##op)
+
+void numvec_init(skeem_ctx_t *ctx)
+{
+  ADD_NUMVEC_PRIMITIVE("vector?", p);
+  ADD_NUMVEC_PRIMITIVE("vector", new);
+  ADD_NUMVEC_PRIMITIVE("vector-length", length);
+  ADD_NUMVEC_PRIMITIVE("vector-ref", ref);
+  ADD_NUMVEC_PRIMITIVE("vector-set!", set);
+  ADD_NUMVEC_PRIMITIVE("vector->list", to_list);
+  ADD_NUMVEC_PRIMITIVE("vector-sum", sum);
+  ADD_NUMVEC_PRIMITIVE("vector-dot", dot);
+  ADD_NUMVEC_PRIMITIVE("vector-min", min);
+  ADD_NUMVEC_PRIMITIVE("vector-max", max);
+  ADD_NUMVEC_PRIMITIVE("vector-axpy!", axpy);
+  ADD_NUMVEC_PRIMITIVE("vector-add", add);
+  ADD_NUMVEC_PRIMITIVE("vector-mul", mul);
+  ADD_NUMVEC_PRIMITIVE("vector-scale!", scale);
+  add_primitive(ctx, "make-f64vector", f64vector_make);
+  add_primitive(ctx, "make-s64vector", s64vector_make);
+  add_primitive(ctx, "list->f64vector", list_to_f64vector);
+  add_primitive(ctx, "list->s64vector", list_to_s64vector);
+}
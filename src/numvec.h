@@ -0,0 +1,56 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef NUMVEC_H
+#define NUMVEC_H
+#include "types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+extern object_t *make_numvector(skeem_ctx_t *ctx, type_t type, size_t len);
+extern bool eq_numvector(struct numvector *v1, struct numvector *v2);
+extern void numvec_init(skeem_ctx_t *ctx);
+
+/*Bulk kernels. None of these allocate, and the pointers must not alias
+ *unless noted otherwise.*/
+extern double f64_sum(const double *x, size_t n);
+extern double f64_dot(const double *x, const double *y, size_t n);
+extern double f64_min(const double *x, size_t n);
+extern double f64_max(const double *x, size_t n);
+extern void f64_axpy(double a, const double *x, double *y, size_t n);
+extern void f64_add(const double *x, const double *y, double *out, size_t n);
+extern void f64_mul(const double *x, const double *y, double *out, size_t n);
+extern void f64_scale(double a, double *x, size_t n);
+
+extern int64_t s64_sum(const int64_t *x, size_t n);
+extern int64_t s64_dot(const int64_t *x, const int64_t *y, size_t n);
+extern int64_t s64_min(const int64_t *x, size_t n);
+extern int64_t s64_max(const int64_t *x, size_t n);
+extern void s64_axpy(int64_t a, const int64_t *x, int64_t *y, size_t n);
+extern void s64_add(const int64_t *x, const int64_t *y, int64_t *out,
+                    size_t n);
+extern void s64_mul(const int64_t *x, const int64_t *y, int64_t *out,
+                    size_t n);
+extern void s64_scale(int64_t a, int64_t *x, size_t n);
+
+#endif
@@ -0,0 +1,530 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*File and string ports. Input from a regular file reads straight out of a
+ *read-only mapping of it, so each line is copied once, from the page cache
+ *into the string that holds it. Other input, such as a pipe or a terminal,
+ *goes through a buffer refilled with read. Output goes through stdio with a
+ *buffer of the port's own, or into memory for a string port.*/
+
+#include "port.h"
+#include "types.h"
+#include "context.h"
+#include "mem.h"
+#include "builtins.h"
+#include "coroutine.h"
+#include "token.h"
+#include "str.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PORT_BUFFER (64 * 1024)
+/*Pages of a mapped file are dropped once this much of it has been read, so
+ *reading a file larger than memory does not fill it*/
+#define PORT_DROP (16 * 1024 * 1024)
+
+struct port {
+  /*Held by each port object; a future's result shares its ports*/
+  int refs;
+  bool input;
+  /*Standard input and output, which are never closed*/
+  bool standard;
+  bool closed;
+  int fd;
+  /*Input: the whole mapped file, or what has been read into a buffer*/
+  char *data;
+  size_t len, pos;
+  bool mapped;
+  /*How much of the mapping has been dropped*/
+  size_t dropped;
+  /*read: the line being scanned, and the tokens left over from it*/
+  char *line;
+  struct reader reader;
+  /*Output*/
+  FILE *stream;
+  char *buffer;
+  /*What has been written to a string port*/
+  bool string;
+  char *written;
+  size_t written_len;
+};
+
+static object_t *make_port(skeem_ctx_t *ctx, struct port *port)
+{
+  object_t *obj = obj_init(ctx, PORT);
+  obj->port = port;
+  port->refs = 1;
+  return obj;
+}
+
+static void port_close(struct port *port)
+{
+  if (port->closed) return;
+  port->closed = true;
+
+  if (port->input) {
+    if (port->mapped)
+      munmap(port->data, port->len);
+    else
+      free(port->data);
+    if (!port->standard) close(port->fd);
+    str_free(port->line);
+    reader_clear(&port->reader);
+  } else if (port->standard) {
+    fflush(port->stream);
+  } else {
+    fclose(port->stream);
+    free(port->buffer);
+    free(port->written);
+  }
+}
+
+void port_unref(struct port *port)
+{
+  if (--port->refs > 0) return;
+  port_close(port);
+  free(port);
+}
+
+void port_ref(struct port *port)
+{
+  port->refs++;
+}
+
+static object_t *current_input(skeem_ctx_t *ctx)
+{
+  if (ctx->input_port == NULL) {
+    struct port *port = ERR_MALLOC(sizeof(struct port));
+
+    port->input = true;
+    port->standard = true;
+    port->fd = STDIN_FILENO;
+    port->data = ERR_MALLOC(PORT_BUFFER);
+    ctx->input_port = make_port(ctx, port);
+  }
+  return ctx->input_port;
+}
+
+static object_t *current_output(skeem_ctx_t *ctx)
+{
+  if (ctx->output_port == NULL) {
+    struct port *port = ERR_MALLOC(sizeof(struct port));
+
+    port->standard = true;
+    port->stream = stdout;
+    ctx->output_port = make_port(ctx, port);
+  }
+  return ctx->output_port;
+}
+
+/*The port argument of FUNCTION, which is optional and defaults to the
+ *current input or output port*/
+static struct port *port_arg(skeem_ctx_t *ctx, const char *function,
+                             cons_t *args, bool input)
+{
+  object_t *obj = args != NULL ? eval(ctx, args->car)
+                  : input      ? current_input(ctx)
+                               : current_output(ctx);
+
+  if (obj->type != PORT)
+    error("%s: Wrong argument type - %s (Expected port)\n", function,
+          types[obj->type]);
+  if (obj->port->input != input)
+    error("%s: Expected an %s port\n", function, input ? "input" : "output");
+  if (obj->port->closed) error("%s: The port is closed\n", function);
+  if (foreign_p(ctx, obj))
+    error("%s: The port belongs to the parent of this future\n", function);
+  return obj->port;
+}
+
+static void optional_arity(skeem_ctx_t *ctx, const char *function,
+                           cons_t *args, int min)
+{
+  int len = length(args);
+
+  if (len != min && len != min + 1)
+    error("Wrong number of arguments to %s (Got %d, Wanted %d or %d)\n",
+          function, len, min, min + 1);
+}
+
+static char *path_arg(skeem_ctx_t *ctx, const char *function, object_t *obj)
+{
+  if (!_STRING_P(obj))
+    error("%s: Wrong argument type - %s (Expected string)\n", function,
+          types[obj->type]);
+  return obj->string;
+}
+
+/*Make input available past POS. False at the end of the input.*/
+static bool refill(skeem_ctx_t *ctx, const char *function, struct port *port)
+{
+  if (port->pos < port->len) return true;
+  if (port->mapped) return false;
+
+  ssize_t n;
+  while ((n = read(port->fd, port->data, PORT_BUFFER)) < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      coroutine_wait_fd(ctx, function, port->fd, EPOLLIN);
+    else if (errno != EINTR)
+      error("%s: %s\n", function, strerror(errno));
+  }
+  port->pos = 0;
+  port->len = n;
+  return n > 0;
+}
+
+/*(open-input-file path)*/
+object_t *open_input_file(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  char *path = path_arg(ctx, "open-input-file", eval(ctx, args->car));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    int err = errno;
+    if (fd >= 0) close(fd);
+    error("open-input-file: %s - %s\n", path, strerror(err));
+  }
+
+  struct port *port = ERR_MALLOC(sizeof(struct port));
+  port->input = true;
+  port->fd = fd;
+
+  /*Files that report no size, like those in /proc, are read*/
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    port->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (port->data == MAP_FAILED) {
+      int err = errno;
+      close(fd);
+      free(port);
+      error("open-input-file: %s - %s\n", path, strerror(err));
+    }
+    port->mapped = true;
+    port->len = st.st_size;
+    madvise(port->data, port->len, MADV_SEQUENTIAL);
+  } else {
+    port->data = ERR_MALLOC(PORT_BUFFER);
+  }
+  return make_port(ctx, port);
+}
+
+/*(open-output-file path) creates or truncates PATH*/
+object_t *open_output_file(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  char *path = path_arg(ctx, "open-output-file", eval(ctx, args->car));
+  FILE *stream = fopen(path, "we");
+
+  if (stream == NULL)
+    error("open-output-file: %s - %s\n", path, strerror(errno));
+
+  struct port *port = ERR_MALLOC(sizeof(struct port));
+  port->fd = fileno(stream);
+  port->stream = stream;
+  port->buffer = ERR_MALLOC(PORT_BUFFER);
+  setvbuf(stream, port->buffer, _IOFBF, PORT_BUFFER);
+  return make_port(ctx, port);
+}
+
+/*Let the kernel drop the pages of a mapped file that have been read*/
+static void drop_read(struct port *port)
+{
+  size_t end = port->pos & ~(size_t)(sysconf(_SC_PAGESIZE) - 1);
+
+  if (end - port->dropped < PORT_DROP) return;
+  madvise(port->data + port->dropped, end - port->dropped, MADV_DONTNEED);
+  port->dropped = end;
+}
+
+/*Append the next line of PORT, without its newline, to the string *LINE.
+ *False at the end of the input.*/
+static bool next_line(skeem_ctx_t *ctx, const char *function,
+                      struct port *port, char **line)
+{
+  bool any = false;
+
+  while (refill(ctx, function, port)) {
+    char *start = port->data + port->pos;
+    size_t avail = port->len - port->pos;
+    char *nl = memchr(start, '\n', avail);
+    size_t n = nl != NULL ? (size_t)(nl - start) : avail;
+
+    *line = str_append(*line, start, n);
+    port->pos += n;
+    any = true;
+
+    if (nl != NULL) {
+      port->pos++;
+      break;
+    }
+  }
+
+  if (port->mapped) drop_read(port);
+  return any;
+}
+
+/*(open-output-string) collects what is written to it in memory, growing
+ *its buffer geometrically*/
+object_t *open_output_string(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(0);
+  struct port *port = ERR_MALLOC(sizeof(struct port));
+
+  port->string = true;
+  port->stream = open_memstream(&port->written, &port->written_len);
+  if (port->stream == NULL) {
+    free(port);
+    error("open-output-string: %s\n", strerror(errno));
+  }
+  port->fd = -1;
+  return make_port(ctx, port);
+}
+
+/*(get-output-string port) is a new string of everything written to PORT*/
+object_t *get_output_string(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  struct port *port = port_arg(ctx, "get-output-string", args, false);
+
+  if (!port->string)
+    error("get-output-string: Expected a string port\n");
+  fflush(port->stream);
+  return make_string(ctx, str_new(port->written, port->written_len));
+}
+
+/*(read-line [port]) is the next line of PORT without its newline*/
+object_t *read_line(skeem_ctx_t *ctx, cons_t *args)
+{
+  optional_arity(ctx, "read-line", args, 0);
+  struct port *port = port_arg(ctx, "read-line", args, true);
+  char *line = NULL;
+
+  if (!next_line(ctx, "read-line", port, &line)) return CONST_EOF;
+  return make_string(ctx, line);
+}
+
+/*(read [port]) is the next datum of PORT, unevaluated. Only the line being
+ *read is held, so a file of any size can be read through.*/
+object_t *read_datum(skeem_ctx_t *ctx, cons_t *args)
+{
+  optional_arity(ctx, "read", args, 0);
+  struct port *port = port_arg(ctx, "read", args, true);
+  object_t *obj;
+
+  while ((obj = reader_next(ctx, &port->reader)) == NULL) {
+    if (port->line != NULL) str_set_len(port->line, 0);
+    if (!next_line(ctx, "read", port, &port->line)) {
+      if (port->reader.tokens == NULL) return CONST_EOF;
+      reader_clear(&port->reader);
+      error("read: Unexpected end of input\n");
+    }
+    port->line = str_append(port->line, "\n", 1);
+    reader_scan(ctx, &port->reader, port->line, STR_HEADER(port->line)->len);
+  }
+  return obj;
+}
+
+static object_t *next_char(skeem_ctx_t *ctx, const char *function,
+                           cons_t *args, bool advance)
+{
+  optional_arity(ctx, function, args, 0);
+  struct port *port = port_arg(ctx, function, args, true);
+
+  if (!refill(ctx, function, port)) return CONST_EOF;
+
+  object_t *c = obj_init(ctx, CHAR);
+  c->character = port->data[port->pos];
+  if (advance) port->pos++;
+  return c;
+}
+
+/*(read-char [port])*/
+object_t *read_char(skeem_ctx_t *ctx, cons_t *args)
+{
+  return next_char(ctx, "read-char", args, true);
+}
+
+/*(peek-char [port]) is the character read-char would return next*/
+object_t *peek_char(skeem_ctx_t *ctx, cons_t *args)
+{
+  return next_char(ctx, "peek-char", args, false);
+}
+
+/*(write-string string [port])*/
+object_t *write_string(skeem_ctx_t *ctx, cons_t *args)
+{
+  optional_arity(ctx, "write-string", args, 1);
+  object_t *str = eval(ctx, args->car);
+  if (!_STRING_P(str))
+    error("write-string: Wrong argument type - %s (Expected string)\n",
+          types[str->type]);
+
+  pin(ctx, str);
+  struct port *port = port_arg(ctx, "write-string", args->cdr, false);
+  unpin_head(ctx);
+
+  size_t len = str_len(str);
+  if (fwrite(str->string, 1, len, port->stream) != len)
+    error("write-string: %s\n", strerror(errno));
+  return CONST_TRUE;
+}
+
+static object_t *print_to(skeem_ctx_t *ctx, const char *function,
+                          cons_t *args, bool display)
+{
+  optional_arity(ctx, function, args, 1);
+  object_t *obj = eval(ctx, args->car);
+
+  pin(ctx, obj);
+  struct port *port = port_arg(ctx, function, args->cdr, false);
+  unpin_head(ctx);
+
+  if (display)
+    display_obj(obj, port->stream);
+  else
+    print_obj(obj, port->stream);
+  return CONST_TRUE;
+}
+
+/*(write obj [port]) writes OBJ as the REPL prints it*/
+object_t *write_obj(skeem_ctx_t *ctx, cons_t *args)
+{
+  return print_to(ctx, "write", args, false);
+}
+
+/*(display obj [port]) writes strings and characters without quotes*/
+object_t *display(skeem_ctx_t *ctx, cons_t *args)
+{
+  return print_to(ctx, "display", args, true);
+}
+
+/*(write-char char [port])*/
+object_t *write_char(skeem_ctx_t *ctx, cons_t *args)
+{
+  optional_arity(ctx, "write-char", args, 1);
+  object_t *c = eval(ctx, args->car);
+  if (c->type != CHAR)
+    error("write-char: Wrong argument type - %s (Expected char)\n",
+          types[c->type]);
+
+  struct port *port = port_arg(ctx, "write-char", args->cdr, false);
+  putc(c->character, port->stream);
+  return CONST_TRUE;
+}
+
+/*(newline [port])*/
+object_t *newline(skeem_ctx_t *ctx, cons_t *args)
+{
+  optional_arity(ctx, "newline", args, 0);
+  struct port *port = port_arg(ctx, "newline", args, false);
+
+  putc('\n', port->stream);
+  return CONST_TRUE;
+}
+
+/*(flush-output-port [port])*/
+object_t *flush_output_port(skeem_ctx_t *ctx, cons_t *args)
+{
+  optional_arity(ctx, "flush-output-port", args, 0);
+  struct port *port = port_arg(ctx, "flush-output-port", args, false);
+
+  if (fflush(port->stream) != 0)
+    error("flush-output-port: %s\n", strerror(errno));
+  return CONST_TRUE;
+}
+
+/*(close-port port). Closing a closed port does nothing.*/
+object_t *close_port(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *obj = eval(ctx, args->car);
+
+  if (obj->type != PORT)
+    error("close-port: Wrong argument type - %s (Expected port)\n",
+          types[obj->type]);
+  if (foreign_p(ctx, obj))
+    error("close-port: The port belongs to the parent of this future\n");
+  port_close(obj->port);
+  return CONST_TRUE;
+}
+
+object_t *current_input_port(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(0);
+  return current_input(ctx);
+}
+
+object_t *current_output_port(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(0);
+  return current_output(ctx);
+}
+
+object_t *port_p(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  return BOOL_TO_OBJ(eval(ctx, args->car)->type == PORT);
+}
+
+object_t *eof_object(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(0);
+  return CONST_EOF;
+}
+
+object_t *eof_object_p(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  return BOOL_TO_OBJ(eval(ctx, args->car) == CONST_EOF);
+}
+
+void port_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "open-input-file", open_input_file);
+  add_primitive(ctx, "open-output-file", open_output_file);
+  add_primitive(ctx, "read-line", read_line);
+  add_primitive(ctx, "read", read_datum);
+  add_primitive(ctx, "read-char", read_char);
+  add_primitive(ctx, "peek-char", peek_char);
+  add_primitive(ctx, "write-string", write_string);
+  add_primitive(ctx, "write-char", write_char);
+  add_primitive(ctx, "write", write_obj);
+  add_primitive(ctx, "display", display);
+  add_primitive(ctx, "open-output-string", open_output_string);
+  add_primitive(ctx, "get-output-string", get_output_string);
+  add_primitive(ctx, "newline", newline);
+  add_primitive(ctx, "flush-output-port", flush_output_port);
+  add_primitive(ctx, "close-port", close_port);
+  add_primitive(ctx, "current-input-port", current_input_port);
+  add_primitive(ctx, "current-output-port", current_output_port);
+  add_primitive(ctx, "port?", port_p);
+  add_primitive(ctx, "eof-object", eof_object);
+  add_primitive(ctx, "eof-object?", eof_object_p);
+}
@@ -0,0 +1,185 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*A sampling profiler. A SIGPROF timer samples the Scheme call stack of the
+ *thread that started it, and the samples are written out at exit as
+ *collapsed stacks, one "skeem;caller;callee count" line per distinct stack,
+ *as read by flamegraph.pl. The signal handler allocates nothing: distinct
+ *stacks go in a fixed hash table, their text in a fixed arena.*/
+
+#include "profile.h"
+#include "types.h"
+#include "context.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define PROFILE_HZ 1000
+/*Frames nearer the root than this are left out of a sample*/
+#define PROFILE_DEPTH 128
+#define PROFILE_LINE 4096
+/*Distinct stacks kept, a power of two, and the bytes for their text*/
+#define PROFILE_STACKS 8192
+#define PROFILE_ARENA (1 << 20)
+
+struct stack_count {
+  uint64_t hash;
+  /*Offset of the text in the arena, and the number of samples; zero for an
+   *unused entry*/
+  uint32_t offset, count;
+};
+
+static struct {
+  skeem_ctx_t *ctx;
+  const char *path;
+  struct stack_count *stacks;
+  size_t num_stacks;
+  char *arena;
+  size_t arena_len;
+  /*Samples with no room left to record them*/
+  uint32_t dropped;
+} profile;
+
+static __thread bool profiled_thread;
+
+/*Append STR to the line in BUF, as far as it fits*/
+static size_t line_append(char *buf, size_t len, const char *str)
+{
+  while (*str != '\0' && len < PROFILE_LINE - 1) buf[len++] = *str++;
+  buf[len] = '\0';
+  return len;
+}
+
+static void record(const char *line, size_t len)
+{
+  uint64_t hash = 14695981039346656037ull;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)line[i];
+    hash *= 1099511628211ull;
+  }
+
+  size_t mask = PROFILE_STACKS - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    struct stack_count *s = &profile.stacks[i];
+
+    if (s->count == 0) {
+      if (profile.num_stacks >= PROFILE_STACKS * 3 / 4 ||
+          profile.arena_len + len + 1 > PROFILE_ARENA) {
+        profile.dropped++;
+        return;
+      }
+      memcpy(profile.arena + profile.arena_len, line, len + 1);
+      s->hash = hash;
+      s->offset = profile.arena_len;
+      s->count = 1;
+      profile.arena_len += len + 1;
+      profile.num_stacks++;
+      return;
+    }
+    if (s->hash == hash && strcmp(profile.arena + s->offset, line) == 0) {
+      s->count++;
+      return;
+    }
+  }
+}
+
+static void sample(int sig)
+{
+  const char *names[PROFILE_DEPTH];
+  char line[PROFILE_LINE];
+  size_t n = 0, len;
+  int saved_errno = errno;
+
+  if (!profiled_thread) return;
+
+  struct frame *f = profile.ctx->frames;
+  for (; f != NULL && n < PROFILE_DEPTH; f = f->caller) names[n++] = f->name;
+
+  len = line_append(line, 0, "skeem");
+  if (f != NULL) len = line_append(line, len, ";[truncated]");
+  while (n-- > 0) {
+    len = line_append(line, len, ";");
+    len = line_append(line, len, names[n]);
+  }
+  record(line, len);
+  errno = saved_errno;
+}
+
+/*Stop sampling and write the samples out. Called at exit, or earlier by
+ *a caller about to free the context being sampled.*/
+void profile_stop(void)
+{
+  struct itimerval off = {{0, 0}, {0, 0}};
+
+  if (profile.path == NULL) return;
+  setitimer(ITIMER_PROF, &off, NULL);
+  signal(SIGPROF, SIG_IGN);
+
+  FILE *out = fopen(profile.path, "w");
+  if (out == NULL) {
+    perror(profile.path);
+    profile.path = NULL;
+    return;
+  }
+  for (size_t i = 0; i < PROFILE_STACKS; i++) {
+    struct stack_count *s = &profile.stacks[i];
+
+    if (s->count != 0)
+      fprintf(out, "%s %u\n", profile.arena + s->offset, s->count);
+  }
+  if (profile.dropped != 0)
+    fprintf(out, "skeem;[dropped] %u\n", profile.dropped);
+  fclose(out);
+  profile.path = NULL;
+}
+
+/*Sample the Scheme call stack of CTX, on the calling thread, until exit,
+ *then write the samples to PATH*/
+void profile_start(skeem_ctx_t *ctx, const char *path)
+{
+  struct sigaction sa;
+  struct itimerval timer = {{0, 1000000 / PROFILE_HZ},
+                            {0, 1000000 / PROFILE_HZ}};
+
+  profile.ctx = ctx;
+  profile.path = path;
+  profile.stacks = calloc(PROFILE_STACKS, sizeof(struct stack_count));
+  profile.arena = malloc(PROFILE_ARENA);
+  if (profile.stacks == NULL || profile.arena == NULL) {
+    perror("profile_start");
+    exit(EXIT_FAILURE);
+  }
+  profiled_thread = true;
+  atexit(profile_stop);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = sample;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGPROF, &sa, NULL);
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
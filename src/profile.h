@@ -0,0 +1,76 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+#include "types.h"
+#include "context.h"
+#include <stdatomic.h>
+
+/*A call to a Scheme procedure. Frames live on the C stack and are linked
+ *from ctx->frames, so the profiler can see the Scheme call stack. ENV is
+ *the environment when the call was made; goto_top drops the frame when it
+ *pops that environment.*/
+struct frame {
+  const char *name;
+  object_t *env;
+  struct frame *caller;
+#ifdef INSTRUMENT
+  procedure_t *proc;
+  /*When the call started, and the time spent in its callees so far*/
+  uint64_t start, callees;
+#endif
+};
+
+#ifdef INSTRUMENT
+extern void instrument_call(skeem_ctx_t *ctx, struct frame *frame);
+extern void instrument_return(skeem_ctx_t *ctx, struct frame *frame);
+#endif
+
+static inline void frame_push(skeem_ctx_t *ctx, struct frame *frame,
+                              procedure_t *proc)
+{
+  frame->name = proc->name;
+  frame->env = ctx->env_head;
+  frame->caller = ctx->frames;
+#ifdef INSTRUMENT
+  frame->proc = proc;
+  instrument_call(ctx, frame);
+#endif
+  /*A sample may be taken between any two instructions, so the frame must
+   *be complete before it is linked*/
+  atomic_signal_fence(memory_order_release);
+  ctx->frames = frame;
+}
+
+static inline void frame_pop(skeem_ctx_t *ctx, struct frame *frame)
+{
+#ifdef INSTRUMENT
+  instrument_return(ctx, frame);
+#endif
+  ctx->frames = frame->caller;
+}
+
+extern void profile_start(skeem_ctx_t *ctx, const char *path);
+extern void profile_stop(void);
+
+#endif
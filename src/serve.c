@@ -0,0 +1,434 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*skeem --serve. The server loads its files once, then accepts connections on
+ *a Unix domain socket and serves each from a process forked off it. Every
+ *request on a connection is evaluated in a further fork, which starts from
+ *the server's warm heap, runs under the request's limits, and takes whatever
+ *the request did to that heap with it when it exits. A request costs a fork
+ *instead of a start-up.*/
+
+#define _GNU_SOURCE
+#include "serve.h"
+#include "types.h"
+#include "context.h"
+#include "mem.h"
+#include "builtins.h"
+#include "token.h"
+#include "macro.h"
+#include "fuel.h"
+#include <errno.h>
+#include <sched.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/*A connection, as its evaluators see it*/
+struct connection {
+  int sock;
+  /*Files taking the standard output and error of the evaluators*/
+  int out, err;
+  /*Set by an evaluator once it has answered, in memory it shares with the
+   *connection's process*/
+  volatile bool *answered;
+};
+
+/*An evaluator forked ahead of the request it is to run*/
+struct evaluator {
+  pid_t pid;
+  /*The request is written here*/
+  int fd;
+};
+
+static bool read_full(int fd, void *buf, size_t len)
+{
+  char *p = buf;
+
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool write_full(int fd, const void *buf, size_t len)
+{
+  const char *p = buf;
+
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+static int capture_fd(const char *name)
+{
+  int fd = memfd_create(name, 0);
+
+  if (fd < 0) {
+    perror("memfd_create");
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+static void capture_reset(int fd)
+{
+  if (ftruncate(fd, 0) != 0) perror("ftruncate");
+  lseek(fd, 0, SEEK_SET);
+}
+
+/*What has been written to the capture file FD*/
+static char *captured(int fd, uint32_t *len)
+{
+  off_t size = lseek(fd, 0, SEEK_END);
+  char *data;
+
+  *len = size > 0 ? size : 0;
+  data = ERR_MALLOC(*len + 1);
+  if (pread(fd, data, *len, 0) != (ssize_t)*len) *len = 0;
+  return data;
+}
+
+/*Send LEN bytes of DATA, preceded by their length*/
+static bool send_field(int sock, const char *data, uint32_t len)
+{
+  return write_full(sock, &len, sizeof(len)) && write_full(sock, data, len);
+}
+
+/*Send a response with CODE, the output of the request and RESULT*/
+static bool respond(struct connection *conn, unsigned char code,
+                    const char *result, uint32_t len)
+{
+  uint32_t out_len;
+  char *out = captured(conn->out, &out_len);
+  bool ok = write_full(conn->sock, &code, 1) &&
+            send_field(conn->sock, out, out_len) &&
+            send_field(conn->sock, result, len);
+
+  free(out);
+  return ok;
+}
+
+/*Allow the address space to grow by KIB from what it is now*/
+static void limit_memory(uint32_t kib)
+{
+  FILE *statm = fopen("/proc/self/statm", "r");
+  unsigned long pages = 0;
+
+  if (statm == NULL || fscanf(statm, "%lu", &pages) != 1) {
+    perror("/proc/self/statm");
+    exit(EXIT_FAILURE);
+  }
+  fclose(statm);
+
+  struct rlimit lim;
+  lim.rlim_cur = lim.rlim_max =
+      pages * sysconf(_SC_PAGESIZE) + (rlim_t)kib * 1024;
+  if (setrlimit(RLIMIT_AS, &lim) != 0) perror("setrlimit");
+}
+
+static void set_timer(uint32_t ms)
+{
+  struct itimerval timer = {{0, 0}, {ms / 1000, ms % 1000 * 1000}};
+  setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+/*Answer with CODE and RESULT, and exit. The time limit no longer applies,
+ *so a response is never cut short.*/
+#if GCC_VERSION >= 40700
+_Noreturn
+#endif
+static void answer(struct connection *conn, unsigned char code,
+                   const char *result, uint32_t len)
+{
+  set_timer(0);
+  fflush(stdout);
+  fflush(stderr);
+  if (respond(conn, code, result, len)) *conn->answered = true;
+  /*Let the client have the answer before this process is torn down*/
+  sched_yield();
+  exit(EXIT_SUCCESS);
+}
+
+/*Evaluate the LEN bytes of source at SRC, which has room for one more, and
+ *print the value of the last form. Several forms may share a line, so they
+ *are read as data are.*/
+static char *eval_source(skeem_ctx_t *ctx, char *src, uint32_t len,
+                         size_t *result_len)
+{
+  struct reader reader = {0};
+  object_t *val = EMPTY_LIST, *obj;
+
+  src[len] = '\n';
+  reader_scan(ctx, &reader, src, len + 1);
+  while ((obj = reader_next(ctx, &reader)) != NULL) {
+    ctx->no_gc = false;
+    macro_expand(ctx, obj);
+    val = eval(ctx, obj);
+  }
+  if (reader.tokens != NULL) error("Unexpected end of input\n");
+
+  char *result = NULL;
+  FILE *stream = open_memstream(&result, result_len);
+
+  print_obj(val, stream);
+  fclose(stream);
+  return result;
+}
+
+/*Evaluate the request in this process, a fork of the server, and answer
+ *with the value of its last form. An error has printed its message by the
+ *time it unwinds, and that is the answer instead.*/
+#if GCC_VERSION >= 40700
+_Noreturn
+#endif
+static void run_request(skeem_ctx_t *ctx, struct connection *conn,
+                        struct serve_request *req, char *src)
+{
+  if (req->time_limit != 0) set_timer(req->time_limit);
+  if (req->memory_limit != 0) limit_memory(req->memory_limit);
+
+  dup2(conn->out, STDOUT_FILENO);
+  dup2(conn->err, STDERR_FILENO);
+  if (setjmp(ctx->err)) {
+    uint32_t len;
+    char *message;
+
+    fflush(stderr);
+    message = captured(conn->err, &len);
+    answer(conn, SERVE_ERROR, message, len);
+  }
+
+  fuel_start(ctx);
+  size_t len;
+  char *result = eval_source(ctx, src, req->len, &len);
+  answer(conn, SERVE_OK, result, len);
+}
+
+/*Fork an evaluator, which waits for its request. Forking before there is
+ *a request keeps the fork out of the time taken to answer it.*/
+static bool evaluator_spawn(skeem_ctx_t *ctx, struct connection *conn,
+                            struct evaluator *ev)
+{
+  int fds[2];
+
+  if (pipe(fds) != 0) return false;
+  /*Nothing buffered may be written twice*/
+  fflush(NULL);
+
+  ev->pid = fork();
+  if (ev->pid == 0) {
+    struct serve_request req;
+
+    close(fds[1]);
+    signal(SIGPIPE, SIG_DFL);
+
+    /*Every page the evaluator writes is first copied from the server.
+     *Rehearsing a request copies most of them before the real one comes.*/
+    char rehearsal[] = "(+ 1 2) ";
+    size_t len;
+    free(eval_source(ctx, rehearsal, sizeof(rehearsal) - 2, &len));
+
+    if (!read_full(fds[0], &req, sizeof(req))) exit(EXIT_SUCCESS);
+
+    char *src = ERR_MALLOC((size_t)req.len + 2);
+    if (!read_full(fds[0], src, req.len)) exit(EXIT_FAILURE);
+    close(fds[0]);
+    run_request(ctx, conn, &req, src);
+  }
+
+  close(fds[0]);
+  if (ev->pid < 0) {
+    close(fds[1]);
+    return false;
+  }
+  ev->fd = fds[1];
+  return true;
+}
+
+/*Hand REQ and SRC to EV and wait for it to finish. If it didn't answer,
+ *because it was killed or exited some other way, answer for it.*/
+static bool evaluate(struct connection *conn, struct evaluator *ev,
+                     struct serve_request *req, char *src)
+{
+  int status = 0;
+  bool sent = write_full(ev->fd, req, sizeof(*req)) &&
+              write_full(ev->fd, src, req->len);
+
+  close(ev->fd);
+  if (!sent) kill(ev->pid, SIGKILL);
+  while (waitpid(ev->pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  if (*conn->answered) return true;
+
+  char reason[64];
+  unsigned char code;
+  uint32_t len = 0;
+  char *err = captured(conn->err, &len);
+
+  if (!sent) {
+    code = SERVE_ERROR;
+    snprintf(reason, sizeof(reason), "Could not send the request");
+  } else if (WIFEXITED(status)) {
+    code = SERVE_ERROR;
+    snprintf(reason, sizeof(reason), "Exited with status %d",
+             WEXITSTATUS(status));
+  } else if (WTERMSIG(status) == SIGALRM) {
+    code = SERVE_TIMEOUT;
+    snprintf(reason, sizeof(reason), "Time limit exceeded");
+  } else {
+    code = SERVE_CRASHED;
+    snprintf(reason, sizeof(reason), "%s", strsignal(WTERMSIG(status)));
+  }
+
+  /*A message left on the way out says more, as when memory ran out*/
+  bool ok = code == SERVE_ERROR && len > 0
+                ? respond(conn, code, err, len)
+                : respond(conn, code, reason, strlen(reason));
+  free(err);
+  return ok;
+}
+
+/*Answer the requests arriving on SOCK until it is closed*/
+#if GCC_VERSION >= 40700
+_Noreturn
+#endif
+static void serve_connection(skeem_ctx_t *ctx, int sock)
+{
+  struct connection conn = {sock, capture_fd("stdout"), capture_fd("stderr"),
+                            mmap(NULL, sizeof(bool), PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0)};
+  struct serve_request req;
+  struct evaluator ev;
+
+  if (conn.answered == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+
+  /*The server leaves its children to be reaped by the system, but here
+   *each evaluator's status is needed*/
+  signal(SIGCHLD, SIG_DFL);
+  signal(SIGPIPE, SIG_IGN);
+  bool ready = evaluator_spawn(ctx, &conn, &ev);
+
+  while (read_full(sock, &req, sizeof(req))) {
+    char *src = ERR_MALLOC((size_t)req.len + 2);
+    if (!read_full(sock, src, req.len)) break;
+
+    capture_reset(conn.out);
+    capture_reset(conn.err);
+    *conn.answered = false;
+
+    if (!ready) ready = evaluator_spawn(ctx, &conn, &ev);
+    bool ok = ready ? evaluate(&conn, &ev, &req, src)
+                    : respond(&conn, SERVE_ERROR, strerror(errno),
+                              strlen(strerror(errno)));
+    free(src);
+    if (!ok) break;
+    ready = evaluator_spawn(ctx, &conn, &ev);
+  }
+
+  /*The spare evaluator exits when it reads no request*/
+  if (ready) {
+    close(ev.fd);
+    waitpid(ev.pid, NULL, 0);
+  }
+  exit(EXIT_SUCCESS);
+}
+
+/*Listen on the Unix domain socket PATH, serving each connection in a fork
+ *of CTX. Never returns.*/
+void serve(skeem_ctx_t *ctx, const char *path)
+{
+  struct sockaddr_un addr;
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (sock < 0) {
+    perror("socket");
+    exit(EXIT_FAILURE);
+  }
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "serve: Socket path too long: %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  /*Replace the socket of an earlier server, but nothing else*/
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      fprintf(stderr, "serve: %s exists and is not a socket\n", path);
+      exit(EXIT_FAILURE);
+    }
+    unlink(path);
+  }
+
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(sock, SOMAXCONN) != 0) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  signal(SIGCHLD, SIG_IGN);
+  while (true) {
+    int conn = accept(sock, NULL, NULL);
+
+    if (conn < 0) {
+      if (errno != EINTR) perror("accept");
+      continue;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(sock);
+      serve_connection(ctx, conn);
+    }
+    if (pid < 0) perror("fork");
+    close(conn);
+  }
+}
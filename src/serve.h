@@ -0,0 +1,58 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef SERVE_H
+#define SERVE_H
+#include "types.h"
+#include <stdint.h>
+
+/*The protocol of skeem --serve. Integers are in host byte order, as both
+ *ends are on the same machine.
+ *
+ *A request is a struct serve_request followed by LEN bytes of source. Its
+ *forms are evaluated in a process of their own, forked from the server, so
+ *that nothing a request does is seen by any other. A limit of zero means
+ *none.
+ *
+ *The response is a status byte, then the length and bytes of what the
+ *request wrote to its standard output, then the length and bytes of the
+ *result: the printed value of the last form on success, and otherwise what
+ *went wrong.*/
+struct serve_request {
+  uint32_t len;
+  /*Wall clock time allowed, in milliseconds*/
+  uint32_t time_limit;
+  /*Memory the request may allocate beyond the server's, in KiB*/
+  uint32_t memory_limit;
+};
+
+enum serve_status {
+  SERVE_OK,
+  SERVE_ERROR,
+  SERVE_TIMEOUT,
+  /*Killed by a signal, as when a request runs out of stack*/
+  SERVE_CRASHED
+};
+
+extern void serve(skeem_ctx_t *ctx, const char *path);
+
+#endif
@@ -24,24 +24,127 @@
 #include "types.h"
 #include "builtins.h"
 #include "mem.h"
+#include "cache.h"
+#include "context.h"
+#include "macro.h"
+#include "serve.h"
+#include "fuel.h"
+#include "profile.h"
+#include "instrument.h"
+#include "trace.h"
+#include "jit.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <setjmp.h>
 
-#define SKEEM_VERSION "1.0a"
-#define get_input(i)               \
-  {                                \
-    size_t __n__;                  \
-    getline(&(i), &__n__, stream); \
+/*Limits on each evaluation, from --steps and --time-limit, and on the
+ *heap, from --heap-limit*/
+static uint64_t max_steps;
+static uint32_t max_ms;
+static size_t max_bytes;
+/*Where --profile=FILE writes the samples of the script or REPL session,
+ *and --trace=FILE its trace*/
+static const char *profile_path, *trace_path;
+
+static skeem_ctx_t *open_ctx(void) {
+  skeem_ctx_t *ctx = ctx_new();
+
+  limits_set(ctx, max_steps, max_ms);
+  ctx->max_bytes = max_bytes;
+  return ctx;
+}
+
+/*Evaluate a script. The parsed forms are taken from the cache if the file has
+ *been run before, otherwise the file is parsed and its image is cached.*/
+static void run_file(skeem_ctx_t *ctx, FILE *stream) {
+  object_t *obj;
+
+  fuel_start(ctx);
+  cache_open(ctx, stream);
+  while ((obj = cache_next(ctx)) != NULL) {
+    uint64_t start = trace_begin();
+
+    ctx->no_gc = false;
+    macro_expand(ctx, obj);
+    eval(ctx, obj);
+    trace_end(TRACE_EVAL, start);
+  }
+  cache_close(ctx);
+}
+
+/*skeem --serve SOCKET [FILE ...] runs the files, then serves requests*/
+static void run_server(int argc, char **argv) {
+  skeem_ctx_t *ctx = open_ctx();
+
+  if (setjmp(ctx->err)) exit(EXIT_FAILURE);
+
+  for (int i = 3; i < argc; i++) {
+    FILE *stream = fopen(argv[i], "r");
+
+    if (stream == NULL) {
+      perror(argv[i]);
+      exit(EXIT_FAILURE);
+    }
+    run_file(ctx, stream);
+    fclose(stream);
   }
+  serve(ctx, argv[2]);
+}
 
 int main(int argc, char **argv) {
 #ifdef DEBUG
   setbuf(stdout, NULL);
 #endif
-  char *input = NULL;
+  /*Options come first: --steps N limits an evaluation to N steps, and
+   *--time-limit MS to MS milliseconds. The script, or each form typed at
+   *the REPL or sent to the server, is one evaluation. --heap-limit BYTES
+   *limits the heap. --profile=FILE samples the script or REPL session and
+   *writes its call stacks to FILE, and --trace=FILE writes a trace of its
+   *collections, environments, top level forms and I/O waits. --no-jit
+   *interprets every procedure, and --perf-map describes the compiled ones
+   *in /tmp/perf-PID.map.*/
+  while (argc > 1) {
+    if (strcmp(argv[1], "--no-jit") == 0) {
+      jit_threshold = 0;
+      argc--;
+      argv++;
+      continue;
+    }
+    if (strcmp(argv[1], "--perf-map") == 0) {
+      jit_perf_map();
+      argc--;
+      argv++;
+      continue;
+    }
+    if (strncmp(argv[1], "--profile=", 10) == 0) {
+      profile_path = argv[1] + 10;
+      argc--;
+      argv++;
+      continue;
+    }
+    if (strncmp(argv[1], "--trace=", 8) == 0) {
+      trace_path = argv[1] + 8;
+      argc--;
+      argv++;
+      continue;
+    }
+    if (argc < 3)
+      break;
+    else if (strcmp(argv[1], "--steps") == 0)
+      max_steps = strtoull(argv[2], NULL, 10);
+    else if (strcmp(argv[1], "--time-limit") == 0)
+      max_ms = strtoul(argv[2], NULL, 10);
+    else if (strcmp(argv[1], "--heap-limit") == 0)
+      max_bytes = strtoull(argv[2], NULL, 10);
+    else
+      break;
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc > 2 && strcmp(argv[1], "--serve") == 0) run_server(argc, argv);
+
   FILE *stream = argc > 1 ? fopen(argv[1], "r") : stdin;
 
   if (stream == NULL) {
@@ -50,57 +153,50 @@ int main(int argc, char **argv) {
   }
 
   if (stream == stdin) printf("skeem version %s\n", SKEEM_VERSION);
-  mem_init();
-  builtins_init();
-
-  paren_depth = 0;
-  nquotes = 0;
-
-  while (true) {
-    if (stream == stdin) printf("skeem> ");
-
-    if (setjmp(err)) {
-      if (stream != stdin) exit(EXIT_FAILURE);
-
-      clear_tokens();
-      continue;
-    }
-  input:
-    get_input(input);
+  skeem_ctx_t *ctx = open_ctx();
+  if (profile_path != NULL) profile_start(ctx, profile_path);
+  if (trace_path != NULL) trace_start(trace_path);
+#ifdef INSTRUMENT
+  instrument_start(ctx);
+#endif
 
-    if (input[0] == '\n') continue;
+  if (setjmp(ctx->err)) {
+    if (stream != stdin) exit(EXIT_FAILURE);
 
-    scan(input, strlen(input));
+    clear_tokens(ctx);
+    ctx->paren_depth = 0;
+    ctx->nquotes = 0;
+  }
 
-    if (feof(stdin)) break;
-    if (paren_depth < 0) {
-      fprintf(stderr, "Unbalanced expression\n");
-      paren_depth = 0;
-      longjmp(err, 1);
-    }
-    if (nquotes % 2 != 0 || paren_depth != 0) {
-      if (stream == stdin) {
-        printf("... ");
-        fflush(stdout);
-      }
-      goto input;
-    }
+  if (stream != stdin) {
+    run_file(ctx, stream);
+    profile_stop();
+#ifdef INSTRUMENT
+    instrument_stop();
+#endif
+    ctx_free(ctx);
+    return 0;
+  }
 
-    register object_t *obj = tokens_to_obj();
-    if (obj == NULL) continue;
-    no_gc = false;
-    obj = eval(obj);
+  object_t *obj;
+  while ((obj = read_form(ctx, stream)) != NULL) {
+    uint64_t start = trace_begin();
 
-    if (stream == stdin) {
-      printf("=> ");
-      fflush(stdout);
-      print_obj(obj, stdout);
-      putchar('\n');
-    }
+    ctx->no_gc = false;
+    fuel_start(ctx);
+    macro_expand(ctx, obj);
+    obj = eval(ctx, obj);
+    trace_end(TRACE_EVAL, start);
 
-    clear_tokens();
-    if (feof(stream)) break;
+    printf("=> ");
+    print_obj(obj, stdout);
+    putchar('\n');
   }
 
+  profile_stop();
+#ifdef INSTRUMENT
+  instrument_stop();
+#endif
+  ctx_free(ctx);
   return 0;
 }
@@ -0,0 +1,146 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*The embedding interface. Everything a host program needs is declared here;
+ *the interpreter's own headers are not installed.
+ *
+ *Values are owned by the context's garbage collector. A value returned by
+ *this interface is held by the innermost scope: inside a foreign procedure
+ *that is the call itself, which releases them on return, and elsewhere it
+ *is a scope opened with skeem_scope_open(). Values that must outlive their
+ *scope are kept with skeem_root_new().
+ *
+ *Errors print a message to stderr and unwind to the innermost call into
+ *the interpreter, which then returns NULL. A context must only be used by
+ *one thread at a time.*/
+
+#ifndef SKEEM_H
+#define SKEEM_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*libskeem is built with hidden visibility; only this interface is exported*/
+#pragma GCC visibility push(default)
+
+typedef struct skeem_ctx skeem_ctx_t;
+typedef struct _object_t skeem_value;
+typedef size_t skeem_scope;
+typedef size_t skeem_root;
+
+/*A procedure implemented by the host. ARGV holds ARGC evaluated arguments;
+ *returning NULL returns the empty list.*/
+typedef skeem_value *(*skeem_fn)(skeem_ctx_t *ctx, int argc,
+                                 skeem_value **argv, void *data);
+
+extern skeem_ctx_t *skeem_open(void);
+extern void skeem_close(skeem_ctx_t *ctx);
+
+/*Limit each evaluation, a call to skeem_eval_string() or skeem_call() from
+ *the host, to STEPS procedure calls, loop iterations and allocations, and
+ *to MS milliseconds. Zero leaves either unlimited. An evaluation over its
+ *limit fails like one raising an error.*/
+extern void skeem_limit(skeem_ctx_t *ctx, uint64_t steps, uint32_t ms);
+/*Limit the heap of CTX to BYTES, or zero for no limit. An allocation that
+ *would take it over, even after collecting garbage, raises an error.*/
+extern void skeem_limit_memory(skeem_ctx_t *ctx, size_t bytes);
+
+/*Evaluate every form in SRC and return the value of the last one*/
+extern skeem_value *skeem_eval_string(skeem_ctx_t *ctx, const char *src,
+                                      size_t len);
+extern skeem_value *skeem_call(skeem_ctx_t *ctx, skeem_value *fn, int argc,
+                               skeem_value **argv);
+/*NULL if NAME is unbound*/
+extern skeem_value *skeem_lookup(skeem_ctx_t *ctx, const char *name);
+extern void skeem_define(skeem_ctx_t *ctx, const char *name,
+                         skeem_value *val);
+/*ARITY is the number of arguments FN takes, or -1 for any number*/
+extern void skeem_define_primitive(skeem_ctx_t *ctx, const char *name,
+                                   skeem_fn fn, int arity, void *data);
+/*Report an error from a foreign procedure. Does not return.*/
+extern void skeem_error(skeem_ctx_t *ctx, const char *fmt, ...)
+    __attribute__((noreturn, format(printf, 2, 3)));
+
+extern skeem_scope skeem_scope_open(skeem_ctx_t *ctx);
+extern void skeem_scope_close(skeem_ctx_t *ctx, skeem_scope scope);
+extern skeem_root skeem_root_new(skeem_ctx_t *ctx, skeem_value *val);
+extern skeem_value *skeem_root_get(skeem_ctx_t *ctx, skeem_root root);
+extern void skeem_root_free(skeem_ctx_t *ctx, skeem_root root);
+
+extern skeem_value *skeem_int(skeem_ctx_t *ctx, int64_t n);
+extern skeem_value *skeem_float(skeem_ctx_t *ctx, double x);
+extern skeem_value *skeem_bool(bool b);
+extern skeem_value *skeem_nil(void);
+extern skeem_value *skeem_string(skeem_ctx_t *ctx, const char *str);
+extern skeem_value *skeem_symbol(skeem_ctx_t *ctx, const char *name);
+extern skeem_value *skeem_cons(skeem_ctx_t *ctx, skeem_value *car,
+                               skeem_value *cdr);
+/*Wrap host memory without copying. It must stay valid, and a string must
+ *stay unmodified and NUL terminated, for as long as the value is reachable.
+ *Borrowed strings are read-only, as no primitive modifies a string in
+ *place; writes from Scheme to a borrowed vector go straight to the host's
+ *buffer.*/
+extern skeem_value *skeem_string_borrow(skeem_ctx_t *ctx, const char *str);
+extern skeem_value *skeem_f64vector_borrow(skeem_ctx_t *ctx, double *data,
+                                           size_t len);
+extern skeem_value *skeem_s64vector_borrow(skeem_ctx_t *ctx, int64_t *data,
+                                           size_t len);
+
+extern bool skeem_is_int(skeem_value *val);
+extern bool skeem_is_float(skeem_value *val);
+extern bool skeem_is_string(skeem_value *val);
+extern bool skeem_is_symbol(skeem_value *val);
+extern bool skeem_is_bool(skeem_value *val);
+extern bool skeem_is_pair(skeem_value *val);
+extern bool skeem_is_nil(skeem_value *val);
+extern bool skeem_is_procedure(skeem_value *val);
+extern bool skeem_is_f64vector(skeem_value *val);
+extern bool skeem_is_s64vector(skeem_value *val);
+
+/*Accessors raise an error if VAL has the wrong type. Only calls into the
+ *interpreter, such as a foreign procedure, catch it, so elsewhere check the
+ *type with the predicates first.*/
+extern int64_t skeem_to_int(skeem_ctx_t *ctx, skeem_value *val);
+extern double skeem_to_float(skeem_ctx_t *ctx, skeem_value *val);
+extern bool skeem_truthy(skeem_value *val);
+extern const char *skeem_to_string(skeem_ctx_t *ctx, skeem_value *val);
+extern skeem_value *skeem_car(skeem_ctx_t *ctx, skeem_value *val);
+extern skeem_value *skeem_cdr(skeem_ctx_t *ctx, skeem_value *val);
+/*The storage of a numeric vector, shared with the interpreter*/
+extern double *skeem_f64vector_data(skeem_ctx_t *ctx, skeem_value *val,
+                                    size_t *len);
+extern int64_t *skeem_s64vector_data(skeem_ctx_t *ctx, skeem_value *val,
+                                     size_t *len);
+extern void skeem_print(skeem_value *val, FILE *stream);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1010 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*skeemc compiles a program ahead of time. skeemc FILE -o OUT writes OUT, a
+ *binary that runs FILE as skeem would, and skeemc -c FILE -o OUT.c its C
+ *source. The binary embeds the source and links against the runtime, which
+ *evaluates each top level form in turn (see aot.c).
+ *
+ *What is compiled is the part of the program whose meaning is known without
+ *running it: the procedures defined once at the top level by
+ *(define (NAME PARAM ...) BODY) whose bodies only use their parameters,
+ *constants, quote, if, + < > and calls to other such procedures. As no
+ *other code runs inside them, nothing can look up their parameters, which
+ *become C variables, and calls among them become direct C calls. Where the
+ *parameters of a procedure being integers makes every value in its body an
+ *integer or a boolean, it also gets a version working on int64_t, which is
+ *called whenever the arguments are integers. A call in tail position
+ *returns the callee's result directly, and one back to the procedure
+ *itself jumps back to the top, so tail recursion runs in constant space.
+ *Everything else is left to the interpreter.*/
+
+#define _GNU_SOURCE
+#include "types.h"
+#include "context.h"
+#include "mem.h"
+#include "builtins.h"
+#include "token.h"
+#include "aot.h"
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*Where the runtime was built and how, for compiling programs against it.
+ *The SKEEM_DIR environment variable overrides the directory, for a tree
+ *that has moved or an installed copy of skeemrt.a and its headers.*/
+#ifndef SKEEM_DIR
+#define SKEEM_DIR "."
+#endif
+#ifndef SKEEM_CC
+#define SKEEM_CC "cc"
+#endif
+#ifndef SKEEM_CFLAGS
+#define SKEEM_CFLAGS "-O2 -std=gnu1x -pthread"
+#endif
+
+/*The types of values in the integer version of a procedure. NONE is that
+ *of a call whose result isn't known yet.*/
+enum { T_NONE, T_INT, T_BOOL, T_OBJ };
+
+struct def {
+  object_t *name;
+  cons_t *params;
+  int nparams;
+  object_t *body;
+  /*The index of the defining form, and the last defining one it calls*/
+  size_t form, needs;
+  bool compiled;
+  /*The type of the integer version's result; T_OBJ if there isn't one*/
+  int ret;
+  object_t **consts;
+  size_t nconsts;
+  /*Whether the function being emitted jumps back to its top, and makes
+   *calls that need a frame*/
+  bool loops, calls;
+};
+
+/*A C expression*/
+typedef struct {
+  char text[64];
+} operand_t;
+
+static struct def *procs;
+static size_t nprocs;
+/*The function being emitted, its indentation and its temporaries*/
+static FILE *code;
+static int depth, temps;
+
+/*The primitives compiled code inlines, which compiled procedures can't be
+ *named after*/
+static const char *inlined[] = {"+", "<", ">", "if", "quote"};
+
+static operand_t operand(const char *fmt, ...)
+{
+  operand_t op;
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(op.text, sizeof(op.text), fmt, ap);
+  va_end(ap);
+  return op;
+}
+
+static operand_t temp(void)
+{
+  return operand("t%d", temps++);
+}
+
+static void line(const char *fmt, ...)
+{
+  va_list ap;
+
+  fprintf(code, "%*s", 2 * depth + 2, "");
+  va_start(ap, fmt);
+  vfprintf(code, fmt, ap);
+  va_end(ap);
+  fputc('\n', code);
+}
+
+/*Join the operands, each formatted with FMT, into a string to be freed*/
+static char *join(operand_t *ops, int n, const char *fmt, const char *sep)
+{
+  char *text;
+  size_t size;
+  FILE *f = open_memstream(&text, &size);
+
+  for (int i = 0; i < n; i++) {
+    if (i > 0) fputs(sep, f);
+    fprintf(f, fmt, ops[i].text);
+  }
+  fclose(f);
+  return text;
+}
+
+static bool head_is(object_t *exp, const char *name)
+{
+  return _LIST_P(exp) && exp != EMPTY_LIST && _SYMBOL_P(exp->cell->car) &&
+         strcmp(exp->cell->car->string, name) == 0;
+}
+
+static object_t *arg(object_t *exp, int i)
+{
+  cons_t *cell = exp->cell->cdr;
+
+  while (i-- > 0) cell = cell->cdr;
+  return cell->car;
+}
+
+static int nargs(object_t *exp)
+{
+  return length(exp->cell) - 1;
+}
+
+static bool inlined_name(const char *name)
+{
+  for (size_t i = 0; i < sizeof(inlined) / sizeof(inlined[0]); i++)
+    if (strcmp(name, inlined[i]) == 0) return true;
+  return false;
+}
+
+static int param(struct def *p, object_t *symbol)
+{
+  int i = 0;
+
+  for (cons_t *cell = p->params; cell != NULL; cell = cell->cdr, i++)
+    if (strcmp(cell->car->string, symbol->string) == 0) return i;
+  return -1;
+}
+
+/*The compiled procedure SYMBOL names, if any*/
+static struct def *find(object_t *symbol)
+{
+  for (size_t i = 0; i < nprocs; i++)
+    if (procs[i].compiled &&
+        strcmp(procs[i].name->string, symbol->string) == 0)
+      return &procs[i];
+  return NULL;
+}
+
+/*The name FORM defines at the top level, if it is a definition*/
+static object_t *defined_name(object_t *form)
+{
+  if (!head_is(form, "define") || nargs(form) != 2) return NULL;
+
+  object_t *target = arg(form, 0);
+  if (_SYMBOL_P(target)) return target;
+  if (_LIST_P(target) && target != EMPTY_LIST &&
+      _SYMBOL_P(target->cell->car))
+    return target->cell->car;
+  return NULL;
+}
+
+/*Find the procedures that may be compiled, defined once by FORMS*/
+static void find_procs(object_t **forms, size_t nforms)
+{
+  procs = ERR_MALLOC((nforms + 1) * sizeof(struct def));
+
+  for (size_t i = 0; i < nforms; i++) {
+    object_t *name = defined_name(forms[i]), *target;
+
+    if (name == NULL) continue;
+    for (size_t j = 0; j < nforms; j++) {
+      object_t *other = defined_name(forms[j]);
+
+      if (j != i && other != NULL &&
+          strcmp(other->string, name->string) == 0)
+        goto next;
+    }
+    target = arg(forms[i], 0);
+    if (!_LIST_P(target) || inlined_name(name->string)) continue;
+
+    struct def *p = &procs[nprocs];
+    *p = (struct def){.name = name, .params = target->cell->cdr,
+                       .nparams = nargs(target), .body = arg(forms[i], 1),
+                       .form = i, .compiled = true};
+    for (cons_t *cell = p->params; cell != NULL; cell = cell->cdr) {
+      if (!_SYMBOL_P(cell->car)) goto next;
+      for (cons_t *prev = p->params; prev != cell; prev = prev->cdr)
+        if (strcmp(prev->car->string, cell->car->string) == 0) goto next;
+    }
+    nprocs++;
+  next:;
+  }
+}
+
+/*Whether compiled code can evaluate EXP in the body of P*/
+static bool compilable(struct def *p, object_t *exp)
+{
+  switch (exp->type) {
+    case SYMBOL:
+      return param(p, exp) >= 0;
+    case INTEGER:
+    case FLOAT:
+    case BOOLEAN:
+    case STRING:
+      return true;
+    case LIST:
+      break;
+    default:
+      return false;
+  }
+  if (exp == EMPTY_LIST || !_SYMBOL_P(exp->cell->car) ||
+      param(p, exp->cell->car) >= 0)
+    return false;
+
+  int n = nargs(exp);
+  if (head_is(exp, "quote")) return n == 1;
+  if (head_is(exp, "if")) {
+    if (n != 3) return false;
+  } else if (head_is(exp, "+")) {
+    if (n == 0) return false;
+  } else if (head_is(exp, "<") || head_is(exp, ">")) {
+    if (n != 2) return false;
+  } else {
+    struct def *q = find(exp->cell->car);
+    if (q == NULL || q->nparams != n) return false;
+  }
+  for (cons_t *cell = exp->cell->cdr; cell != NULL; cell = cell->cdr)
+    if (!compilable(p, cell->car)) return false;
+  return true;
+}
+
+/*Drop the procedures that can't be compiled, and then those calling them,
+ *until the rest only call each other*/
+static void choose_procs(void)
+{
+  bool changed;
+
+  do {
+    changed = false;
+    for (size_t i = 0; i < nprocs; i++)
+      if (procs[i].compiled && !compilable(&procs[i], procs[i].body)) {
+        procs[i].compiled = false;
+        changed = true;
+      }
+  } while (changed);
+}
+
+static int join_type(int a, int b)
+{
+  if (a == T_NONE) return b;
+  if (b == T_NONE) return a;
+  return a == b ? a : T_OBJ;
+}
+
+/*The type of EXP in the integer version of P*/
+static int int_type(struct def *p, object_t *exp)
+{
+  if (_SYMBOL_P(exp) || _INTEGER_P(exp)) return T_INT;
+  if (!_LIST_P(exp) || head_is(exp, "quote")) return T_OBJ;
+
+  if (head_is(exp, "if")) {
+    int test = int_type(p, arg(exp, 0));
+    int val = join_type(int_type(p, arg(exp, 1)), int_type(p, arg(exp, 2)));
+
+    if (test == T_OBJ || val == T_OBJ) return T_OBJ;
+    return test == T_NONE ? T_NONE : val;
+  }
+
+  int type = T_INT;
+  bool known = true;
+
+  if (head_is(exp, "<") || head_is(exp, ">"))
+    type = T_BOOL;
+  else if (!head_is(exp, "+"))
+    type = find(exp->cell->car)->ret;
+  for (cons_t *cell = exp->cell->cdr; cell != NULL; cell = cell->cdr) {
+    int t = int_type(p, cell->car);
+
+    if (t == T_OBJ || t == T_BOOL) return T_OBJ;
+    if (t == T_NONE) known = false;
+  }
+  return known ? type : T_NONE;
+}
+
+static void settle_types(void)
+{
+  bool changed;
+
+  do {
+    changed = false;
+    for (size_t i = 0; i < nprocs; i++) {
+      if (!procs[i].compiled) continue;
+
+      int type = int_type(&procs[i], procs[i].body);
+      if (type != procs[i].ret) {
+        procs[i].ret = type;
+        changed = true;
+      }
+    }
+  } while (changed);
+}
+
+/*Work out which procedures have an integer version, and what it returns.
+ *A procedure whose result is still unknown once the types have settled
+ *never returns one, and has none.*/
+static void infer_types(void)
+{
+  for (size_t i = 0; i < nprocs; i++) procs[i].ret = T_NONE;
+  settle_types();
+  for (size_t i = 0; i < nprocs; i++)
+    if (procs[i].ret == T_NONE) procs[i].ret = T_OBJ;
+  settle_types();
+}
+
+static bool has_int(struct def *p)
+{
+  return p->ret == T_INT || p->ret == T_BOOL;
+}
+
+static size_t index_of(struct def *p)
+{
+  return p - procs;
+}
+
+static bool simple(object_t *exp)
+{
+  return !_LIST_P(exp) || head_is(exp, "quote");
+}
+
+static bool is_call(object_t *exp)
+{
+  return _LIST_P(exp) && exp != EMPTY_LIST && _SYMBOL_P(exp->cell->car) &&
+         find(exp->cell->car) != NULL;
+}
+
+static void find_needs(struct def *p, object_t *exp, bool *seen)
+{
+  if (!_LIST_P(exp) || exp == EMPTY_LIST || head_is(exp, "quote")) return;
+  if (is_call(exp)) {
+    struct def *q = find(exp->cell->car);
+
+    if (!seen[index_of(q)]) {
+      seen[index_of(q)] = true;
+      if (q->form > p->needs) p->needs = q->form;
+      find_needs(p, q->body, seen);
+    }
+  }
+  for (cons_t *cell = exp->cell->cdr; cell != NULL; cell = cell->cdr)
+    find_needs(p, cell->car, seen);
+}
+
+/*Work out which forms must have been evaluated before the code of each
+ *procedure can run: those defining the procedures it may call*/
+static void needs(void)
+{
+  bool seen[nprocs];
+
+  for (size_t i = 0; i < nprocs; i++) {
+    if (!procs[i].compiled) continue;
+    memset(seen, 0, sizeof(seen));
+    procs[i].needs = procs[i].form;
+    find_needs(&procs[i], procs[i].body, seen);
+  }
+}
+
+/*The integer version*/
+
+static operand_t emit_int(struct def *p, object_t *exp);
+
+static void emit_int_args(struct def *p, object_t *exp, operand_t *args)
+{
+  int i = 0;
+
+  for (cons_t *cell = exp->cell->cdr; cell != NULL; cell = cell->cdr)
+    args[i++] = emit_int(p, cell->car);
+}
+
+static operand_t int_literal(int64_t val)
+{
+  if (val == INT64_MIN) return operand("INT64_MIN");
+  return operand("INT64_C(%lld)", (long long)val);
+}
+
+static operand_t emit_int(struct def *p, object_t *exp)
+{
+  if (_SYMBOL_P(exp)) return operand("a%d", param(p, exp));
+  if (_INTEGER_P(exp)) return int_literal(exp->integer);
+
+  operand_t t, args[nargs(exp)];
+
+  if (head_is(exp, "if")) {
+    operand_t test = emit_int(p, arg(exp, 0));
+
+    t = temp();
+    line("int64_t %s;", t.text);
+    /*Integers are true*/
+    if (int_type(p, arg(exp, 0)) == T_INT) {
+      line("%s = %s;", t.text, emit_int(p, arg(exp, 1)).text);
+      return t;
+    }
+    line("if (%s) {", test.text);
+    depth++;
+    line("%s = %s;", t.text, emit_int(p, arg(exp, 1)).text);
+    depth--;
+    line("} else {");
+    depth++;
+    line("%s = %s;", t.text, emit_int(p, arg(exp, 2)).text);
+    depth--;
+    line("}");
+    return t;
+  }
+
+  emit_int_args(p, exp, args);
+  t = temp();
+  if (head_is(exp, "+")) {
+    char *sum = join(args, nargs(exp), "(uint64_t)%s", " + ");
+
+    line("int64_t %s = (int64_t)(%s);", t.text, sum);
+    free(sum);
+  } else if (head_is(exp, "<") || head_is(exp, ">")) {
+    line("int64_t %s = %s %s %s;", t.text, args[0].text,
+         exp->cell->car->string, args[1].text);
+  } else {
+    size_t q = index_of(find(exp->cell->car));
+    char *list = join(args, nargs(exp), ", %s", "");
+
+    p->calls = true;
+    line("frame_push(ctx, &frame, f%zu_proc);", q);
+    line("int64_t %s = f%zu_i(ctx%s);", t.text, q, list);
+    line("frame_pop(ctx, &frame);");
+    free(list);
+  }
+  return t;
+}
+
+static void emit_int_tail(struct def *p, object_t *exp)
+{
+  if (head_is(exp, "if")) {
+    operand_t test = emit_int(p, arg(exp, 0));
+
+    if (int_type(p, arg(exp, 0)) == T_INT) {
+      emit_int_tail(p, arg(exp, 1));
+      return;
+    }
+    line("if (%s) {", test.text);
+    depth++;
+    emit_int_tail(p, arg(exp, 1));
+    depth--;
+    line("} else {");
+    depth++;
+    emit_int_tail(p, arg(exp, 2));
+    depth--;
+    line("}");
+    return;
+  }
+  if (!is_call(exp)) {
+    line("return %s;", emit_int(p, exp).text);
+    return;
+  }
+
+  struct def *q = find(exp->cell->car);
+  operand_t args[nargs(exp)];
+
+  emit_int_args(p, exp, args);
+  if (q != p) {
+    char *list = join(args, nargs(exp), ", %s", "");
+
+    line("return f%zu_i(ctx%s);", index_of(q), list);
+    free(list);
+    return;
+  }
+  /*The arguments may be parameters, so they are all read before any is
+   *assigned*/
+  for (int i = 0; i < p->nparams; i++) {
+    operand_t t = temp();
+
+    line("int64_t %s = %s;", t.text, args[i].text);
+    args[i] = t;
+  }
+  for (int i = 0; i < p->nparams; i++) line("a%d = %s;", i, args[i].text);
+  line("goto top;");
+  p->loops = true;
+}
+
+/*The object version, whose arguments are the last values pinned, and which
+ *unpins them*/
+
+static operand_t emit_obj(struct def *p, object_t *exp);
+
+static operand_t constant(struct def *p, object_t *exp)
+{
+  size_t i = 0;
+
+  if (head_is(exp, "quote")) exp = arg(exp, 0);
+  while (p->consts[i] != exp) i++;
+  return operand("f%zu_k[%zu]", index_of(p), i);
+}
+
+static void emit_obj_args(struct def *p, object_t *exp, operand_t *args)
+{
+  int i = 0;
+
+  for (cons_t *cell = exp->cell->cdr; cell != NULL; cell = cell->cdr) {
+    args[i] = emit_obj(p, cell->car);
+    line("pin(ctx, %s);", args[i++].text);
+  }
+}
+
+/*The condition that the pinned ARGS are all integers*/
+static char *all_int(operand_t *args, int n)
+{
+  if (n == 0) return strdup("true");
+  return join(args, n, "%s->type == INTEGER", " && ");
+}
+
+/*Emit the operands of a comparison into X and Y*/
+static void emit_compared(struct def *p, object_t *exp, operand_t *x,
+                          operand_t *y)
+{
+  /*X must survive the evaluation of Y if that can allocate*/
+  bool keep = !simple(arg(exp, 0)) && !simple(arg(exp, 1));
+
+  *x = emit_obj(p, arg(exp, 0));
+  if (keep) line("pin(ctx, %s);", x->text);
+  *y = emit_obj(p, arg(exp, 1));
+  if (keep) line("unpin_head(ctx);");
+}
+
+/*A C condition that is true if EXP is*/
+static operand_t emit_test(struct def *p, object_t *exp)
+{
+  if (!head_is(exp, "<") && !head_is(exp, ">"))
+    return operand("IS_TRUE(%s)", emit_obj(p, exp).text);
+
+  operand_t x, y, t;
+  const char *op = exp->cell->car->string;
+
+  emit_compared(p, exp, &x, &y);
+  t = temp();
+  line("bool %s = %s->type == INTEGER && %s->type == INTEGER ?", t.text,
+       x.text, y.text);
+  line("  %s->integer %s %s->integer :", x.text, op, y.text);
+  line("  IS_TRUE(aot_compare(ctx, %s, %s, %s));",
+       op[0] == '<' ? "lesser" : "greater", x.text, y.text);
+  return t;
+}
+
+static operand_t emit_obj(struct def *p, object_t *exp)
+{
+  if (_SYMBOL_P(exp)) return operand("a%d", param(p, exp));
+  if (simple(exp)) return constant(p, exp);
+
+  operand_t t, args[nargs(exp)];
+
+  if (head_is(exp, "if")) {
+    operand_t test = emit_test(p, arg(exp, 0));
+
+    t = temp();
+    line("object_t *%s;", t.text);
+    line("if (%s) {", test.text);
+    depth++;
+    line("%s = %s;", t.text, emit_obj(p, arg(exp, 1)).text);
+    depth--;
+    line("} else {");
+    depth++;
+    line("%s = %s;", t.text, emit_obj(p, arg(exp, 2)).text);
+    depth--;
+    line("}");
+    return t;
+  }
+
+  if (head_is(exp, "+")) {
+    /*Integers are summed unboxed, in S, until an operand isn't one. From
+     *then on the sum is R, pinned.*/
+    int n = temps++;
+
+    line("int64_t s%d = 0;", n);
+    line("object_t *r%d = NULL;", n);
+    for (cons_t *cell = exp->cell->cdr; cell != NULL; cell = cell->cdr) {
+      if (_INTEGER_P(cell->car)) {
+        line("if (r%d == NULL)", n);
+        line("  s%d = (int64_t)((uint64_t)s%d + (uint64_t)%s);", n, n,
+             int_literal(cell->car->integer).text);
+        line("else");
+        line("  add(ctx, r%d, %s, r%d);", n, constant(p, cell->car).text, n);
+        continue;
+      }
+
+      operand_t val = emit_obj(p, cell->car);
+      line("if (r%d == NULL && %s->type == INTEGER)", n, val.text);
+      line("  s%d = (int64_t)((uint64_t)s%d + (uint64_t)%s->integer);", n, n,
+           val.text);
+      line("else");
+      line("  r%d = aot_add(ctx, r%d, s%d, %s);", n, n, n, val.text);
+    }
+    t = temp();
+    line("object_t *%s;", t.text);
+    line("if (r%d != NULL) {", n);
+    line("  unpin_head(ctx);");
+    line("  %s = r%d;", t.text, n);
+    line("} else {");
+    line("  %s = aot_box(ctx, s%d);", t.text, n);
+    line("}");
+    return t;
+  }
+
+  if (head_is(exp, "<") || head_is(exp, ">")) {
+    operand_t x, y;
+    const char *op = exp->cell->car->string;
+
+    emit_compared(p, exp, &x, &y);
+    t = temp();
+    line("object_t *%s = %s->type == INTEGER && %s->type == INTEGER ?",
+         t.text, x.text, y.text);
+    line("  BOOL_TO_OBJ(%s->integer %s %s->integer) :", x.text, op, y.text);
+    line("  aot_compare(ctx, %s, %s, %s);",
+         op[0] == '<' ? "lesser" : "greater", x.text, y.text);
+    return t;
+  }
+
+  struct def *q = find(exp->cell->car);
+  size_t i = index_of(q);
+  int n = nargs(exp);
+
+  emit_obj_args(p, exp, args);
+  p->calls = true;
+  t = temp();
+  line("object_t *%s;", t.text);
+  line("frame_push(ctx, &frame, f%zu_proc);", i);
+  if (has_int(q)) {
+    char *cond = all_int(args, n), *list = join(args, n, ", %s->integer", "");
+
+    line("if (%s) {", cond);
+    line("  int64_t val = f%zu_i(ctx%s);", i, list);
+    line("  ctx->num_pinned -= %d;", n);
+    line(q->ret == T_BOOL ? "  %s = BOOL_TO_OBJ(val);"
+                          : "  %s = aot_box(ctx, val);", t.text);
+    line("} else {");
+    line("  %s = f%zu_o(ctx);", t.text, i);
+    line("}");
+    free(cond);
+    free(list);
+  } else {
+    line("%s = f%zu_o(ctx);", t.text, i);
+  }
+  line("frame_pop(ctx, &frame);");
+  return t;
+}
+
+static void emit_obj_tail(struct def *p, object_t *exp)
+{
+  if (head_is(exp, "if")) {
+    operand_t test = emit_test(p, arg(exp, 0));
+
+    line("if (%s) {", test.text);
+    depth++;
+    emit_obj_tail(p, arg(exp, 1));
+    depth--;
+    line("} else {");
+    depth++;
+    emit_obj_tail(p, arg(exp, 2));
+    depth--;
+    line("}");
+    return;
+  }
+  if (!is_call(exp)) {
+    operand_t val = emit_obj(p, exp);
+
+    line("ctx->num_pinned = base;");
+    line("return %s;", val.text);
+    return;
+  }
+
+  struct def *q = find(exp->cell->car);
+  size_t i = index_of(q);
+  int n = nargs(exp);
+  operand_t args[n];
+
+  emit_obj_args(p, exp, args);
+  if (has_int(q)) {
+    char *cond = all_int(args, n), *list = join(args, n, ", %s->integer", "");
+
+    line("if (%s) {", cond);
+    line("  int64_t val = f%zu_i(ctx%s);", i, list);
+    line("  ctx->num_pinned = base;");
+    line(q->ret == T_BOOL ? "  return BOOL_TO_OBJ(val);"
+                          : "  return aot_box(ctx, val);");
+    line("}");
+    free(cond);
+    free(list);
+  }
+  /*The arguments take the place of this call's*/
+  for (int j = 0; j < n; j++)
+    line("ctx->pinned[base + %d] = %s;", j, args[j].text);
+  line("ctx->num_pinned = base + %d;", n);
+  if (q != p) {
+    line("return f%zu_o(ctx);", i);
+    return;
+  }
+  for (int j = 0; j < n; j++) line("a%d = ctx->pinned[base + %d];", j, j);
+  line("goto top;");
+  p->loops = true;
+}
+
+/*Output*/
+
+/*Write the LEN bytes at S as a C string literal*/
+static void write_string(FILE *f, const char *s, size_t len)
+{
+  fputc('"', f);
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = s[i];
+
+    if (c == '"' || c == '\\')
+      fprintf(f, "\\%c", c);
+    else if (c == '\n')
+      fputs(i + 1 < len ? "\\n\"\n\"" : "\\n", f);
+    else if (c < ' ' || c >= 0x7f)
+      fprintf(f, "\\%03o", c);
+    else
+      fputc(c, f);
+  }
+  fputc('"', f);
+}
+
+/*Emit the body of a version of P, as built by EMIT, then its prologue
+ *followed by the body to OUT*/
+static void emit_function(FILE *out, struct def *p, bool ints,
+                          void (*emit)(struct def *, object_t *))
+{
+  char *text;
+  size_t size;
+  size_t i = index_of(p);
+
+  code = open_memstream(&text, &size);
+  depth = temps = 0;
+  p->loops = p->calls = false;
+  emit(p, p->body);
+  fclose(code);
+
+  if (ints) {
+    fprintf(out, "static int64_t f%zu_i(skeem_ctx_t *ctx", i);
+    for (int j = 0; j < p->nparams; j++) fprintf(out, ", int64_t a%d", j);
+    fprintf(out, ")\n{\n");
+  } else {
+    fprintf(out, "static object_t *f%zu_o(skeem_ctx_t *ctx)\n{\n", i);
+    fprintf(out, "  size_t base = ctx->num_pinned - %d;\n", p->nparams);
+    for (int j = 0; j < p->nparams; j++)
+      fprintf(out, "  object_t *a%d = ctx->pinned[base + %d];\n", j, j);
+  }
+  if (p->calls) fprintf(out, "  struct frame frame;\n");
+  if (p->calls || !ints) fputc('\n', out);
+  fprintf(out, "  stack_check(ctx);\n");
+  fprintf(out, p->loops ? "top:\n  fuel_step(ctx);\n" : "  fuel_step(ctx);\n");
+  fwrite(text, 1, size, out);
+  fprintf(out, "}\n\n");
+  free(text);
+}
+
+/*The entry from the interpreter, called with the bindings of the
+ *parameters*/
+static void emit_entry(FILE *out, struct def *p)
+{
+  size_t i = index_of(p);
+
+  fprintf(out, "static object_t *f%zu(skeem_ctx_t *ctx, "
+               "struct bind_tree **bindings)\n{\n", i);
+  fprintf(out, "  if (!aot_ready(ctx, %zu)) "
+               "return eval_nopush(ctx, f%zu_body);\n", p->needs, i);
+  if (has_int(p)) {
+    fprintf(out, "  if (true");
+    for (int j = 0; j < p->nparams; j++)
+      fprintf(out, " &&\n      bindings[%d]->val->type == INTEGER", j);
+    fprintf(out, ") {\n    int64_t val = f%zu_i(ctx", i);
+    for (int j = 0; j < p->nparams; j++)
+      fprintf(out, ", bindings[%d]->val->integer", j);
+    fprintf(out, ");\n    return %s;\n  }\n",
+            p->ret == T_BOOL ? "BOOL_TO_OBJ(val)" : "aot_box(ctx, val)");
+  }
+  for (int j = 0; j < p->nparams; j++)
+    fprintf(out, "  pin(ctx, bindings[%d]->val);\n", j);
+  fprintf(out, "  return f%zu_o(ctx);\n}\n\n", i);
+}
+
+static void emit_program(FILE *out, const char *path, const char *src,
+                         size_t len)
+{
+  fprintf(out, "/*Compiled by skeemc from %s*/\n\n", path);
+  fprintf(out, "#include \"aot.h\"\n#include \"builtins.h\"\n"
+               "#include \"fuel.h\"\n#include \"mem.h\"\n"
+               "#include \"profile.h\"\n\n");
+  fprintf(out, "static const char source[] =\n");
+  write_string(out, src, len);
+  fprintf(out, ";\n\n");
+
+  for (size_t i = 0; i < nprocs; i++) {
+    struct def *p = &procs[i];
+
+    if (!p->compiled) continue;
+    p->nconsts = aot_constants(p->body, NULL, 0);
+    p->consts = ERR_MALLOC((p->nconsts + 1) * sizeof(object_t *));
+    aot_constants(p->body, p->consts, p->nconsts);
+
+    fprintf(out, "static object_t *f%zu_k[%zu];\n", i,
+            p->nconsts > 0 ? p->nconsts : 1);
+    fprintf(out, "static object_t *f%zu_body;\n", i);
+    fprintf(out, "static procedure_t *f%zu_proc;\n", i);
+    if (has_int(p)) {
+      fprintf(out, "static int64_t f%zu_i(skeem_ctx_t *ctx", i);
+      for (int j = 0; j < p->nparams; j++) fprintf(out, ", int64_t");
+      fprintf(out, ");\n");
+    }
+    fprintf(out, "static object_t *f%zu_o(skeem_ctx_t *ctx);\n\n", i);
+  }
+
+  for (size_t i = 0; i < nprocs; i++) {
+    struct def *p = &procs[i];
+
+    if (!p->compiled) continue;
+    if (has_int(p)) emit_function(out, p, true, emit_int_tail);
+    emit_function(out, p, false, emit_obj_tail);
+    emit_entry(out, p);
+  }
+
+  fprintf(out, "static struct aot_proc procs[] = {\n");
+  for (size_t i = 0; i < nprocs; i++) {
+    struct def *p = &procs[i];
+
+    if (!p->compiled) continue;
+    fprintf(out, "  {");
+    write_string(out, p->name->string, strlen(p->name->string));
+    fprintf(out, ", %zu, %zu, f%zu, f%zu_k, %zu, &f%zu_body, &f%zu_proc},\n",
+            p->form, p->needs, i, i, p->nconsts, i, i);
+  }
+  fprintf(out, "  {NULL},\n};\n\n");
+  fprintf(out, "int main(void)\n{\n"
+               "  return aot_main(source, sizeof(source) - 1, procs);\n}\n");
+}
+
+/*Compile the C source at PATH into the binary OUTPUT*/
+static int build(const char *path, const char *output)
+{
+  char *flags = strdup(SKEEM_CFLAGS), *argv[64];
+  const char *dir = getenv("SKEEM_DIR");
+  int argc = 0, status;
+  pid_t pid;
+
+  if (dir == NULL || dir[0] == '\0') dir = SKEEM_DIR;
+  size_t size = strlen(dir) + sizeof("/skeemrt.a");
+  char include[size], runtime[size];
+  snprintf(include, size, "-I%s", dir);
+  snprintf(runtime, size, "%s/skeemrt.a", dir);
+
+  argv[argc++] = SKEEM_CC;
+  for (char *flag = strtok(flags, " "); flag != NULL && argc < 56;
+       flag = strtok(NULL, " "))
+    argv[argc++] = flag;
+  argv[argc++] = include;
+  argv[argc++] = (char *)path;
+  argv[argc++] = runtime;
+  argv[argc++] = "-o";
+  argv[argc++] = (char *)output;
+  argv[argc] = NULL;
+
+  if ((pid = fork()) == 0) {
+    execvp(argv[0], argv);
+    perror(argv[0]);
+    _exit(127);
+  }
+  free(flags);
+  if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+    perror("skeemc");
+    return EXIT_FAILURE;
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : EXIT_FAILURE;
+}
+
+/*Write the program compiled from the LEN bytes of SRC, read from PATH, to
+ *OUTPUT, as a binary or if SOURCE_ONLY as C*/
+static int write_program(const char *path, const char *src, size_t len,
+                         const char *output, bool source_only)
+{
+  char tmp[] = "/tmp/skeemcXXXXXX.c";
+  const char *c_path = source_only ? output : tmp;
+  FILE *out;
+
+  if (source_only) {
+    out = fopen(output, "w");
+  } else {
+    int fd = mkstemps(tmp, 2);
+    out = fd < 0 ? NULL : fdopen(fd, "w");
+  }
+  if (out == NULL) {
+    perror(c_path);
+    return EXIT_FAILURE;
+  }
+  emit_program(out, path, src, len);
+  if (fclose(out) != 0) {
+    perror(c_path);
+    return EXIT_FAILURE;
+  }
+  if (source_only) return 0;
+
+  int status = build(tmp, output);
+  unlink(tmp);
+  return status;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = NULL, *output = NULL;
+  bool source_only = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-c") == 0)
+      source_only = true;
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      output = argv[++i];
+    else
+      path = argv[i];
+  }
+  if (path == NULL || output == NULL) {
+    fprintf(stderr, "usage: skeemc [-c] FILE -o OUT\n");
+    return EXIT_FAILURE;
+  }
+
+  FILE *stream = fopen(path, "r");
+  char *src = NULL;
+  size_t cap = 0;
+  ssize_t len;
+
+  if (stream == NULL) {
+    perror(path);
+    return EXIT_FAILURE;
+  }
+  /*The whole file, which has no NUL bytes*/
+  if ((len = getdelim(&src, &cap, '\0', stream)) < 0) len = 0;
+  fclose(stream);
+
+  skeem_ctx_t *ctx = ctx_new();
+  object_t **forms = NULL, *obj;
+  size_t nforms = 0;
+
+  if (setjmp(ctx->err)) return EXIT_FAILURE;
+  stream = fmemopen(src, len > 0 ? len : 1, "r");
+  while (len > 0 && (obj = read_form(ctx, stream)) != NULL) {
+    pin(ctx, obj);
+    forms = realloc(forms, (nforms + 1) * sizeof(object_t *));
+    forms[nforms++] = obj;
+  }
+  fclose(stream);
+
+  find_procs(forms, nforms);
+  choose_procs();
+  infer_types();
+  needs();
+
+  int status = write_program(path, src, len, output, source_only);
+
+  for (size_t i = 0; i < nprocs; i++) free(procs[i].consts);
+  free(procs);
+  free(forms);
+  free(src);
+  ctx_free(ctx);
+  return status;
+}
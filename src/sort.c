@@ -0,0 +1,440 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "sort.h"
+#include "types.h"
+#include "mem.h"
+#include "builtins.h"
+#include "future.h"
+#include "vector.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*Vectors at least this long are split between threads, provided the
+ *comparator doesn't need to call back into the interpreter*/
+#define PARALLEL_SORT_MIN 65536
+#define MAX_SORT_THREADS 16
+/*Partitions this short are finished with insertion sort*/
+#define INSERTION_SORT_MAX 16
+
+enum sort_mode { SORT_PROC, SORT_LESS, SORT_GREATER };
+
+struct sorter {
+  skeem_ctx_t *ctx;
+  enum sort_mode mode;
+  object_t *less;
+  /*Pinned lists keeping every cell reachable while a list is relinked*/
+  object_t *roots[3];
+};
+
+static inline bool num_less(object_t *a, object_t *b)
+{
+  if (_INTEGER_P(a) && _INTEGER_P(b)) return a->integer < b->integer;
+  return (_INTEGER_P(a) ? (double)a->integer : a->flt) <
+         (_INTEGER_P(b) ? (double)b->integer : b->flt);
+}
+
+/*True if A must be placed before B*/
+static inline bool before(struct sorter *s, object_t *a, object_t *b)
+{
+  switch (s->mode) {
+    case SORT_LESS:
+      return num_less(a, b);
+    case SORT_GREATER:
+      return num_less(b, a);
+    default: {
+      cons_t second = {b, NULL};
+      cons_t first = {a, &second};
+      return IS_TRUE(apply_values(s->ctx, s->less, &first));
+    }
+  }
+}
+
+static inline void swap(object_t **a, object_t **b)
+{
+  object_t *tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+/*Vectors are only ever permuted by swapping, so every element stays
+ *reachable from the vector while a user comparator runs*/
+static void insertion_sort(struct sorter *s, object_t **v, size_t n)
+{
+  for (size_t i = 1; i < n; i++)
+    for (size_t j = i; j > 0 && before(s, v[j], v[j - 1]); j--)
+      swap(&v[j], &v[j - 1]);
+}
+
+static void heap_sift(struct sorter *s, object_t **v, size_t root, size_t n)
+{
+  for (;;) {
+    size_t child = 2 * root + 1;
+
+    if (child >= n) return;
+    if (child + 1 < n && before(s, v[child], v[child + 1])) child++;
+    if (!before(s, v[root], v[child])) return;
+
+    swap(&v[root], &v[child]);
+    root = child;
+  }
+}
+
+static void heap_sort(struct sorter *s, object_t **v, size_t n)
+{
+  for (size_t i = n / 2; i-- > 0;) heap_sift(s, v, i, n);
+
+  for (size_t end = n; end-- > 1;) {
+    swap(&v[0], &v[end]);
+    heap_sift(s, v, 0, end);
+  }
+}
+
+static int depth_limit(size_t n)
+{
+  int depth = 0;
+  while (n >>= 1) depth++;
+  return 2 * depth;
+}
+
+/*Quicksort with a median-of-three pivot, switching to heapsort once DEPTH
+ *partitions have been made*/
+static void intro_sort(struct sorter *s, object_t **v, size_t n, int depth)
+{
+  while (n > INSERTION_SORT_MAX) {
+    if (depth-- == 0) {
+      heap_sort(s, v, n);
+      return;
+    }
+
+    size_t mid = n / 2;
+    if (before(s, v[mid], v[0])) swap(&v[mid], &v[0]);
+    if (before(s, v[n - 1], v[mid])) {
+      swap(&v[n - 1], &v[mid]);
+      if (before(s, v[mid], v[0])) swap(&v[mid], &v[0]);
+    }
+    swap(&v[0], &v[mid]);
+
+    /*The pivot stays in v[0] until the partition is done*/
+    size_t i = 0, j = n;
+    for (;;) {
+      do i++; while (i < n && before(s, v[i], v[0]));
+      do j--; while (j > 0 && before(s, v[0], v[j]));
+      if (i >= j) break;
+      swap(&v[i], &v[j]);
+    }
+    swap(&v[0], &v[j]);
+
+    /*Recurse into the smaller side and loop on the larger one*/
+    if (j < n - j - 1) {
+      intro_sort(s, v, j, depth);
+      v += j + 1;
+      n -= j + 1;
+    } else {
+      intro_sort(s, v + j + 1, n - j - 1, depth);
+      n = j;
+    }
+  }
+  insertion_sort(s, v, n);
+}
+
+struct sort_task {
+  struct sorter *s;
+  object_t **src, **dst;
+  size_t lo, mid, hi;
+};
+
+static void *sort_chunk(void *arg)
+{
+  struct sort_task *t = arg;
+  intro_sort(t->s, t->src + t->lo, t->hi - t->lo, depth_limit(t->hi - t->lo));
+  return NULL;
+}
+
+/*Stable merge of src[lo, mid) and src[mid, hi) into dst[lo, hi)*/
+static void *merge_chunks(void *arg)
+{
+  struct sort_task *t = arg;
+  size_t i = t->lo, j = t->mid, k = t->lo;
+
+  while (i < t->mid && j < t->hi)
+    t->dst[k++] = before(t->s, t->src[j], t->src[i]) ? t->src[j++]
+                                                      : t->src[i++];
+  while (i < t->mid) t->dst[k++] = t->src[i++];
+  while (j < t->hi) t->dst[k++] = t->src[j++];
+  return NULL;
+}
+
+/*Run every task on its own thread, or inline if one can't be started*/
+static void run_tasks(void *(*fn)(void *), struct sort_task *tasks, int n)
+{
+  pthread_t threads[n];
+  bool started[n];
+
+  for (int i = 0; i < n; i++) {
+    started[i] = pthread_create(&threads[i], NULL, fn, &tasks[i]) == 0;
+    if (!started[i]) fn(&tasks[i]);
+  }
+  for (int i = 0; i < n; i++)
+    if (started[i]) pthread_join(threads[i], NULL);
+}
+
+/*Sort chunks of V in parallel, then merge neighbouring chunks pairwise,
+ *one thread per merge, until a single run is left. Only used when the
+ *comparator is native, since the interpreter isn't thread safe.*/
+static void parallel_sort(struct sorter *s, object_t **v, size_t n)
+{
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int nchunks = ncpu > MAX_SORT_THREADS ? MAX_SORT_THREADS : ncpu;
+
+  if (nchunks < 2) {
+    intro_sort(s, v, n, depth_limit(n));
+    return;
+  }
+
+  size_t bounds[nchunks + 1];
+  struct sort_task tasks[nchunks];
+
+  for (int i = 0; i <= nchunks; i++) bounds[i] = n * i / nchunks;
+  for (int i = 0; i < nchunks; i++)
+    tasks[i] = (struct sort_task){s, v, NULL, bounds[i], 0, bounds[i + 1]};
+  run_tasks(sort_chunk, tasks, nchunks);
+
+  object_t **tmp = ERR_MALLOC(n * sizeof(object_t *));
+  object_t **src = v, **dst = tmp;
+
+  for (int width = 1; width < nchunks; width *= 2) {
+    int ntasks = 0;
+
+    for (int i = 0; i < nchunks; i += 2 * width) {
+      int mid = i + width < nchunks ? i + width : nchunks;
+      int hi = i + 2 * width < nchunks ? i + 2 * width : nchunks;
+      tasks[ntasks++] =
+          (struct sort_task){s, src, dst, bounds[i], bounds[mid], bounds[hi]};
+    }
+    run_tasks(merge_chunks, tasks, ntasks);
+
+    object_t **swap_tmp = src;
+    src = dst;
+    dst = swap_tmp;
+  }
+
+  if (src != v) memcpy(v, src, n * sizeof(object_t *));
+  free(tmp);
+}
+
+/*Point the GC roots at the cells a list sort is still holding on to*/
+static inline void keep(struct sorter *s, cons_t *head, cons_t *p, cons_t *q)
+{
+  if (s->mode != SORT_PROC) return;
+
+  s->roots[0]->cell = head;
+  s->roots[1]->cell = p;
+  s->roots[2]->cell = q;
+}
+
+/*Length of the non-descending run starting at CELL*/
+static size_t run_length(struct sorter *s, cons_t *cell)
+{
+  size_t n = 1;
+
+  for (; cell->cdr != NULL && !before(s, cell->cdr->car, cell->car);
+       cell = cell->cdr)
+    n++;
+  return n;
+}
+
+/*Natural merge sort: every pass merges neighbouring ascending runs by
+ *relinking cells, until a pass finds the list is a single run*/
+static cons_t *merge_sort_cells(struct sorter *s, cons_t *list)
+{
+  for (;;) {
+    cons_t *p = list, *head = NULL, **tail = &head;
+    int merges = 0;
+
+    while (p != NULL) {
+      merges++;
+      keep(s, head, p, NULL);
+      size_t psize = run_length(s, p);
+
+      cons_t *q = p;
+      for (size_t i = 0; i < psize; i++) q = q->cdr;
+      size_t qsize = q == NULL ? 0 : run_length(s, q);
+
+      while (psize > 0 || qsize > 0) {
+        cons_t *e;
+
+        keep(s, head, p, q);
+        if (qsize == 0 || (psize > 0 && !before(s, q->car, p->car))) {
+          e = p;
+          p = p->cdr;
+          psize--;
+        } else {
+          e = q;
+          q = q->cdr;
+          qsize--;
+        }
+        *tail = e;
+        tail = &e->cdr;
+      }
+      p = q;
+    }
+    *tail = NULL;
+
+    if (merges <= 1) return head;
+    list = head;
+  }
+}
+
+static object_t *sort_list(skeem_ctx_t *ctx, struct sorter *s, object_t *list,
+                           bool in_place)
+{
+  if (list == EMPTY_LIST) return EMPTY_LIST;
+
+  if (!in_place) {
+    object_t *copy = obj_init(ctx, LIST);
+    cons_t **tail = &copy->cell;
+
+    for (cons_t *cur = list->cell; cur != NULL; cur = cur->cdr) {
+      *tail = cons_init(ctx);
+      (*tail)->car = cur->car;
+      tail = &(*tail)->cdr;
+    }
+    list = copy;
+  }
+
+  pin(ctx, list);
+  if (s->mode == SORT_PROC)
+    for (int i = 0; i < 3; i++) {
+      s->roots[i] = obj_init(ctx, LIST);
+      pin(ctx, s->roots[i]);
+    }
+
+  list->cell = merge_sort_cells(s, list->cell);
+
+  if (s->mode == SORT_PROC)
+    for (int i = 0; i < 3; i++) unpin_head(ctx);
+  unpin_head(ctx);
+  return list;
+}
+
+static object_t *sort_vector(skeem_ctx_t *ctx, struct sorter *s, object_t *vec,
+                             bool in_place)
+{
+  size_t n = vec->vector->len;
+
+  if (!in_place) {
+    object_t *copy = make_vector(ctx, n, NULL);
+    memcpy(copy->vector->items, vec->vector->items, n * sizeof(object_t *));
+    vec = copy;
+  }
+
+  pin(ctx, vec);
+  if (s->mode != SORT_PROC && n >= PARALLEL_SORT_MIN)
+    parallel_sort(s, vec->vector->items, n);
+  else
+    intro_sort(s, vec->vector->items, n, depth_limit(n));
+  unpin_head(ctx);
+
+  return vec;
+}
+
+/*Use a native comparison when LESS is the builtin < or > and every
+ *element is a number*/
+static enum sort_mode sort_mode(object_t *less, object_t *seq)
+{
+  enum sort_mode mode;
+
+  if (less->type != PRIMITIVE) return SORT_PROC;
+  if (less->primitive == lesser)
+    mode = SORT_LESS;
+  else if (less->primitive == greater)
+    mode = SORT_GREATER;
+  else
+    return SORT_PROC;
+
+  if (_LIST_P(seq)) {
+    for (cons_t *cur = seq->cell; cur != NULL; cur = cur->cdr)
+      if (!_NUMBER_P(cur->car)) return SORT_PROC;
+  } else {
+    for (size_t i = 0; i < seq->vector->len; i++)
+      if (!_NUMBER_P(seq->vector->items[i])) return SORT_PROC;
+  }
+  return mode;
+}
+
+/*True if sorting SEQ in place would modify data of a future's parent*/
+static bool foreign_seq(skeem_ctx_t *ctx, object_t *seq)
+{
+  if (seq == EMPTY_LIST) return false;
+  if (foreign_p(ctx, seq)) return true;
+  if (_LIST_P(seq))
+    for (cons_t *cur = seq->cell; cur != NULL; cur = cur->cdr)
+      if (cur->heap != ctx->heap_id) return true;
+  return false;
+}
+
+/*(sort seq less?) and (sort! seq less?), where SEQ is a list or vector*/
+static object_t *sort_seq(skeem_ctx_t *ctx, const char *function, cons_t *args,
+                          bool in_place)
+{
+  correct_number_args(ctx, function, 2, args);
+  object_t *seq = eval(ctx, args->car);
+  pin(ctx, seq);
+  object_t *less = eval(ctx, args->cdr->car);
+  pin(ctx, less);
+
+  if (!_LIST_P(seq) && !_VECTOR_P(seq))
+    error("%s: Wrong argument type - %s (Expected list or vector)\n",
+          function, types[seq->type]);
+  if (in_place && foreign_seq(ctx, seq))
+    error("%s: The %s belongs to the parent of this future\n", function,
+          _LIST_P(seq) ? "list" : "vector");
+  if (in_place) futures_join(ctx);
+
+  struct sorter s = {ctx, sort_mode(less, seq), less, {NULL}};
+  object_t *sorted = _LIST_P(seq) ? sort_list(ctx, &s, seq, in_place)
+                                  : sort_vector(ctx, &s, seq, in_place);
+
+  unpin_head(ctx);
+  unpin_head(ctx);
+  return sorted;
+}
+
+object_t *sort(skeem_ctx_t *ctx, cons_t *args)
+{
+  return sort_seq(ctx, "sort", args, false);
+}
+
+object_t *sort_in_place(skeem_ctx_t *ctx, cons_t *args)
+{
+  return sort_seq(ctx, "sort!", args, true);
+}
+
+void sort_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "sort", sort);
+  add_primitive(ctx, "sort!", sort_in_place);
+}
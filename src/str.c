@@ -0,0 +1,148 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "str.h"
+#include "types.h"
+#include "mem.h"
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*An empty string with room for CAP characters*/
+char *str_alloc(size_t cap)
+{
+  struct str_header *h = ERR_MALLOC(sizeof(struct str_header) + cap + 1);
+
+  h->len = 0;
+  h->cap = cap;
+  ((char *)(h + 1))[0] = '\0';
+  return (char *)(h + 1);
+}
+
+char *str_new(const char *chars, size_t len)
+{
+  char *s = str_alloc(len);
+
+  memcpy(s, chars, len);
+  str_set_len(s, len);
+  return s;
+}
+
+/*Append LEN characters to S, which may be NULL, and return the string, which
+ *may have moved. The capacity doubles as needed, so building a string by
+ *appending to it takes time linear in its length.*/
+char *str_append(char *s, const char *chars, size_t len)
+{
+  if (s == NULL) s = str_alloc(len);
+
+  struct str_header *h = STR_HEADER(s);
+  if (h->len + len > h->cap) {
+    size_t cap = h->cap * 2;
+    if (cap < h->len + len) cap = h->len + len;
+
+    h = realloc(h, sizeof(struct str_header) + cap + 1);
+    if (h == NULL) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+    h->cap = cap;
+    s = (char *)(h + 1);
+  }
+
+  memcpy(s + h->len, chars, len);
+  str_set_len(s, h->len + len);
+  return s;
+}
+
+void str_set_len(char *s, size_t len)
+{
+  STR_HEADER(s)->len = len;
+  s[len] = '\0';
+}
+
+void str_free(char *s)
+{
+  if (s != NULL) free(STR_HEADER(s));
+}
+
+size_t str_len(const object_t *obj)
+{
+  return obj->borrowed ? strlen(obj->string) : STR_HEADER(obj->string)->len;
+}
+
+/*A string object that takes S*/
+object_t *make_string(skeem_ctx_t *ctx, char *s)
+{
+  mem_reserve(ctx, sizeof(struct str_header) + STR_HEADER(s)->cap + 1);
+  object_t *obj = obj_init(ctx, STRING);
+  obj->string = s;
+  return obj;
+}
+
+/*OBJ, checked to be a string*/
+static object_t *string_arg(skeem_ctx_t *ctx, const char *function,
+                            object_t *obj)
+{
+  if (!_STRING_P(obj))
+    error("%s: Wrong argument type - %s (Expected string)\n", function,
+          types[obj->type]);
+  return obj;
+}
+
+object_t *string_length(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *str = string_arg(ctx, "string-length", eval(ctx, args->car));
+  size_t n = str_len(str);
+  object_t *len = obj_init(ctx, INTEGER);
+
+  len->integer = n;
+  return len;
+}
+
+/*(string-append string ...) copies each string once into a result of the
+ *exact size*/
+object_t *string_append(skeem_ctx_t *ctx, cons_t *args)
+{
+  size_t total = 0;
+  int n = 0;
+
+  for (cons_t *cur = args; cur != NULL; cur = cur->cdr, n++) {
+    object_t *str = string_arg(ctx, "string-append", eval(ctx, cur->car));
+    pin(ctx, str);
+    total += str_len(str);
+  }
+
+  char *s = str_alloc(total);
+  for (int i = n - 1; i >= 0; i--) {
+    object_t *str = ctx->pinned[ctx->num_pinned - 1 - i];
+    s = str_append(s, str->string, str_len(str));
+  }
+  ctx->num_pinned -= n;
+  return make_string(ctx, s);
+}
+
+void str_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "string-length", string_length);
+  add_primitive(ctx, "string-append", string_append);
+}
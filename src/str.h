@@ -0,0 +1,46 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#ifndef STR_H
+#define STR_H
+#include "types.h"
+#include <stddef.h>
+
+/*A string's length and capacity sit just before its characters, so that
+ *obj->string is still an ordinary NUL-terminated C string. Strings borrowed
+ *from an embedder have no header, and must never be modified, so string
+ *primitives only ever build new strings.*/
+struct str_header {
+  size_t len, cap;
+};
+
+#define STR_HEADER(s) ((struct str_header *)(s) - 1)
+
+extern char *str_alloc(size_t cap);
+extern char *str_new(const char *chars, size_t len);
+extern char *str_append(char *s, const char *chars, size_t len);
+extern void str_set_len(char *s, size_t len);
+extern void str_free(char *s);
+extern size_t str_len(const object_t *obj);
+extern object_t *make_string(skeem_ctx_t *ctx, char *s);
+extern void str_init(skeem_ctx_t *ctx);
+
+#endif
@@ -0,0 +1,28 @@
+(define (assert x) (if x #t (exit 1)))
+(define (same a b) (if (< a b) #f (if (> a b) #f #t)))
+(assert (same (string-length "") 0))
+(assert (same (string-length "hello world") 11))
+(define s (string-append "abc" "" "defg"))
+(assert (equal? s "abcdefg"))
+(assert (same (string-length s) 7))
+(assert (equal? (string-append) ""))
+(assert (equal? "abc" (string-append "a" "bc")))
+(assert (if (equal? "abc" "abcd") #f #t))
+(define o (open-output-string))
+(assert (equal? (get-output-string o) ""))
+(display "x = " o)
+(write 42 o)
+(write-string ", " o)
+(write "q" o)
+(assert (same (string-length (get-output-string o)) 11))
+(define o (open-output-string))
+(define (emit n) (if (> n 0) (emit-next n) #t))
+(define (emit-next n) ((display "abcd" o) (emit (+ n -1))))
+(define (emit-block i) (if (> i 0) (emit-block-next i) #t))
+(define (emit-block-next i) ((emit 100) (emit-block (+ i -1))))
+(emit-block 100)
+(define big (get-output-string o))
+(assert (same (string-length big) 40000))
+(assert (equal? (string-append big "") big))
+(write (list 1 "two" (vector 3)) o)
+(assert (same (string-length (get-output-string o)) 40014))
@@ -0,0 +1,21 @@
+(define (assert x) (if x #t (exit 1)))
+(define (printed x) (printed-to x (open-output-string)))
+(define (printed-to x o) ((write x o) (get-output-string o)))
+(assert (equal? (printed 0.1) "0.1"))
+(assert (equal? (printed 2.5) "2.5"))
+(assert (equal? (printed 100.0) "100.0"))
+(assert (equal? (printed -0.0) "-0.0"))
+(assert (equal? (printed 1e21) "1e21"))
+(assert (equal? (printed 1.5e-7) "1.5e-7"))
+(assert (equal? (printed 0.000001) "0.000001"))
+(assert (equal? (printed (+ 0.1 0.2)) "0.30000000000000004"))
+(assert (equal? (printed 1.7976931348623157e308) "1.7976931348623157e308"))
+(assert (equal? (printed 5e-324) "5e-324"))
+(assert (equal? (printed 0) "0"))
+(assert (equal? (printed -9876543210) "-9876543210"))
+(assert (eqv? (string-length (printed #s64(-1 0 99))) 13))
+(assert (eqv? (string-length (printed #f64(0.5 2))) 13))
+(assert (eqv? (string-length (printed (list 1 (list) (vector 2 (list 3 #t)) "s"))) 22))
+(define (nest n x) (if (> n 0) (nest (+ n -1) (list x)) x))
+(define deep (printed (nest 1000 7)))
+(assert (eqv? (string-length deep) 2001))
@@ -0,0 +1,36 @@
+(define (assert x) (if x #t (exit 1)))
+(define-syntax my-list (syntax-rules () ((_ x ...) (list x ...))))
+(assert (equal? (my-list 1 2 3) (list 1 2 3)))
+(assert (eq? (my-list) (list)))
+(define-syntax my-or (syntax-rules () ((_) #f) ((_ e) e) ((_ e r ...) (if e e (my-or r ...)))))
+(assert (eqv? (my-or #f #f 3) 3))
+(assert (eqv? (my-or) #f))
+(define-syntax pick (syntax-rules (left right) ((_ left a b) a) ((_ right a b) b)))
+(assert (eqv? (pick left 1 2) 1))
+(assert (eqv? (pick right 1 2) 2))
+(define-syntax table (syntax-rules () ((_ (k v ...) ...) (list (list k v ...) ...))))
+(assert (equal? (table (1 2 3) (4)) (list (list 1 2 3) (list 4))))
+(define (call-with-value proc value) (proc value))
+(define-syntax swap! (syntax-rules () ((_ a b) (call-with-value (lambda (tmp) ((set! a b) (set! b tmp))) a))))
+(define tmp 1)
+(define y 2)
+(swap! tmp y)
+(assert (equal? (list tmp y) (list 2 1)))
+(define-syntax version (syntax-rules () ((_) 1)))
+(define (get-version) (version))
+(assert (eqv? (get-version) 1))
+(define-syntax version (syntax-rules () ((_) 2)))
+(assert (eqv? (get-version) 1))
+(assert (eqv? (version) 2))
+(define (late) (twice 21))
+(define-syntax twice (syntax-rules () ((_ x) (+ x x))))
+(assert (eqv? (late) 42))
+(assert (eqv? (late) 42))
+(begin (define defined-in-begin 5))
+(assert (eqv? defined-in-begin 5))
+(define-syntax unless-zero (syntax-rules () ((_ n e) (if (< n 1) 0 e))))
+(define (sum-to n) (unless-zero n (+ n (sum-to (+ n -1)))))
+(assert (eqv? (sum-to 500) 125250))
+(define (double-all xs) (parallel-map (lambda (x) (twice x)) xs))
+(assert (equal? (double-all (list 1 2 3 4)) (list 2 4 6 8)))
+(assert (eqv? (join (spawn (lambda () (my-or #f 7)))) 7))
@@ -0,0 +1,30 @@
+(define (assert x) (if x #t (exit 1)))
+(define loads 0)
+(define helper 1)
+(define-library (util)
+  (export twice sum-to (rename helper util-helper))
+  (begin
+    (set! loads (+ loads 1))
+    (define helper 10)
+    (define (twice x) (+ x x))
+    (define (sum-to n) (if (> n 0) (+ n (sum-to (+ n -1))) helper))))
+(assert (eqv? loads 0))
+(import (util))
+(assert (eqv? loads 1))
+(assert (eqv? (twice 4) 8))
+(assert (eqv? (sum-to 3) 16))
+(assert (eqv? util-helper 10))
+(assert (eqv? helper 1))
+(import (util))
+(assert (eqv? loads 1))
+(import (prefix (only (util) twice) u-))
+(assert (eqv? (u-twice 5) 10))
+(import (rename (except (util) sum-to) (twice double)))
+(assert (eqv? (double 6) 12))
+(import (scheme base) (tests lib stack))
+(define s (push (push (make-stack) 1) 2))
+(assert (eqv? (top s) 2))
+(assert (eqv? (size s) 2))
+(define (make-counter) ((define start 3) (lambda (k) (if (> k 0) (counter (+ k -1)) start))))
+(define counter (make-counter))
+(assert (eqv? (counter 4) 3))
@@ -0,0 +1,10 @@
+(define (assert x) (if x #t (exit 1)))
+(define (total) (car (cdr (assq (quote total) (memory-usage)))))
+(define before (total))
+(define v (make-vector 100000 0))
+(assert (> (car (cdr (assq (quote vector) (memory-usage)))) 800000))
+(assert (> (total) (+ before 800000)))
+(assert (> (car (cdr (assq (quote pair) (memory-usage)))) 0))
+(assert (> (car (cdr (assq (quote environment) (memory-usage)))) 0))
+(define v #f)
+(assert (< (total) (+ before 800000)))
@@ -0,0 +1,4 @@
+(define (assert x) (if x #t (exit 1)))
+(define (spin n) (if (> n 0) (spin (+ n -1)) 0))
+(define (work n) (if (> n 0) (+ (spin 100) (work (+ n -1))) 0))
+(assert (eqv? (work 300) 0))
@@ -0,0 +1,35 @@
+(define (assert x) (if x #t (exit 1)))
+(define (repeat k f) (if (> k 0) (begin (f) (repeat (+ k -1) f)) #t))
+(define (fib n) (if (< n 2) n (+ (fib (+ n -1)) (fib (+ n -2)))))
+(assert (eqv? (fib 20) 6765))
+(define (sum-to n) (if (> n 0) (+ n (sum-to (+ n -1))) 0))
+(assert (eqv? (sum-to 100) 5050))
+(assert (eqv? (sum-to 2.5) 4.5))
+(define (add1 x) (+ 1 x))
+(repeat 100 (lambda () (add1 1)))
+(assert (eqv? (add1 41) 42))
+(assert (eqv? (add1 2.5) 3.5))
+(define (below x) (< 1 x))
+(repeat 100 (lambda () (below 1)))
+(assert (below 1.5))
+(assert (eqv? (below 0.5) #f))
+(define (truthy x) (if x 1 2))
+(repeat 100 (lambda () (truthy 0)))
+(assert (eqv? (truthy (quote ())) 1))
+(assert (eqv? (truthy #f) 2))
+(define (hello) (quote hello))
+(repeat 100 hello)
+(assert (eq? (hello) (quote hello)))
+(define (bump) (set! n (+ n 1)))
+(define (bumped n) (+ (bump) n))
+(repeat 100 (lambda () (bumped 1)))
+(assert (eqv? (bumped 1) 4))
+(define (plus a b) (+ a b))
+(repeat 100 (lambda () (plus 1 2)))
+(define (twice x) (+ x x))
+(repeat 100 (lambda () (twice 1)))
+(define (with-plus + x) (twice x))
+(assert (eqv? (with-plus - 5) 0))
+(assert (eqv? (twice 5) 10))
+(define + (lambda (a b) 42))
+(assert (eqv? (plus 1 2) 42))
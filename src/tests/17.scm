@@ -0,0 +1,35 @@
+(define (assert x) (if x #t (exit 1)))
+(define (fib n) (if (< n 2) n (+ (fib (+ n -1)) (fib (+ n -2)))))
+(assert (eqv? (fib 20) 6765))
+(define (sum-to n) (if (> n 0) (+ n (sum-to (+ n -1))) 0))
+(assert (eqv? (sum-to 100) 5050))
+(assert (eqv? (sum-to 2.5) 4.5))
+(define (count i limit) (if (< i limit) (count (+ i 1) limit) i))
+(assert (eqv? (count 0 500) 500))
+(assert (eqv? (count 0.5 10) 10.5))
+(define (rot a b k) (if (> k 0) (rot b a (+ k -1)) a))
+(assert (eqv? (rot 1 2 5) 2))
+(assert (eqv? (rot 1.5 2 4) 1.5))
+(define (evn k) (if (< k 1) #t (od (+ k -1))))
+(define (od k) (if (< k 1) #f (evn (+ k -1))))
+(assert (evn 10))
+(assert (eqv? (od 10) #f))
+(define (below x) (< 1 x))
+(assert (below 2))
+(assert (eqv? (below 0.5) #f))
+(define (hello) (quote hello))
+(assert (eq? (hello) (quote hello)))
+(define (greet) "hi")
+(assert (equal? (greet) "hi"))
+(define (pick x) (if x 1 2))
+(assert (eqv? (pick (quote ())) 1))
+(assert (eqv? (pick #f) 2))
+(define (twice x) (+ x x))
+(define (use-twice x) (twice x))
+(define (shadowed twice x) (use-twice x))
+(assert (eqv? (shadowed (lambda (x) 0) 5) 0))
+(assert (eqv? (use-twice 5) 10))
+(assert (eqv? (fib 10) 55))
+(define (fib-of k) (fib k))
+(set! fib (lambda (n) 0))
+(assert (eqv? (fib-of 10) 0))
@@ -0,0 +1,33 @@
+(define (assert x) (if x #t (exit 1)))
+(define (sum a b) (+ a b))
+(assert (eqv? (sum 1 2) 3))
+(assert (eqv? (sum 3 4) 7))
+(assert (eqv? (sum 1 2.5) 3.5))
+(assert (eqv? (sum 1 2) 3))
+(define (fsum a b c) (+ a b c))
+(assert (eqv? (fsum 0.5 0.25 0.25) 1.0))
+(assert (eqv? (fsum 0.5 0.5 1) 2.0))
+(assert (eqv? (fsum 1 2 3) 6))
+(define (diff a b) (- a b))
+(assert (eqv? (diff 5 2) 3))
+(assert (eqv? (diff 5.5 2) 3.5))
+(assert (eqv? (diff 2 0.5) 1.5))
+(define (neg a) (- a))
+(assert (eqv? (neg 5) -5))
+(assert (eqv? (neg 0.5) -0.5))
+(assert (eqv? (- 10 2 3) 5))
+(define (prod a b) (* a b))
+(assert (eqv? (prod 6 7) 42))
+(assert (eqv? (prod 1.5 2.0) 3.0))
+(assert (eqv? (prod 2 0.25) 0.5))
+(define (less a b) (< a b))
+(assert (less 1 2))
+(assert (eqv? (less 2 1) #f))
+(assert (less 1.5 2))
+(assert (less 1 2))
+(define (more a b) (> a b))
+(assert (more 2.5 1.5))
+(assert (more 3 1.5))
+(assert (eqv? (more 1 2) #f))
+(define (count k) (if (> k 0) (count (- k 1)) k))
+(assert (eqv? (count 100) 0))
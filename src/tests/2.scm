@@ -0,0 +1,14 @@
+(define (assert x) (if x #t (exit 1)))
+(define (same a b) (if (< a b) #f (if (> a b) #f #t)))
+(define v (make-vector 3 0))
+(assert (vector? v))
+(assert (same (vector-length v) 3))
+(vector-set! v 1 42)
+(assert (same (vector-ref v 1) 42))
+(vector-fill! v 7)
+(assert (same (vector-ref v 2) 7))
+(define w #(1 2 3))
+(assert (same (vector-ref w 2) 3))
+(assert (same (vector-length (list->vector (vector->list w))) 3))
+(assert (same (vector-ref (vector 4 5 (+ 3 3)) 2) 6))
+(assert (same (vector-length #()) 0))
@@ -0,0 +1,22 @@
+(define (assert x) (if x #t (exit 1)))
+(define (same a b) (if (< a b) #f (if (> a b) #f #t)))
+(define x (f64vector 1 2 3 4 5 6 7 8 9 10))
+(define y (make-f64vector 10 0.5))
+(assert (f64vector? x))
+(assert (same (f64vector-sum x) 55))
+(assert (same (f64vector-dot x y) 27.5))
+(assert (same (f64vector-min x) 1))
+(assert (same (f64vector-max x) 10))
+(f64vector-axpy! 2 x y)
+(assert (same (f64vector-ref y 9) 20.5))
+(f64vector-scale! 2 y)
+(assert (same (f64vector-ref y 0) 5))
+(assert (same (f64vector-ref (f64vector-add x x) 4) 10))
+(assert (same (f64vector-ref (f64vector-mul x x) 4) 25))
+(define s (list->s64vector (quote (3 -1 4 1 5 9 2 6))))
+(assert (same (s64vector-sum s) 29))
+(assert (same (s64vector-min s) -1))
+(assert (same (s64vector-max s) 9))
+(assert (same (s64vector-dot s s) 173))
+(assert (same (s64vector-length #s64(1 2 3)) 3))
+(assert (same (f64vector-ref #f64(1.5 2) 0) 1.5))
@@ -0,0 +1,33 @@
+(define (assert x) (if x #t (exit 1)))
+(define (same a b) (if (< a b) #f (if (> a b) #f #t)))
+(define t (make-hash-table))
+(assert (hash-table? t))
+(hash-table-set! t "apple" 1)
+(hash-table-set! t (quote (1 2)) 2)
+(hash-table-set! t 3 30)
+(assert (same (hash-table-ref t "apple") 1))
+(assert (same (hash-table-ref t (quote (1 2))) 2))
+(assert (same (hash-table-count t) 3))
+(assert (same (hash-table-ref/default t 4 -1) -1))
+(assert (same (hash-table-ref t 4 (lambda () 7)) 7))
+(hash-table-update! t 3 (lambda (v) (+ v 1)))
+(assert (same (hash-table-ref t 3) 31))
+(hash-table-update! t 5 (lambda (v) (+ v 1)) (lambda () 0))
+(assert (same (hash-table-ref t 5) 1))
+(assert (hash-table-delete! t 3))
+(assert (if (hash-table-contains? t 3) #f #t))
+(assert (same (hash-table-count t) 3))
+(define total (make-vector 1 0))
+(hash-table-walk t (lambda (k v) (vector-set! total 0 (+ (vector-ref total 0) v))))
+(assert (same (vector-ref total 0) 4))
+(define e (make-hash-table eqv?))
+(define (fill n) (if (< n 1) #t (fill-step n)))
+(define (fill-step n) ((hash-table-set! e n (+ n 1000)) (fill (+ n -1))))
+(define (drop n) (if (< n 1) #t (drop-step n)))
+(define (drop-step n) ((hash-table-delete! e (+ n n)) (drop (+ n -1))))
+(fill 500)
+(drop 250)
+(assert (same (hash-table-count e) 250))
+(assert (same (hash-table-ref e 499) 1499))
+(assert (if (hash-table-contains? e 498) #f #t))
+(assert (same (hash-table-count (make-hash-table eq?)) 0))
@@ -0,0 +1,33 @@
+(define (assert x) (if x #t (exit 1)))
+(define (same a b) (if (< a b) #f (if (> a b) #f #t)))
+(define l (list 1 2 3 4))
+(assert (same (length l) 4))
+(assert (same (length (quote ())) 0))
+(assert (same (car l) 1))
+(assert (same (car (cdr l)) 2))
+(assert (equal? (cons 0 l) (list 0 1 2 3 4)))
+(assert (equal? (append l (list 5) (quote ())) (list 1 2 3 4 5)))
+(assert (equal? (append (list 1) (list 2 3)) (list 1 2 3)))
+(assert (equal? (reverse l) (list 4 3 2 1)))
+(assert (equal? (list-tail l 2) (list 3 4)))
+(assert (same (list-ref l 3) 4))
+(assert (equal? (map (lambda (x) (+ x 10)) l) (list 11 12 13 14)))
+(assert (equal? (map + l (list 10 20 30)) (list 11 22 33)))
+(assert (equal? (filter (lambda (x) (> x 2)) l) (list 3 4)))
+(assert (same (fold + 0 l) 10))
+(assert (equal? (fold cons (quote ()) l) (list 4 3 2 1)))
+(define total (make-vector 1 0))
+(for-each (lambda (x) (vector-set! total 0 (+ (vector-ref total 0) x))) l)
+(assert (same (vector-ref total 0) 10))
+(define al (list (list (quote a) 1) (list "b" 2) (list 3 4)))
+(assert (same (car (cdr (assq (quote a) al))) 1))
+(assert (same (car (cdr (assoc "b" al))) 2))
+(assert (same (car (cdr (assv 3 al))) 4))
+(assert (eq? (assq (quote z) al) #f))
+(assert (equal? (member 3 l) (list 3 4)))
+(assert (eq? (memv 9 l) #f))
+(define (build n acc) (if (< n 1) acc (build (+ n -1) (cons n acc))))
+(define big (build 3000 (quote ())))
+(garbage-collect)
+(assert (same (length big) 3000))
+(assert (same (fold + 0 (map (lambda (x) (+ x x)) big)) 9003000))
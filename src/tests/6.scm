@@ -0,0 +1,32 @@
+(define (assert x) (if x #t (exit 1)))
+(define (same a b) (if (< a b) #f (if (> a b) #f #t)))
+(assert (equal? (sort (list 3 1 2) <) (list 1 2 3)))
+(assert (equal? (sort (list 3 1.5 2) >) (list 3 2 1.5)))
+(assert (equal? (sort (quote ()) <) (quote ())))
+(define l (list 5 4 9 2 8 0 7))
+(assert (equal? (sort l (lambda (a b) (< a b))) (list 0 2 4 5 7 8 9)))
+(assert (equal? l (list 5 4 9 2 8 0 7)))
+(define pairs (list (list 2 "a") (list 1 "b") (list 2 "c") (list 1 "d")))
+(define (car< a b) (< (car a) (car b)))
+(assert (equal? (sort pairs car<)
+                (list (list 1 "b") (list 1 "d") (list 2 "a") (list 2 "c"))))
+(sort! l <)
+(assert (equal? l (list 0 2 4 5 7 8 9)))
+(define v (vector 3 1 4 1 5 9 2 6 5 3 5 8 9 7 9 3 2 3 8 4 6))
+(assert (equal? (sort v >) (vector 9 9 9 8 8 7 6 6 5 5 5 4 4 3 3 3 3 2 2 1 1)))
+(assert (same (vector-ref v 0) 3))
+(sort! v (lambda (a b) (< a b)))
+(assert (equal? v (vector 1 1 2 2 3 3 3 3 4 4 5 5 5 6 6 7 8 8 9 9 9)))
+(define c (make-vector 1 0))
+(define (next x) ((vector-set! c 0 (+ (vector-ref c 0) -1)) (vector-ref c 0)))
+(define down (map next (vector->list (make-vector 40000 0))))
+(define up (reverse down))
+(define big (list->vector (append down up)))
+(sort! big <)
+(assert (same (vector-ref big 0) -40000))
+(assert (same (vector-ref big 2) -39999))
+(assert (same (vector-ref big 40000) -20000))
+(assert (same (vector-ref big 79999) -1))
+(define bigl (sort (append up down) <))
+(assert (same (list-ref bigl 79999) -1))
+(assert (same (car bigl) -40000))
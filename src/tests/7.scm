@@ -0,0 +1,42 @@
+(define (assert x) (if x #t (exit 1)))
+(define (same a b) (if (< a b) #f (if (> a b) #f #t)))
+(define f (future (lambda () (+ 1 2))))
+(assert (same (touch f) 3))
+(assert (same (touch f) 3))
+(define (add-later n) (future (lambda () (+ n 10))))
+(assert (same (touch (add-later 5)) 15))
+(define shared (list 7 8 9))
+(define g (future (lambda () (list 1 "two" (vector 3 shared) (make-f64vector 2 0.5)))))
+(assert (equal? (touch g) (list 1 "two" (vector 3 (list 7 8 9)) (make-f64vector 2 0.5))))
+(assert (eq? (vector-ref (car (cdr (cdr (touch g)))) 1) shared))
+(define l (list 1 2 3 4 5 6 7 8 9 10))
+(assert (equal? (parallel-map (lambda (x) (+ x x)) l) (list 2 4 6 8 10 12 14 16 18 20)))
+(assert (equal? (parallel-map car (list l shared)) (list 1 7)))
+(assert (equal? (parallel-map (lambda (x) x) (quote ())) (quote ())))
+(define (build n acc) (if (same n 0) acc (build (+ n -1) (cons n acc))))
+(define big (build 2000 (quote ())))
+(assert (same (fold + 0 (parallel-map (lambda (x) (+ x 1)) big)) 2003000))
+(define (nested x) (touch (future (lambda () (+ x 100)))))
+(assert (equal? (parallel-map nested (list 1 2 3)) (list 101 102 103)))
+(define (inner x) (future (lambda () (+ x 1))))
+(assert (same (touch (touch (future (lambda () (inner 41))))) 42))
+(define (keep-busy n) (if (same n 0) 0 (keep-busy (+ n -1))))
+(define fs (map (lambda (n) (future (lambda () (keep-busy n)))) (list 100 200 300 400)))
+(garbage-collect)
+(assert (equal? (map touch fs) (list 0 0 0 0)))
+(define tab (make-hash-table))
+(hash-table-set! tab 1 10)
+(define (fill t k) (if (hash-table-set! t k (hash-table-ref/default tab k 0)) (hash-table-ref t k) #f))
+(define (own k) (fill (make-hash-table) k))
+(assert (equal? (parallel-map own (list 1 2)) (list 10 0)))
+(define counter 5)
+(define grown (make-hash-table))
+(hash-table-set! grown 0 1)
+(define (read-all n acc) (if (same n 0) acc (read-all (+ n -1) (+ acc counter (hash-table-ref/default grown 0 0)))))
+(define reader (future (lambda () (read-all 2000 0))))
+(define (grow n) (if (same n 0) #t (begin (hash-table-set! grown n n) (grow (+ n -1)))))
+(grow 500)
+(set! counter 100)
+(hash-table-set! grown 0 1000)
+(assert (same (touch reader) 12000))
+(assert (same (hash-table-ref grown 250) 250))
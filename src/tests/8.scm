@@ -0,0 +1,39 @@
+(define (assert x) (if x #t (exit 1)))
+(define (same a b) (if (< a b) #f (if (> a b) #f #t)))
+(assert (same (join (spawn (lambda () 42))) 42))
+(define ch (make-channel))
+(define (count-to n i) (if (> i n) (channel-send ch -1) (send-next n i)))
+(define (send-next n i) ((channel-send ch i) (yield) (count-to n (+ i 1))))
+(define producer (spawn (lambda () (count-to 5 1))))
+(define (drain acc) (add-or-stop (channel-receive ch) acc))
+(define (add-or-stop v acc) (if (same v -1) acc (drain (+ acc v))))
+(assert (same (drain 0) 15))
+(define (spawn-adder n) (spawn (lambda () (+ n 1))))
+(assert (same (join (spawn-adder 9)) 10))
+(define pp (make-pipe))
+(define reader (spawn (lambda () (fd-read (car pp) 100))))
+(yield)
+(fd-write (car (cdr pp)) "hello")
+(assert (equal? (join reader) "hello"))
+(fd-close (car (cdr pp)))
+(assert (equal? (fd-read (car pp) 100) #f))
+(define srv (tcp-listen "127.0.0.1" 0))
+(define port (socket-port srv))
+(define (echo c) (echo-data c (fd-read c 64)))
+(define (echo-data c data) (if data (echo-more c data) (fd-close c)))
+(define (echo-more c data) ((fd-write c data) (echo c)))
+(define (spawn-echo c) (spawn (lambda () (echo c))))
+(define (serve n) (if (same n 0) 0 (serve-one n)))
+(define (serve-one n) ((spawn-echo (accept srv)) (serve (+ n -1))))
+(define server (spawn (lambda () (serve 200))))
+(define results (make-channel))
+(define (client) (talk (tcp-connect "127.0.0.1" port)))
+(define (talk c) (finish-talk c (fd-write c "ping") (fd-read c 64)))
+(define (finish-talk c n reply) ((fd-close c) (channel-send results reply)))
+(define (start-clients n) (if (same n 0) 0 (start-client n)))
+(define (start-client n) ((spawn client) (start-clients (+ n -1))))
+(start-clients 200)
+(define (collect n ok) (if (same n 0) ok (collect (+ n -1) (if (equal? (channel-receive results) "ping") (+ ok 1) ok))))
+(assert (same (collect 200 0) 200))
+(join server)
+(garbage-collect)
@@ -0,0 +1,70 @@
+(define (assert x) (if x #t (exit 1)))
+(define path "/tmp/skeem-port-test.txt")
+
+(define out (open-output-file path))
+(assert (port? out))
+(write-string "alpha" out)
+(newline out)
+(write-string "beta gamma" out)
+(newline out)
+(write-string "delta" out)
+(close-port out)
+
+(define in (open-input-file path))
+(assert (equal? (read-line in) "alpha"))
+(assert (eqv? (peek-char in) (read-char in)))
+(assert (equal? (read-line in) "eta gamma"))
+(assert (equal? (read-line in) "delta"))
+(assert (eof-object? (read-line in)))
+(assert (eof-object? (read-char in)))
+(assert (eof-object? (peek-char in)))
+(close-port in)
+
+(define (emit port i) (if (> i 0) (emit-next port i) #t))
+(define (emit-next port i) ((write-string "line" port) (newline port) (emit port (+ i -1))))
+(define (emit-block port i) (if (> i 0) (emit-block-next port i) #t))
+(define (emit-block-next port i) ((emit port 200) (emit-block port (+ i -1))))
+(define out (open-output-file path))
+(emit-block out 100)
+(close-port out)
+
+(define (count port n) (if (> n 0) (if (eof-object? (read-line port)) #f (count port (+ n -1))) #t))
+(define (count-block port i) (if (> i 0) (if (count port 200) (count-block port (+ i -1)) #f) (eof-object? (read-line port))))
+(define in (open-input-file path))
+(assert (count-block in 100))
+(close-port in)
+
+(define null (open-input-file "/dev/null"))
+(assert (eof-object? (read-line null)))
+(close-port null)
+(assert (port? (current-output-port)))
+(assert (eof-object? (eof-object)))
+(define self (open-input-file "tests/9.scm"))
+(define first (read self))
+(assert (eqv? (length first) 3))
+(assert (equal? (car (cdr (cdr (read self)))) path))
+(close-port self)
+(define out (open-output-file path))
+(write-string "1 2" out)
+(newline out)
+(write-string "  3" out)
+(close-port out)
+(define in (open-input-file path))
+(assert (eqv? (read in) 1))
+(assert (eqv? (read in) 2))
+(assert (eqv? (read in) 3))
+(assert (eof-object? (read in)))
+(close-port in)
+(define out (open-output-file path))
+(write (list (quote foo) (list (quote bar) (quote baz))) out)
+(close-port out)
+(define in (open-input-file path))
+(define d (read in))
+(assert (eq? (car d) (quote foo)))
+(define sym (car d))
+(assert (eq? sym (quote foo)))
+(assert (equal? (map (lambda (s) (eq? s (quote baz))) (car (cdr d))) (list #f #t)))
+(define t (make-hash-table))
+(hash-table-set! t sym 1)
+(hash-table-walk t (lambda (k v) (assert (eq? k sym))))
+(close-port in)
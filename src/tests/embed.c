@@ -0,0 +1,146 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Exercises the embedding interface through libskeem.a*/
+
+#include "skeem.h"
+#include <assert.h>
+#include <string.h>
+
+#define EVAL(ctx, src) skeem_eval_string((ctx), (src), strlen(src))
+
+static skeem_value *host_add(skeem_ctx_t *ctx, int argc, skeem_value **argv,
+                             void *data) {
+  int64_t sum = 0;
+
+  for (int i = 0; i < argc; i++) sum += skeem_to_int(ctx, argv[i]);
+  (*(int *)data)++;
+  return skeem_int(ctx, sum);
+}
+
+/*Evaluates its argument as code, so errors can happen in a nested entry*/
+static skeem_value *host_eval(skeem_ctx_t *ctx, int argc, skeem_value **argv,
+                              void *data) {
+  const char *src = skeem_to_string(ctx, argv[0]);
+  skeem_value *val = skeem_eval_string(ctx, src, strlen(src));
+
+  return val == NULL ? skeem_bool(false) : val;
+}
+
+int main() {
+  skeem_ctx_t *ctx = skeem_open();
+  skeem_scope scope = skeem_scope_open(ctx);
+  int calls = 0;
+
+  assert(skeem_to_int(ctx, EVAL(ctx, "(+ 1 2)")) == 3);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(define x 5)\n(+ x 1)")) == 6);
+  assert(EVAL(ctx, "(car 1)") == NULL);
+  assert(EVAL(ctx, "(+ 1") == NULL);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(+ x 2)")) == 7);
+
+  EVAL(ctx, "(define (twice n) (+ n n))");
+  skeem_value *twice = skeem_lookup(ctx, "twice");
+  skeem_value *arg = skeem_int(ctx, 21);
+  assert(skeem_is_procedure(twice));
+  assert(skeem_to_int(ctx, skeem_call(ctx, twice, 1, &arg)) == 42);
+  assert(skeem_lookup(ctx, "unbound") == NULL);
+
+  skeem_define_primitive(ctx, "host-add", host_add, -1, &calls);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(host-add 1 2 (twice 3))")) == 9);
+  assert(EVAL(ctx, "(host-add 1 (quote a))") == NULL);
+  assert(calls == 1);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(fold host-add 0 (list 1 2 3))")) == 6);
+
+  skeem_define_primitive(ctx, "host-eval", host_eval, 1, NULL);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(twice (host-eval \"x\"))")) == 10);
+  assert(!skeem_truthy(EVAL(ctx, "(host-eval \"y\")")));
+  assert(skeem_to_int(ctx, EVAL(ctx, "(+ 1 (if (host-eval \"y\") 0 2))")) == 3);
+  assert(EVAL(ctx, "(host-eval)") == NULL);
+
+  double buf[4] = {1, 2, 3, 4};
+  skeem_define(ctx, "buf", skeem_f64vector_borrow(ctx, buf, 4));
+  assert(skeem_to_float(ctx, EVAL(ctx, "(f64vector-sum buf)")) == 10);
+  EVAL(ctx, "(f64vector-set! buf 0 8.0)");
+  assert(buf[0] == 8);
+
+  const char *msg = "hello";
+  skeem_define(ctx, "msg", skeem_string_borrow(ctx, msg));
+  assert(skeem_to_string(ctx, EVAL(ctx, "msg")) == msg);
+
+  skeem_value *list = skeem_cons(ctx, skeem_int(ctx, 1),
+                                 skeem_cons(ctx, skeem_float(ctx, 2.5),
+                                            skeem_nil()));
+  assert(skeem_to_int(ctx, skeem_car(ctx, list)) == 1);
+  assert(skeem_to_float(ctx, skeem_car(ctx, skeem_cdr(ctx, list))) == 2.5);
+  assert(skeem_is_nil(skeem_cdr(ctx, skeem_cdr(ctx, list))));
+
+  skeem_root root = skeem_root_new(ctx, skeem_string(ctx, "kept"));
+  skeem_scope_close(ctx, scope);
+  for (int i = 0; i < 100; i++) EVAL(ctx, "(list 1 2 3)");
+  EVAL(ctx, "(garbage-collect)");
+  assert(strcmp(skeem_to_string(ctx, skeem_root_get(ctx, root)), "kept") == 0);
+  skeem_root_free(ctx, root);
+
+  EVAL(ctx, "(define (count n) (if (> n 0) (+ 1 (count (+ n -1))) 0))");
+  assert(EVAL(ctx, "(count 100000000)") == NULL);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(count 1000)")) == 1000);
+  skeem_limit(ctx, 100000, 0);
+  assert(EVAL(ctx, "(while #t 1)") == NULL);
+  assert(EVAL(ctx, "(count 100000)") == NULL);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(count 1000)")) == 1000);
+  skeem_limit(ctx, 0, 20);
+  assert(EVAL(ctx, "(while #t 1)") == NULL);
+  skeem_limit(ctx, 0, 0);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(count 10000)")) == 10000);
+
+  skeem_limit_memory(ctx, 1 << 20);
+  EVAL(ctx, "(define (churn n) (if (> n 0) "
+            "(+ (vector-length (make-vector 1000 0)) (churn (+ n -1))) 0))");
+  assert(skeem_to_int(ctx, EVAL(ctx, "(churn 1000)")) == 1000000);
+  assert(EVAL(ctx, "(make-vector 1000000 0)") == NULL);
+  assert(EVAL(ctx, "(make-f64vector 1000000)") == NULL);
+  assert(EVAL(ctx, "(make-vector 2305843009213693952 0)") == NULL);
+  assert(EVAL(ctx, "(make-f64vector 2305843009213693952 0)") == NULL);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(churn 10)")) == 10000);
+  skeem_limit_memory(ctx, 0);
+
+  /*A future may read its parent's data but not modify it*/
+  EVAL(ctx, "(define table (make-hash-table))");
+  EVAL(ctx, "(define vec (make-vector 4 0))");
+  EVAL(ctx, "(hash-table-set! table 1 1)");
+  assert(EVAL(ctx, "(parallel-map (lambda (k) (hash-table-set! table k k))"
+                   " (list 1 2 3 4 5 6 7 8))") == NULL);
+  assert(EVAL(ctx, "(touch (future (lambda () (hash-table-delete! table 1))))")
+         == NULL);
+  assert(EVAL(ctx, "(touch (future (lambda () (vector-set! vec 0 1))))")
+         == NULL);
+  assert(EVAL(ctx, "(touch (future (lambda () (sort! vec <))))") == NULL);
+  assert(EVAL(ctx, "(touch (future (lambda () (f64vector-scale! 2.0 buf))))")
+         == NULL);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(hash-table-count table)")) == 1);
+  assert(skeem_to_int(ctx, EVAL(ctx, "(touch (future (lambda () "
+                                     "(hash-table-ref table 1))))")) == 1);
+  assert(buf[0] == 8);
+
+  skeem_close(ctx);
+  return 0;
+}
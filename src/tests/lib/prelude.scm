@@ -0,0 +1,2 @@
+(import (tests lib stack))
+(define greeting 42)
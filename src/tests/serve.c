@@ -0,0 +1,160 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Exercises skeem --serve through its socket*/
+
+#include "serve.h"
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+struct response {
+  unsigned char status;
+  char out[4096], result[65536];
+};
+
+static void read_full(int fd, void *buf, size_t len) {
+  char *p = buf;
+
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    assert(n > 0);
+    p += n;
+    len -= n;
+  }
+}
+
+static void read_field(int fd, char *buf, size_t size) {
+  uint32_t len;
+
+  read_full(fd, &len, sizeof(len));
+  assert(len < size);
+  read_full(fd, buf, len);
+  buf[len] = '\0';
+}
+
+static struct response request(int fd, const char *src, uint32_t time_limit,
+                               uint32_t memory_limit) {
+  struct serve_request req = {strlen(src), time_limit, memory_limit};
+  struct response res;
+
+  assert(write(fd, &req, sizeof(req)) == sizeof(req));
+  assert(write(fd, src, req.len) == (ssize_t)req.len);
+
+  read_full(fd, &res.status, 1);
+  read_field(fd, res.out, sizeof(res.out));
+  read_field(fd, res.result, sizeof(res.result));
+  return res;
+}
+
+static int connect_to(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strcpy(addr.sun_path, path);
+
+  /*The server may still be loading its files*/
+  for (int tries = 0; tries < 500; tries++) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+    close(fd);
+    usleep(10000);
+  }
+  fprintf(stderr, "serve: could not connect to %s\n", path);
+  exit(EXIT_FAILURE);
+}
+
+int main() {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/skeem-serve-%d.sock", (int)getpid());
+
+  pid_t server = fork();
+  if (server == 0) {
+    /*Don't outlive a failed test*/
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    execl("./skeem", "skeem", "--serve", path, "tests/lib/prelude.scm",
+          (char *)NULL);
+    _exit(127);
+  }
+
+  int fd = connect_to(path);
+  struct response res = request(fd, "(+ 1 2)", 0, 0);
+  assert(res.status == SERVE_OK && strcmp(res.result, "3") == 0);
+  assert(res.out[0] == '\0');
+
+  res = request(fd, "(display 5) (define x 1) x", 0, 0);
+  assert(res.status == SERVE_OK && strcmp(res.result, "1") == 0);
+  assert(strcmp(res.out, "5") == 0);
+
+  /*Requests don't see each other's definitions*/
+  res = request(fd, "x", 0, 0);
+  assert(res.status == SERVE_ERROR && strstr(res.result, "x") != NULL);
+
+  /*but do see the server's*/
+  res = request(fd, "(top (push (make-stack) greeting))", 0, 0);
+  assert(res.status == SERVE_OK && strcmp(res.result, "42") == 0);
+
+  res = request(fd,
+                "(define (fib n) (if (< n 2) n (+ (fib (+ n -1)) "
+                "(fib (+ n -2))))) (fib 60)",
+                100, 0);
+  assert(res.status == SERVE_TIMEOUT);
+
+  res = request(fd, "(make-vector 100000000 0)", 0, 65536);
+  assert(res.status != SERVE_OK);
+
+  res = request(fd, "", 0, 0);
+  assert(res.status == SERVE_OK && strcmp(res.result, "()") == 0);
+
+  /*Connections are served independently*/
+  int other = connect_to(path);
+  res = request(other, "(+ greeting 1)", 0, 0);
+  assert(res.status == SERVE_OK && strcmp(res.result, "43") == 0);
+  close(other);
+
+  res = request(fd, "(+ 2 2)", 0, 0);
+  assert(res.status == SERVE_OK && strcmp(res.result, "4") == 0);
+  close(fd);
+
+  kill(server, SIGTERM);
+  waitpid(server, NULL, 0);
+
+  /*A file that isn't a socket is left alone*/
+  int status;
+  unlink(path);
+  fclose(fopen(path, "w"));
+  server = fork();
+  if (server == 0) {
+    execl("./skeem", "skeem", "--serve", path, (char *)NULL);
+    _exit(127);
+  }
+  waitpid(server, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE);
+  assert(access(path, F_OK) == 0);
+  unlink(path);
+  return 0;
+}
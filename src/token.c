@@ -24,10 +24,14 @@
 #include "types.h"
 #include "mem.h"
 #include "builtins.h"
+#include "vector.h"
+#include "numvec.h"
+#include "str.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <ctype.h>
 
 enum tok_type {
   TOK_INT,
@@ -36,6 +40,9 @@ enum tok_type {
   TOK_STRING,
   TOK_SYMBOL,
   TOK_PAREN_OPEN,
+  TOK_VECTOR_OPEN,
+  TOK_F64VECTOR_OPEN,
+  TOK_S64VECTOR_OPEN,
   TOK_PAREN_CLOSE
 };
 
@@ -51,10 +58,18 @@ typedef struct _token {
   struct _token *next;
 } token_t;
 
-static token_t *tokens, *head_tok, *list_end;
-static bool in_string;
+object_t *token_to_obj(skeem_ctx_t *ctx, token_t *tok);
 
-object_t *token_to_obj(token_t *tok);
+/*True if WORD from START is an exponent, like e10 or E-3*/
+static bool exponent_p(char *word, size_t start) {
+  size_t i = start + 1;
+
+  if (word[start] != 'e' && word[start] != 'E') return false;
+  if (word[i] == '+' || word[i] == '-') i++;
+  if (!isdigit(word[i])) return false;
+  while (isdigit(word[i])) i++;
+  return word[i] == '\0';
+}
 
 enum tok_type type(char *word, size_t start) {
   enum tok_type sub;
@@ -72,20 +87,31 @@ enum tok_type type(char *word, size_t start) {
         return sub == TOK_FLOAT || sub == TOK_INT ? sub : TOK_SYMBOL;
       }
       return TOK_SYMBOL;
-    case '0' ... '9':
-      for (size_t i = start; i < strlen(word); i++) {
-        if (!(word[i] >= '0' && word[i] <= '9')) {
-          if (word[i] == '.' && type(word, i + 1) == TOK_INT) return TOK_FLOAT;
-          return TOK_SYMBOL;
-        }
+    case '0' ... '9': {
+      size_t i = start;
+      bool point = false;
+
+      while (isdigit(word[i])) i++;
+      if (word[i] == '\0') return TOK_INT;
+      if (word[i] == '.' && isdigit(word[i + 1])) {
+        for (i++; isdigit(word[i]); i++)
+          ;
+        point = true;
       }
-      return TOK_INT;
+      if (exponent_p(word, i)) return TOK_FLOAT;
+      return point && word[i] == '\0' ? TOK_FLOAT : TOK_SYMBOL;
+    }
     case '\"':
       return TOK_STRING;
     case '(':
       return TOK_PAREN_OPEN;
     case ')':
       return TOK_PAREN_CLOSE;
+    case '#':
+      if (word[start + 1] == '(') return TOK_VECTOR_OPEN;
+      if (strcmp(word + start, "#f64(") == 0) return TOK_F64VECTOR_OPEN;
+      if (strcmp(word + start, "#s64(") == 0) return TOK_S64VECTOR_OPEN;
+      return TOK_SYMBOL;
     default:
       return TOK_SYMBOL;
   }
@@ -98,16 +124,14 @@ token_t *str_to_tok(char *word) {
 
   switch (tok->type) {
     case TOK_INT:
-      tok->integer = atoi(word);
+      tok->integer = strtoll(word, NULL, 10);
       return tok;
     case TOK_FLOAT:
       tok->flt = atof(word);
       return tok;
     case TOK_STRING: {
       /*Subtract 2 for the commas*/
-      size_t size = (strlen(word) - 2) * sizeof(char);
-      tok->string = malloc(size);
-      strncpy(tok->string, word + 1, size);
+      tok->string = str_new(word + 1, strlen(word) - 2);
     }
       return tok;
     case TOK_SYMBOL:
@@ -118,110 +142,173 @@ token_t *str_to_tok(char *word) {
   }
 }
 
-void add_token(char *str) {
+void add_token(skeem_ctx_t *ctx, char *str) {
   if (str[0] == '\0') return;
-  if (tokens == NULL) {
-    tokens = str_to_tok(str);
-    head_tok = tokens;
+  if (ctx->tokens == NULL) {
+    ctx->tokens = str_to_tok(str);
+    ctx->head_tok = ctx->tokens;
   } else {
-    head_tok->next = str_to_tok(str);
-    head_tok = head_tok->next;
+    ctx->head_tok->next = str_to_tok(str);
+    ctx->head_tok = ctx->head_tok->next;
   }
 }
 
-cons_t *token_to_cons(token_t *tok) {
-  object_t *obj = token_to_obj(tok);
+cons_t *token_to_cons(skeem_ctx_t *ctx, token_t *tok) {
+  object_t *obj = token_to_obj(ctx, tok);
   cons_t *cell;
 
   if (obj == NULL) return NULL;
-  if (obj->type == LIST) tok = list_end;
+  if (tok->type == TOK_PAREN_OPEN || tok->type == TOK_VECTOR_OPEN ||
+      tok->type == TOK_F64VECTOR_OPEN || tok->type == TOK_S64VECTOR_OPEN)
+    tok = ctx->list_end;
 
-  cell = cons_init();
+  cell = cons_init(ctx);
   cell->car = obj;
-  cell->cdr = token_to_cons(tok->next);
+  cell->cdr = token_to_cons(ctx, tok->next);
   return cell;
 }
 
-object_t *token_to_obj(token_t *tok) {
+object_t *token_to_obj(skeem_ctx_t *ctx, token_t *tok) {
   object_t *obj;
-  no_gc = true;
+  ctx->no_gc = true;
 
   switch (tok->type) {
     case TOK_INT:
-      obj = obj_init(INTEGER);
+      obj = obj_init(ctx, INTEGER);
       obj->integer = tok->integer;
       return obj;
     case TOK_FLOAT:
-      obj = obj_init(FLOAT);
+      obj = obj_init(ctx, FLOAT);
       obj->flt = tok->flt;
       return obj;
     case TOK_STRING:
-      obj = obj_init(STRING);
+      obj = obj_init(ctx, STRING);
       obj->string = tok->string;
+      tok->string = NULL;
       return obj;
     case TOK_SYMBOL:
       if (tok->string[1] != '\0' && tok->string[0] == '#') {
-        if (tok->string[1] == 't')
-          return CONST_TRUE;
-        else if (tok->string[1] == 'f')
-          return CONST_FALSE;
+        obj = tok->string[1] == 't'   ? CONST_TRUE
+              : tok->string[1] == 'f' ? CONST_FALSE
+                                      : NULL;
+        if (obj != NULL) {
+          free(tok->string);
+          tok->string = NULL;
+          return obj;
+        }
       }
 
-      obj = obj_init(SYMBOL);
-      obj->string = tok->string;
+      obj = symbol_new(ctx, tok->string);
+      free(tok->string);
+      tok->string = NULL;
       return obj;
     case TOK_PAREN_OPEN:
       if (tok->next->type == TOK_PAREN_CLOSE) {
-        list_end = tok->next;
+        ctx->list_end = tok->next;
         return EMPTY_LIST;
       }
-      obj = obj_init(LIST);
-      obj->cell = token_to_cons(tok->next);
+      obj = obj_init(ctx, LIST);
+      obj->cell = token_to_cons(ctx, tok->next);
       return obj;
+    case TOK_VECTOR_OPEN: {
+      if (tok->next->type == TOK_PAREN_CLOSE) {
+        ctx->list_end = tok->next;
+        return make_vector(ctx, 0, NULL);
+      }
+      cons_t *elems = token_to_cons(ctx, tok->next);
+      obj = make_vector(ctx, length(elems), NULL);
+
+      for (size_t i = 0; elems != NULL; i++) {
+        cons_t *next = elems->cdr;
+        obj->vector->items[i] = elems->car;
+        cons_free(ctx, elems);
+        elems = next;
+      }
+      return obj;
+    }
+    case TOK_F64VECTOR_OPEN:
+    case TOK_S64VECTOR_OPEN: {
+      type_t vtype = tok->type == TOK_F64VECTOR_OPEN ? F64VECTOR : S64VECTOR;
+      cons_t *elems = NULL;
+
+      if (tok->next->type == TOK_PAREN_CLOSE)
+        ctx->list_end = tok->next;
+      else
+        elems = token_to_cons(ctx, tok->next);
+      obj = make_numvector(ctx, vtype, length(elems));
+
+      for (size_t i = 0; elems != NULL; i++) {
+        cons_t *next = elems->cdr;
+        object_t *n = elems->car;
+
+        if (vtype == S64VECTOR && _INTEGER_P(n))
+          obj->numvector->s64[i] = n->integer;
+        else if (vtype == F64VECTOR && _NUMBER_P(n))
+          obj->numvector->f64[i] = _INTEGER_P(n) ? n->integer : n->flt;
+        else
+          error("Invalid element in %s literal: %s\n", types[vtype],
+                types[n->type]);
+        cons_free(ctx, elems);
+        elems = next;
+      }
+      return obj;
+    }
     case TOK_PAREN_CLOSE:
-      list_end = tok;
+      ctx->list_end = tok;
       return NULL;
   }
 }
 
-inline object_t *tokens_to_obj() {
-  if (tokens == NULL) return NULL;
-  return token_to_obj(tokens);
+inline object_t *tokens_to_obj(skeem_ctx_t *ctx) {
+  if (ctx->tokens == NULL) return NULL;
+  return token_to_obj(ctx, ctx->tokens);
 }
 
-void scan(char *str, size_t limit) {
+void scan(skeem_ctx_t *ctx, char *str, size_t limit) {
   char word[100];
   size_t word_index = 0;
 
   for (size_t i = 0; i < limit; i++) {
+    if (word_index == sizeof(word) - 1) error("Token too long\n");
     switch (str[i]) {
       case ' ':
         if (str[i + 1] == ' ') continue;
-        if (in_string) {
+        if (ctx->in_string) {
           word[word_index++] = str[i];
           continue;
         }
         word[word_index] = '\0';
-        add_token(word);
+        add_token(ctx, word);
         word_index = 0;
         continue;
       case '(':
-        paren_depth++;
-        add_token("(");
+        ctx->paren_depth++;
+        if (!ctx->in_string && word_index > 0 && word[0] == '#') {
+          word[word_index] = '\0';
+          if (word_index == 1 || strcmp(word, "#f64") == 0 ||
+              strcmp(word, "#s64") == 0) {
+            word[word_index++] = '(';
+            word[word_index] = '\0';
+            add_token(ctx, word);
+            word_index = 0;
+            continue;
+          }
+        }
+        add_token(ctx, "(");
         continue;
       case ')':
-        paren_depth--;
-        if (str[i - 1] != ' ') {
+        ctx->paren_depth--;
+        if (word_index > 0) {
           word[word_index] = '\0';
-          add_token(word);
+          add_token(ctx, word);
           word_index = 0;
         }
-        add_token(")");
+        add_token(ctx, ")");
         continue;
       case '\n':
-        if (head_tok == NULL || head_tok->type != TOK_PAREN_CLOSE) {
+        if (ctx->head_tok == NULL || ctx->head_tok->type != TOK_PAREN_CLOSE) {
           word[word_index] = '\0';
-          add_token(word);
+          add_token(ctx, word);
           word_index = 0;
           break;
         }
@@ -232,22 +319,139 @@ void scan(char *str, size_t limit) {
         continue;
       default:
         if (str[i] == '"') {
-          in_string = !in_string;
-          nquotes++;
+          ctx->in_string = !ctx->in_string;
+          ctx->nquotes++;
         }
         word[word_index++] = str[i];
     }
   }
 }
 
-void clear_tokens() {
-  token_t *cur = tokens, *next;
+static void free_tokens(token_t *cur) {
+  token_t *next;
 
   while (cur != NULL) {
     next = cur->next;
+    /*Strings not taken by an object, left by an unfinished or failed read*/
+    if (cur->type == TOK_STRING) str_free(cur->string);
+    if (cur->type == TOK_SYMBOL) free(cur->string);
     free(cur);
     cur = next;
   }
-  tokens = NULL;
-  head_tok = NULL;
+}
+
+void clear_tokens(skeem_ctx_t *ctx) {
+  free_tokens(ctx->tokens);
+  ctx->tokens = NULL;
+  ctx->head_tok = NULL;
+}
+
+/*Read lines from STREAM until a complete expression has been scanned, and
+ *return it. Returns NULL on end of file.*/
+object_t *read_form(skeem_ctx_t *ctx, FILE *stream) {
+  object_t *obj;
+
+  while (true) {
+    if (stream == stdin) {
+      bool continued = ctx->paren_depth != 0 || ctx->nquotes % 2 != 0;
+      printf(continued ? "... " : "skeem> ");
+      fflush(stdout);
+    }
+
+    ssize_t n = getline(&ctx->line, &ctx->line_cap, stream);
+    if (n < 0) return NULL;
+    if (ctx->line[0] == '\n') continue;
+
+    /*A word is only complete at a delimiter, so terminate a final line*/
+    if (ctx->line[n - 1] != '\n') {
+      if ((size_t)n + 2 > ctx->line_cap) {
+        ctx->line = realloc(ctx->line, ctx->line_cap = n + 2);
+        if (ctx->line == NULL) {
+          perror("realloc");
+          exit(EXIT_FAILURE);
+        }
+      }
+      ctx->line[n++] = '\n';
+      ctx->line[n] = '\0';
+    }
+
+    scan(ctx, ctx->line, n);
+
+    if (ctx->paren_depth < 0) {
+      ctx->paren_depth = 0;
+      error("Unbalanced expression\n");
+    }
+    if (ctx->nquotes % 2 != 0 || ctx->paren_depth != 0) continue;
+
+    obj = tokens_to_obj(ctx);
+    clear_tokens(ctx);
+    if (obj != NULL) return obj;
+  }
+}
+
+/*The top level reader is idle while a form is evaluated, so a data reader
+ *borrows its token list to scan. The tokens are owned by CTX meanwhile, so an
+ *error in between leaves them to be freed at the top level.*/
+static void reader_enter(skeem_ctx_t *ctx, struct reader *reader) {
+  ctx->tokens = reader->tokens;
+  ctx->head_tok = reader->head_tok;
+  ctx->in_string = reader->in_string;
+  ctx->paren_depth = reader->paren_depth;
+  ctx->nquotes = reader->nquotes;
+  reader->tokens = reader->head_tok = NULL;
+}
+
+static void reader_leave(skeem_ctx_t *ctx, struct reader *reader) {
+  reader->tokens = ctx->tokens;
+  reader->head_tok = ctx->head_tok;
+  reader->in_string = ctx->in_string;
+  reader->paren_depth = ctx->paren_depth;
+  reader->nquotes = ctx->nquotes;
+  ctx->tokens = ctx->head_tok = NULL;
+  ctx->in_string = false;
+  ctx->paren_depth = 0;
+  ctx->nquotes = 0;
+}
+
+/*Scan LINE, which ends with a newline, into READER*/
+void reader_scan(skeem_ctx_t *ctx, struct reader *reader, char *line,
+                 size_t len) {
+  reader_enter(ctx, reader);
+  scan(ctx, line, len);
+  if (ctx->paren_depth < 0) error("Unbalanced expression\n");
+  reader_leave(ctx, reader);
+}
+
+/*The first datum scanned into READER, or NULL until one is complete. The
+ *tokens after it are kept for the next call, so a line may hold several.*/
+object_t *reader_next(skeem_ctx_t *ctx, struct reader *reader) {
+  if (reader->tokens == NULL || reader->paren_depth != 0 ||
+      reader->nquotes % 2 != 0)
+    return NULL;
+
+  bool no_gc = ctx->no_gc;
+  reader_enter(ctx, reader);
+  token_t *first = ctx->tokens, *last = first;
+  enum tok_type type = first->type;
+
+  if (type == TOK_PAREN_CLOSE) error("Unbalanced expression\n");
+  object_t *obj = token_to_obj(ctx, first);
+  if (type != TOK_INT && type != TOK_FLOAT && type != TOK_STRING &&
+      type != TOK_SYMBOL)
+    last = ctx->list_end;
+
+  /*Free what the datum was made of, and keep the rest*/
+  ctx->tokens = last->next;
+  if (ctx->tokens == NULL) ctx->head_tok = NULL;
+  last->next = NULL;
+  reader_leave(ctx, reader);
+  free_tokens(first);
+
+  ctx->no_gc = no_gc;
+  return obj;
+}
+
+void reader_clear(struct reader *reader) {
+  free_tokens(reader->tokens);
+  memset(reader, 0, sizeof(*reader));
 }
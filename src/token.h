@@ -24,12 +24,29 @@
 #define TOKEN_H
 #include "types.h"
 #include <stddef.h>
+#include <stdbool.h>
 
-int paren_depth;
-unsigned int nquotes;
+/*Bump whenever the reader produces different data for the same text, so
+ *that parse caches written by an older reader aren't used*/
+#define READER_VERSION 1
 
-extern void scan(char *str, size_t limit);
-extern object_t *tokens_to_obj();
-extern void clear_tokens();
+extern void scan(skeem_ctx_t *ctx, char *str, size_t limit);
+extern object_t *tokens_to_obj(skeem_ctx_t *ctx);
+extern void clear_tokens(skeem_ctx_t *ctx);
+extern object_t *read_form(skeem_ctx_t *ctx, FILE *stream);
+
+/*The state of a reader that returns data instead of evaluating them, kept
+ *between the lines fed to it*/
+struct reader {
+  struct _token *tokens, *head_tok;
+  bool in_string;
+  int paren_depth;
+  unsigned int nquotes;
+};
+
+extern void reader_scan(skeem_ctx_t *ctx, struct reader *reader, char *line,
+                        size_t len);
+extern object_t *reader_next(skeem_ctx_t *ctx, struct reader *reader);
+extern void reader_clear(struct reader *reader);
 
 #endif
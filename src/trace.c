@@ -0,0 +1,175 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*Event tracing. Each thread records into its own ring buffer, keeping the
+ *latest TRACE_EVENTS events, without locking. The rings are written out as
+ *Chrome trace JSON, which Perfetto and chrome://tracing read, at exit or
+ *by (trace-dump).*/
+
+#include "trace.h"
+#include "types.h"
+#include "builtins.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define TRACE_EVENTS (1 << 16)
+
+struct trace_event {
+  uint64_t start;
+  /*UINT64_MAX for an instant*/
+  uint64_t dur;
+  enum trace_kind kind;
+};
+
+struct trace_ring {
+  struct trace_event events[TRACE_EVENTS];
+  /*Events ever recorded. Only the owning thread writes it.*/
+  _Atomic uint64_t head;
+  int tid;
+  struct trace_ring *next;
+};
+
+static const char *const names[] = {"gc", "mark", "sweep", "env-push",
+                                    "env-pop", "eval", "io-wait", "poll"};
+static const char *const categories[] = {"gc", "gc", "gc", "env",
+                                         "env", "eval", "io", "io"};
+
+bool trace_enabled;
+static const char *trace_path;
+static uint64_t trace_epoch;
+
+static __thread struct trace_ring *ring;
+static struct trace_ring *rings;
+static int num_rings;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct trace_ring *ring_new(void)
+{
+  struct trace_ring *r = malloc(sizeof(struct trace_ring));
+
+  if (r == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  atomic_init(&r->head, 0);
+
+  pthread_mutex_lock(&rings_lock);
+  r->tid = ++num_rings;
+  r->next = rings;
+  rings = r;
+  pthread_mutex_unlock(&rings_lock);
+  return r;
+}
+
+void trace_record(enum trace_kind kind, uint64_t start, uint64_t dur)
+{
+  if (ring == NULL) ring = ring_new();
+
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  struct trace_event *e = &ring->events[head % TRACE_EVENTS];
+
+  e->start = start;
+  e->dur = dur;
+  e->kind = kind;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/*Write the events in every ring to PATH. Rings of threads still running
+ *are read as they are.*/
+static bool trace_write(const char *path)
+{
+  FILE *out = fopen(path, "w");
+  pid_t pid = getpid();
+  bool first = true;
+
+  if (out == NULL) return false;
+
+  fputs("{\"traceEvents\":[", out);
+  pthread_mutex_lock(&rings_lock);
+  for (struct trace_ring *r = rings; r != NULL; r = r->next) {
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    uint64_t i = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+
+    fprintf(out,
+            "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+            first ? "" : ",", (int)pid, r->tid,
+            r->tid == 1 ? "main" : "thread", r->tid);
+    first = false;
+
+    for (; i < head; i++) {
+      struct trace_event *e = &r->events[i % TRACE_EVENTS];
+      /*Microseconds, as the format wants*/
+      double ts = (e->start - trace_epoch) / 1000.0;
+
+      if (e->dur == UINT64_MAX)
+        fprintf(out,
+                ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+                "\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+                names[e->kind], categories[e->kind], ts, (int)pid, r->tid);
+      else
+        fprintf(out,
+                ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                names[e->kind], categories[e->kind], ts, e->dur / 1000.0,
+                (int)pid, r->tid);
+    }
+  }
+  pthread_mutex_unlock(&rings_lock);
+  fputs("\n]}\n", out);
+  return fclose(out) == 0;
+}
+
+/*Trace events from now on, and write them to PATH at exit*/
+void trace_start(const char *path)
+{
+  trace_path = path;
+  trace_epoch = trace_now();
+  ring = ring_new();
+  trace_enabled = true;
+  atexit(trace_stop);
+}
+
+void trace_stop(void)
+{
+  if (!trace_enabled) return;
+  trace_enabled = false;
+  if (!trace_write(trace_path)) perror(trace_path);
+}
+
+/*(trace-dump) writes the events traced so far to the --trace file*/
+static object_t *trace_dump(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(0);
+  if (!trace_enabled) error("trace-dump: Tracing is off\n");
+  if (!trace_write(trace_path))
+    error("trace-dump: Can't write %s\n", trace_path);
+  return CONST_TRUE;
+}
+
+void trace_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "trace-dump", trace_dump);
+}
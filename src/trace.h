@@ -0,0 +1,76 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+#include "types.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+enum trace_kind {
+  TRACE_GC,
+  TRACE_MARK,
+  TRACE_SWEEP,
+  TRACE_ENV_PUSH,
+  TRACE_ENV_POP,
+  TRACE_EVAL,
+  TRACE_IO_WAIT,
+  TRACE_POLL
+};
+
+/*Set once, before any event, by trace_start*/
+extern bool trace_enabled;
+
+extern void trace_record(enum trace_kind kind, uint64_t start, uint64_t dur);
+extern void trace_start(const char *path);
+extern void trace_stop(void);
+extern void trace_init(skeem_ctx_t *ctx);
+
+static inline uint64_t trace_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*The start of a span, to pass to trace_end*/
+static inline uint64_t trace_begin(void)
+{
+  return __builtin_expect(trace_enabled, 0) ? trace_now() : 0;
+}
+
+static inline void trace_end(enum trace_kind kind, uint64_t start)
+{
+  if (__builtin_expect(trace_enabled, 0))
+    trace_record(kind, start, trace_now() - start);
+}
+
+/*An event with no duration*/
+static inline void trace_instant(enum trace_kind kind)
+{
+  if (__builtin_expect(trace_enabled, 0))
+    trace_record(kind, trace_now(), UINT64_MAX);
+}
+
+#endif
@@ -30,6 +30,8 @@
 #include <math.h>
 #include "types.h"
 #include "token.h"
+#include "str.h"
+#include "dtoa.h"
 
 int length(cons_t *list) {
   if (list == NULL) return 0;
@@ -45,54 +47,230 @@ int length(cons_t *list) {
 }
 
 
-void print_obj(object_t *obj, FILE *stream) {
+/*Output is gathered here and written in large chunks*/
+#define PRINT_BUFFER (64 * 1024)
+
+struct printer {
+  FILE *stream;
+  size_t len;
+  char buf[PRINT_BUFFER];
+};
+
+/*A list or vector being printed, and how far into it*/
+struct print_frame {
+  object_t *obj;
+  cons_t *cell;
+  size_t i;
+};
+
+static _Thread_local struct printer *printer;
+static _Thread_local struct print_frame *print_stack;
+static _Thread_local size_t print_stack_cap;
+
+static void flush_printer(struct printer *p) {
+  fwrite(p->buf, 1, p->len, p->stream);
+  p->len = 0;
+}
+
+static void put(struct printer *p, const char *s, size_t len) {
+  if (p->len + len > PRINT_BUFFER) {
+    flush_printer(p);
+    if (len > PRINT_BUFFER) {
+      fwrite(s, 1, len, p->stream);
+      return;
+    }
+  }
+  memcpy(p->buf + p->len, s, len);
+  p->len += len;
+}
+
+#define PUT_LITERAL(p, s) put(p, s, sizeof(s) - 1)
+
+static void put_int(struct printer *p, int64_t n) {
+  if (p->len + FORMAT_MAX > PRINT_BUFFER) flush_printer(p);
+  p->len += format_int(n, p->buf + p->len);
+}
+
+static void put_double(struct printer *p, double d) {
+  if (p->len + FORMAT_MAX > PRINT_BUFFER) flush_printer(p);
+  p->len += format_double(d, p->buf + p->len);
+}
+
+static void put_atom(struct printer *p, object_t *obj, bool display) {
   switch (obj->type) {
     case INTEGER:
-      fprintf(stream, "%ld", obj->integer);
+      put_int(p, obj->integer);
       break;
     case FLOAT:
-      fprintf(stream, "%f", obj->flt);
+      put_double(p, obj->flt);
       break;
     case CHAR:
-      fprintf(stream, "%c", obj->character);
+      put(p, &obj->character, 1);
       break;
     case STRING:
-      fprintf(stream, "\"%s\"", obj->string);
+      if (!display) PUT_LITERAL(p, "\"");
+      put(p, obj->string, str_len(obj));
+      if (!display) PUT_LITERAL(p, "\"");
       break;
     case SYMBOL:
-      fprintf(stream, "%s", obj->string);
+      put(p, obj->string, strlen(obj->string));
       break;
     case BOOLEAN:
-      fprintf(stream, obj->boolean ? "#t" : "#f");
-      break;
-    case LIST: {
-      if (obj == EMPTY_LIST) {
-        fprintf(stream, "()");
-        return;
-      }
-
-      fprintf(stream, "(");
-      cons_t *cur = obj->cell;
-
-      while (cur->cdr != NULL) {
-        print_obj(cur->car, stream);
-        fputs(" ", stream);
-        cur = cur->cdr;
-      }
-      print_obj(cur->car, stream);
-      fprintf(stream, ")");
-    }
+      if (obj->boolean)
+        PUT_LITERAL(p, "#t");
+      else
+        PUT_LITERAL(p, "#f");
       break;
     case PRIMITIVE:
-      fprintf(stream, "<builtin procedure>");
+      PUT_LITERAL(p, "<builtin procedure>");
       break;
     case PROCEDURE:
-      fprintf(stream, "<procedure %s>", obj->procedure->name);
+      PUT_LITERAL(p, "<procedure ");
+      put(p, obj->procedure->name, strlen(obj->procedure->name));
+      PUT_LITERAL(p, ">");
       break;
     case CLOSURE:
-      fprintf(stream, "<closure>");
+      PUT_LITERAL(p, "<closure>");
       break;
     case ENVIRONMENT:
-      fprintf(stream, "<environment>");
+      PUT_LITERAL(p, "<environment>");
+      break;
+    case F64VECTOR:
+    case S64VECTOR:
+      if (obj->type == F64VECTOR)
+        PUT_LITERAL(p, "#f64(");
+      else
+        PUT_LITERAL(p, "#s64(");
+      for (size_t i = 0; i < obj->numvector->len; i++) {
+        if (i != 0) PUT_LITERAL(p, " ");
+        if (obj->type == F64VECTOR)
+          put_double(p, obj->numvector->f64[i]);
+        else
+          put_int(p, obj->numvector->s64[i]);
+      }
+      PUT_LITERAL(p, ")");
+      break;
+    case HASH_TABLE:
+      PUT_LITERAL(p, "<hash-table>");
+      break;
+    case FOREIGN:
+      PUT_LITERAL(p, "<foreign procedure ");
+      put(p, obj->foreign->name, strlen(obj->foreign->name));
+      PUT_LITERAL(p, ">");
+      break;
+    case FUTURE:
+      PUT_LITERAL(p, "<future>");
+      break;
+    case COROUTINE:
+      PUT_LITERAL(p, "<coroutine>");
+      break;
+    case CHANNEL:
+      PUT_LITERAL(p, "<channel>");
+      break;
+    case PORT:
+      PUT_LITERAL(p, "<port>");
+      break;
+    case EOF_OBJECT:
+      PUT_LITERAL(p, "#<eof>");
+      break;
+    case MACRO:
+      PUT_LITERAL(p, "<macro>");
+      break;
+    case LIST:
+    case VECTOR:
+      break;
+  }
+}
+
+/*Lists and vectors are walked with an explicit stack, so printing a deeply
+ *nested structure cannot overflow the C stack*/
+static void print_value(object_t *obj, FILE *stream, bool display) {
+  if (printer == NULL) {
+    printer = malloc(sizeof(struct printer));
+    if (printer == NULL) {
+      perror("malloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  struct printer *p = printer;
+  size_t depth = 0;
+  p->stream = stream;
+  p->len = 0;
+
+  while (true) {
+    if (obj->type == LIST && obj != EMPTY_LIST) {
+      PUT_LITERAL(p, "(");
+    } else if (obj->type == VECTOR) {
+      PUT_LITERAL(p, "#(");
+    } else {
+      if (obj == EMPTY_LIST)
+        PUT_LITERAL(p, "()");
+      else
+        put_atom(p, obj, display);
+      obj = NULL;
+    }
+
+    if (obj != NULL) {
+      if (depth == print_stack_cap) {
+        print_stack_cap = print_stack_cap == 0 ? 64 : print_stack_cap * 2;
+        print_stack = realloc(print_stack,
+                              print_stack_cap * sizeof(struct print_frame));
+        if (print_stack == NULL) {
+          perror("realloc");
+          exit(EXIT_FAILURE);
+        }
+      }
+      print_stack[depth++] = (struct print_frame){obj, obj->cell, 0};
+    }
+
+    /*Find the next element to print, closing what has been finished*/
+    obj = NULL;
+    while (depth > 0 && obj == NULL) {
+      struct print_frame *top = &print_stack[depth - 1];
+
+      if (top->obj->type == LIST && top->cell != NULL) {
+        obj = top->cell->car;
+        top->cell = top->cell->cdr;
+      } else if (top->obj->type == VECTOR &&
+                 top->i < top->obj->vector->len) {
+        obj = top->obj->vector->items[top->i];
+      } else {
+        PUT_LITERAL(p, ")");
+        depth--;
+        continue;
+      }
+      if (top->i++ != 0) PUT_LITERAL(p, " ");
+    }
+    if (obj == NULL) break;
   }
+
+  flush_printer(p);
+}
+
+void print_obj(object_t *obj, FILE *stream) {
+  print_value(obj, stream, false);
+}
+
+/*As print_obj, but strings and characters are written as they are*/
+void display_obj(object_t *obj, FILE *stream) {
+  print_value(obj, stream, true);
+}
+
+/*The printed form of OBJ, as a string with a length header*/
+char *repr(object_t *obj) {
+  char *buf;
+  size_t len;
+  FILE *stream = open_memstream(&buf, &len);
+
+  if (stream == NULL) {
+    perror("open_memstream");
+    exit(EXIT_FAILURE);
+  }
+  print_obj(obj, stream);
+  fclose(stream);
+
+  char *s = str_new(buf, len);
+  free(buf);
+  return s;
 }
@@ -30,6 +30,8 @@
                      + __GNUC_MINOR__ * 100           \
                      + __GNUC_PATCHLEVEL__)
 
+#define SKEEM_VERSION "1.0a"
+
 /*Object types.*/
 typedef enum types {
   INTEGER,
@@ -42,12 +44,31 @@ typedef enum types {
   PRIMITIVE,
   PROCEDURE,
   CLOSURE,
-  ENVIRONMENT
+  ENVIRONMENT,
+  VECTOR,
+  F64VECTOR,
+  S64VECTOR,
+  HASH_TABLE,
+  FOREIGN,
+  FUTURE,
+  COROUTINE,
+  CHANNEL,
+  PORT,
+  EOF_OBJECT,
+  MACRO
 } type_t;
 
 #define BUILTIN_LEN 27
 extern char *builtin_syms[];
 struct cons;
+struct hash_table;
+struct task;
+struct coroutine;
+struct channel;
+struct port;
+struct macro;
+struct jit_code;
+typedef struct skeem_ctx skeem_ctx_t;
 
 struct obj_list {
   struct _object_t *val;
@@ -55,22 +76,74 @@ struct obj_list {
   struct obj_list *prev;
 };
 
-typedef struct _object_t *(*primitive_t)(struct cons *);
+typedef struct _object_t *(*primitive_t)(skeem_ctx_t *, struct cons *);
+
+#ifdef INSTRUMENT
+/*Counters kept for each procedure by the instrumented build. Times are in
+ *timestamp counter cycles.*/
+struct proc_stats {
+  uint64_t calls, inclusive, exclusive, allocations, collections;
+  /*Calls under way, so that a recursive call's time is only counted once
+   *towards the inclusive time*/
+  unsigned int active;
+};
+#endif
 
 typedef struct proc {
   char *name;
   struct cons *params;
+  int nparams;
   struct _object_t *body;
+  /*Calls counted towards compiling the procedure, and its machine code
+   *once it has been*/
+  unsigned int calls;
+  struct jit_code *jit;
+#ifdef INSTRUMENT
+  struct proc_stats stats;
+#endif
 } procedure_t;
 
+/*A procedure implemented by an embedder. The arguments arrive evaluated.*/
+typedef struct _object_t *(*foreign_fn)(skeem_ctx_t *, int,
+                                        struct _object_t **, void *);
+
+typedef struct foreign {
+  char *name;
+  foreign_fn fn;
+  /*Number of arguments, or -1 to accept any number*/
+  int arity;
+  void *data;
+} foreign_t;
+
 typedef struct closure {
   struct _object_t *proc;
   struct _object_t *env;
 } closure_t;
 
+/*Elements are stored inline, so a vector is a single allocation*/
+struct vector {
+  size_t len;
+  struct _object_t *items[];
+};
+
+/*Unboxed storage for homogeneous numeric vectors, aligned for SIMD loads*/
+struct numvector {
+  size_t len;
+  union {
+    double *f64;
+    int64_t *s64;
+  };
+};
+
 typedef struct _object_t {
   type_t type;
   bool marked;
+  /*The string or numeric vector storage belongs to the embedder, or the
+   *name of a symbol to the table of interned names*/
+  bool borrowed;
+  /*Id of the context whose heap the object lives on. Zero for the shared
+   *constants.*/
+  uint16_t heap;
   union {
     int64_t integer;
     double flt;
@@ -78,11 +151,20 @@ typedef struct _object_t {
     char *string;
     char character;
     struct cons *cell;
+    struct vector *vector;
+    struct numvector *numvector;
+    struct hash_table *table;
     bool boolean;
 
     procedure_t *procedure;
     closure_t *closure;
     primitive_t primitive;
+    foreign_t *foreign;
+    struct task *task;
+    struct coroutine *coroutine;
+    struct channel *channel;
+    struct port *port;
+    struct macro *macro;
     /*This allows environments to be GC'd*/
     struct env *env;
   };
@@ -91,11 +173,18 @@ typedef struct _object_t {
 typedef struct cons {
   object_t *car;
   struct cons *cdr;
+  bool marked;
+  bool used;
+  uint16_t heap;
+  /*The operand types seen by the arithmetic or comparison whose arguments
+   *start at this cell, when it is called (see builtins.c)*/
+  _Atomic uint8_t seen;
 } cons_t;
 
 extern cons_t *tok_to_cons(char **tokens, char *types, int *index);
 extern int length(cons_t *list);
 extern char *repr(object_t *obj);
 extern void print_obj(object_t *obj, FILE *stream);
+extern void display_obj(object_t *obj, FILE *stream);
 
 #endif
@@ -0,0 +1,221 @@
+/* Copyright (c) 2015 Vibhav Pant <vibhavp@gmail.com>
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "vector.h"
+#include "types.h"
+#include "mem.h"
+#include "builtins.h"
+#include "future.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+object_t *make_vector(skeem_ctx_t *ctx, size_t len, object_t *fill)
+{
+  if (len > (SIZE_MAX - sizeof(struct vector)) / sizeof(object_t *))
+    error("Out of memory: %zu elements are too many for one vector\n", len);
+  mem_reserve(ctx, sizeof(struct vector) + len * sizeof(object_t *));
+  object_t *vec = obj_init(ctx, VECTOR);
+  vec->vector = ERR_MALLOC(sizeof(struct vector) + len * sizeof(object_t *));
+  vec->vector->len = len;
+
+  if (fill != NULL)
+    for (size_t i = 0; i < len; i++) vec->vector->items[i] = fill;
+
+  return vec;
+}
+
+bool eq_vector(struct vector *v1, struct vector *v2)
+{
+  if (v1->len != v2->len) return false;
+
+  for (size_t i = 0; i < v1->len; i++)
+    if (!_equal(v1->items[i], v2->items[i])) return false;
+
+  return true;
+}
+
+static object_t *vector_arg(skeem_ctx_t *ctx, const char *function,
+                            object_t *obj)
+{
+  if (!_VECTOR_P(obj))
+    error("%s: Wrong argument type - %s (Expected vector)\n", function,
+          types[obj->type]);
+  return obj;
+}
+
+/*Check that K is a valid index into VEC*/
+static size_t index_arg(skeem_ctx_t *ctx, const char *function, object_t *vec,
+                        object_t *k)
+{
+  if (!_INTEGER_P(k))
+    error("%s: Wrong argument type - %s (Expected integer)\n", function,
+          types[k->type]);
+  if (k->integer < 0 || (size_t)k->integer >= vec->vector->len)
+    error("%s: Index out of range - %ld (Length %zu)\n", function,
+          k->integer, vec->vector->len);
+  return k->integer;
+}
+
+object_t *vector_p(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  return BOOL_TO_OBJ(_VECTOR_P(eval(ctx, args->car)));
+}
+
+/*(make-vector k [fill])*/
+object_t *make_vector_prim(skeem_ctx_t *ctx, cons_t *args)
+{
+  int len = length(args);
+  if (len != 1 && len != 2)
+    error("Wrong number of arguments to make-vector (Got %d, Wanted 1 or 2)\n",
+          len);
+
+  object_t *k = eval(ctx, args->car);
+  if (!_INTEGER_P(k) || k->integer < 0)
+    error("make-vector: Wrong argument - expected a non-negative integer\n");
+
+  object_t *fill = len == 2 ? eval(ctx, args->cdr->car) : CONST_FALSE;
+  pin(ctx, fill);
+  object_t *vec = make_vector(ctx, k->integer, fill);
+  unpin_head(ctx);
+  return vec;
+}
+
+object_t *vector(skeem_ctx_t *ctx, cons_t *args)
+{
+  object_t *vec = make_vector(ctx, length(args), NULL);
+
+  pin(ctx, vec);
+  for (size_t i = 0; args != NULL; i++, args = args->cdr)
+    vec->vector->items[i] = eval(ctx, args->car);
+  unpin_head(ctx);
+
+  return vec;
+}
+
+object_t *vector_length(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *vec = vector_arg(ctx, "vector-length", eval(ctx, args->car));
+  size_t n = vec->vector->len;
+  /*VEC may be unreachable, and collected by the allocation below*/
+  object_t *len = obj_init(ctx, INTEGER);
+  len->integer = n;
+  return len;
+}
+
+object_t *vector_ref(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  object_t *vec = vector_arg(ctx, "vector-ref", eval(ctx, args->car));
+  pin(ctx, vec);
+  size_t i = index_arg(ctx, "vector-ref", vec, eval(ctx, args->cdr->car));
+  unpin_head(ctx);
+  return vec->vector->items[i];
+}
+
+object_t *vector_set(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(3);
+  object_t *vec = vector_arg(ctx, "vector-set!", eval(ctx, args->car));
+  pin(ctx, vec);
+  size_t i = index_arg(ctx, "vector-set!", vec, eval(ctx, args->cdr->car));
+  object_t *val = eval(ctx, args->cdr->cdr->car);
+  unpin_head(ctx);
+
+  if (foreign_p(ctx, vec))
+    error("vector-set!: The vector belongs to the parent of this future\n");
+  futures_join(ctx);
+  vec->vector->items[i] = val;
+  return val;
+}
+
+object_t *vector_fill(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(2);
+  object_t *vec = vector_arg(ctx, "vector-fill!", eval(ctx, args->car));
+  pin(ctx, vec);
+  object_t *fill = eval(ctx, args->cdr->car);
+  unpin_head(ctx);
+
+  if (foreign_p(ctx, vec))
+    error("vector-fill!: The vector belongs to the parent of this future\n");
+  futures_join(ctx);
+  for (size_t i = 0; i < vec->vector->len; i++)
+    vec->vector->items[i] = fill;
+  return vec;
+}
+
+object_t *vector_to_list(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *vec = vector_arg(ctx, "vector->list", eval(ctx, args->car));
+  struct vector *v = vec->vector;
+
+  if (v->len == 0) return EMPTY_LIST;
+
+  pin(ctx, vec);
+  object_t *list = obj_init(ctx, LIST);
+  unpin_head(ctx);
+
+  cons_t **cur = &list->cell;
+  for (size_t i = 0; i < v->len; i++) {
+    *cur = cons_init(ctx);
+    (*cur)->car = v->items[i];
+    cur = &(*cur)->cdr;
+  }
+  return list;
+}
+
+object_t *list_to_vector(skeem_ctx_t *ctx, cons_t *args)
+{
+  assert_arity(1);
+  object_t *list = eval(ctx, args->car);
+
+  if (!_LIST_P(list))
+    error("list->vector: Wrong argument type - %s (Expected list)\n",
+          types[list->type]);
+  if (list == EMPTY_LIST) return make_vector(ctx, 0, NULL);
+
+  pin(ctx, list);
+  object_t *vec = make_vector(ctx, length(list->cell), NULL);
+  unpin_head(ctx);
+
+  size_t i = 0;
+  for (cons_t *cur = list->cell; cur != NULL; cur = cur->cdr)
+    vec->vector->items[i++] = cur->car;
+  return vec;
+}
+
+void vector_init(skeem_ctx_t *ctx)
+{
+  add_primitive(ctx, "vector?", vector_p);
+  add_primitive(ctx, "make-vector", make_vector_prim);
+  add_primitive(ctx, "vector", vector);
+  add_primitive(ctx, "vector-length", vector_length);
+  add_primitive(ctx, "vector-ref", vector_ref);
+  add_primitive(ctx, "vector-set!", vector_set);
+  add_primitive(ctx, "vector-fill!", vector_fill);
+  add_primitive(ctx, "vector->list", vector_to_list);
+  add_primitive(ctx, "list->vector", list_to_vector);
+}